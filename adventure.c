@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       3
+ * Version:       22
  * Creation Date: Fri Sep  9 21:42:12 2011
  * Filename:      adventure.c
  * History:
@@ -33,23 +33,70 @@
  *        Redesigned simple game loop to manage ticks and timing.
  *    SL    3    Wed Sep 14 20:57:22 2011
  *        Cleaned up code for distribution.
+ *          4
+ *        Moved drawing and display to a render thread.
+ *          5
+ *        Added per-phase tick timing.
+ *          6
+ *        Added input recording and replay.
+ *          7
+ *        Replaced busy-waiting and the status thread with an epoll loop.
+ *          8
+ *        Applied every queued keyboard command, merging scrolls.
+ *          9
+ *        Replaced the Tux command slot with a lock-free ring.
+ *          10
+ *        Published status messages with a sequence lock.
+ *          11
+ *        Added idle tasks run in the slack before each tick.
+ *          12
+ *        Drew the lines around the view ahead of time when idle.
+ *          13
+ *        Started worker threads for full-view redraws.
+ *          14
+ *        Added -w to choose the world file.
+ *          15
+ *        Added saving and resuming games(-S), with autosave when idle.
+ *          16
+ *        Added a picture-in-picture inventory view(-i).
+ *          17
+ *        Matched typed verbs with a trie and nouns as interned words.
+ *          18
+ *        Carried out typed commands through typed_cmd.
+ *          19
+ *        Freed the world, photos, and images at the end of the game.
+ *          20
+ *        Kept a resumed view and its speeds within bounds.
+ *          21
+ *        Recorded typing that finishes no command once per tick again.
+ *          22
+ *        Measured the input latency of each command.
  */
 
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "assert.h"
+#include "idle.h"
 #include "input.h"
 #include "modex.h"
 #include "photo.h"
+#include "render.h"
 #include "text.h"
+#include "timing.h"
+#include "workers.h"
 #include "world.h"
+#include "world_ids.h"
 
 
 /*
@@ -64,14 +111,45 @@ static int sanity_check(void);
 
 #define ADVENTURE_USE_TUX_CONTROLLER 1
 
+/*
+ * If ADVENTURE_RENDER_THREAD is 1, drawing and display are done by a
+ * separate thread(see render.h); otherwise, the game thread does them.
+ */
+#define ADVENTURE_RENDER_THREAD 1
+
+/*
+ * If ADVENTURE_PREFILL_MARGINS is 1, the lines just outside the view are
+ * drawn ahead of time while waiting for each tick, so that scrolling by a
+ * few pixels needs no line drawing(see modex.h).
+ */
+#define ADVENTURE_PREFILL_MARGINS 1
+
+/*
+ * If ADVENTURE_REDRAW_WORKERS is 1, full-view redraws are split among
+ * worker threads, one for each CPU not used by the game and render
+ * threads(see workers.h).
+ */
+#define ADVENTURE_REDRAW_WORKERS 1
+
 /* a few constants */
 #define TICK_USEC      50000 /* tick length in microseconds          */
+#define STATUS_USEC  1500000 /* time for which status message shows  */
 #define STATUS_MSG_LEN 40    /* maximum length of status message     */
 #define MOTION_SPEED   2     /* pixels moved per command             */
+#define INPUT_BATCH    16    /* keyboard commands read at a time     */
+#define TUX_RING_LEN   64    /* Tux commands queued; a power of two  */
+#define MAX_IDLE_TASKS 8     /* idle tasks registered at once        */
+#define AUTOSAVE_TICKS 100   /* ticks between autosaves              */
+#define SAVE_MAGIC 0x45564153 /* "SAVE"                              */
 
 /* outcome of the game */
 typedef enum {GAME_WON, GAME_QUIT} game_condition_t;
 
+/* result of applying one command */
+#define APPLY_NOTHING    0    /* stay in the current room */
+#define APPLY_NEW_ROOM   1    /* player changed rooms     */
+#define APPLY_QUIT      -1    /* player quit              */
+
 /* structure used to hold game information */
 typedef struct {
     room_t*      where;          /* current room for player               */
@@ -80,37 +158,31 @@ typedef struct {
     int          y_speed;        /* number of pixels of y motion per move */
 } game_info_t;
 
+/*
+ * A saved game file holds a save_header_t followed by a snapshot of the
+ * world state(see save_world_state in world.h).
+ */
+typedef struct {
+    uint32_t magic;          /* SAVE_MAGIC                    */
+    uint32_t size;           /* size of world state in bytes  */
+    uint32_t map_x, map_y;   /* view position                 */
+    int32_t  x_speed;        /* game_info.x_speed             */
+    int32_t  y_speed;        /* game_info.y_speed             */
+} save_header_t;
+
 
 /*
- * enumerated values, structure, and static data used for parsing typed
- * commands
+ * structure and static data used for parsing typed commands(the verbs
+ * are listed in world_ids.h)
  *
  * Note that the structure allows us to abbreviate commands and to create
  * synonyms for verbs(e.g., get and grab).
  */
-typedef enum { /* TC = typed command */
-    TC_BUY,
-    TC_CHARGE,
-    TC_DO,
-    TC_DRINK,
-    TC_DROP,
-    TC_FIX,
-    TC_FLASH,
-    TC_GET,
-    TC_GO,
-    TC_INSTALL,
-    TC_INVENTORY,
-    TC_SIGH,
-    TC_USE,
-    TC_WEAR,
-    NUM_TC_VALUES
-} cmd_id_t;
-
 typedef struct typed_cmd_t typed_cmd_t;
 struct typed_cmd_t {
     const char* name;    /* verb that must be typed               */
     int32_t min_len;    /* minimum number of matching characters */
-    cmd_id_t cmd;    /* resulting command                     */
+    int32_t cmd;    /* resulting command(a TC_* verb)        */
 };
 
 static const typed_cmd_t cmd_list[] = {
@@ -132,93 +204,211 @@ static const typed_cmd_t cmd_list[] = {
     {NULL,        0, 0}
 };
 
+/*
+ * Typed verbs are matched by walking a trie of the verbs in cmd_list,
+ * one node per prefix, built by build_verb_trie.  A node's command is
+ * that of the first entry in cmd_list of which the prefix is an allowed
+ * abbreviation(at least min_len characters long), so matching gives the
+ * same command as comparing with each entry in turn.  Verbs are spelled
+ * with lower-case letters; node 0 is the root, so a child of 0 means no
+ * child.
+ */
+#define MAX_VERB_NODES 128
+static uint8_t verb_child[MAX_VERB_NODES]['z' - 'a' + 1]; /* children    */
+static int8_t  verb_cmd[MAX_VERB_NODES];  /* command, or -1 for none      */
+
 
 /* local functions--see function headers for details */
 
-static void cancel_status_thread(void* ignore);
+static int32_t apply_command(cmd_t cmd);
+static int32_t build_verb_trie(void);
+static void close_events(void* ignore);
+static void flush_scroll(void);
 static game_condition_t game_loop(void);
 static int32_t handle_typing(void);
+static int32_t init_events(void);
 static void init_game(void);
+static int32_t load_game(void);
+static void record_command(uint32_t tick, cmd_t cmd);
+static int32_t replay_tick(uint32_t tick);
+static int32_t run_idle_slice(void);
 static void move_photo_down(void);
 static void move_photo_left(void);
 static void move_photo_right(void);
 static void move_photo_up(void);
-static void redraw_room(void);
-static void* status_thread(void* ignore);
-static int time_is_after(struct timeval* t1, struct timeval* t2);
+static int32_t set_timer(int timer_fd, uint32_t usec, int32_t periodic);
+static int32_t save_game(void* ignore);
+static void show_new_room(void);
+static uint32_t read_status_msg(char* buf);
+static void set_status_msg(const char* s);
+static void update_status_bar(void);
+static int32_t wait_for_tick(uint32_t tick, int32_t block);
 
 
 /* file-scope variables */
 
 static game_info_t game_info; /* game information */
 
+/*
+ * Set when the view has moved since the last render_scroll request.
+ * Commands that move the view change only game_info.map_x and map_y;
+ * flush_scroll then sends one request for all of them together.
+ */
+static int32_t scroll_pending = 0;
+
+
+/*
+ * Input recording and replay.  When record_file is open, every command
+ * read during a tick is written to it as a line holding the tick number,
+ * the command number, and the typed command text at that time(a line is
+ * also written at the end of a tick in which only the typed text
+ * changed).  The first line gives the random seed.  When replay_file is
+ * open, commands are read from it instead of the input devices, and the
+ * game ends after the last line; recording a replay gives back the same
+ * lines.
+ * If no_pacing is set, each tick starts as soon as the last frame has
+ * been drawn.
+ */
+static FILE* record_file = NULL;
+static FILE* replay_file = NULL;
+static int32_t no_pacing = 0;
+
 
 /*
- * The variables below are used to keep track of the status message helper
- * thread, with Posix thread id recorded in status_thread_id.
+ * File descriptors for the event loop.  Between ticks, the game thread
+ * sleeps in epoll_wait on epoll_fd until one of these is ready:
  *
+ *   tick_fd -- a timer that expires once per tick
+ *   stdin -- keystrokes(not watched during a replay)
+ *   tux_event_fd -- signaled by the Tux controller thread after it queues
+ *                   a command(the controller's tty never becomes readable,
+ *                   so that thread must still poll the buttons)
+ *   status_event_fd -- signaled by show_status for a new message
+ *   status_timer_fd -- a timer that expires when the message should go
+ */
+static int epoll_fd = -1;
+static int tick_fd = -1;
+static int tux_event_fd = -1;
+static int status_event_fd = -1;
+static int status_timer_fd = -1;
+
+
+/*
+ * Idle tasks(see idle.h).  A slot with a NULL fn is free.  Only the game
+ * thread touches these.
+ */
+typedef struct {
+    const char* name;     /* name printed by idle_dump            */
+    int32_t     priority; /* higher priorities run first          */
+    idle_fn_t   fn;       /* does one slice of work               */
+    void*       arg;      /* argument for fn                      */
+    int32_t     pending;  /* has work to do                       */
+    uint32_t    slices;   /* number of slices run                 */
+    uint64_t    cpu_ns;   /* thread CPU time used, in nanoseconds */
+} idle_task_t;
+static idle_task_t idle_task[MAX_IDLE_TASKS];
+
+/* idle task that draws lines ahead of scrolling(-1 if none) */
+static int32_t margin_task = -1;
+
+
+/*
+ * Saved games.  If save_name is set(-S), the game is resumed from that
+ * file if it exists, saved there when the player quits, and also saved
+ * every AUTOSAVE_TICKS ticks by an idle task, so that the write happens
+ * in the slack before a tick.  The file is written under a temporary
+ * name and then renamed, so a crash never leaves half a save.  The
+ * snapshot is built in save_buf, which is allocated once.  resume_x and
+ * resume_y give the view position to restore on entering the first room.
+ */
+static const char* save_name = NULL;
+static uint8_t* save_buf = NULL;
+static uint32_t save_len = 0;
+static int32_t save_task = -1;
+static uint32_t n_saves = 0;
+static uint64_t save_max_ns = 0;
+static unsigned int resume_x = 0;
+static unsigned int resume_y = 0;
+
+
+/*
  * The status_msg records the current status message: when the
  * string recorded there is empty, no status message need be displayed, and
  * the status bar should instead reflect the name of the current room and the
  * player's typing(for typed commands).
  *
- * The status_msg is protected by the msg_lock mutex, which should be
- * acquired before reading or writing the message.  Further, if the message
- * is changed, the helper thread must be notified by signaling it with the
- * condition variable msg_cv(while holding the msg_lock).
+ * The status_msg is published with a sequence lock.  A writer holds the
+ * msg_lock mutex(which serializes writers only) and increments status_seq
+ * before and after changing the message, so status_seq is odd during a
+ * change.  Readers never block: they copy the message and retry if
+ * status_seq was odd or changed during the copy(see read_status_msg).
+ * status_seq thus also serves as a version number for the message.  If
+ * the message is changed by show_status, the game loop must be notified
+ * by signaling status_event_fd so that it can restart the timer for
+ * removing the message.
  */
-static pthread_t status_thread_id;
 static pthread_mutex_t msg_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t  msg_cv = PTHREAD_COND_INITIALIZER;
+static uint32_t status_seq = 0;
 static char status_msg[STATUS_MSG_LEN + 1] = { '\0' };
 
 #if (ADVENTURE_USE_TUX_CONTROLLER == 1)
 
 /*
  * These variables are used for interacting with the tux controller and
- * setting up the tux controller thread. tux_command acts as a buffer that
- * holds the current command and is empty when ready to read a new command.
+ * setting up the tux controller thread.  Button presses are passed to the
+ * game thread through tux_ring, which has a single producer(the tux
+ * controller thread) and a single consumer(the game thread) and so needs
+ * no lock.  The producer alone writes tux_tail, and the consumer alone
+ * writes tux_head; both only increase and are masked to index the ring.
+ * Index stores use release semantics and loads of the other side's index
+ * use acquire semantics, so an event is complete before it is seen.  A
+ * press that finds the ring full is counted in tux_overflow and dropped.
  */
 static pthread_t tuxcontroller_thread_id;
-static pthread_mutex_t tuxlock = PTHREAD_MUTEX_INITIALIZER;
-cmd_t tux_command = CMD_NONE;
+static input_event_t tux_ring[TUX_RING_LEN];
+static unsigned int tux_head = 0;
+static unsigned int tux_tail = 0;
+static unsigned int tux_overflow = 0;
 
 /*closes the tuxcontoller thread on exit*/
 static void cancel_tuxcontroller_thread(void * ignore){
       close(fd);
       (void)pthread_cancel(tuxcontroller_thread_id);
+      (void)pthread_join(tuxcontroller_thread_id, NULL);
+      if(0 != tux_overflow){
+            fprintf(stderr, "tux: %u commands dropped\n", tux_overflow);
+      }
       return;
 }
 
-/*Writes a command to the tux_command variable*/
-void write_to_buffer(cmd_t command){
-      pthread_mutex_lock(&tuxlock);
-      tux_command = command;
-      pthread_mutex_unlock(&tuxlock);
-      return;
+/*Adds a command to the ring(tux controller thread only); returns 0 if
+ *the ring is full
+ */
+static int tux_push(cmd_t command){
+      unsigned int tail = tux_tail;
+
+      if(TUX_RING_LEN == tail - __atomic_load_n(&tux_head, __ATOMIC_ACQUIRE)){
+            tux_overflow++;
+            return 0;
+      }
+      tux_ring[tail & (TUX_RING_LEN - 1)].cmd = command;
+      tux_ring[tail & (TUX_RING_LEN - 1)].time = timing_now();
+      __atomic_store_n(&tux_tail, tail + 1, __ATOMIC_RELEASE);
+      return 1;
 }
 
-/*Reads from the tux controller variable and clears it, signaling the
- *program is ready for more input
+/*Removes up to max commands from the ring, oldest first(game thread
+ *only); returns the number removed
  */
-cmd_t read_from_buffer(){
-      cmd_t buffer_contents;
-      pthread_mutex_lock(&tuxlock);
-      buffer_contents = tux_command;
-      tux_command = CMD_NONE;
-      pthread_mutex_unlock(&tuxlock);
-      return buffer_contents;
-}
+static int32_t tux_pop(input_event_t* ev, int32_t max){
+      unsigned int head = tux_head;
+      int32_t n;
 
-/*empty_buffer checks if the tux_command buffer is ready for another command*/
-int empty_buffer(){
-      pthread_mutex_lock(&tuxlock);
-      if(tux_command == CMD_NONE){
-            pthread_mutex_unlock(&tuxlock);
-            return 1;
+      for(n = 0; n < max && head != __atomic_load_n(&tux_tail, __ATOMIC_ACQUIRE); n++){
+            ev[n] = tux_ring[head++ & (TUX_RING_LEN - 1)];
       }
-      pthread_mutex_unlock(&tuxlock);
-      return 0;
+      __atomic_store_n(&tux_head, head, __ATOMIC_RELEASE);
+      return n;
 }
 
 /*tuxcontroller_thread - handles adding and updating the command received
@@ -245,11 +435,13 @@ static void * tuxcontroller_thread(void * ignore){
                 (last_cmd == CMD_MOVE_RIGHT))){
                      continue;
                }
+            last_cmd = local_cmd;
 
-               /*Otherwise write the command if the buffer is empty*/
-            if(empty_buffer()){
-                  last_cmd = local_cmd;
-                  write_to_buffer(local_cmd);
+               /*Otherwise queue the command(held directions repeat on
+                *each poll) and wake up the game loop*/
+            if(CMD_NONE != local_cmd && tux_push(local_cmd)){
+                  uint64_t one = 1;
+                  (void)write(tux_event_fd, &one, sizeof (one));
             }
       }
       return NULL;
@@ -258,18 +450,347 @@ static void * tuxcontroller_thread(void * ignore){
 #endif
 
 /*
- * cancel_status_thread
- *   DESCRIPTION: Terminates the status message helper thread.  Used as
+ * init_events
+ *   DESCRIPTION: Creates the timers, event counters, and epoll instance
+ *                used by the game loop, and starts the tick timer.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t init_events() {
+    struct epoll_event ev; /* event to watch              */
+    int watch[5];          /* file descriptors to watch   */
+    int n_watch;           /* number of descriptors       */
+    int i;                 /* loop index over descriptors */
+
+    if (-1 == (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) ||
+        -1 == (tick_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) ||
+        -1 == (status_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) ||
+        -1 == (status_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) ||
+        -1 == (tux_event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {
+        perror("create event loop descriptors");
+        return -1;
+    }
+
+    n_watch = 0;
+    watch[n_watch++] = tick_fd;
+    watch[n_watch++] = status_timer_fd;
+    watch[n_watch++] = status_event_fd;
+    watch[n_watch++] = tux_event_fd;
+    if (NULL == replay_file) {
+        watch[n_watch++] = fileno(stdin);
+    }
+    for (i = 0; i < n_watch; i++) {
+        memset(&ev, 0, sizeof (ev));
+        ev.events = EPOLLIN;
+        ev.data.fd = watch[i];
+        if (-1 == epoll_ctl(epoll_fd, EPOLL_CTL_ADD, watch[i], &ev)) {
+            perror("epoll_ctl");
+            return -1;
+        }
+    }
+
+    return set_timer(tick_fd, TICK_USEC, 1);
+}
+
+
+/*
+ * close_events
+ *   DESCRIPTION: Closes the descriptors made by init_events.  Used as
  *                a cleanup method to ensure proper shutdown.
  *   INPUTS: none(ignored)
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-static void cancel_status_thread(void* ignore) {
-    (void)pthread_cancel(status_thread_id);
+static void close_events(void* ignore) {
+    int* fds[5] = {&epoll_fd, &tick_fd, &status_timer_fd, &status_event_fd, &tux_event_fd};
+    int i; /* loop index over descriptors */
+
+    for (i = 0; i < 5; i++) {
+        if (-1 != *fds[i]) {
+            (void)close(*fds[i]);
+            *fds[i] = -1;
+        }
+    }
+}
+
+
+/*
+ * set_timer
+ *   DESCRIPTION: Starts a timer.
+ *   INPUTS: timer_fd -- the timer
+ *           usec -- time until expiry in microseconds
+ *           periodic -- if non-zero, the timer expires every usec after that
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: none
+ */
+static int32_t set_timer(int timer_fd, uint32_t usec, int32_t periodic) {
+    struct itimerspec its; /* timer setting */
+
+    memset(&its, 0, sizeof (its));
+    its.it_value.tv_sec = usec / 1000000;
+    its.it_value.tv_nsec = (usec % 1000000) * 1000;
+    if (periodic) {
+        its.it_interval = its.it_value;
+    }
+    if (-1 == timerfd_settime(timer_fd, 0, &its, NULL)) {
+        perror("timerfd_settime");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * wait_for_tick
+ *   DESCRIPTION: Handles events until the next tick.  Commands from the
+ *                keyboard and Tux controller are carried out as soon as
+ *                they arrive, and the status message is removed when its
+ *                time is up.  If any ticks were missed completely, they
+ *                are skipped.
+ *   INPUTS: tick -- the current tick number(for recording commands)
+ *           block -- if zero, handle only events that are already
+ *                    pending rather than waiting for the tick
+ *   OUTPUTS: none
+ *   RETURN VALUE: APPLY_QUIT if the player quits, APPLY_NEW_ROOM if the
+ *                 player's room changes, or APPLY_NOTHING otherwise
+ *   SIDE EFFECTS: may move the view, the player, or objects
+ */
+static int32_t wait_for_tick(uint32_t tick, int32_t block) {
+    struct epoll_event ev[8]; /* events ready                */
+    uint64_t count;           /* timer expirations or events */
+    uint64_t start;           /* start time of a phase       */
+    int32_t result;           /* result of commands          */
+    int32_t applied;          /* result of one command       */
+    int32_t ran;              /* ran an idle task slice      */
+    int n_ev;                 /* number of events ready      */
+    int i;                    /* loop index over events      */
+    input_event_t in[INPUT_BATCH]; /* commands read            */
+    int32_t n_in;             /* number of commands read     */
+    int32_t j;                /* loop index over commands    */
+
+    result = APPLY_NOTHING;
+    while (1) {
+        /*
+         * Spend the wait on idle tasks, if any have work and there is
+         * time; only check for events between slices.  Otherwise sleep
+         * until an event arrives.
+         */
+        ran = 0;
+        if (block) {
+            start = timing_now();
+            if (0 != (ran = run_idle_slice())) {
+                timing_add(TM_BACKGROUND, start);
+            }
+        }
+        start = timing_now();
+        n_ev = epoll_wait(epoll_fd, ev, sizeof (ev) / sizeof (ev[0]), (block && !ran) ? -1 : 0);
+        timing_add(TM_IDLE, start);
+        if (-1 == n_ev) {
+            if (EINTR == errno) {
+                continue;
+            }
+            PANIC("epoll_wait failed");
+        }
+
+        for (i = 0; i < n_ev; i++) {
+            if (tick_fd == ev[i].data.fd) {
+                (void)read(tick_fd, &count, sizeof (count));
+                block = 0;
+            }
+            else if (status_event_fd == ev[i].data.fd) {
+                /* A new message: show it for the full time. */
+                (void)read(status_event_fd, &count, sizeof (count));
+                (void)set_timer(status_timer_fd, STATUS_USEC, 0);
+            }
+            else if (status_timer_fd == ev[i].data.fd) {
+                (void)read(status_timer_fd, &count, sizeof (count));
+                set_status_msg("");
+            }
+            else {
+                /*
+                 * Read every Tux controller or keyboard command queued.
+                 * Keyboard decoding may leave keystrokes for later, so
+                 * keep reading until nothing is left rather than waiting
+                 * for stdin to become readable again.
+                 */
+                if (tux_event_fd == ev[i].data.fd) {
+                    (void)read(tux_event_fd, &count, sizeof (count));
+                }
+                while (1) {
+                    start = timing_now();
+                    if (tux_event_fd == ev[i].data.fd) {
+#if (ADVENTURE_USE_TUX_CONTROLLER == 1)
+                        n_in = tux_pop(in, INPUT_BATCH);
+#else
+                        n_in = 0;
+#endif
+                    }
+                    else {
+                        n_in = get_commands(in, INPUT_BATCH);
+                    }
+                    timing_add(TM_INPUT, start);
+                    if (0 == n_in) {
+                        break;
+                    }
+
+                    /* Carry them out, noting how long each one waited. */
+                    for (j = 0; j < n_in; j++) {
+                        record_command(tick, in[j].cmd);
+                        applied = apply_command(in[j].cmd);
+                        timing_latency(in[j].time);
+                        if (APPLY_QUIT == applied) {
+                            return APPLY_QUIT;
+                        }
+                        result |= applied;
+                    }
+                }
+
+                /* Start drawing any lines exposed by the commands. */
+                flush_scroll();
+            }
+        }
+
+        if (!block) {
+            /*
+             * Keystrokes that finish no command still change the typed
+             * text; record it once per tick so that a replay shows it.
+             */
+            record_command(tick, CMD_NONE);
+            return result;
+        }
+    }
+}
+
+/*
+ * run_idle_slice
+ *   DESCRIPTION: Runs one slice of the highest-priority idle task that has
+ *                work pending, unless the next tick is too close.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if a slice ran, or 0 if not
+ *   SIDE EFFECTS: records the thread CPU time used by the task
+ */
+static int32_t run_idle_slice() {
+    struct itimerspec its; /* time left until the next tick */
+    struct timespec t0;    /* thread CPU time before slice  */
+    struct timespec t1;    /* thread CPU time after slice   */
+    idle_task_t* task;     /* task to run                   */
+    int32_t i;             /* loop index over tasks         */
+
+    task = NULL;
+    for (i = 0; i < MAX_IDLE_TASKS; i++) {
+        if (NULL != idle_task[i].fn && idle_task[i].pending &&
+            (NULL == task || task->priority < idle_task[i].priority)) {
+            task = &idle_task[i];
+        }
+    }
+    if (NULL == task) {
+        return 0;
+    }
+
+    /* Leave the time just before the tick for drawing the next frame. */
+    if (0 != timerfd_gettime(tick_fd, &its) ||
+        (0 == its.it_value.tv_sec &&
+         IDLE_MARGIN_USEC * 1000 > its.it_value.tv_nsec)) {
+        return 0;
+    }
+
+    (void)clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+    task->pending = task->fn(task->arg);
+    (void)clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+    task->slices++;
+    task->cpu_ns += (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000 +
+                    t1.tv_nsec - t0.tv_nsec;
+    return 1;
+}
+
+
+/*
+ * idle_register(interface function; declared in idle.h)
+ *   DESCRIPTION: Adds an idle task, with work pending.
+ *   INPUTS: name -- name printed by idle_dump(not copied)
+ *           priority -- higher priorities run first
+ *           fn -- does one slice of work; returns non-zero if more remains
+ *           arg -- argument for fn
+ *   OUTPUTS: none
+ *   RETURN VALUE: the task id, or -1 if too many tasks are registered
+ *   SIDE EFFECTS: none
+ */
+int32_t idle_register(const char* name, int32_t priority, idle_fn_t fn, void* arg) {
+    int32_t i; /* loop index over task slots */
+
+    for (i = 0; i < MAX_IDLE_TASKS; i++) {
+        if (NULL == idle_task[i].fn) {
+            idle_task[i].name = name;
+            idle_task[i].priority = priority;
+            idle_task[i].fn = fn;
+            idle_task[i].arg = arg;
+            idle_task[i].pending = 1;
+            idle_task[i].slices = 0;
+            idle_task[i].cpu_ns = 0;
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * idle_unregister(interface function; declared in idle.h)
+ *   DESCRIPTION: Removes an idle task.
+ *   INPUTS: id -- the task id from idle_register
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void idle_unregister(int32_t id) {
+    if (0 <= id && MAX_IDLE_TASKS > id) {
+        idle_task[id].fn = NULL;
+    }
+}
+
+
+/*
+ * idle_wake(interface function; declared in idle.h)
+ *   DESCRIPTION: Marks an idle task as having work to do.
+ *   INPUTS: id -- the task id from idle_register
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void idle_wake(int32_t id) {
+    if (0 <= id && MAX_IDLE_TASKS > id) {
+        idle_task[id].pending = 1;
+    }
+}
+
+
+/*
+ * idle_dump(interface function; declared in idle.h)
+ *   DESCRIPTION: Prints the number of slices and the thread CPU time used
+ *                by each registered idle task.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to stderr
+ */
+void idle_dump() {
+    int32_t i; /* loop index over tasks */
+
+    for (i = 0; i < MAX_IDLE_TASKS; i++) {
+        if (NULL != idle_task[i].fn) {
+            fprintf(stderr, "idle task %-16s %8u slices %10.1f ms\n",
+                    idle_task[i].name, idle_task[i].slices,
+                    idle_task[i].cpu_ns / 1000000.0);
+        }
+    }
 }
 
+
 /*
  * game_loop
  *   DESCRIPTION: Main event loop for the adventure game.
@@ -280,191 +801,416 @@ static void cancel_status_thread(void* ignore) {
  */
 static game_condition_t game_loop() {
 
-    /*
-     * Variables used to carry information between event loop ticks; see
-     * initialization below for explanations of purpose.
-     */
-    struct timeval start_time, tick_time;
-
-    struct timeval cur_time; /* current time(during tick)      */
-    cmd_t cmd;               /* command issued by input control */
-    int32_t enter_room;      /* player has changed rooms        */
-
-    /* Record the starting time--assume success. */
-    (void)gettimeofday(&start_time, NULL);
+    uint64_t phase_start;    /* start time of a tick phase      */
+    uint32_t tick;           /* number of the current tick      */
 
-    /* Calculate the time at which the first event loop tick should occur. */
-    tick_time = start_time;
-    if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-        tick_time.tv_sec++;
-        tick_time.tv_usec -= 1000000;
+    /* The player has just entered the first room(perhaps a saved view). */
+    show_new_room();
+    if (0 != resume_x || 0 != resume_y) {
+        game_info.map_x = resume_x;
+        game_info.map_y = resume_y;
+        scroll_pending = 1;
     }
 
-    /* The player has just entered the first room. */
-    enter_room = 1;
-
     /* The main event loop. */
-    while (1) {
+    for (tick = 0; 1; tick++) {
 
         /*
-         * Update the screen, preparing the VGA palette and photo-drawing
-         * routines and drawing a new room photo first if the player has
-         * entered a new room, then showing the screen(and status bar,
-         * once you have it working).
+         * Update the screen, drawing any lines exposed by the commands
+         * since the last frame, then showing the screen and status bar.
+         * New rooms are drawn as soon as the player enters them(see
+         * apply_command).
          */
+        flush_scroll();
+        render_frame();
 
-        if (enter_room) {
-            /* Reset the view window to(0,0). */
-            game_info.map_x = game_info.map_y = 0;
-            set_view_window(game_info.map_x, game_info.map_y);
+        update_status_bar();
 
-            /* Discard any partially-typed command. */
-            reset_typed_command();
+        /*
+         * Wait for tick.  The tick defines the basic timing of our
+         * event loop, and is the minimum amount of time between frames.
+         * Player commands are carried out as they arrive.  Without
+         * pacing, wait only for the render thread to finish the frame,
+         * so that no frame is dropped.
+         */
+        if (no_pacing) {
+            phase_start = timing_now();
+            render_sync();
+            timing_add(TM_IDLE, phase_start);
+        }
+        if (APPLY_QUIT == wait_for_tick(tick, !no_pacing)) {
+            return GAME_QUIT;
+        }
 
-            /* Adjust colors and photo drawing for the current room photo. */
-            prep_room(game_info.where);
+        /* A new tick begins: record the time spent in the last one. */
+        timing_end_tick();
 
-            /* Draw the room(calls show). */
-            redraw_room();
+        /* Save the game now and then. */
+        if (0 == (tick + 1) % AUTOSAVE_TICKS) {
+            idle_wake(save_task);
+        }
 
-            /* Only draw once on entry. */
-            enter_room = 0;
+        /* A replay carries out the commands recorded for this tick. */
+        if (NULL != replay_file) {
+            if (APPLY_QUIT == replay_tick(tick)) {
+                return GAME_QUIT;
+            }
         }
 
-        show_screen();
+        /* If player wins the game, their room becomes NULL. */
+        if (NULL == game_info.where) {
+            return GAME_WON;
+        }
+    } /* end of the main event loop */
+}
 
-        /*
-         * Fill the status bar. first check if the status_msg is empty.
-         * Otherwise fill in the room name and typed command.
-         */
 
-         /*Check to see if there's a status message we should display*/
+/*
+ * apply_command
+ *   DESCRIPTION: Carry out one command from an input device(or from a
+ *                replayed recording).  Moves of the view are merged until
+ *                flush_scroll is called or a command of another kind is
+ *                carried out.  If the player changes rooms, the new room
+ *                is drawn at once, so that later commands apply to it.
+ *   INPUTS: cmd -- the command
+ *   OUTPUTS: none
+ *   RETURN VALUE: APPLY_NEW_ROOM if the player's room changes, APPLY_QUIT
+ *                 if the player quits, or APPLY_NOTHING otherwise
+ *   SIDE EFFECTS: may move the view, the player, or objects
+ */
+static int32_t apply_command(cmd_t cmd) {
+    int32_t result; /* result of the command */
+    uint64_t start; /* start time of a typed command */
+
+    result = APPLY_NOTHING;
+    if (CMD_RIGHT != cmd && CMD_LEFT != cmd &&
+        CMD_UP != cmd && CMD_DOWN != cmd) {
+        flush_scroll();
+    }
+    switch (cmd) {
+        case CMD_UP:    move_photo_down();  break;
+        case CMD_RIGHT: move_photo_left();  break;
+        case CMD_DOWN:  move_photo_up();    break;
+        case CMD_LEFT:  move_photo_right(); break;
+        case CMD_MOVE_LEFT:
+            if (TC_CHANGE_ROOM == try_to_move_left(&game_info.where)) {
+                result = APPLY_NEW_ROOM;
+            }
+            break;
+        case CMD_ENTER:
+            if (TC_CHANGE_ROOM == try_to_enter(&game_info.where)) {
+                result = APPLY_NEW_ROOM;
+            }
+            break;
+        case CMD_MOVE_RIGHT:
+            if (TC_CHANGE_ROOM == try_to_move_right(&game_info.where)) {
+                result = APPLY_NEW_ROOM;
+            }
+            break;
+        case CMD_TYPED:
+            start = timing_now();
+            if (handle_typing()) {
+                result = APPLY_NEW_ROOM;
+            }
+            timing_add(TM_TYPED, start);
+            break;
+        case CMD_QUIT:
+            result = APPLY_QUIT;
+            break;
+        default: break;
+    }
 
-        if(status_msg[0] != '\0'){
-             /*first synchronize with the helper thread to ensure we have access to the status_msg*/
-             (void)pthread_mutex_lock(&msg_lock);
+    /* If player wins the game, their room becomes NULL. */
+    if (APPLY_NEW_ROOM == result && NULL != game_info.where) {
+        show_new_room();
+    }
 
-             /*Display the status message*/
-             fill_status_bar(status_msg);
+    /* The view or the room contents may have changed. */
+    if (CMD_NONE != cmd) {
+        idle_wake(margin_task);
+    }
+    return result;
+}
 
-             /*Now that we no longer need access to the status_msg string, we can release our lock*/
-             (void)pthread_mutex_unlock(&msg_lock);
-        }
 
+/*
+ * show_new_room
+ *   DESCRIPTION: Resets the view for the room that the player has just
+ *                entered, then prepares the palette and photo drawing for
+ *                the room and draws it.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: discards any partially-typed command and any view
+ *                 motion not yet drawn
+ */
+static void show_new_room() {
+    /* Reset the view window to(0,0). */
+    game_info.map_x = game_info.map_y = 0;
+    scroll_pending = 0;
 
-        /*Otherwise print the room name + currently typed command*/
-        else{
-             char * room_name = get_room_name(game_info.where);   /*String containing room name*/
-             char * command = (char *)get_typed_command();        /*String containint typed command*/
-             char status[STATUS_X_DIM/FONT_WIDTH + 1];            /*String that holds what to write to status bar*/
+    /* Discard any partially-typed command. */
+    reset_typed_command();
 
-             /*Remove all the unecessary spaces from the typed command*/
-             while(' ' == *command) { command++; }
+    /*
+     * Adjust colors and photo drawing for the current room photo,
+     * then draw the room.
+     */
+    render_enter_room(game_info.where);
+    idle_wake(margin_task);
+}
 
-             /*Fill the status with empty spaces - basically placeholders*/
-             memset(status, ' ', STATUS_X_DIM/FONT_WIDTH);
 
-             /*Calculate the length of the room name and typed command*/
-             int len_room_name = strlen(room_name);
-             int cmd_len = strlen(command);
+/*
+ * flush_scroll
+ *   DESCRIPTION: Moves the view window to the position reached by the
+ *                commands carried out since the last call, drawing any
+ *                newly exposed lines.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer(possibly later)
+ */
+static void flush_scroll() {
+    if (scroll_pending) {
+        scroll_pending = 0;
+        render_scroll(game_info.map_x, game_info.map_y);
+    }
+}
 
-             /*memcpy(void * destination, void * source, size_t n)*/
-             /*Place the room name on the left side of the status screen (beginning of status string)*/
-             memcpy(status, room_name, (size_t)len_room_name);
-             /*Place the typed command on the right side of the screen (end of status string), minus one space*/
-             memcpy((status+(STATUS_X_DIM/FONT_WIDTH)-cmd_len-1), command, (size_t)cmd_len);
-             /*Fill the last space with an underscore to prompt the user to type in commands*/
-             status[39] = '_';
 
-             /*call fill_status_bar to print the status string into the status bar*/
-             fill_status_bar(status);
-        }
+/*
+ * save_game
+ *   DESCRIPTION: Saves the game to save_name.  The snapshot takes time
+ *                linear in the size of the world, and the file is small,
+ *                so a save takes far less than a tick.  Also used as an
+ *                idle task.
+ *   INPUTS: none(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0(no more work to do)
+ *   SIDE EFFECTS: writes the save file; prints an error message on
+ *                 failure
+ */
+static int32_t save_game(void* ignore) {
+    save_header_t* hdr = (save_header_t*)save_buf; /* file header      */
+    char tmp_name[FILENAME_MAX];                   /* temporary file   */
+    uint64_t start;                                /* start time       */
+    int fd;                                        /* temporary file   */
+    ssize_t written;                               /* bytes written    */
+
+    if (NULL == save_name || NULL == game_info.where) {
+        return 0;
+    }
+    start = timing_now();
+
+    hdr->magic = SAVE_MAGIC;
+    hdr->size = save_len - sizeof (*hdr);
+    hdr->map_x = game_info.map_x;
+    hdr->map_y = game_info.map_y;
+    hdr->x_speed = game_info.x_speed;
+    hdr->y_speed = game_info.y_speed;
+    save_world_state(hdr + 1, game_info.where);
+
+    (void)snprintf(tmp_name, sizeof (tmp_name), "%s.tmp", save_name);
+    if (-1 == (fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0666))) {
+        perror(tmp_name);
+        return 0;
+    }
+    written = write(fd, save_buf, save_len);
+    if (-1 == close(fd) || save_len != written || -1 == rename(tmp_name, save_name)) {
+        perror("save game");
+        (void)unlink(tmp_name);
+        return 0;
+    }
 
-        /*
-         * Wait for tick.  The tick defines the basic timing of our
-         * event loop, and is the minimum amount of time between events.
-         */
-        do {
-            if (gettimeofday(&cur_time, NULL) != 0) {
-                /* Panic!(should never happen) */
-                clear_mode_X();
-                shutdown_input();
-                perror("gettimeofday");
-                exit(3);
-            }
-        } while (!time_is_after(&cur_time, &tick_time));
+    n_saves++;
+    if (save_max_ns < timing_now() - start) {
+        save_max_ns = timing_now() - start;
+    }
+    return 0;
+}
 
-        /*
-         * Advance the tick time.  If we missed one or more ticks completely,
-         * i.e., if the current time is already after the time for the next
-         * tick, just skip the extra ticks and advance the clock to the one
-         * that we haven't missed.
-         */
-        do {
-            if ((tick_time.tv_usec += TICK_USEC) > 1000000) {
-                tick_time.tv_sec++;
-                tick_time.tv_usec -= 1000000;
-            }
-        } while (time_is_after(&cur_time, &tick_time));
 
-        /*
-         * Handle synchronous events--in this case, only player commands.
-         * Note that typed commands that move objects may cause the room
-         * to be redrawn.
-         */
+/*
+ * load_game
+ *   DESCRIPTION: Resumes a game saved in save_name by save_game.  Must be
+ *                called after the world is built and the game is
+ *                initialized.  Allocates save_buf.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if a game was resumed, 0 if there is no saved game,
+ *                 or -1 if the saved game cannot be used
+ *   SIDE EFFECTS: restores the world state and the player's room and view
+ *                 (clamped to the room's photo)
+ */
+static int32_t load_game() {
+    save_header_t* hdr; /* file header             */
+    room_t* where;      /* player's room           */
+    uint32_t max_x;     /* farthest view position  */
+    uint32_t max_y;
+    int fd;             /* save file               */
+    ssize_t got;        /* bytes read              */
+
+    save_len = sizeof (*hdr) + world_state_size();
+    if (NULL == (save_buf = malloc(save_len + 1))) {
+        return -1;
+    }
+    hdr = (save_header_t*)save_buf;
 
-         /*Read the keyboard input and perform the appropriate action*/
-        cmd = get_command();
-        switch (cmd) {
-            case CMD_UP:    move_photo_down();  break;
-            case CMD_RIGHT: move_photo_left();  break;
-            case CMD_DOWN:  move_photo_up();    break;
-            case CMD_LEFT:  move_photo_right(); break;
-            case CMD_MOVE_LEFT:
-                enter_room = (TC_CHANGE_ROOM == try_to_move_left(&game_info.where));
-                break;
-            case CMD_ENTER:
-                enter_room = (TC_CHANGE_ROOM == try_to_enter(&game_info.where));
-                break;
-            case CMD_MOVE_RIGHT:
-                enter_room = (TC_CHANGE_ROOM == try_to_move_right(&game_info.where));
-                break;
-            case CMD_TYPED:
-                if (handle_typing()) {
-                    enter_room = 1;
-                }
-                break;
-            case CMD_QUIT: return GAME_QUIT;
-            default: break;
+    if (-1 == (fd = open(save_name, O_RDONLY))) {
+        if (ENOENT == errno) {
+            return 0;
         }
+        perror(save_name);
+        return -1;
+    }
 
-        #if(ADVENTURE_USE_TUX_CONTROLLER == 1)
+    /* Read one byte more than expected to catch files that are too long. */
+    got = read(fd, save_buf, save_len + 1);
+    (void)close(fd);
+    if (save_len != got || SAVE_MAGIC != hdr->magic ||
+        world_state_size() != hdr->size ||
+        NULL == (where = load_world_state(hdr + 1, hdr->size))) {
+        fprintf(stderr, "%s is not a saved game for this world\n", save_name);
+        return -1;
+    }
+
+    /*
+     * The view and speeds are not checked by load_world_state; keep them
+     * within the resumed room's photo, as the scrolling commands do.
+     */
+    max_x = room_photo_width(where);
+    max_x = (SCROLL_X_DIM < max_x ? max_x - SCROLL_X_DIM : 0);
+    max_y = room_photo_height(where);
+    max_y = (SCROLL_Y_DIM < max_y ? max_y - SCROLL_Y_DIM : 0);
+    game_info.where = where;
+    game_info.x_speed = (0 < hdr->x_speed && MOTION_SPEED * 3 >= hdr->x_speed ?
+                         hdr->x_speed : MOTION_SPEED);
+    game_info.y_speed = (0 < hdr->y_speed && MOTION_SPEED * 3 >= hdr->y_speed ?
+                         hdr->y_speed : MOTION_SPEED);
+    resume_x = (max_x < hdr->map_x ? max_x : hdr->map_x);
+    resume_y = (max_y < hdr->map_y ? max_y : hdr->map_y);
+    return 1;
+}
+
+
+/*
+ * record_command
+ *   DESCRIPTION: Write a command to the recording, if one is being made.
+ *                Nothing is written for CMD_NONE unless the typed command
+ *                has changed since the last line written.
+ *   INPUTS: tick -- the current tick number
+ *           cmd -- the command read
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to record_file
+ */
+static void record_command(uint32_t tick, cmd_t cmd) {
+    static char last_typed[MAX_TYPED_LEN + 1] = {'\0'}; /* typing last written */
+    const char* typed;                                  /* current typing      */
 
-        /*Read the tux controller input and do the appropriate action*/
-        switch(read_from_buffer()){
-             case CMD_UP:    move_photo_down();  break;
-             case CMD_RIGHT: move_photo_left();  break;
-             case CMD_DOWN:  move_photo_up();    break;
-             case CMD_LEFT:  move_photo_right(); break;
-             case CMD_MOVE_LEFT:
-                 enter_room = (TC_CHANGE_ROOM == try_to_move_left(&game_info.where));
-                 break;
-             case CMD_ENTER:
-                 enter_room = (TC_CHANGE_ROOM == try_to_enter(&game_info.where));
-                 break;
-             case CMD_MOVE_RIGHT:
-                 enter_room = (TC_CHANGE_ROOM == try_to_move_right(&game_info.where));
-                 break;
+    if (NULL == record_file) {
+        return;
+    }
+    typed = get_typed_command();
+    if (CMD_NONE == cmd && 0 == strcmp(typed, last_typed)) {
+        return;
+    }
+    strcpy(last_typed, typed);
+    fprintf(record_file, "%u %d %s\n", tick, (int)cmd, typed);
+}
+
+
+/*
+ * replay_tick
+ *   DESCRIPTION: Apply all recorded commands for one tick.  The line read
+ *                ahead for a later tick is kept until that tick.
+ *   INPUTS: tick -- the current tick number
+ *   OUTPUTS: none
+ *   RETURN VALUE: APPLY_QUIT at the end of the recording(or if a quit
+ *                 command was recorded), APPLY_NEW_ROOM if the player's
+ *                 room changes, or APPLY_NOTHING otherwise
+ *   SIDE EFFECTS: reads replay_file; may move the view, player, or objects;
+ *                 writes the commands to record_file, if open
+ */
+static int32_t replay_tick(uint32_t tick) {
+    static char line[80];           /* line read ahead          */
+    static int32_t have_line = 0;   /* is a line waiting?       */
+    unsigned int rec_tick;          /* tick number from line    */
+    int rec_cmd;                    /* command number from line */
+    int typed_at;                   /* offset of typed text     */
+    int32_t result;                 /* result of commands       */
+    uint64_t start;                 /* start time of reading    */
+
+    result = APPLY_NOTHING;
+    while (1) {
+        start = timing_now();
+        if (!have_line && NULL == fgets(line, sizeof (line), replay_file)) {
+            return APPLY_QUIT;
+        }
+        have_line = 1;
+        typed_at = -1;
+        if (2 > sscanf(line, "%u %d %n", &rec_tick, &rec_cmd, &typed_at) ||
+            0 > typed_at || 0 > rec_cmd || NUM_COMMANDS <= rec_cmd) {
+            fprintf(stderr, "bad line in replay: %s", line);
+            return APPLY_QUIT;
+        }
+        if (tick < rec_tick) {
+            return result;
+        }
+        have_line = 0;
+        line[strcspn(line, "\n")] = '\0';
+        set_typed_command(&line[typed_at]);
+        record_command(tick, (cmd_t)rec_cmd);
+        timing_add(TM_INPUT, start);
+        switch (apply_command((cmd_t)rec_cmd)) {
+            case APPLY_QUIT:     return APPLY_QUIT;
+            case APPLY_NEW_ROOM: result = APPLY_NEW_ROOM; break;
             default: break;
-       }
+        }
+    }
+}
 
-       #endif
 
-        /* If player wins the game, their room becomes NULL. */
-        if (NULL == game_info.where) {
-            return GAME_WON;
+/*
+ * build_verb_trie
+ *   DESCRIPTION: Builds the trie used to match typed verbs from cmd_list.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 if a verb is not spelled with lower-case
+ *                 letters or the trie is too small
+ *   SIDE EFFECTS: none
+ */
+static int32_t build_verb_trie() {
+    int32_t     n_nodes; /* nodes used in trie                */
+    int32_t     node;    /* current node                      */
+    int32_t     idx;     /* loop index over command list      */
+    int32_t     len;     /* length of prefix reached          */
+    const char* c;       /* scan pointer over verb            */
+
+    (void)memset(verb_child, 0, sizeof (verb_child));
+    (void)memset(verb_cmd, -1, sizeof (verb_cmd));
+    n_nodes = 1;
+    for (idx = 0; NULL != cmd_list[idx].name; idx++) {
+        for (node = 0, len = 1, c = cmd_list[idx].name; '\0' != *c; c++, len++) {
+            if ('a' > *c || 'z' < *c) {
+                return -1;
+            }
+            if (0 == verb_child[node][*c - 'a']) {
+                if (MAX_VERB_NODES == n_nodes) {
+                    return -1;
+                }
+                verb_child[node][*c - 'a'] = n_nodes++;
+            }
+            node = verb_child[node][*c - 'a'];
+
+            /* Earlier entries take precedence. */
+            if (cmd_list[idx].min_len <= len && -1 == verb_cmd[node]) {
+                verb_cmd[node] = cmd_list[idx].cmd;
+            }
         }
-    } /* end of the main event loop */
+    }
+    return 0;
 }
 
 
@@ -480,7 +1226,9 @@ static int32_t handle_typing() {
     const char*      cmd;     /* command verb typed                */
     int32_t          cmd_len; /* length of command verb            */
     const char*      arg;     /* argument given to command verb    */
-    int32_t          idx;     /* loop index over command list      */
+    int32_t          word;    /* argument as an interned word      */
+    int32_t          node;    /* verb trie node for verb so far    */
+    int              letter;  /* character of verb(in lower case)  */
     tc_action_t      result;  /* result of typed command execution */
 
     /* Read the command and strip leading spaces.  If it's empty, return. */
@@ -489,102 +1237,69 @@ static int32_t handle_typing() {
     if ('\0' == *cmd) { return 0; }
 
     /*
-     * Walk over the command verb, calculating its length as we go.  Space
-     * or NUL marks the end of the verb, after which the argument begins.
-     * Leading spaces are first stripped from the argument, but we make no
-     * attempt to deal with trailing spaces(argument names must match
-     * exactly).
+     * Typed commands may change the room contents, so wait for the render
+     * thread to finish drawing before executing them.
      */
-    for (cmd_len = 0; ' ' != cmd[cmd_len] && '\0' != cmd[cmd_len]; cmd_len++);
-    arg = &cmd[cmd_len];
-    while (' ' == *arg) { arg++; }
-
-    /* Compare the typed verb with each command in our list. */
-    for (idx = 0; NULL != cmd_list[idx].name; idx++) {
-
-        /* If the typed verb is not long enough, it can't match. */
-        if (cmd_list[idx].min_len > cmd_len) { continue; }
-
-        /* Compare the prefix of the command with the typed verb. */
-        if (0 != strncasecmp(cmd_list[idx].name, cmd, cmd_len)) { continue; }
+    render_sync();
 
-        /* Execute the command found. */
-        switch (cmd_list[idx].cmd) {
-            case TC_BUY:
-                result = typed_cmd_buy(&game_info.where, arg);
-                break;
-            case TC_CHARGE:
-                result = typed_cmd_charge(&game_info.where, arg);
-                break;
-            case TC_DO:
-                result = typed_cmd_do(&game_info.where, arg);
-                break;
-            case TC_DRINK:
-                result = typed_cmd_drink(&game_info.where, arg);
-                break;
-            case TC_DROP:
-                result = typed_cmd_drop(&game_info.where, arg);
-                if (!player_has_board()) {
-                    game_info.x_speed = MOTION_SPEED;
-                }
-                if (!player_has_jetpack()) {
-                    game_info.y_speed = MOTION_SPEED;
-                }
-                break;
-            case TC_FIX:
-                result = typed_cmd_fix(&game_info.where, arg);
-                break;
-            case TC_FLASH:
-                result = typed_cmd_flash(&game_info.where, arg);
-                break;
-            case TC_GET:
-                result = typed_cmd_get(&game_info.where, arg);
-                if (player_has_board()) {
-                    game_info.x_speed = MOTION_SPEED * 3;
-                }
-                if (player_has_jetpack()) {
-                    game_info.y_speed = MOTION_SPEED * 3;
-                }
-                break;
-            case TC_GO:
-                result = typed_cmd_go(&game_info.where, arg);
-                break;
-            case TC_INSTALL:
-                result = typed_cmd_install(&game_info.where, arg);
-                break;
-            case TC_INVENTORY:
-                result = typed_cmd_inventory(&game_info.where, arg);
-                break;
-            case TC_SIGH:
-                result = typed_cmd_sigh(&game_info.where, arg);
-                break;
-            case TC_USE:
-                result = typed_cmd_use(&game_info.where, arg);
-                break;
-            case TC_WEAR:
-                result = typed_cmd_wear(&game_info.where, arg);
-                break;
-            default:
-                show_status("Bug...!");
-                result = TC_ALLOW_EDIT;
-                break;
+    /*
+     * Walk over the command verb, following it down the verb trie as we
+     * go(a character with no child leaves the verb unmatched).  Space or
+     * NUL marks the end of the verb, after which the argument begins.
+     * Leading spaces are first stripped from the argument, which is then
+     * interned as a word, but we make no attempt to deal with trailing
+     * spaces(argument names must match exactly).
+     */
+    for (cmd_len = node = 0; ' ' != cmd[cmd_len] && '\0' != cmd[cmd_len]; cmd_len++) {
+        letter = tolower((uint8_t)cmd[cmd_len]);
+        if (-1 != node) {
+            node = ('a' <= letter && 'z' >= letter && 0 != verb_child[node][letter - 'a'] ?
+                    verb_child[node][letter - 'a'] : -1);
         }
+    }
+    arg = &cmd[cmd_len];
+    while (' ' == *arg) { arg++; }
 
-        /* Handle command result and return. */
-        if (TC_CHANGE_ROOM == result) {
-            return 1;
-        }
-        if (TC_ALLOW_EDIT != result) {
-            reset_typed_command();
-            if (TC_REDRAW_ROOM == result) {
-                redraw_room();
-            }
-        }
+    /* The verb must be an allowed abbreviation of some command. */
+    if (-1 == node || -1 == verb_cmd[node]) {
+        show_status("What are you babbling about?");
         return 0;
     }
+    word = find_word(arg);
+
+    /* Execute the command found, then update the speeds for get and drop. */
+    result = typed_cmd(&game_info.where, verb_cmd[node], word);
+    switch (verb_cmd[node]) {
+        case TC_DROP:
+            if (!player_has_board()) {
+                game_info.x_speed = MOTION_SPEED;
+            }
+            if (!player_has_jetpack()) {
+                game_info.y_speed = MOTION_SPEED;
+            }
+            break;
+        case TC_GET:
+            if (player_has_board()) {
+                game_info.x_speed = MOTION_SPEED * 3;
+            }
+            if (player_has_jetpack()) {
+                game_info.y_speed = MOTION_SPEED * 3;
+            }
+            break;
+        default:
+            break;
+    }
 
-    /* The command was not recognized. */
-    show_status("What are you babbling about?");
+    /* Handle command result and return. */
+    if (TC_CHANGE_ROOM == result) {
+        return 1;
+    }
+    if (TC_ALLOW_EDIT != result) {
+        reset_typed_command();
+        if (TC_REDRAW_ROOM == result) {
+            render_redraw();
+        }
+    }
     return 0;
 }
 
@@ -619,19 +1334,13 @@ static void init_game() {
  */
 static void move_photo_down() {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over rows to redraw.         */
 
     /* Calculate the number of pixels by which to move. */
     delta = (game_info.y_speed > game_info.map_y ? game_info.map_y : game_info.y_speed);
 
     /* Shift the logical view upward. */
     game_info.map_y -= delta;
-    set_view_window(game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 0; delta > idx; idx++) {
-        (void)draw_horiz_line(idx);
-    }
+    scroll_pending |= (0 != delta);
 }
 
 
@@ -647,7 +1356,6 @@ static void move_photo_down() {
  */
 static void move_photo_left() {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over columns to redraw.      */
 
     /* Calculate the number of pixels by which to move. */
     delta = room_photo_width(game_info.where) - SCROLL_X_DIM - game_info.map_x;
@@ -655,12 +1363,7 @@ static void move_photo_left() {
 
     /* Shift the logical view to the right. */
     game_info.map_x += delta;
-    set_view_window(game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 1; delta >= idx; idx++) {
-        (void)draw_vert_line(SCROLL_X_DIM - idx);
-    }
+    scroll_pending |= (0 != delta);
 }
 
 
@@ -676,19 +1379,13 @@ static void move_photo_left() {
  */
 static void move_photo_right() {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over columns to redraw.      */
 
     /* Calculate the number of pixels by which to move. */
     delta = (game_info.x_speed > game_info.map_x ? game_info.map_x : game_info.x_speed);
 
     /* Shift the logical view to the left. */
     game_info.map_x -= delta;
-    set_view_window(game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 0; delta > idx; idx++) {
-        (void)draw_vert_line(idx);
-    }
+    scroll_pending |= (0 != delta);
 }
 
 
@@ -704,7 +1401,6 @@ static void move_photo_right() {
  */
 static void move_photo_up() {
     int32_t delta; /* Number of pixels by which to move. */
-    int32_t idx;   /* Index over rows to redraw.         */
 
     /* Calculate the number of pixels by which to move. */
     delta = room_photo_height(game_info.where) - SCROLL_Y_DIM - game_info.map_y;
@@ -712,115 +1408,119 @@ static void move_photo_up() {
 
     /* Shift the logical view upward. */
     game_info.map_y += delta;
-    set_view_window(game_info.map_x, game_info.map_y);
-
-    /* Draw the newly exposed lines. */
-    for (idx = 1; delta >= idx; idx++) {
-        (void)draw_horiz_line(SCROLL_Y_DIM - idx);
-    }
+    scroll_pending |= (0 != delta);
 }
 
 
 /*
- * redraw_room
- *   DESCRIPTION: Draw all lines on the screen.
+ * update_status_bar
+ *   DESCRIPTION: Fills the status bar with the status message, if there
+ *                is one, or with the room name and the player's typing.
+ *                Nothing is sent to the render thread if the text is the
+ *                same as last time.
  *   INPUTS: none
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: Draws the entire screen(but not the status bar).
+ *   SIDE EFFECTS: writes to the display(possibly later)
  */
-static void redraw_room() {
-    int32_t i; /* index over rows */
-
-    /* Draw all lines in the scroll region. */
-    for (i = 0; i < SCROLL_Y_DIM; i++) {
-        (void)draw_horiz_line(i);
+static void update_status_bar() {
+    static uint32_t shown_seq = 0;                         /* version of message shown */
+    static char shown[STATUS_X_DIM / FONT_WIDTH + 1] = ""; /* room text shown          */
+    char msg[STATUS_MSG_LEN + 1];                          /* current status message   */
+    uint32_t seq;                                          /* version of msg           */
+
+    seq = read_status_msg(msg);
+
+    /*Check to see if there's a status message we should display; if it
+     *hasn't changed since we showed it, there's nothing to do*/
+    if('\0' != msg[0]){
+         if(seq != shown_seq){
+              render_status(msg);
+              shown_seq = seq;
+              shown[0] = '\0';
+         }
     }
 
+    /*Otherwise print the room name + currently typed command*/
+    else{
+         char * room_name = get_room_name(game_info.where);   /*String containing room name*/
+         char * command = (char *)get_typed_command();        /*String containint typed command*/
+         char status[STATUS_X_DIM/FONT_WIDTH + 1];            /*String that holds what to write to status bar*/
+
+         /*Remove all the unecessary spaces from the typed command*/
+         while(' ' == *command) { command++; }
+
+         /*Fill the status with empty spaces - basically placeholders*/
+         memset(status, ' ', STATUS_X_DIM/FONT_WIDTH);
+
+         /*Calculate the length of the room name and typed command*/
+         int len_room_name = strlen(room_name);
+         int cmd_len = strlen(command);
+
+         /*memcpy(void * destination, void * source, size_t n)*/
+         /*Place the room name on the left side of the status screen (beginning of status string)*/
+         memcpy(status, room_name, (size_t)len_room_name);
+         /*Place the typed command on the right side of the screen (end of status string), minus one space*/
+         memcpy((status+(STATUS_X_DIM/FONT_WIDTH)-cmd_len-1), command, (size_t)cmd_len);
+         /*Fill the last space with an underscore to prompt the user to type in commands*/
+         status[39] = '_';
+         status[STATUS_X_DIM/FONT_WIDTH] = '\0';
+
+         /*call render_status to print the status string into the status bar,
+          *unless it's already there*/
+         if(seq != shown_seq || 0 != strcmp(status, shown)){
+              render_status(status);
+              strcpy(shown, status);
+              shown_seq = seq;
+         }
+    }
 }
 
 
 /*
- * status_thread
- *   DESCRIPTION: Function executed by status message helper thread.
- *                Waits for a message to be displayed, then shows the
- *                message for 1.5 seconds before deleting it.  If a
- *                new message has appeared in the meantime, restarts the
- *                clock and tries again.
- *   INPUTS: none(ignored)
- *   OUTPUTS: none
- *   RETURN VALUE: NULL
- *   SIDE EFFECTS: Changes the status message to an empty string.
+ * read_status_msg
+ *   DESCRIPTION: Copies the current status message without blocking.
+ *   INPUTS: none
+ *   OUTPUTS: buf -- the message(STATUS_MSG_LEN + 1 bytes)
+ *   RETURN VALUE: version of the message copied
+ *   SIDE EFFECTS: none
  */
-static void* status_thread(void* ignore) {
-    struct timespec ts; /* absolute wake-up time */
-
-    while (1) {
-        /*
-         * Wait for a message to appear.  Note that we must check the
-         * condition after acquiring the lock, and that pthread_cond_wait
-         * yields the lock, then reacquires the lock before returning.
-         */
-        (void)pthread_mutex_lock(&msg_lock);
-        while ('\0' == status_msg[0]) {
-            pthread_cond_wait(&msg_cv, &msg_lock);
-        }
-
-        /*
-         * A message is present: if we stop before the timeout
-         * passes, assume that a new one has been posted; if the
-         * timeout passes, clear the message and wait for a new one.
-         */
-        do {
-            /* Get the current time. */
-            clock_gettime(CLOCK_REALTIME, &ts);
-
-            /* Add 1.5 seconds to it. */
-            if (500000000 <= ts.tv_nsec) {
-                ts.tv_sec += 2;
-                ts.tv_nsec -= 500000000;
-            }
-else {
-                ts.tv_sec += 1;
-                ts.tv_nsec += 500000000;
-            }
-
-            /*
-             * And go to sleep.  If we wake up due to anything but a
-             * timeout, we assume(possibly incorrectly) that a new
-             * message has appeared and try to wait 1.5 seconds again.
-             */
-        } while (ETIMEDOUT != pthread_cond_timedwait(&msg_cv, &msg_lock, &ts));
-
-        /*
-         * Clear the message, then release the lock(remember that
-         * pthread_cond_timedwait reacquires the lock before returning).
-         */
-        status_msg[0] = '\0';
-        (void)pthread_mutex_unlock(&msg_lock);
-    }
-
-    /* This code never executes--the thread should always be cancelled. */
-    return NULL;
+static uint32_t read_status_msg(char* buf) {
+    uint32_t seq; /* version before copy */
+
+    do {
+        /* Wait out any change in progress, then copy. */
+        while (1 & (seq = __atomic_load_n(&status_seq, __ATOMIC_ACQUIRE)));
+        memcpy(buf, status_msg, STATUS_MSG_LEN + 1);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (seq != __atomic_load_n(&status_seq, __ATOMIC_RELAXED));
+    buf[STATUS_MSG_LEN] = '\0';
+    return seq;
 }
 
 
 /*
- * time_is_after
- *   DESCRIPTION: Check whether one time is at or after a second time.
- *   INPUTS: t1 -- the first time
- *           t2 -- the second time
+ * set_status_msg
+ *   DESCRIPTION: Changes the status message and its version.
+ *   INPUTS: s -- the new message(only the first STATUS_MSG_LEN
+ *                characters are used)
  *   OUTPUTS: none
- *   RETURN VALUE: 1 if t1 >= t2
- *                 0 if t1 < t2
+ *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-static int time_is_after(struct timeval* t1, struct timeval* t2) {
-    if (t1->tv_sec == t2->tv_sec)
-        return (t1->tv_usec >= t2->tv_usec);
-    if (t1->tv_sec > t2->tv_sec)
-        return 1;
-    return 0;
+static void set_status_msg(const char* s) {
+    /* msg_lock critical section starts here. */
+    (void)pthread_mutex_lock(&msg_lock);
+
+    /* Mark the change as in progress, make it, then mark it done. */
+    __atomic_store_n(&status_seq, status_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    strncpy(status_msg, s, STATUS_MSG_LEN);
+    status_msg[STATUS_MSG_LEN] = '\0';
+    __atomic_store_n(&status_seq, status_seq + 1, __ATOMIC_RELEASE);
+
+    /* msg_lock critical section ends here. */
+    (void)pthread_mutex_unlock(&msg_lock);
 }
 
 
@@ -834,85 +1534,198 @@ static int time_is_after(struct timeval* t1, struct timeval* t2) {
  *   SIDE EFFECTS: Overwrites any previous message.
  */
 void show_status(const char* s) {
-    /* msg_lock critical section starts here. */
-    (void)pthread_mutex_lock(&msg_lock);
+    uint64_t one = 1; /* event count for status_event_fd */
 
-    /* Copy the new message under the protection of msg_lock. */
-    strncpy(status_msg, s, STATUS_MSG_LEN);
-    status_msg[STATUS_MSG_LEN] = '\0';
+    set_status_msg(s);
 
-    /*
-     * Wake up the status message helper thread.  Note that we still hold
-     * the msg_lock, so the thread can't wake up until we release it.
-     */
-    (void)pthread_cond_signal(&msg_cv);
-
-    /* msg_lock critical section ends here. */
-    (void)pthread_mutex_unlock(&msg_lock);
+    /* Tell the game loop to restart the timer for removing the message. */
+    (void)write(status_event_fd, &one, sizeof (one));
 }
 
 
 /*
  * main
  *   DESCRIPTION: Play the adventure game.
- *   INPUTS: none(command line arguments are ignored)
+ *   INPUTS: -r file -- record input to file
+ *           -p file -- replay input from file(recorded with -r)
+ *           -s seed -- random seed(otherwise based on the time)
+ *           -f -- do not wait between ticks(useful with -p)
+ *           -w file -- world file(default WORLD_FILE)
+ *           -S file -- resume from and save to file
+ *           -i -- show the inventory in a small view within the main one
  *   OUTPUTS: none
- *   RETURN VALUE: 0 on success, 3 in panic situations
+ *   RETURN VALUE: 0 on success, 2 on bad arguments, 3 in panic situations
  */
-int main() {
-    game_condition_t game;  /* outcome of playing */
+int main(int argc, char* argv[]) {
+    game_condition_t game;  /* outcome of playing         */
+    unsigned int seed;      /* random seed                */
+    int opt;                /* command line option letter */
+    int32_t n_cleanups;     /* cleanup methods pushed     */
+    const char* world_file; /* world file name            */
+    int32_t show_inv = 0;   /* show the inventory view    */
+
+    /* Randomize for more fun(use -s for a deterministic layout). */
+    seed = time(NULL);
+    world_file = WORLD_FILE;
+    while (-1 != (opt = getopt(argc, argv, "fip:r:s:S:w:"))) {
+        switch (opt) {
+            case 'f': no_pacing = 1; break;
+            case 'i': show_inv = 1; break;
+            case 'p':
+                if (NULL == (replay_file = fopen(optarg, "r"))) {
+                    perror(optarg);
+                    return 2;
+                }
+                break;
+            case 'r':
+                if (NULL == (record_file = fopen(optarg, "w"))) {
+                    perror(optarg);
+                    return 2;
+                }
+                break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            case 'S': save_name = optarg; break;
+            case 'w': world_file = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-f] [-i] [-p replay] [-r record] [-s seed] [-S save] [-w world]\n", argv[0]);
+                return 2;
+        }
+    }
 
-    /* Randomize for more fun(remove for deterministic layout). */
-    srand(time(NULL));
+    /* A replay uses the seed with which it was recorded. */
+    if (NULL != replay_file && 1 != fscanf(replay_file, "seed %u\n", &seed)) {
+        fprintf(stderr, "replay file has no seed\n");
+        return 2;
+    }
+    if (NULL != record_file) {
+        fprintf(record_file, "seed %u\n", seed);
+    }
+    srand(seed);
 
     /* Provide some protection against fatal errors. */
     clean_on_signals();
 
-    if (!build_world()) { PANIC("can't build world"); }
+    /* Allow tick timing to be printed on SIGUSR1. */
+    if (0 != timing_init()) {
+        PANIC("cannot set up tick timing");
+    }
+
+    if (!build_world(world_file)) { PANIC("can't build world"); }
     init_game();
 
-    /* Perform sanity checks. */
+    /* Resume a saved game, if any. */
+    if (NULL != save_name && -1 == load_game()) {
+        PANIC("cannot resume saved game");
+    }
+
+    /* Build the verb trie, then perform sanity checks. */
+    if (0 != build_verb_trie()) {
+        PANIC("cannot build the verb trie");
+    }
     if (0 != sanity_check()) {
         PANIC("failed sanity checks");
     }
 
-    /* Create status message thread. */
-    if (0 != pthread_create(&status_thread_id, NULL, status_thread, NULL)) {
-        PANIC("failed to create status thread");
+    /* Create the timers and event counters for the game loop. */
+    if (0 != init_events()) {
+        PANIC("failed to set up event loop");
     }
-    push_cleanup(cancel_status_thread, NULL);
+    push_cleanup(close_events, NULL);
+    n_cleanups = 1;
 
     /* Start mode X. */
-    if (0 != set_mode_X(fill_horiz_buffer, fill_vert_buffer)) {
+    if (0 != set_mode_X()) {
         PANIC("cannot initialize mode X");
     }
     push_cleanup((cleanup_fn_t)clear_mode_X, NULL);
+    n_cleanups++;
+    if (0 != render_open()) {
+        PANIC("cannot make the main view");
+    }
+    if (show_inv) {
+        render_inventory(inventory_room());
+    }
 
-    /* Initialize the keyboard and/or Tux controller. */
-    if (0 != init_input()) {
-        PANIC("cannot initialize input");
+    #if(ADVENTURE_REDRAW_WORKERS == 1)
+    /*
+     * Start the redraw workers.  They are stopped after the render thread,
+     * which uses them.
+     */
+    if (0 != workers_start(sysconf(_SC_NPROCESSORS_ONLN) - 2)) {
+        PANIC("cannot start redraw workers");
     }
-    push_cleanup((cleanup_fn_t)shutdown_input, NULL);
+    push_cleanup(workers_stop, NULL);
+    n_cleanups++;
+    #endif
 
-    #if(ADVENTURE_USE_TUX_CONTROLLER == 1)
-    /*Setup the tux controller thread*/
-    if(0!= pthread_create(&tuxcontroller_thread_id, NULL, tuxcontroller_thread, NULL)){
-          PANIC("Failed to create tuxcontroller thread");
+    #if(ADVENTURE_RENDER_THREAD == 1)
+    /* Hand drawing and display over to the render thread. */
+    if (0 != render_start()) {
+        PANIC("cannot start render thread");
     }
-    push_cleanup(cancel_tuxcontroller_thread, NULL);
+    push_cleanup(render_stop, NULL);
+    n_cleanups++;
     #endif
 
+    #if(ADVENTURE_PREFILL_MARGINS == 1)
+    /* Draw lines ahead of scrolling when idle. */
+    margin_task = idle_register("margins", 1, render_prefill_margins, NULL);
+    #endif
+
+    /* Save the game now and then(see save_game). */
+    if (NULL != save_name) {
+        save_task = idle_register("autosave", 0, save_game, NULL);
+    }
+
+    /*
+     * Initialize the keyboard and/or Tux controller.  A replay takes no
+     * input from either.
+     */
+    if (NULL == replay_file) {
+        if (0 != init_input()) {
+            PANIC("cannot initialize input");
+        }
+        push_cleanup((cleanup_fn_t)shutdown_input, NULL);
+        n_cleanups++;
+
+        #if(ADVENTURE_USE_TUX_CONTROLLER == 1)
+        /*Setup the tux controller thread*/
+        if(0!= pthread_create(&tuxcontroller_thread_id, NULL, tuxcontroller_thread, NULL)){
+              PANIC("Failed to create tuxcontroller thread");
+        }
+        push_cleanup(cancel_tuxcontroller_thread, NULL);
+        n_cleanups++;
+        #endif
+    }
+
     game = game_loop();
 
-    #if(ADVENTURE_USE_TUX_CONTROLLER == 1)
-    pop_cleanup(1);
-    #endif
+    /* A quitter can come back later; a winner starts over. */
+    if (NULL != save_name) {
+        if (GAME_QUIT == game) {
+            (void)save_game(NULL);
+        } else {
+            (void)unlink(save_name);
+        }
+    }
 
-    pop_cleanup(1);
-    pop_cleanup(1);
-    pop_cleanup(1);
+    while (0 < n_cleanups--) {
+        pop_cleanup(1);
+    }
+    if (NULL != record_file) {
+        (void)fclose(record_file);
+    }
+    if (NULL != replay_file) {
+        (void)fclose(replay_file);
+    }
+    free_world();
 
-    /* Print a message about the outcome. */
+    /* Print the tick timing, then a message about the outcome. */
+    timing_dump();
+    idle_dump();
+    if (0 != n_saves) {
+        fprintf(stderr, "save: %u saves, longest %.1f us\n", n_saves, save_max_ns / 1e3);
+    }
     switch (game) {
         case GAME_WON: printf("You win the game! CONGRATULATIONS!\n"); break;
         case GAME_QUIT: printf("Quitter!\n"); break;
@@ -964,10 +1777,15 @@ static int sanity_check() {
 
     /*
      * Now check that every typed command can be issued with some string.
-     * We could be fancier and check that it's possible to match(shadowing
-     * can prevent it: matching "a" in entry #1 prevents matching "an" in
-     * entry #2.).
+     * The verb trie accounts for shadowing(matching "a" in entry #1
+     * prevents matching "an" in entry #2), so count its nodes.
      */
+    (void)memset(cnt, 0, sizeof (cnt));
+    for (idx = 0; MAX_VERB_NODES > idx; idx++) {
+        if (-1 != verb_cmd[idx]) {
+            cnt[verb_cmd[idx]]++;
+        }
+    }
     for (idx = 0; NUM_TC_VALUES > idx; idx++) {
         if (0 == cnt[idx]) {
             fprintf(stderr, "TC_ #%d has no valid command strings.\n", idx);
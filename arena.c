@@ -0,0 +1,154 @@
+/* tab:4
+ *
+ * arena.c - memory arenas
+ *
+ * Version:       1
+ * Filename:      arena.c
+ * History:
+ *    1    First written.
+ */
+
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+
+/* size of a huge page(on x86, the arena is rounded up to a multiple) */
+#define HUGE_PAGE_SIZE  (2 * 1024 * 1024)
+
+
+/*
+ * An arena: the mapping, and how much of it has been handed out.
+ */
+struct arena_t {
+    uint8_t* base;  /* start of the mapping  */
+    size_t   size;  /* bytes mapped          */
+    size_t   used;  /* bytes handed out      */
+};
+
+
+/*
+ * arena_create
+ *   DESCRIPTION: Maps memory for an arena.  If huge pages are wanted, asks
+ *                for them outright first(which works only if the system
+ *                has some set aside), then settles for normal pages with
+ *                advice that they be merged into huge pages.
+ *   INPUTS: size -- least number of bytes to map
+ *           huge -- non-zero to back the arena with huge pages if possible
+ *   OUTPUTS: none
+ *   RETURN VALUE: the arena, or NULL on failure
+ *   SIDE EFFECTS: maps memory
+ */
+arena_t* arena_create(size_t size, int32_t huge) {
+    arena_t* a; /* new arena */
+
+    if (NULL == (a = malloc(sizeof (*a)))) {
+        return NULL;
+    }
+    a->size = ARENA_ROUND(0 == size ? 1 : size);
+    a->used = 0;
+    a->base = MAP_FAILED;
+#if defined(MAP_HUGETLB)
+    if (huge) {
+        a->size = (a->size + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+        a->base = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (MAP_FAILED == a->base) {
+        a->base = mmap(NULL, a->size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (MAP_FAILED == a->base) {
+            free(a);
+            return NULL;
+        }
+#if defined(MADV_HUGEPAGE)
+        if (huge) {
+            (void)madvise(a->base, a->size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    return a;
+}
+
+
+/*
+ * arena_alloc
+ *   DESCRIPTION: Hands out the next block of an arena.
+ *   INPUTS: a -- the arena
+ *           size -- bytes wanted
+ *   OUTPUTS: none
+ *   RETURN VALUE: the block(aligned to ARENA_ALIGN), or NULL if the
+ *                 arena has too little left
+ *   SIDE EFFECTS: none
+ */
+void* arena_alloc(arena_t* a, size_t size) {
+    void* p; /* the block */
+
+    size = ARENA_ROUND(size);
+    if (a->size - a->used < size) {
+        return NULL;
+    }
+    p = a->base + a->used;
+    a->used += size;
+    return p;
+}
+
+
+/*
+ * arena_owns
+ *   DESCRIPTION: Checks whether a block came from an arena.
+ *   INPUTS: a -- the arena, or NULL
+ *           p -- the block
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the block lies within the arena, 0 if not
+ *   SIDE EFFECTS: none
+ */
+int32_t arena_owns(const arena_t* a, const void* p) {
+    return (NULL != a && (uintptr_t)a->base <= (uintptr_t)p &&
+            (uintptr_t)a->base + a->size > (uintptr_t)p);
+}
+
+
+/*
+ * arena_used
+ *   DESCRIPTION: Gets the number of bytes handed out by an arena.
+ *   INPUTS: a -- the arena
+ *   OUTPUTS: none
+ *   RETURN VALUE: bytes handed out since the arena was made or reset
+ *   SIDE EFFECTS: none
+ */
+size_t arena_used(const arena_t* a) {
+    return a->used;
+}
+
+
+/*
+ * arena_reset
+ *   DESCRIPTION: Takes back every block of an arena, so that its memory
+ *                can be handed out again.
+ *   INPUTS: a -- the arena
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: blocks handed out before must no longer be used
+ */
+void arena_reset(arena_t* a) {
+    a->used = 0;
+}
+
+
+/*
+ * arena_destroy
+ *   DESCRIPTION: Unmaps an arena and frees it.
+ *   INPUTS: a -- the arena, or NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: blocks handed out must no longer be used
+ */
+void arena_destroy(arena_t* a) {
+    if (NULL != a) {
+        (void)munmap(a->base, a->size);
+        free(a);
+    }
+}
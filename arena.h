@@ -0,0 +1,60 @@
+/* tab:4
+ *
+ * arena.h - header file for memory arenas
+ *
+ * Version:       1
+ * Filename:      arena.h
+ * History:
+ *    1    First written.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+ * NOTES
+ *
+ * An arena is one mapping of memory from which blocks are handed out in
+ * order, with no bookkeeping per block.  Blocks are never freed one at a
+ * time: arena_reset takes back every block at once(for scratch space that
+ * is reused), and arena_destroy unmaps the whole arena.  The memory is
+ * zero when first handed out, but not after a reset.  An arena does not
+ * grow; arena_alloc returns NULL once it is full, and the caller can then
+ * fall back to malloc(using arena_owns to tell the two kinds of block
+ * apart when freeing).  An arena is not for use by more than one thread
+ * at a time.
+ */
+
+typedef struct arena_t arena_t;
+
+/* bytes taken from an arena by a block of n bytes(blocks are aligned) */
+#define ARENA_ALIGN        16
+#define ARENA_ROUND(n)     (((size_t)(n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/*
+ * make an arena of at least size bytes, backed by huge pages if huge is
+ * non-zero and the system allows; returns NULL on failure
+ */
+extern arena_t* arena_create(size_t size, int32_t huge);
+
+/* get an aligned block of size bytes, or NULL if the arena is full */
+extern void* arena_alloc(arena_t* a, size_t size);
+
+/* check whether a block came from an arena(a may be NULL) */
+extern int32_t arena_owns(const arena_t* a, const void* p);
+
+/* get the bytes handed out since the arena was made or reset */
+extern size_t arena_used(const arena_t* a);
+
+/* take back every block handed out */
+extern void arena_reset(arena_t* a);
+
+/* unmap an arena and free it(a may be NULL) */
+extern void arena_destroy(arena_t* a);
+
+#endif /* ARENA_H */
@@ -0,0 +1,394 @@
+/* tab:4
+ *
+ * fbdev.c - linear 32-bit framebuffer backend for the mode X routines
+ *
+ * Version:       2
+ * Filename:      fbdev.c
+ * History:
+ *    1    First written.
+ *    2    Said so when /dev/fb0 cannot be used.
+ */
+
+#include <fcntl.h>
+#include <linux/fb.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <immintrin.h>
+#define FB_USE_SIMD 1
+#else
+#define FB_USE_SIMD 0
+#endif
+
+#include "fbdev.h"
+#include "modex.h"
+
+
+/* local functions--see function headers for details */
+static void present_row(int y, const unsigned char* row);
+static void expand_row(uint32_t* dst, const unsigned char* src);
+static void interleave_planes(unsigned char* dst, const unsigned char* const plane[4]);
+#if (FB_USE_SIMD == 1)
+static void expand_row_avx2(uint32_t* dst, const unsigned char* src);
+static void interleave_planes_sse2(unsigned char* dst, const unsigned char* const plane[4]);
+#endif
+
+
+/*
+ * The surface that we present into.  For /dev/fb0, surface points into
+ * the mapped video memory(of size fb_size bytes); for the in-memory
+ * surface, it points to a malloc'd block and fb_size is zero.  The
+ * surface_pitch is the distance between rows in 32-bit pixels.
+ */
+static uint32_t* surface = NULL;
+static size_t    fb_size = 0;
+static int       surface_pitch;
+
+/* bit positions of the color channels in a 32-bit surface pixel */
+static int red_shift = 16, green_shift = 8, blue_shift = 0;
+
+/*
+ * The palette, already expanded into surface pixel values, and a
+ * generation number that changes whenever any palette entry changes.
+ * Each presented row records the palette generation used to expand it
+ * (row_gen), and the shadow array holds the color indices presented
+ * in each row, so that rows are expanded and written to the surface
+ * only when their indices or the palette have changed.
+ */
+static uint32_t      palette[256];
+static uint32_t      pal_gen = 1;
+static uint32_t      row_gen[IMAGE_Y_DIM];
+static unsigned char shadow[IMAGE_Y_DIM][IMAGE_X_DIM];
+
+/* kernels selected for this processor by fb_open */
+static void (*expand_fn)(uint32_t*, const unsigned char*) = expand_row;
+static void (*interleave_fn)(unsigned char*, const unsigned char* const[4]) = interleave_planes;
+
+
+/*
+ * fb_open
+ *   DESCRIPTION: Opens the surface used to present frames.  If use_device
+ *                is non-zero, tries to map /dev/fb0 (which must use 32 bits
+ *                per pixel and be at least 320x200 pixels); if that is not
+ *                possible, says so and allocates an in-memory surface
+ *                instead.
+ *   INPUTS: use_device -- non-zero to try /dev/fb0 first
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: maps video memory or allocates memory; selects the
+ *                 palette expansion kernel for the processor; prints a
+ *                 message if /dev/fb0 cannot be used
+ */
+int fb_open(int use_device) {
+    struct fb_var_screeninfo var; /* variable screen information */
+    struct fb_fix_screeninfo fix; /* fixed screen information    */
+    void* mem;                    /* mapped video memory         */
+    int fb_fd;                    /* file descriptor for fb0     */
+
+#if (FB_USE_SIMD == 1)
+    /* Pick the fastest kernels supported by the processor. */
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        expand_fn = expand_row_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        interleave_fn = interleave_planes_sse2;
+    }
+#endif
+
+    if (use_device && -1 == (fb_fd = open("/dev/fb0", O_RDWR))) {
+        perror("open /dev/fb0");
+    }
+    else if (use_device) {
+        if (0 == ioctl(fb_fd, FBIOGET_VSCREENINFO, &var) &&
+            0 == ioctl(fb_fd, FBIOGET_FSCREENINFO, &fix) &&
+            32 == var.bits_per_pixel &&
+            IMAGE_X_DIM <= var.xres && IMAGE_Y_DIM <= var.yres &&
+            MAP_FAILED != (mem = mmap(0, fix.smem_len, PROT_READ | PROT_WRITE,
+                                      MAP_SHARED, fb_fd, 0))) {
+            surface = mem;
+            fb_size = fix.smem_len;
+            surface_pitch = fix.line_length / sizeof (surface[0]);
+            red_shift = var.red.offset;
+            green_shift = var.green.offset;
+            blue_shift = var.blue.offset;
+        }
+        else {
+            fprintf(stderr, "/dev/fb0 is not a mappable 32-bit display of at least %dx%d.\n",
+                    IMAGE_X_DIM, IMAGE_Y_DIM);
+        }
+        (void)close(fb_fd);
+    }
+
+    /* No usable framebuffer: present into memory instead. */
+    if (NULL == surface) {
+        if (use_device) {
+            fprintf(stderr, "Presenting frames into memory; nothing will be shown.\n");
+        }
+        if (NULL == (surface = malloc(IMAGE_X_DIM * IMAGE_Y_DIM * sizeof (surface[0])))) {
+            return -1;
+        }
+        fb_size = 0;
+        surface_pitch = IMAGE_X_DIM;
+    }
+
+    fb_clear();
+    return 0;
+}
+
+
+/*
+ * fb_close
+ *   DESCRIPTION: Releases the surface opened by fb_open.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: unmaps video memory or frees the in-memory surface
+ */
+void fb_close() {
+    if (NULL == surface) {
+        return;
+    }
+    if (0 != fb_size) {
+        (void)munmap(surface, fb_size);
+    }
+    else {
+        free(surface);
+    }
+    surface = NULL;
+}
+
+
+/*
+ * fb_clear
+ *   DESCRIPTION: Clears the visible part of the surface to black and
+ *                forgets the contents of every row presented so far.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to the surface
+ */
+void fb_clear() {
+    int y; /* loop index over rows */
+
+    for (y = 0; y < IMAGE_Y_DIM; y++) {
+        memset(surface + y * surface_pitch, 0, IMAGE_X_DIM * sizeof (surface[0]));
+        row_gen[y] = 0;
+    }
+}
+
+
+/*
+ * fb_set_palette
+ *   DESCRIPTION: Changes a range of palette colors.  Colors are given
+ *                as 6-bit VGA intensities and scaled to 8 bits.
+ *   INPUTS: first -- first palette entry to change
+ *           count -- number of entries to change
+ *           rgb -- 6-bit red, green, and blue values(three bytes per color)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: rows are re-expanded when next presented
+ */
+void fb_set_palette(int first, int count, const unsigned char* rgb) {
+    uint32_t r, g, b; /* 8-bit color intensities */
+    uint32_t pix;     /* resulting surface pixel */
+    int changed = 0;  /* any entry changed?      */
+    int i;            /* loop index over colors  */
+
+    for (i = first; i < first + count && i < 256; i++, rgb += 3) {
+        r = ((rgb[0] & 0x3F) << 2) | ((rgb[0] & 0x3F) >> 4);
+        g = ((rgb[1] & 0x3F) << 2) | ((rgb[1] & 0x3F) >> 4);
+        b = ((rgb[2] & 0x3F) << 2) | ((rgb[2] & 0x3F) >> 4);
+        pix = (r << red_shift) | (g << green_shift) | (b << blue_shift);
+        if (palette[i] != pix) {
+            palette[i] = pix;
+            changed = 1;
+        }
+    }
+
+    /* Changing the palette invalidates every row presented so far. */
+    if (changed && 0 == ++pal_gen) {
+        pal_gen = 1;
+    }
+}
+
+
+/*
+ * fb_draw_planar
+ *   DESCRIPTION: Presents rows held as four planes in the mode X layout,
+ *                in which pixel x of a row is byte(x >> 2) of plane(x & 3).
+ *   INPUTS: y0 -- screen row of the first row given
+ *           rows -- number of rows
+ *           plane -- pointers to the first row of each display plane
+ *           stride -- distance between rows within a plane in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes changed rows to the surface
+ */
+void fb_draw_planar(int y0, int rows, const unsigned char* const plane[4], int stride) {
+    unsigned char row[IMAGE_X_DIM]; /* chunky image of one row */
+    const unsigned char* p[4];      /* plane pointers for row  */
+    int y;                          /* loop index over rows    */
+    int i;                          /* loop index over planes  */
+
+    for (y = 0; y < rows; y++) {
+        for (i = 0; i < 4; i++) {
+            p[i] = plane[i] + y * stride;
+        }
+        (*interleave_fn)(row, p);
+        present_row(y0 + y, row);
+    }
+}
+
+
+/*
+ * fb_draw_chunky
+ *   DESCRIPTION: Presents rows held as one byte per pixel.
+ *   INPUTS: y0 -- screen row of the first row given
+ *           rows -- number of rows
+ *           pix -- color indices of the first row
+ *           stride -- distance between rows in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes changed rows to the surface
+ */
+void fb_draw_chunky(int y0, int rows, const unsigned char* pix, int stride) {
+    int y; /* loop index over rows */
+
+    for (y = 0; y < rows; y++) {
+        present_row(y0 + y, pix + y * stride);
+    }
+}
+
+
+/*
+ * present_row
+ *   DESCRIPTION: Presents one row of color indices, skipping the row
+ *                entirely if neither its indices nor the palette have
+ *                changed since it was last presented.
+ *   INPUTS: y -- screen row
+ *           row -- IMAGE_X_DIM color indices
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may write the row to the surface
+ */
+static void present_row(int y, const unsigned char* row) {
+    if (0 > y || IMAGE_Y_DIM <= y) {
+        return;
+    }
+    if (row_gen[y] == pal_gen && 0 == memcmp(shadow[y], row, IMAGE_X_DIM)) {
+        return;
+    }
+    memcpy(shadow[y], row, IMAGE_X_DIM);
+    row_gen[y] = pal_gen;
+    (*expand_fn)(surface + y * surface_pitch, row);
+}
+
+
+/*
+ * expand_row
+ *   DESCRIPTION: Expands one row of color indices into surface pixels
+ *                through the palette(portable version).
+ *   INPUTS: src -- IMAGE_X_DIM color indices
+ *   OUTPUTS: dst -- IMAGE_X_DIM surface pixels
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void expand_row(uint32_t* dst, const unsigned char* src) {
+    int x; /* loop index over pixels */
+
+    for (x = 0; x < IMAGE_X_DIM; x += 4) {
+        dst[x]     = palette[src[x]];
+        dst[x + 1] = palette[src[x + 1]];
+        dst[x + 2] = palette[src[x + 2]];
+        dst[x + 3] = palette[src[x + 3]];
+    }
+}
+
+
+/*
+ * interleave_planes
+ *   DESCRIPTION: Interleaves one row of four display planes into chunky
+ *                color indices(portable version).
+ *   INPUTS: plane -- pointers to the row within each display plane
+ *   OUTPUTS: dst -- IMAGE_X_DIM color indices
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void interleave_planes(unsigned char* dst, const unsigned char* const plane[4]) {
+    int x; /* loop index over plane bytes */
+
+    for (x = 0; x < IMAGE_X_WIDTH; x++, dst += 4) {
+        dst[0] = plane[0][x];
+        dst[1] = plane[1][x];
+        dst[2] = plane[2][x];
+        dst[3] = plane[3][x];
+    }
+}
+
+
+#if (FB_USE_SIMD == 1)
+
+/*
+ * expand_row_avx2
+ *   DESCRIPTION: Expands one row of color indices into surface pixels
+ *                through the palette, eight pixels at a time with the
+ *                AVX2 gather instruction.
+ *   INPUTS: src -- IMAGE_X_DIM color indices
+ *   OUTPUTS: dst -- IMAGE_X_DIM surface pixels
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("avx2")))
+static void expand_row_avx2(uint32_t* dst, const unsigned char* src) {
+    __m256i idx; /* eight color indices, widened to 32 bits */
+    int x;       /* loop index over pixels                  */
+
+    for (x = 0; x < IMAGE_X_DIM; x += 8) {
+        idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + x)));
+        _mm256_storeu_si256((__m256i*)(dst + x),
+                            _mm256_i32gather_epi32((const int*)palette, idx, 4));
+    }
+}
+
+
+/*
+ * interleave_planes_sse2
+ *   DESCRIPTION: Interleaves one row of four display planes into chunky
+ *                color indices, 64 pixels at a time with SSE2 unpacks.
+ *   INPUTS: plane -- pointers to the row within each display plane
+ *   OUTPUTS: dst -- IMAGE_X_DIM color indices
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+__attribute__((target("sse2")))
+static void interleave_planes_sse2(unsigned char* dst, const unsigned char* const plane[4]) {
+    __m128i p0, p1, p2, p3; /* 16 bytes from each plane           */
+    __m128i lo01, hi01;     /* planes 0 and 1, interleaved        */
+    __m128i lo23, hi23;     /* planes 2 and 3, interleaved        */
+    int x;                  /* loop index over plane bytes        */
+
+    /* IMAGE_X_WIDTH(80) is a multiple of 16. */
+    for (x = 0; x < IMAGE_X_WIDTH; x += 16, dst += 64) {
+        p0 = _mm_loadu_si128((const __m128i*)(plane[0] + x));
+        p1 = _mm_loadu_si128((const __m128i*)(plane[1] + x));
+        p2 = _mm_loadu_si128((const __m128i*)(plane[2] + x));
+        p3 = _mm_loadu_si128((const __m128i*)(plane[3] + x));
+        lo01 = _mm_unpacklo_epi8(p0, p1);
+        hi01 = _mm_unpackhi_epi8(p0, p1);
+        lo23 = _mm_unpacklo_epi8(p2, p3);
+        hi23 = _mm_unpackhi_epi8(p2, p3);
+        _mm_storeu_si128((__m128i*)dst,        _mm_unpacklo_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i*)(dst + 16), _mm_unpackhi_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i*)(dst + 32), _mm_unpacklo_epi16(hi01, hi23));
+        _mm_storeu_si128((__m128i*)(dst + 48), _mm_unpackhi_epi16(hi01, hi23));
+    }
+}
+
+#endif /* FB_USE_SIMD == 1 */
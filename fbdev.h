@@ -0,0 +1,57 @@
+/* tab:4
+ *
+ * fbdev.h - header file for the linear framebuffer display backend
+ *
+ * Version:       1
+ * Filename:      fbdev.h
+ * History:
+ *    1    First written.
+ */
+
+#ifndef FBDEV_H
+#define FBDEV_H
+
+
+#include <stdint.h>
+
+
+/*
+ * NOTES
+ *
+ * Machines without legacy VGA hardware cannot use mode X at all.  On
+ * those machines, the mode X routines in modex.c present frames through
+ * this backend instead.  Frames are still built in the planar build buffer
+ * used for mode X; the backend interleaves the four planes of each
+ * scanline back into a chunky row of 8-bit color indices, compares that
+ * row with the row last presented, and expands only rows that changed
+ * through the current 256-entry palette into 32-bit pixels.
+ *
+ * The target surface is /dev/fb0 when it is available and uses 32 bits
+ * per pixel; otherwise, frames go to an in-memory surface (useful for
+ * benchmarking and for running without any display at all).
+ *
+ * The 200 rows of the mode X screen are laid out as on the VGA: the
+ * scrolling region occupies rows 0 to SCROLL_Y_DIM - 1, and the status
+ * bar follows it.
+ */
+
+/* open /dev/fb0(or an in-memory surface if use_device is 0 or fails) */
+extern int fb_open(int use_device);
+
+/* release the framebuffer surface */
+extern void fb_close(void);
+
+/* forget everything presented so far(forces a full upload next time) */
+extern void fb_clear(void);
+
+/* change count palette colors(6-bit RGB triples) starting at first */
+extern void fb_set_palette(int first, int count, const unsigned char* rgb);
+
+/* present rows from four display planes(plane[i] holds pixels with x&3 == i) */
+extern void fb_draw_planar(int y0, int rows, const unsigned char* const plane[4],
+                           int stride);
+
+/* present rows of chunky (one byte per pixel) color indices */
+extern void fb_draw_chunky(int y0, int rows, const unsigned char* pix, int stride);
+
+#endif /* FBDEV_H */
@@ -0,0 +1,58 @@
+/* tab:4
+ *
+ * idle.h - header file for background work done between ticks
+ *
+ * Version:       1
+ * Filename:      idle.h
+ * History:
+ *    1    First written.
+ */
+
+#ifndef IDLE_H
+#define IDLE_H
+
+
+#include <stdint.h>
+
+
+/*
+ * NOTES
+ *
+ * Most of each game loop tick is spent waiting.  Deferrable work(such as
+ * drawing lines before they scroll into view) can be registered as an
+ * idle task, which the game thread then runs in slices while it waits for
+ * the next tick.  Among tasks with work pending, the one with the highest
+ * priority runs first.  A slice should take well under a millisecond; no
+ * slice is started within IDLE_MARGIN_USEC of the next tick.  Input that
+ * arrives during a slice is handled as soon as the slice ends.
+ *
+ * A task function does one slice of work and returns non-zero if more
+ * work remains.  After it returns zero, the task is not run again until
+ * idle_wake is called for it.  The thread CPU time used by each task is
+ * recorded and printed by idle_dump.
+ *
+ * All of these functions must be called from the game thread.
+ */
+
+#define IDLE_MARGIN_USEC 5000 /* no slices this close to the next tick */
+
+/* a task function; returns non-zero if more work remains */
+typedef int32_t (*idle_fn_t)(void* arg);
+
+/*
+ * register a task(pending at first); higher priorities run first;
+ * returns a task id, or -1 if there is no room
+ */
+extern int32_t idle_register(const char* name, int32_t priority,
+                             idle_fn_t fn, void* arg);
+
+/* remove a task */
+extern void idle_unregister(int32_t id);
+
+/* mark a task as having work pending */
+extern void idle_wake(int32_t id);
+
+/* print the CPU time used by each task to stderr */
+extern void idle_dump(void);
+
+#endif /* IDLE_H */
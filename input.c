@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       7
+ * Version:       9
  * Creation Date: Thu Sep 9 22:25:48 2004
  * Filename:      input.c
  * History:
@@ -42,6 +42,10 @@
  *        Updated input control and test driver for adventure game.
  *    SL    7    Wed Sep 14 17:07:38 2011
  *        Added keyboard input support when using Tux kernel mode.
+ *          8
+ *        Replaced per-byte reads with a buffered, queued decoder.
+ *          9
+ *        Stamped commands left from a read with that read's time.
  */
 
 #include <ctype.h>
@@ -52,6 +56,7 @@
 #include <sys/io.h>
 #include <termio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <errno.h>
@@ -77,6 +82,12 @@
 #define TUX_BUTTON_A          0x02
 #define TUX_BUTTON_START      0x01
 
+/* size of the keystroke buffer filled by each read */
+#define KEY_BUF_LEN      256
+
+/* number of decoded commands that fit in the queue; a power of two */
+#define CMD_QUEUE_LEN    64
+
 /*Ofset of select bytes in an array*/
 #define BYTE_OFFSET_1 0
 #define BYTE_OFFSET_2 8
@@ -91,6 +102,31 @@ static struct termios tio_orig;
 void tux_init();
 cmd_t get_tux_input();
 
+/* local functions--see function headers for details */
+static void decode_keys(uint64_t now);
+static void push_command(cmd_t cmd, uint64_t now);
+
+/*
+ * Keystrokes read from stdin wait in key_buf until decoded; key_pos and
+ * key_len mark the undecoded bytes, and key_time is when they were read
+ * (CLOCK_MONOTONIC, in nanoseconds).  Decoding stops after each typed
+ * command, so that the typing buffer holds that command's text until the
+ * game has carried it out; the bytes after it are decoded on a later call.
+ * Decoded commands wait in the cmd_q ring(cmd_head is the oldest; both
+ * indices increase and are masked).  If the ring fills, the oldest command
+ * is discarded.
+ */
+static unsigned char key_buf[KEY_BUF_LEN];
+static int32_t key_pos = 0;
+static int32_t key_len = 0;
+static uint64_t key_time = 0;
+static input_event_t cmd_q[CMD_QUEUE_LEN];
+static uint32_t cmd_head = 0;
+static uint32_t cmd_tail = 0;
+#if (USE_TUX_CONTROLLER == 0) /* use keyboard control with arrow keys */
+static int key_state = 0;     /* small FSM for arrow keys */
+#endif
+
 /*
  * init_input
  *   DESCRIPTION: Initializes the input controller.  As both keyboard and
@@ -154,6 +190,11 @@ void reset_typed_command() {
     typing[0] = '\0';
 }
 
+void set_typed_command(const char* s) {
+    strncpy(typing, s, MAX_TYPED_LEN);
+    typing[MAX_TYPED_LEN] = '\0';
+}
+
 static int32_t valid_typing(char c) {
     /* Valid typing include letters, numbers, space, and backspace/delete. */
     return (isalpha(c) || isdigit(c) || ' ' == c || 8 == c || 127 == c);
@@ -173,32 +214,109 @@ static void typed_a_char(char c) {
     }
 }
 
+/*
+ * get_commands
+ *   DESCRIPTION: Reads all available keystrokes from stdin with a single
+ *                read, decodes them into queued commands, and removes up
+ *                to max commands from the queue, oldest first.  Each
+ *                command is stamped with the time at which its keystrokes
+ *                were read.  A typed command(CMD_TYPED) is always the last
+ *                command returned, since later keystrokes may change the
+ *                typed text; the next call continues after it.
+ *   INPUTS: max -- space available in ev
+ *   OUTPUTS: ev -- the commands, in the order issued
+ *   RETURN VALUE: number of commands written to ev
+ *   SIDE EFFECTS: drains keyboard input; changes the typed command
+ */
+int32_t get_commands(input_event_t* ev, int32_t max) {
+    struct timespec ts; /* time of read      */
+    ssize_t got;        /* bytes read        */
+    int32_t n;          /* commands returned */
+
+    /*
+     * Decode anything left from the last read first(with the time of
+     * that read); if nothing is queued after that, read more keystrokes.
+     */
+    decode_keys(key_time);
+    if (cmd_head == cmd_tail && key_pos == key_len) {
+        if (0 < (got = read(fileno(stdin), key_buf, KEY_BUF_LEN))) {
+            (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+            key_time = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+            key_pos = 0;
+            key_len = got;
+            decode_keys(key_time);
+        }
+    }
+
+    for (n = 0; n < max && cmd_head != cmd_tail; n++) {
+        ev[n] = cmd_q[cmd_head++ & (CMD_QUEUE_LEN - 1)];
+        if (CMD_TYPED == ev[n].cmd) {
+            return n + 1;
+        }
+    }
+    return n;
+}
+
+
 /*
  * get_command
- *   DESCRIPTION: Reads a command from the input controller.  As some
- *                controllers provide only absolute input(e.g., go
- *                right), the current direction is needed as an input
- *                to this routine.
- *   INPUTS: cur_dir -- current direction of motion
+ *   DESCRIPTION: Reads one command from the input controller.  Any other
+ *                commands decoded from the same keystrokes stay queued for
+ *                later calls.
+ *   INPUTS: none
  *   OUTPUTS: none
- *   RETURN VALUE: command issued by the input controller
+ *   RETURN VALUE: command issued by the input controller, or CMD_NONE
  *   SIDE EFFECTS: drains any keyboard input
  */
 cmd_t get_command() {
+    input_event_t ev; /* the command */
 
-#if (USE_TUX_CONTROLLER == 0) /* use keyboard control with arrow keys */
-    static int state = 0;                 /* small FSM for arrow keys */
-#endif
-    static cmd_t command = CMD_NONE;
-    cmd_t pushed = CMD_NONE;
-    int ch;
+    return (1 == get_commands(&ev, 1) ? ev.cmd : CMD_NONE);
+}
+
+
+/*
+ * push_command
+ *   DESCRIPTION: Adds a command to the queue, discarding the oldest
+ *                command if the queue is full.
+ *   INPUTS: cmd -- the command
+ *           now -- time at which its keystrokes were read
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void push_command(cmd_t cmd, uint64_t now) {
+    input_event_t* ev; /* queue slot */
+
+    if (CMD_QUEUE_LEN == cmd_tail - cmd_head) {
+        cmd_head++;
+    }
+    ev = &cmd_q[cmd_tail++ & (CMD_QUEUE_LEN - 1)];
+    ev->cmd = cmd;
+    ev->time = now;
+}
+
+
+/*
+ * decode_keys
+ *   DESCRIPTION: Turns buffered keystrokes into queued commands, stopping
+ *                after a typed command(see get_commands).
+ *   INPUTS: now -- time at which the keystrokes were read
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the typed command
+ */
+static void decode_keys(uint64_t now) {
+    int ch; /* keystroke */
 
-    /* Read all characters from stdin. */
-    while ((ch = getc(stdin)) != EOF) {
+    while (key_pos < key_len) {
+        ch = key_buf[key_pos++];
 
         /* Backquote is used to quit the game. */
-        if (ch == '`')
-            return CMD_QUIT;
+        if (ch == '`') {
+            push_command(CMD_QUIT, now);
+            continue;
+        }
 
 #if (USE_TUX_CONTROLLER == 0) /* use keyboard control with arrow keys */
 
@@ -209,108 +327,68 @@ cmd_t get_command() {
          * Insert, home, and page up keys deliver 27, 91, '2'/'1'/'5' and
          * then a tilde.  We recognize the digits and don't check for the
          * tilde.
+         *
+         * A sequence split between two reads simply continues in the
+         * same state on the next call.
          */
-        switch (state) {
+        switch (key_state) {
             case 0:
                 if (27 == ch) {
-                    state = 1;
-                }
-                else if (valid_typing(ch)) {
-                    typed_a_char(ch);
-                }
-                else if (10 == ch || 13 == ch) {
-                    pushed = CMD_TYPED;
+                    key_state = 1;
+                    continue;
                 }
                 break;
             case 1:
+                key_state = 0;
                 if (91 == ch) {
-                    state = 2;
-                }
-                else {
-                    state = 0;
-                    if (valid_typing(ch)) {
-                        /*
-                         * Note that we may be discarding an ESC(27), but
-                         * we don't use that as typed input anyway.
-                         */
-                        typed_a_char(ch);
-                    }
-                    else if (10 == ch || 13 == ch) {
-                        pushed = CMD_TYPED;
-                    }
+                    key_state = 2;
+                    continue;
                 }
+                /*
+                 * Note that we may be discarding an ESC(27), but we
+                 * don't use that as typed input anyway.
+                 */
                 break;
             case 2:
-                if (ch >= 'A' && ch <= 'D') {
-                    switch (ch) {
-                        case 'A': pushed = CMD_UP;    break;
-                        case 'B': pushed = CMD_DOWN;  break;
-                        case 'C': pushed = CMD_RIGHT; break;
-                        case 'D': pushed = CMD_LEFT;  break;
-                    }
-                    state = 0;
-                }
-                else if (ch == '1' || ch == '2' || ch == '5') {
-                    switch (ch) {
-                        case '2': pushed = CMD_MOVE_LEFT;  break;
-                        case '1': pushed = CMD_ENTER;      break;
-                        case '5': pushed = CMD_MOVE_RIGHT; break;
-                    }
-                    state = 3; /* Consume a '~'. */
-                }
-                else {
-                    state = 0;
-                    if (valid_typing(ch)) {
+                key_state = 0;
+                switch (ch) {
+                    case 'A': push_command(CMD_UP, now);    continue;
+                    case 'B': push_command(CMD_DOWN, now);  continue;
+                    case 'C': push_command(CMD_RIGHT, now); continue;
+                    case 'D': push_command(CMD_LEFT, now);  continue;
+                    case '2': push_command(CMD_MOVE_LEFT, now);  break;
+                    case '1': push_command(CMD_ENTER, now);      break;
+                    case '5': push_command(CMD_MOVE_RIGHT, now); break;
+                    default:
                         /*
                          * Note that we may be discarding an ESC(27) and
                          * a bracket(91), but we don't use either as
                          * typed input anyway.
                          */
-                        typed_a_char(ch);
-                    }
-                    else if (10 == ch || 13 == ch) {
-                        pushed = CMD_TYPED;
-                    }
+                        goto typed;
                 }
-                break;
+                key_state = 3; /* Consume a '~'. */
+                continue;
             case 3:
-                state = 0;
+                key_state = 0;
                 if ('~' == ch) {
                     /* Consume it silently. */
-                }
-                else if (valid_typing(ch)) {
-                    typed_a_char(ch);
-                }
-                else if (10 == ch || 13 == ch) {
-                    pushed = CMD_TYPED;
+                    continue;
                 }
                 break;
         }
-#else /* USE_TUX_CONTROLLER */
-        /* Tux controller mode; still need to support typed commands. */
+    typed:
+#endif /* USE_TUX_CONTROLLER */
 
+        /* Tux controller mode still needs to support typed commands. */
         if (valid_typing(ch)) {
             typed_a_char(ch);
         }
         else if (10 == ch || 13 == ch) {
-            pushed = CMD_TYPED;
+            push_command(CMD_TYPED, now);
+            return;
         }
-#endif /* USE_TUX_CONTROLLER */
     }
-
-    /*
-     * Once a direction is pushed, that command remains active
-     * until a turn is taken.
-     */
-    if (pushed == CMD_NONE) {
-        command = CMD_NONE;
-    }
-
-    if(command != CMD_NONE){
-          pushed = command;
-   }
-
-    return pushed;
 }
 
 /*
@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       3
+ * Version:       4
  * Creation Date: Thu Sep 9 22:22:00 2004
  * Filename:      input.h
  * History:
@@ -33,11 +33,15 @@
  *        Changed display interface for Tux controller.
  *    SL    3    Wed Sep 14 02:06:59 2011
  *        Updated command names and numbers for adventure game.
+ *          4
+ *        Added queued, timestamped commands.
  */
 
 #ifndef INPUT_H
 #define INPUT_H
 
+#include <stdint.h>
+
 /* possible commands from input device, whether keyboard or game controller */
 typedef enum {
     CMD_NONE, CMD_RIGHT, CMD_LEFT, CMD_UP, CMD_DOWN,
@@ -47,6 +51,15 @@ typedef enum {
     NUM_COMMANDS
 } cmd_t;
 
+/*
+ * a command along with the time at which its keystrokes were read(used
+ * to measure input latency; see timing_latency in timing.h)
+ */
+typedef struct {
+    cmd_t    cmd;
+    uint64_t time; /* CLOCK_MONOTONIC, in nanoseconds */
+} input_event_t;
+
 #define MAX_TYPED_LEN 20
 
 /* Initialize the input device. */
@@ -55,12 +68,21 @@ extern int init_input();
 /* Read a command from the input device. */
 extern cmd_t get_command();
 
+/*
+ * Read up to max queued commands from the input device; returns the
+ * number read.
+ */
+extern int32_t get_commands(input_event_t* ev, int32_t max);
+
 /* Get currently typed command string. */
 extern const char* get_typed_command();
 
 /* Reset typed command. */
 extern void reset_typed_command();
 
+/* Replace typed command(used when replaying recorded input). */
+extern void set_typed_command(const char* s);
+
 /* Shut down the input device. */
 extern void shutdown_input();
 
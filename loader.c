@@ -0,0 +1,565 @@
+/* tab:4
+ *
+ * loader.c - batched asynchronous file reads
+ *
+ * Version:       1
+ * Filename:      loader.c
+ * History:
+ *    1    First written.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "assert.h"
+#include "loader.h"
+
+
+/*
+ * Use io_uring if possible.  It is reached by raw system calls, so only
+ * the kernel headers are needed, not a library.
+ */
+#ifndef LOADER_USE_IO_URING
+#define LOADER_USE_IO_URING 1
+#endif
+#if LOADER_USE_IO_URING && !defined(__NR_io_uring_setup)
+#undef LOADER_USE_IO_URING
+#define LOADER_USE_IO_URING 0
+#endif
+#if LOADER_USE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
+/* number of reader threads used when io_uring is not */
+#define LOADER_THREADS 4
+
+
+/* how a loader does its reads */
+typedef enum {
+    LD_PREAD,   /* one at a time, in loader_next  */
+    LD_THREADS, /* by reader threads              */
+    LD_URING    /* through io_uring               */
+} ld_method_t;
+
+/*
+ * A batch of reads.  Reads are started in order; n_started counts those
+ * started, in_flight those started but not yet finished, and n_done those
+ * handed back by loader_next.  Finished reads are queued in done, and
+ * handed back in that order(see next_ready).  The data of each read stays
+ * in buf until it is handed back, and is then freed by the next call.
+ * No read is started while LOADER_MAX_DEPTH(or, for io_uring, entries)
+ * reads are waiting to be handed back.
+ *
+ * With reader threads, everything above is protected by lock.  Threads
+ * wait on cv when too many reads are waiting to be handed back, and
+ * loader_next waits on cv for a read to be queued in done.
+ *
+ * With io_uring, the ring is mapped as the kernel describes in the
+ * io_uring_params filled in by io_uring_setup.
+ */
+struct loader_t {
+    const load_req_t* req;       /* the reads                              */
+    int32_t           n;         /* number of reads                        */
+    int32_t           n_started; /* reads started                          */
+    int32_t           in_flight; /* reads started but not finished         */
+    int32_t           n_done;    /* reads handed back                      */
+    int32_t           depth;     /* most reads in flight at once           */
+    uint8_t**         buf;       /* data of each read(NULL if failed)      */
+    uint8_t*          last;      /* data last handed back                  */
+    ld_method_t       method;    /* how reads are done                     */
+
+    pthread_t         thread[LOADER_THREADS]; /* reader threads            */
+    int32_t           n_threads; /* number of reader threads               */
+    int32_t           stopping;  /* set to stop the reader threads         */
+    int32_t*          done;      /* finished reads, in order of finishing  */
+    int32_t           n_queued;  /* reads in done                          */
+    pthread_mutex_t   lock;      /* protects the above                      */
+    pthread_cond_t    cv;        /* signalled when the above change        */
+
+#if LOADER_USE_IO_URING
+    int               ring_fd;   /* the io_uring                           */
+    uint32_t          entries;   /* most reads submitted at once           */
+    uint32_t          unsent;    /* entries queued but not submitted       */
+    void*             sq_ring;   /* submission queue ring                  */
+    size_t            sq_size;
+    void*             cq_ring;   /* completion queue ring(may be sq_ring)  */
+    size_t            cq_size;
+    struct io_uring_sqe* sqes;   /* submission queue entries               */
+    size_t            sqes_size;
+    uint32_t*         sq_tail;
+    uint32_t*         sq_mask;
+    uint32_t*         sq_array;
+    uint32_t*         cq_head;
+    uint32_t*         cq_tail;
+    uint32_t*         cq_mask;
+    struct io_uring_cqe* cqes;
+#endif
+};
+
+
+/* local functions--see function headers for details */
+static int32_t next_ready(loader_t* l);
+static uint8_t* read_rest(const load_req_t* r, uint8_t* buf, uint32_t got);
+static void* read_thread(void* arg);
+#if LOADER_USE_IO_URING
+static void uring_reap(loader_t* l);
+static int32_t uring_start(loader_t* l);
+static void uring_stop(loader_t* l);
+static void uring_submit(loader_t* l);
+#endif
+
+
+/*
+ * next_ready
+ *   DESCRIPTION: Checks whether a finished read can be handed back next.
+ *                Reads are handed back in the order they finished, except
+ *                that the first read started is always handed back first
+ *                (it is the one wanted soonest), so until it has finished,
+ *                none can be.
+ *   INPUTS: l -- the loader
+ *   OUTPUTS: l -- the first read moved to the front of done
+ *   RETURN VALUE: 1 if done[n_done] can be handed back, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t next_ready(loader_t* l) {
+    int32_t j; /* index over finished reads */
+
+    if (0 < l->n_done) {
+        return (l->n_queued > l->n_done);
+    }
+    for (j = 0; l->n_queued > j; j++) {
+        if (0 == l->done[j]) {
+            l->done[j] = l->done[0];
+            l->done[0] = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * read_rest
+ *   DESCRIPTION: Reads what is left of a read with pread, retrying until
+ *                all of it has been read.
+ *   INPUTS: r -- the read
+ *           buf -- its data, or NULL to allocate it
+ *           got -- bytes already in buf
+ *   OUTPUTS: none
+ *   RETURN VALUE: the data, or NULL on failure
+ *   SIDE EFFECTS: frees buf on failure
+ */
+static uint8_t* read_rest(const load_req_t* r, uint8_t* buf, uint32_t got) {
+    ssize_t n; /* bytes read by one pread */
+
+    if (NULL == buf && NULL == (buf = malloc(0 == r->size ? 1 : r->size))) {
+        return NULL;
+    }
+    while (r->size > got) {
+        n = pread(r->fd, buf + got, r->size - got, r->offset + got);
+        if (0 >= n && !(0 > n && EINTR == errno)) {
+            free(buf);
+            return NULL;
+        }
+        got += (0 < n ? n : 0);
+    }
+    return buf;
+}
+
+
+/*
+ * read_thread
+ *   DESCRIPTION: Reader thread: starts reads in order until all have been
+ *                started or the loader is stopping, holding back while
+ *                LOADER_MAX_DEPTH reads are waiting to be handed back.
+ *   INPUTS: arg -- the loader
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: queues each finished read in done
+ */
+static void* read_thread(void* arg) {
+    loader_t* l = arg; /* the loader        */
+    int32_t   i;       /* index of the read */
+    uint8_t*  buf;     /* its data          */
+
+    (void)pthread_mutex_lock(&l->lock);
+    while (!l->stopping && l->n > l->n_started) {
+        if (LOADER_MAX_DEPTH <= l->n_started - l->n_done) {
+            (void)pthread_cond_wait(&l->cv, &l->lock);
+            continue;
+        }
+        i = l->n_started++;
+        if (++l->in_flight > l->depth) {
+            l->depth = l->in_flight;
+        }
+        (void)pthread_mutex_unlock(&l->lock);
+
+        buf = read_rest(&l->req[i], NULL, 0);
+
+        (void)pthread_mutex_lock(&l->lock);
+        l->buf[i] = buf;
+        l->in_flight--;
+        l->done[l->n_queued++] = i;
+        (void)pthread_cond_broadcast(&l->cv);
+    }
+    (void)pthread_mutex_unlock(&l->lock);
+    return NULL;
+}
+
+
+/*
+ * loader_start
+ *   DESCRIPTION: Starts a batch of reads: through io_uring if wanted and
+ *                the kernel allows, else by reader threads, else(if no
+ *                thread can be started) one at a time in loader_next.
+ *   INPUTS: req -- the reads(must stay valid until loader_finish)
+ *           n -- number of reads
+ *           use_uring -- non-zero to try io_uring
+ *   OUTPUTS: none
+ *   RETURN VALUE: the loader, or NULL if memory runs out
+ *   SIDE EFFECTS: submits reads to the kernel or starts threads
+ */
+loader_t* loader_start(const load_req_t* req, int32_t n, int32_t use_uring) {
+    loader_t* l; /* new loader              */
+    int32_t   i; /* index over threads      */
+
+    if (NULL == (l = calloc(1, sizeof (*l)))) {
+        return NULL;
+    }
+    if (NULL == (l->buf = calloc(n + 1, sizeof (l->buf[0]))) ||
+        NULL == (l->done = malloc((n + 1) * sizeof (l->done[0])))) {
+        free(l->buf);
+        free(l);
+        return NULL;
+    }
+    l->req = req;
+    l->n = n;
+    (void)pthread_mutex_init(&l->lock, NULL);
+    (void)pthread_cond_init(&l->cv, NULL);
+
+#if LOADER_USE_IO_URING
+    l->ring_fd = -1;
+    if (use_uring && uring_start(l)) {
+        l->method = LD_URING;
+        uring_submit(l);
+        return l;
+    }
+#endif
+    for (i = 0; LOADER_THREADS > i; i++) {
+        if (0 != pthread_create(&l->thread[i], NULL, read_thread, l)) {
+            break;
+        }
+        l->n_threads++;
+    }
+    l->method = (0 < l->n_threads ? LD_THREADS : LD_PREAD);
+    return l;
+}
+
+
+/*
+ * loader_next
+ *   DESCRIPTION: Waits for the next read to finish and hands it back.  A
+ *                read that comes up short is finished with pread.
+ *   INPUTS: l -- the loader
+ *   OUTPUTS: *idx -- index of the read
+ *            *buf -- its data, or NULL if the read failed
+ *   RETURN VALUE: 1 if a read was handed back, 0 if all have been
+ *   SIDE EFFECTS: frees the data handed back by the last call
+ */
+int32_t loader_next(loader_t* l, int32_t* idx, const uint8_t** buf) {
+    int32_t i; /* index of the read */
+
+    free(l->last);
+    l->last = NULL;
+    if (l->n <= l->n_done) {
+        return 0;
+    }
+    switch (l->method) {
+#if LOADER_USE_IO_URING
+        case LD_URING:
+            while (!next_ready(l)) {
+                uring_reap(l);
+            }
+            i = l->done[l->n_done++];
+            uring_submit(l);
+            break;
+#endif
+        case LD_THREADS:
+            (void)pthread_mutex_lock(&l->lock);
+            while (!next_ready(l)) {
+                (void)pthread_cond_wait(&l->cv, &l->lock);
+            }
+            i = l->done[l->n_done++];
+            (void)pthread_cond_broadcast(&l->cv);
+            (void)pthread_mutex_unlock(&l->lock);
+            break;
+        default:
+            i = l->n_started++;
+            l->depth = 1;
+            l->buf[i] = read_rest(&l->req[i], NULL, 0);
+            l->n_done++;
+            break;
+    }
+    *idx = i;
+    *buf = l->last = l->buf[i];
+    l->buf[i] = NULL;
+    return 1;
+}
+
+
+/*
+ * loader_method
+ *   DESCRIPTION: Gets how a loader does its reads.
+ *   INPUTS: l -- the loader
+ *   OUTPUTS: none
+ *   RETURN VALUE: "io_uring", "threads", or "pread"
+ *   SIDE EFFECTS: none
+ */
+const char* loader_method(const loader_t* l) {
+    static const char* const name[] = {"pread", "threads", "io_uring"};
+
+    return name[l->method];
+}
+
+
+/*
+ * loader_depth
+ *   DESCRIPTION: Gets the most reads a loader has had in flight at once.
+ *   INPUTS: l -- the loader
+ *   OUTPUTS: none
+ *   RETURN VALUE: the queue depth reached
+ *   SIDE EFFECTS: none
+ */
+int32_t loader_depth(const loader_t* l) {
+    int32_t depth; /* depth reached */
+
+    (void)pthread_mutex_lock((pthread_mutex_t*)&l->lock);
+    depth = l->depth;
+    (void)pthread_mutex_unlock((pthread_mutex_t*)&l->lock);
+    return depth;
+}
+
+
+/*
+ * loader_finish
+ *   DESCRIPTION: Starts no more reads, waits for those in flight(which
+ *                still write into their buffers), and frees the loader.
+ *   INPUTS: l -- the loader, or NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: stops the reader threads or closes the io_uring
+ */
+void loader_finish(loader_t* l) {
+    int32_t i; /* index over reads and threads */
+
+    if (NULL == l) {
+        return;
+    }
+    switch (l->method) {
+#if LOADER_USE_IO_URING
+        case LD_URING:
+            l->n = l->n_started;
+            while (0 < l->in_flight) {
+                uring_reap(l);
+            }
+            uring_stop(l);
+            break;
+#endif
+        case LD_THREADS:
+            (void)pthread_mutex_lock(&l->lock);
+            l->stopping = 1;
+            (void)pthread_cond_broadcast(&l->cv);
+            (void)pthread_mutex_unlock(&l->lock);
+            for (i = 0; l->n_threads > i; i++) {
+                (void)pthread_join(l->thread[i], NULL);
+            }
+            break;
+        default:
+            break;
+    }
+    free(l->last);
+    for (i = 0; l->n_started > i; i++) {
+        free(l->buf[i]);
+    }
+    (void)pthread_mutex_destroy(&l->lock);
+    (void)pthread_cond_destroy(&l->cv);
+    free(l->done);
+    free(l->buf);
+    free(l);
+}
+
+
+#if LOADER_USE_IO_URING
+
+/*
+ * uring_reap
+ *   DESCRIPTION: Waits for the io_uring to finish a read, finishes it with
+ *                pread if it came up short, and queues it in done.
+ *   INPUTS: l -- the loader
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: panics if the io_uring fails
+ */
+static void uring_reap(loader_t* l) {
+    uint32_t             head; /* next completion to take     */
+    struct io_uring_cqe* cqe;  /* the completion              */
+    int32_t              i;    /* index of the read           */
+    int32_t              res;  /* bytes read, or minus errno  */
+    long                 ret;  /* io_uring_enter result       */
+
+    head = *l->cq_head;
+    while (head == __atomic_load_n(l->cq_tail, __ATOMIC_ACQUIRE)) {
+        ret = syscall(__NR_io_uring_enter, l->ring_fd, l->unsent, 1,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+        if (0 <= ret) {
+            l->unsent -= ret;
+        } else if (EINTR != errno && EAGAIN != errno && EBUSY != errno) {
+            PANIC("io_uring_enter failed");
+        }
+    }
+    cqe = &l->cqes[head & *l->cq_mask];
+    i = (int32_t)cqe->user_data;
+    res = cqe->res;
+    __atomic_store_n(l->cq_head, head + 1, __ATOMIC_RELEASE);
+    l->in_flight--;
+
+    /* Short or failed reads(or NOPs standing in for them) use pread. */
+    if (l->req[i].size > (uint32_t)(0 > res ? 0 : res) || NULL == l->buf[i]) {
+        l->buf[i] = read_rest(&l->req[i], l->buf[i], (0 > res || NULL == l->buf[i] ? 0 : res));
+    }
+    l->done[l->n_queued++] = i;
+}
+
+
+/*
+ * uring_start
+ *   DESCRIPTION: Sets up an io_uring with room for every read(up to
+ *                LOADER_MAX_DEPTH) and maps its rings.
+ *   INPUTS: l -- the loader
+ *   OUTPUTS: l -- ring fields filled in
+ *   RETURN VALUE: 1 on success, 0 if io_uring is not available
+ *   SIDE EFFECTS: none
+ */
+static int32_t uring_start(loader_t* l) {
+    struct io_uring_params p; /* ring layout from the kernel */
+
+    l->entries = (LOADER_MAX_DEPTH < l->n ? LOADER_MAX_DEPTH : l->n);
+    if (0 == l->entries) {
+        return 0;
+    }
+    (void)memset(&p, 0, sizeof (p));
+    if (0 > (l->ring_fd = syscall(__NR_io_uring_setup, l->entries, &p))) {
+        l->ring_fd = -1;
+        return 0;
+    }
+
+    l->sq_size = p.sq_off.array + p.sq_entries * sizeof (uint32_t);
+    l->cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+    if (0 != (p.features & IORING_FEAT_SINGLE_MMAP)) {
+        l->sq_size = l->cq_size = (l->sq_size > l->cq_size ? l->sq_size : l->cq_size);
+    }
+    l->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+    l->sq_ring = mmap(NULL, l->sq_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, l->ring_fd, IORING_OFF_SQ_RING);
+    l->cq_ring = (0 != (p.features & IORING_FEAT_SINGLE_MMAP) ? l->sq_ring :
+                  mmap(NULL, l->cq_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, l->ring_fd, IORING_OFF_CQ_RING));
+    l->sqes = mmap(NULL, l->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, l->ring_fd, IORING_OFF_SQES);
+    if (MAP_FAILED == l->sq_ring || MAP_FAILED == l->cq_ring || MAP_FAILED == l->sqes) {
+        uring_stop(l);
+        return 0;
+    }
+
+    l->sq_tail = (uint32_t*)((uint8_t*)l->sq_ring + p.sq_off.tail);
+    l->sq_mask = (uint32_t*)((uint8_t*)l->sq_ring + p.sq_off.ring_mask);
+    l->sq_array = (uint32_t*)((uint8_t*)l->sq_ring + p.sq_off.array);
+    l->cq_head = (uint32_t*)((uint8_t*)l->cq_ring + p.cq_off.head);
+    l->cq_tail = (uint32_t*)((uint8_t*)l->cq_ring + p.cq_off.tail);
+    l->cq_mask = (uint32_t*)((uint8_t*)l->cq_ring + p.cq_off.ring_mask);
+    l->cqes = (struct io_uring_cqe*)((uint8_t*)l->cq_ring + p.cq_off.cqes);
+    return 1;
+}
+
+
+/*
+ * uring_stop
+ *   DESCRIPTION: Unmaps the rings of an io_uring and closes it.
+ *   INPUTS: l -- the loader(nothing may be in flight)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void uring_stop(loader_t* l) {
+    if (NULL != l->sqes && MAP_FAILED != l->sqes) {
+        (void)munmap(l->sqes, l->sqes_size);
+    }
+    if (NULL != l->cq_ring && MAP_FAILED != l->cq_ring && l->sq_ring != l->cq_ring) {
+        (void)munmap(l->cq_ring, l->cq_size);
+    }
+    if (NULL != l->sq_ring && MAP_FAILED != l->sq_ring) {
+        (void)munmap(l->sq_ring, l->sq_size);
+    }
+    (void)close(l->ring_fd);
+    l->ring_fd = -1;
+}
+
+
+/*
+ * uring_submit
+ *   DESCRIPTION: Queues reads on the io_uring, in order, until it is full
+ *                or all have been started, and submits them with one
+ *                system call.  A read whose buffer cannot be allocated is
+ *                queued as a NOP and retried by uring_reap.
+ *   INPUTS: l -- the loader
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: allocates the buffers of the reads started
+ */
+static void uring_submit(loader_t* l) {
+    uint32_t             tail; /* next free submission entry */
+    uint32_t             slot; /* entry for a read           */
+    struct io_uring_sqe* sqe;  /* the entry                  */
+    const load_req_t*    r;    /* the read                   */
+    int32_t              i;    /* index of the read          */
+    long                 ret;  /* io_uring_enter result      */
+
+    tail = *l->sq_tail;
+    while (l->n > l->n_started && (int32_t)l->entries > l->n_started - l->n_done) {
+        i = l->n_started++;
+        r = &l->req[i];
+        l->buf[i] = malloc(0 == r->size ? 1 : r->size);
+        slot = tail++ & *l->sq_mask;
+        sqe = &l->sqes[slot];
+        (void)memset(sqe, 0, sizeof (*sqe));
+        sqe->opcode = (NULL == l->buf[i] ? IORING_OP_NOP : IORING_OP_READ);
+        sqe->fd = r->fd;
+        sqe->off = r->offset;
+        sqe->addr = (uintptr_t)l->buf[i];
+        sqe->len = r->size;
+        sqe->user_data = i;
+        l->sq_array[slot] = slot;
+        l->unsent++;
+        if (++l->in_flight > l->depth) {
+            l->depth = l->in_flight;
+        }
+    }
+    __atomic_store_n(l->sq_tail, tail, __ATOMIC_RELEASE);
+
+    /* Entries the kernel does not take now are sent by uring_reap. */
+    while (0 < l->unsent) {
+        ret = syscall(__NR_io_uring_enter, l->ring_fd, l->unsent, 0, 0, NULL, 0);
+        if (0 < ret) {
+            l->unsent -= ret;
+        } else if (0 == ret || EINTR != errno) {
+            break;
+        }
+    }
+}
+
+#endif /* LOADER_USE_IO_URING */
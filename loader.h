@@ -0,0 +1,69 @@
+/* tab:4
+ *
+ * loader.h - header file for batched asynchronous file reads
+ *
+ * Version:       1
+ * Filename:      loader.h
+ * History:
+ *    1    First written.
+ */
+
+#ifndef LOADER_H
+#define LOADER_H
+
+
+#include <stdint.h>
+
+
+/*
+ * NOTES
+ *
+ * loader_start begins a batch of whole-buffer reads(such as every photo
+ * and image needed to build the world) at once, and loader_next hands
+ * back each read as it finishes, in whatever order they finish, so the
+ * caller can work on one while the others are still being read.  The
+ * reads go through io_uring where the kernel allows, with up to
+ * LOADER_MAX_DEPTH of them submitted to the kernel together; otherwise a
+ * few threads read with pread, and failing that, loader_next reads each
+ * one itself.  Reads are started in the order given, and the first is
+ * always handed back first, so the one wanted soonest should come first.
+ * The file descriptors must stay open until loader_finish.  Only one
+ * thread may use a loader.
+ */
+
+/* most reads in flight at once(bounds the memory held in buffers) */
+#define LOADER_MAX_DEPTH 256
+
+/* one read: size bytes at offset in the file fd */
+typedef struct load_req_t {
+    int      fd;      /* file to read      */
+    uint64_t offset;  /* where to start    */
+    uint32_t size;    /* bytes to read     */
+} load_req_t;
+
+typedef struct loader_t loader_t;
+
+/*
+ * start the n reads in req(which must stay valid until loader_finish),
+ * through io_uring if use_uring is non-zero and the kernel allows;
+ * returns NULL if memory runs out
+ */
+extern loader_t* loader_start(const load_req_t* req, int32_t n, int32_t use_uring);
+
+/*
+ * wait for the next read to finish; sets *idx to its index in req and
+ * *buf to its data(NULL if the read failed), which stays valid until
+ * the next call; returns 1, or 0 once every read has been handed back
+ */
+extern int32_t loader_next(loader_t* l, int32_t* idx, const uint8_t** buf);
+
+/* get how the reads were done: "io_uring", "threads", or "pread" */
+extern const char* loader_method(const loader_t* l);
+
+/* get the most reads that were in flight at once */
+extern int32_t loader_depth(const loader_t* l);
+
+/* wait for any reads still in flight, then free the loader */
+extern void loader_finish(loader_t* l);
+
+#endif /* LOADER_H */
@@ -0,0 +1,309 @@
+/* tab:4
+ *
+ * mkbigworld.c - utility program for producing large synthetic worlds
+ *
+ * Version:       2
+ * Filename:      mkbigworld.c
+ * History:
+ *    1    First written.
+ *    2    Added synthetic typed-command rules.
+ */
+
+
+/*
+ * This file is a standalone utility program that writes a synthetic world
+ * for measuring how the game scales with the size of its world(see the
+ * bench-world target in the Makefile).  Given an output directory, it
+ * writes a few room photos, an object image, and a world source, which
+ * mkworld then compiles into a world file.
+ *
+ * Every room and object named in world_ids.h is defined, followed by
+ * numbered rooms up to the requested count.  Rooms 1 to N - 1 form a ring
+ * through their left and right neighbors, and each enters a random room.
+ * Each room holds the requested number of numbered objects, placed at
+ * random by the game.  The room photos differ in their colors, so that
+ * each is quantized like a real photo.
+ *
+ * The requested number of typed-command rules follows, for measuring how
+ * the game scales with its rules.  Each is for a random verb and a word
+ * from a small vocabulary(or any word), limited to a random room and
+ * often to an accomplishment flag.
+ */
+
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "photo.h"
+#include "photo_headers.h"
+#include "world_ids.h"
+
+
+#define N_PHOTOS    8      /* distinct room photos written   */
+#define OBJ_WIDTH   32     /* width of object image          */
+#define OBJ_HEIGHT  24     /* height of object image         */
+#define N_RULE_WORDS 8     /* words used by rules(and "*")   */
+
+/* names from world_ids.h */
+#define WORLD_NAME(sym) #sym,
+static const char* const named_room[N_NAMED_ROOMS] = { WORLD_ROOMS(WORLD_NAME) };
+static const char* const named_obj[N_NAMED_OBJECTS] = { WORLD_OBJECTS(WORLD_NAME) };
+static const char* const named_swap[N_SWAPS] = { WORLD_SWAPS(WORLD_NAME) };
+static const char* const named_flag[NUM_FLAGS] = { WORLD_FLAGS(WORLD_NAME) };
+#define WORLD_WORD(id, word) word,
+static const char* const named_verb[NUM_TC_VALUES] = { WORLD_VERBS(WORLD_WORD) };
+
+
+/* functions local to this file--see function headers for details */
+static int write_photo(const char* fname, int32_t w, int32_t h, int32_t which);
+static int write_object(const char* fname);
+static void print_room(FILE* out, int32_t n);
+static void print_rule(FILE* out, int32_t n, int32_t n_rooms);
+
+
+/*
+ * write_photo
+ *   DESCRIPTION: Writes a synthetic room photo: smooth color gradients
+ *                with a little noise, tinted differently for each photo.
+ *   INPUTS: fname -- file to write
+ *           w, h -- photo dimensions
+ *           which -- photo number(selects the tint)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int write_photo(const char* fname, int32_t w, int32_t h, int32_t which) {
+    FILE*          out;    /* output file        */
+    photo_header_t hdr;    /* photo header       */
+    uint16_t*      row;    /* one row of pixels  */
+    int32_t        x, y;   /* pixel coordinates  */
+    uint32_t       r, g, b;/* pixel color        */
+    int            ok;     /* write succeeded    */
+
+    if (NULL == (out = fopen(fname, "wb")) ||
+        NULL == (row = malloc(w * sizeof (row[0])))) {
+        perror(fname);
+        if (NULL != out) {
+            (void)fclose(out);
+        }
+        return 0;
+    }
+    hdr.width = w;
+    hdr.height = h;
+    ok = (1 == fwrite(&hdr, sizeof (hdr), 1, out));
+    for (y = 0; ok && h > y; y++) {
+        for (x = 0; w > x; x++) {
+            r = ((x * 32) / w + which * 4 + rand() % 2) & 0x1F;
+            g = ((y * 64) / h + rand() % 3) & 0x3F;
+            b = (((x + y) * 32) / (w + h) + which * 3) & 0x1F;
+            row[x] = (r << 11) | (g << 5) | b;
+        }
+        ok = (w == fwrite(row, sizeof (row[0]), w, out));
+    }
+    free(row);
+    if (EOF == fclose(out) || !ok) {
+        perror(fname);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * write_object
+ *   DESCRIPTION: Writes a synthetic object image: a filled diamond with
+ *                transparent corners.
+ *   INPUTS: fname -- file to write
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int write_object(const char* fname) {
+    FILE*          out;                 /* output file       */
+    photo_header_t hdr;                 /* image header      */
+    uint8_t        pix[OBJ_HEIGHT][OBJ_WIDTH]; /* pixels     */
+    int32_t        x, y;                /* pixel coordinates */
+    int            ok;                  /* write succeeded   */
+
+    for (y = 0; OBJ_HEIGHT > y; y++) {
+        for (x = 0; OBJ_WIDTH > x; x++) {
+            pix[y][x] = (abs(2 * x - OBJ_WIDTH) * OBJ_HEIGHT + abs(2 * y - OBJ_HEIGHT) * OBJ_WIDTH <
+                         OBJ_WIDTH * OBJ_HEIGHT ? (x + y) & 0x3F : OBJ_CLR_TRANSP);
+        }
+    }
+    if (NULL == (out = fopen(fname, "wb"))) {
+        perror(fname);
+        return 0;
+    }
+    hdr.width = OBJ_WIDTH;
+    hdr.height = OBJ_HEIGHT;
+    ok = (1 == fwrite(&hdr, sizeof (hdr), 1, out) &&
+          1 == fwrite(pix, sizeof (pix), 1, out));
+    if (EOF == fclose(out) || !ok) {
+        perror(fname);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * print_room
+ *   DESCRIPTION: Prints the symbol for a room.
+ *   INPUTS: out -- the world source
+ *           n -- room number(named rooms come first)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void print_room(FILE* out, int32_t n) {
+    if (N_NAMED_ROOMS > n) {
+        fprintf(out, " %s", named_room[n]);
+    } else {
+        fprintf(out, " R_%d", n);
+    }
+}
+
+
+/*
+ * print_rule
+ *   DESCRIPTION: Prints a random typed-command rule for a random room.
+ *                Its word is "thing"(every numbered object), the keyword
+ *                of one of the first few named objects, or any word.
+ *   INPUTS: out -- the world source
+ *           n -- rule number(for its status message)
+ *           n_rooms -- rooms in world
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void print_rule(FILE* out, int32_t n, int32_t n_rooms) {
+    int32_t w;    /* word of rule */
+
+    fprintf(out, "rule %s ", named_verb[rand() % NUM_TC_VALUES]);
+    if (0 == (w = rand() % (N_RULE_WORDS + 2))) {
+        fprintf(out, "*");
+    } else if (1 == w) {
+        fprintf(out, "thing");
+    } else {
+        fprintf(out, "thing%d", w - 2);
+    }
+    fprintf(out, " in");
+    print_room(out, 1 + rand() % (n_rooms - 1));
+    if (0 != rand() % 2) {
+        fprintf(out, " %sflag %s", (0 == rand() % 2 ? "!" : ""), named_flag[rand() % NUM_FLAGS]);
+    }
+    fprintf(out, " ->");
+    if (0 == rand() % 4) {
+        fprintf(out, " set %s", named_flag[rand() % NUM_FLAGS]);
+    }
+    fprintf(out, " discard \"Rule %d fired.\"\n", n);
+}
+
+
+int main(int argc, char* argv[]) {
+    int32_t     n_rooms = 100;      /* rooms in world                */
+    int32_t     per_room = 2;       /* numbered objects in each room */
+    int32_t     n_rules = 0;        /* typed-command rules           */
+    int32_t     width = 320;        /* room photo width              */
+    int32_t     height = 200;       /* room photo height             */
+    unsigned    seed = 1;           /* random seed                   */
+    const char* dir;                /* output directory              */
+    char        fname[1024];        /* file name buffer              */
+    FILE*       out;                /* world source                  */
+    int32_t     i, j;               /* loop indices                  */
+    int         opt;                /* command line option letter    */
+
+    while (-1 != (opt = getopt(argc, argv, "n:m:r:W:H:s:"))) {
+        switch (opt) {
+            case 'n': n_rooms = atoi(optarg); break;
+            case 'm': per_room = atoi(optarg); break;
+            case 'r': n_rules = atoi(optarg); break;
+            case 'W': width = atoi(optarg); break;
+            case 'H': height = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default: optind = argc + 1; break;
+        }
+    }
+
+    // Check syntax of invocation.
+    if (argc != optind + 1 || N_NAMED_ROOMS > n_rooms || 0 > per_room || 0 > n_rules ||
+        SCROLL_X_DIM > width || MAX_PHOTO_WIDTH < width ||
+        SCROLL_Y_DIM > height || MAX_PHOTO_HEIGHT < height) {
+        fprintf(stderr, "usage: %s [-n rooms(>= %d)] [-m objects per room] "
+                "[-r rules] [-W width(%d-%d)] [-H height(%d-%d)] [-s seed] <directory>\n",
+                argv[0], N_NAMED_ROOMS, SCROLL_X_DIM, MAX_PHOTO_WIDTH,
+                SCROLL_Y_DIM, MAX_PHOTO_HEIGHT);
+        return 2;
+    }
+    dir = argv[optind];
+    srand(seed);
+
+    // Write the images.
+    if (-1 == mkdir(dir, 0777) && EEXIST != errno) {
+        perror(dir);
+        return 3;
+    }
+    for (i = 0; N_PHOTOS > i; i++) {
+        (void)snprintf(fname, sizeof (fname), "%s/room%d.photo", dir, i);
+        if (!write_photo(fname, width, height, i)) {
+            return 3;
+        }
+    }
+    (void)snprintf(fname, sizeof (fname), "%s/thing.obj", dir);
+    if (!write_object(fname)) {
+        return 3;
+    }
+
+    // Write the world source.
+    (void)snprintf(fname, sizeof (fname), "%s/world.txt", dir);
+    if (NULL == (out = fopen(fname, "w"))) {
+        perror(fname);
+        return 3;
+    }
+    fprintf(out, "# synthetic world: %d rooms, %d objects per room, %d rules, "
+            "%dx%d photos\n\n", n_rooms, per_room, n_rules, width, height);
+    fprintf(out, "start ");
+    print_room(out, 1);
+    fprintf(out, "\n\nroom R_INVENTORY Inventory %s/room0.photo - - -\n", dir);
+    for (i = 1; n_rooms > i; i++) {
+        fprintf(out, "room ");
+        print_room(out, i);
+        fprintf(out, " \"Room %d\" %s/room%d.photo", i, dir, i % N_PHOTOS);
+        print_room(out, (1 == i ? n_rooms - 1 : i - 1));
+        print_room(out, 1 + rand() % (n_rooms - 1));
+        print_room(out, (n_rooms - 1 == i ? 1 : i + 1));
+        fputc('\n', out);
+    }
+    fputc('\n', out);
+    for (i = 0; N_NAMED_OBJECTS > i; i++) {
+        fprintf(out, "object %s thing%d %s/thing.obj", named_obj[i], i, dir);
+        print_room(out, 1 + rand() % (n_rooms - 1));
+        fputc('\n', out);
+    }
+    for (i = 1; n_rooms > i; i++) {
+        for (j = 0; per_room > j; j++) {
+            fprintf(out, "object O_%d_%d thing %s/thing.obj", i, j, dir);
+            print_room(out, i);
+            fputc('\n', out);
+        }
+    }
+    fputc('\n', out);
+    for (i = 0; N_SWAPS > i; i++) {
+        fprintf(out, "swap %s %s/room%d.photo\n", named_swap[i], dir, i);
+    }
+    fputc('\n', out);
+    for (i = 0; n_rules > i; i++) {
+        print_rule(out, i, n_rooms);
+    }
+    if (EOF == fclose(out)) {
+        perror(fname);
+        return 3;
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+/* tab:4
+ *
+ * mkpack.c - utility program for packing photo and image files into an
+ *            asset pack
+ *
+ * Version:       1
+ * Filename:      mkpack.c
+ * History:
+ *    1    First written.
+ */
+
+
+/*
+ * This file is a standalone utility program that gathers room photo and
+ * object image files into one asset pack(the format is described in
+ * photo_headers.h).  Each file is stored under the name given on the
+ * command line, which must be the name by which the world file refers to
+ * it(such as images/tux.obj).  The contents are copied unchanged, so the
+ * game reads a packed file just as it would the file itself.
+ */
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "photo_headers.h"
+
+
+/* round up to a multiple of PACK_ALIGN */
+#define PACK_ROUND(n) (((n) + PACK_ALIGN - 1) & ~(uint64_t)(PACK_ALIGN - 1))
+
+
+/* functions local to this file--see function headers for details */
+static int compare_names(const void* a, const void* b);
+static int32_t copy_file(FILE* out, const char* fname, uint64_t size);
+static int32_t pad_to(FILE* out, uint64_t* pos, uint64_t to);
+static int32_t write_pack(FILE* out, char** name, int32_t n);
+
+
+/*
+ * compare_names
+ *   DESCRIPTION: Orders file names for qsort, as strcmp does.
+ *   INPUTS: a, b -- pointers to the names
+ *   OUTPUTS: none
+ *   RETURN VALUE: less than, equal to, or greater than zero
+ *   SIDE EFFECTS: none
+ */
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+
+/*
+ * copy_file
+ *   DESCRIPTION: Copies the contents of a file into the pack.
+ *   INPUTS: out -- the pack
+ *           fname -- the file
+ *           size -- its size in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t copy_file(FILE* out, const char* fname, uint64_t size) {
+    FILE*  in;         /* the file                */
+    char   buf[65536]; /* a piece of the contents */
+    size_t n;          /* bytes in buf            */
+
+    if (NULL == (in = fopen(fname, "rb"))) {
+        perror(fname);
+        return 0;
+    }
+    for (; 0 < size; size -= n) {
+        n = (sizeof (buf) < size ? sizeof (buf) : size);
+        if (n != fread(buf, 1, n, in) || n != fwrite(buf, 1, n, out)) {
+            fprintf(stderr, "%s: copy failed\n", fname);
+            (void)fclose(in);
+            return 0;
+        }
+    }
+    (void)fclose(in);
+    return 1;
+}
+
+
+/*
+ * pad_to
+ *   DESCRIPTION: Writes zero bytes up to an offset in the pack.
+ *   INPUTS: out -- the pack
+ *           *pos -- offset reached so far
+ *           to -- offset wanted
+ *   OUTPUTS: *pos -- set to to
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: none
+ */
+static int32_t pad_to(FILE* out, uint64_t* pos, uint64_t to) {
+    for (; to > *pos; (*pos)++) {
+        if (EOF == fputc(0, out)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * write_pack
+ *   DESCRIPTION: Writes an asset pack holding some files.
+ *   INPUTS: out -- the pack
+ *           name -- the file names(sorted by compare_names)
+ *           n -- number of files
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints the number of files and bytes packed, or an
+ *                 error message on failure
+ */
+static int32_t write_pack(FILE* out, char** name, int32_t n) {
+    pack_header_t hdr;   /* pack header                     */
+    pack_entry_t* ent;   /* table of contents               */
+    struct stat   st;    /* status of a file                */
+    uint64_t      pos;   /* offset reached in pack          */
+    uint64_t      next;  /* offset of next file's contents  */
+    int32_t       i;     /* index over files                */
+    int32_t       ok;    /* writes succeeded                */
+
+    if (NULL == (ent = calloc(n, sizeof (ent[0])))) {
+        perror("allocate table of contents");
+        return 0;
+    }
+
+    /* Lay out the names, then the contents after them. */
+    hdr.magic = PACK_MAGIC;
+    hdr.version = PACK_VERSION;
+    hdr.n_files = n;
+    hdr.str_size = 0;
+    for (i = 0; n > i; i++) {
+        if (-1 == stat(name[i], &st)) {
+            perror(name[i]);
+            free(ent);
+            return 0;
+        }
+        ent[i].size = st.st_size;
+        ent[i].name = hdr.str_size;
+        hdr.str_size += strlen(name[i]) + 1;
+    }
+    next = PACK_ROUND(sizeof (hdr) + n * sizeof (ent[0]) + hdr.str_size);
+    for (i = 0; n > i; i++) {
+        ent[i].offset = next;
+        next = PACK_ROUND(next + ent[i].size);
+    }
+
+    ok = (1 == fwrite(&hdr, sizeof (hdr), 1, out) &&
+          (size_t)n == fwrite(ent, sizeof (ent[0]), n, out));
+    for (i = 0; ok && n > i; i++) {
+        ok = (EOF != fputs(name[i], out) && EOF != fputc('\0', out));
+    }
+    pos = sizeof (hdr) + n * sizeof (ent[0]) + hdr.str_size;
+    for (i = 0; ok && n > i; i++) {
+        ok = (pad_to(out, &pos, ent[i].offset) && copy_file(out, name[i], ent[i].size));
+        pos += ent[i].size;
+    }
+    ok = (ok && pad_to(out, &pos, next));
+    if (!ok) {
+        fprintf(stderr, "writing pack failed\n");
+    } else {
+        printf("%d files, %llu bytes\n", n, (unsigned long long)next);
+    }
+    free(ent);
+    return ok;
+}
+
+
+int main(int argc, char* argv[]) {
+    FILE*   out;      /* the pack                 */
+    char**  name;     /* file names, sorted       */
+    int32_t n;        /* number of files          */
+    int32_t i;        /* index over files         */
+    int32_t written;  /* pack written successfully */
+
+    // Check syntax of invocation.
+    if (3 > argc) {
+        fprintf(stderr, "usage: %s <pack file> <photo or image file>...\n", argv[0]);
+        return 2;
+    }
+
+    // Sort the names, which the game finds by binary search.
+    n = argc - 2;
+    name = argv + 2;
+    qsort(name, n, sizeof (name[0]), compare_names);
+    for (i = 1; n > i; i++) {
+        if (0 == strcmp(name[i - 1], name[i])) {
+            fprintf(stderr, "%s is named twice\n", name[i]);
+            return 2;
+        }
+    }
+
+    if (NULL == (out = fopen(argv[1], "wb"))) {
+        perror("open pack file");
+        return 2;
+    }
+    written = write_pack(out, name, n);
+    if (EOF == fclose(out)) {
+        perror("close pack file");
+        written = 0;
+    }
+    if (!written) {
+        (void)remove(argv[1]);
+    }
+    return (written ? 0 : 3);
+}
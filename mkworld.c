@@ -0,0 +1,1341 @@
+/* tab:4
+ *
+ * mkworld.c - utility program for producing adventure game world files
+ *
+ * Version:       4
+ * Filename:      mkworld.c
+ * History:
+ *    1    First written.
+ *    2    Interned object keywords as words, with a perfect hash.
+ *    3    Compiled typed-command rules, with an index by verb, word, and
+ *         room.
+ *    4    Left hashing the rule keys to the game.
+ */
+
+
+/*
+ * This file is a standalone utility program that compiles the readable
+ * world description(world.txt; its syntax is described at the top of
+ * that file) into the binary world file read by build_world(the format
+ * is described in world_ids.h).
+ *
+ * All lines are read first, so rooms may refer to rooms defined later.
+ * Rooms and objects named in world_ids.h receive the identifiers given
+ * there; all others are numbered after those in the order in which they
+ * appear.  Symbols are looked up in a hash table, so large worlds compile
+ * in time linear in their size.
+ *
+ * Object keywords are interned the same way as words, after the words
+ * named in world_ids.h, and a perfect hash of all words is written for
+ * the game's lookups(see make_hash).  The words of rules are
+ * interned after the object keywords.
+ *
+ * Rules are compiled into records in source order(see compile_rule),
+ * and each is listed under its verb, each of its words, and the room to
+ * which it is limited, if any.  Each key the game may look up is then
+ * given the whole list of rules that apply to it(see index_rules), so
+ * that a typed command costs the game one list, however many rules
+ * there are.
+ */
+
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "world_ids.h"
+
+
+#define MAX_LINE_LEN 1024   /* longest line in the text source */
+#define MAX_TOKENS   32     /* most tokens on one line         */
+#define MAX_HASH     (1 << 24) /* largest hash table             */
+#define MAX_DISP     (1 << 16) /* displacements tried per bucket */
+
+/* a room line, before its symbols are resolved */
+typedef struct {
+    int32_t line;     /* source line number  */
+    char*   sym;      /* room symbol         */
+    char*   name;     /* name of room        */
+    char*   photo;    /* photo file name     */
+    char*   link[3];  /* left, enter, right  */
+} room_line_t;
+
+/* an object line, before its symbols are resolved */
+typedef struct {
+    int32_t line;     /* source line number            */
+    char*   sym;      /* object symbol                 */
+    char*   name;     /* object keyword                */
+    char*   image;    /* image file name               */
+    char*   room;     /* starting room symbol          */
+    int32_t x, y;     /* starting position(-1 random)  */
+} obj_line_t;
+
+/* a rule line, before its symbols are resolved */
+typedef struct {
+    int32_t line;     /* source line number                      */
+    char*   words;    /* its words("*" for any), NUL-separated     */
+    int32_t n_words;  /* number of words                         */
+    int32_t n_tok;    /* number of tokens                        */
+    char*   tok[MAX_TOKENS]; /* tokens(verb first)               */
+} rule_line_t;
+
+/* a rule's listing under one key, before the keys are grouped */
+typedef struct {
+    int32_t  verb;    /* verb id                  */
+    int32_t  word;    /* word id, or RULE_ANY     */
+    int32_t  room;    /* room id, or RULE_ANY     */
+    uint32_t rule;    /* rule id                  */
+} rule_ref_t;
+
+/* a condition or effect of a rule as written, with its number of arguments */
+typedef struct {
+    const char* name;
+    int32_t     kind;
+    int32_t     n_args;
+} rule_part_t;
+
+/* an entry in a symbol table */
+typedef struct {
+    const char* sym;      /* symbol(NULL for empty entry) */
+    int32_t     id;       /* identifier                   */
+    int32_t     defined;  /* 1 once defined by a line     */
+} symbol_t;
+
+/* a symbol table(open addressing; size is a power of two) */
+typedef struct {
+    symbol_t* entry;
+    uint32_t  size;
+} sym_table_t;
+
+
+/* names from world_ids.h */
+#define WORLD_NAME(sym) #sym,
+static const char* const named_room[N_NAMED_ROOMS] = { WORLD_ROOMS(WORLD_NAME) };
+static const char* const named_obj[N_NAMED_OBJECTS] = { WORLD_OBJECTS(WORLD_NAME) };
+static const char* const named_swap[N_SWAPS] = { WORLD_SWAPS(WORLD_NAME) };
+static const char* const named_flag[NUM_FLAGS] = { WORLD_FLAGS(WORLD_NAME) };
+#define WORLD_WORD(sym, word) word,
+static const char* const named_word[N_NAMED_WORDS] = { WORLD_WORDS(WORLD_WORD) };
+static const char* const named_verb[NUM_TC_VALUES] = { WORLD_VERBS(WORLD_WORD) };
+
+/* the parts of rules(see compile_rule) */
+static const rule_part_t cond_part[] = {
+    {"in",   RC_IN,   1},
+    {"at",   RC_AT,   2},
+    {"has",  RC_AT,   1},  /* at R_INVENTORY */
+    {"here", RC_HERE, 1},
+    {"flag", RC_FLAG, 1},
+    {NULL,   0,       0}
+};
+static const rule_part_t effect_part[] = {
+    {"get",  RE_GET,  1},
+    {"lose", RE_LOSE, 1},
+    {"put",  RE_PUT,  4},
+    {"set",  RE_SET,  1},
+    {"swap", RE_SWAP, 1},
+    {"link", RE_LINK, 2},
+    {"goto", RE_GOTO, 1},
+    {"win",  RE_WIN,  0},
+    {NULL,   0,       0}
+};
+static const char* const result_name[N_RULE_RESULTS] = {
+    "allow", "discard", "redraw", "change", "pass"
+};
+
+
+/* functions local to this file--see function headers for details */
+static int32_t add_key(rule_ref_t** list, int32_t* n, int32_t* cap,
+                       int32_t verb, int32_t word, int32_t room);
+static int32_t add_string(const char* s);
+static int compare_keys(const void* a, const void* b);
+static int compare_refs(const void* a, const void* b);
+static int32_t compile_rule(const rule_line_t* rl, world_file_rule_t* rule, int32_t* room);
+static int32_t find_name(const char* sym, const char* const* name, int32_t n_names);
+static void* grow(void* array, int32_t n, int32_t* cap, size_t elt_size);
+static int32_t index_rules(const rule_ref_t* refs, int32_t n_refs,
+                           world_file_key_t** keys, int32_t* n_keys,
+                           world_file_ref_t** krefs, int32_t* n_krefs);
+static int32_t init_table(sym_table_t* t, int32_t n_syms);
+static symbol_t* lookup(sym_table_t* t, const char* sym);
+static int compare_buckets(const void* a, const void* b);
+static int32_t make_hash(const uint64_t* h, int32_t n_words, const char* what,
+                         world_file_hash_t** table, uint32_t* size);
+static int32_t read_source(FILE* in, const char* fname);
+static int32_t resolve_obj(const char* sym, int32_t line, int32_t* id);
+static int32_t resolve_room(const char* sym, int32_t line, int32_t* id);
+static char* save(const char* s);
+static int32_t split_line(char* buf, char* tok[MAX_TOKENS]);
+static int32_t write_world(FILE* out);
+
+
+/* file-scope variables */
+static const char*  src_name;          /* name of text source, for errors   */
+static room_line_t* room_line;         /* room lines in source order        */
+static int32_t      n_room_lines;
+static int32_t      room_line_cap;
+static obj_line_t*  obj_line;          /* object lines in source order      */
+static int32_t      n_obj_lines;
+static int32_t      obj_line_cap;
+static rule_line_t* rule_line;         /* rule lines in source order        */
+static int32_t      n_rule_lines;
+static int32_t      rule_line_cap;
+static int32_t      n_rule_words;      /* words of all rules                */
+static world_file_cond_t*   conds;     /* condition records                 */
+static int32_t      n_conds;
+static int32_t      cond_cap;
+static world_file_effect_t* effects;   /* effect records                    */
+static int32_t      n_effects;
+static int32_t      effect_cap;
+static char*        swap_photo[N_SWAPS]; /* swap photo file names           */
+static char*        start_sym;         /* starting room symbol              */
+static int32_t      start_line;
+static sym_table_t  room_syms;         /* room symbols to identifiers       */
+static sym_table_t  obj_syms;          /* object symbols to identifiers     */
+static sym_table_t  word_syms;         /* words to identifiers              */
+static const int32_t* bucket_first;    /* hash buckets(compare_buckets)      */
+static char*        strings;           /* string table for output           */
+static int32_t      str_size;
+static int32_t      str_cap;
+
+
+/*
+ * grow
+ *   DESCRIPTION: Makes room for one more element at the end of a
+ *                dynamically allocated array, doubling its capacity when
+ *                it is full.
+ *   INPUTS: array -- the array(NULL if none allocated yet)
+ *           n -- number of elements in use
+ *           cap -- pointer to capacity of array in elements
+ *           elt_size -- size of one element in bytes
+ *   OUTPUTS: *cap -- new capacity
+ *   RETURN VALUE: the(possibly moved) array, or NULL on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static void* grow(void* array, int32_t n, int32_t* cap, size_t elt_size) {
+    void* new_array; /* reallocated array */
+
+    if (n < *cap) {
+        return array;
+    }
+    new_array = realloc(array, (0 == *cap ? 64 : 2 * *cap) * elt_size);
+    if (NULL == new_array) {
+        perror("grow array");
+        return NULL;
+    }
+    *cap = (0 == *cap ? 64 : 2 * *cap);
+    return new_array;
+}
+
+
+/*
+ * save
+ *   DESCRIPTION: Copies a token out of the line buffer.
+ *   INPUTS: s -- the token
+ *   OUTPUTS: none
+ *   RETURN VALUE: a dynamically allocated copy, or NULL on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static char* save(const char* s) {
+    char* copy; /* the copy */
+
+    if (NULL == (copy = strdup(s))) {
+        perror("copy token");
+    }
+    return copy;
+}
+
+
+/*
+ * split_line
+ *   DESCRIPTION: Splits a line of the text source into tokens separated
+ *                by white space.  A token starting with a double quote
+ *                runs to the next double quote(the quotes are dropped).
+ *                A '#' outside of quotes starts a comment.
+ *   INPUTS: buf -- the line(modified in place)
+ *   OUTPUTS: tok -- the tokens(pointers into buf)
+ *   RETURN VALUE: number of tokens, or -1 on error(too many tokens or an
+ *                 unterminated quote)
+ *   SIDE EFFECTS: none
+ */
+static int32_t split_line(char* buf, char* tok[MAX_TOKENS]) {
+    int32_t n_tok; /* number of tokens found */
+    char*   s;     /* scan pointer           */
+
+    for (n_tok = 0, s = buf; 1; ) {
+        while (' ' == *s || '\t' == *s || '\r' == *s || '\n' == *s) {
+            s++;
+        }
+        if ('\0' == *s || '#' == *s) {
+            return n_tok;
+        }
+        if (MAX_TOKENS == n_tok) {
+            return -1;
+        }
+        if ('"' == *s) {
+            tok[n_tok++] = ++s;
+            if (NULL == (s = strchr(s, '"'))) {
+                return -1;
+            }
+        } else {
+            tok[n_tok++] = s;
+            while ('\0' != *s && NULL == strchr(" \t\r\n#", *s)) {
+                s++;
+            }
+            if ('#' == *s) {
+                *s = '\0';
+                return n_tok;
+            }
+            if ('\0' == *s) {
+                return n_tok;
+            }
+        }
+        *s++ = '\0';
+    }
+}
+
+
+/*
+ * read_source
+ *   DESCRIPTION: Reads every line of the text source, saving room,
+ *                object, and rule lines for resolve_room and write_world.
+ *   INPUTS: in -- the text source
+ *           fname -- its name(for error messages)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints error messages to stderr on failure
+ */
+static int32_t read_source(FILE* in, const char* fname) {
+    char         buf[MAX_LINE_LEN];  /* line buffer             */
+    char*        tok[MAX_TOKENS];    /* tokens on current line  */
+    int32_t      n_tok;              /* number of tokens        */
+    int32_t      line;               /* current line number     */
+    int32_t      i;                  /* loop index              */
+    room_line_t* r;                  /* new room line           */
+    obj_line_t*  o;                  /* new object line         */
+    rule_line_t* u;                  /* new rule line           */
+    char*        c;                  /* scan pointer over words */
+
+    for (line = 1; NULL != fgets(buf, sizeof (buf), in); line++) {
+        if (NULL == strchr(buf, '\n') && !feof(in)) {
+            fprintf(stderr, "%s:%d: line too long\n", fname, line);
+            return 0;
+        }
+        if (0 > (n_tok = split_line(buf, tok))) {
+            fprintf(stderr, "%s:%d: bad line\n", fname, line);
+            return 0;
+        }
+        if (0 == n_tok) {
+            continue;
+        }
+
+        if (0 == strcmp(tok[0], "start") && 2 == n_tok) {
+            if (NULL != start_sym) {
+                fprintf(stderr, "%s:%d: second start room\n", fname, line);
+                return 0;
+            }
+            start_sym = save(tok[1]);
+            start_line = line;
+
+        } else if (0 == strcmp(tok[0], "room") && 7 == n_tok) {
+            if (NULL == (room_line = grow(room_line, n_room_lines, &room_line_cap, sizeof (*room_line)))) {
+                return 0;
+            }
+            r = &room_line[n_room_lines++];
+            r->line = line;
+            r->sym = save(tok[1]);
+            r->name = save(tok[2]);
+            r->photo = save(tok[3]);
+            for (i = 0; 3 > i; i++) {
+                r->link[i] = save(tok[4 + i]);
+            }
+
+        } else if (0 == strcmp(tok[0], "object") && (5 == n_tok || 7 == n_tok)) {
+            if (NULL == (obj_line = grow(obj_line, n_obj_lines, &obj_line_cap, sizeof (*obj_line)))) {
+                return 0;
+            }
+            o = &obj_line[n_obj_lines++];
+            o->line = line;
+            o->sym = save(tok[1]);
+            o->name = save(tok[2]);
+            for (i = 0; NULL != o->name && '\0' != o->name[i]; i++) {
+                o->name[i] = tolower((uint8_t)o->name[i]);
+            }
+            o->image = save(tok[3]);
+            o->room = save(tok[4]);
+            o->x = (7 == n_tok ? atoi(tok[5]) : -1);
+            o->y = (7 == n_tok ? atoi(tok[6]) : -1);
+            if (7 == n_tok && (0 > o->x || 0 > o->y)) {
+                fprintf(stderr, "%s:%d: bad object position\n", fname, line);
+                return 0;
+            }
+
+        } else if (0 == strcmp(tok[0], "swap") && 3 == n_tok) {
+            if (0 > (i = find_name(tok[1], named_swap, N_SWAPS))) {
+                fprintf(stderr, "%s:%d: unknown swap %s\n", fname, line, tok[1]);
+                return 0;
+            }
+            if (NULL != swap_photo[i]) {
+                fprintf(stderr, "%s:%d: duplicate swap %s\n", fname, line, tok[1]);
+                return 0;
+            }
+            swap_photo[i] = save(tok[2]);
+
+        } else if (0 == strcmp(tok[0], "rule") && 5 <= n_tok) {
+            if (NULL == (rule_line = grow(rule_line, n_rule_lines, &rule_line_cap, sizeof (*rule_line)))) {
+                return 0;
+            }
+            u = &rule_line[n_rule_lines++];
+            u->line = line;
+            u->n_tok = n_tok - 1;
+            for (i = 1; n_tok > i; i++) {
+                u->tok[i - 1] = save(tok[i]);
+            }
+            if (NULL == (u->words = save(tok[2]))) {
+                return 0;
+            }
+            for (u->n_words = 1, c = u->words; '\0' != *c; c++) {
+                if (',' == *c) {
+                    *c = '\0';
+                    u->n_words++;
+                } else {
+                    *c = tolower((uint8_t)*c);
+                }
+            }
+            n_rule_words += u->n_words;
+
+
+        } else {
+            fprintf(stderr, "%s:%d: bad line\n", fname, line);
+            return 0;
+        }
+    }
+
+    if (ferror(in)) {
+        perror("read world source");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * init_table
+ *   DESCRIPTION: Creates an empty symbol table large enough to hold a
+ *                given number of symbols with a load factor of at most
+ *                one half.
+ *   INPUTS: t -- the table
+ *           n_syms -- number of symbols to be held
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t init_table(sym_table_t* t, int32_t n_syms) {
+    for (t->size = 16; t->size < 2 * (uint32_t)n_syms; t->size *= 2) { }
+    if (NULL == (t->entry = calloc(t->size, sizeof (t->entry[0])))) {
+        perror("allocate symbol table");
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * lookup
+ *   DESCRIPTION: Finds the entry for a symbol in a symbol table, or the
+ *                empty entry in which the symbol belongs.
+ *   INPUTS: t -- the table(never full; see init_table)
+ *           sym -- the symbol
+ *   OUTPUTS: none
+ *   RETURN VALUE: the entry(its sym field is NULL if sym is not present)
+ *   SIDE EFFECTS: none
+ */
+static symbol_t* lookup(sym_table_t* t, const char* sym) {
+    uint32_t    h; /* hash of symbol(FNV-1a) */
+    const char* s; /* scan pointer            */
+
+    for (h = 2166136261U, s = sym; '\0' != *s; s++) {
+        h = (h ^ (uint8_t)*s) * 16777619U;
+    }
+    for (h &= t->size - 1; NULL != t->entry[h].sym; h = (h + 1) & (t->size - 1)) {
+        if (0 == strcmp(sym, t->entry[h].sym)) {
+            break;
+        }
+    }
+    return &t->entry[h];
+}
+
+
+/*
+ * resolve_room
+ *   DESCRIPTION: Translates a room symbol("-" for none) into a room
+ *                identifier.
+ *   INPUTS: sym -- the symbol
+ *           line -- source line using the symbol(for error messages)
+ *   OUTPUTS: *id -- the identifier
+ *   RETURN VALUE: 1 on success, 0 if the room is not defined
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t resolve_room(const char* sym, int32_t line, int32_t* id) {
+    symbol_t* s; /* symbol table entry */
+
+    if (0 == strcmp(sym, "-")) {
+        *id = R_NONE;
+        return 1;
+    }
+    s = lookup(&room_syms, sym);
+    if (NULL == s->sym || !s->defined) {
+        fprintf(stderr, "%s:%d: undefined room %s\n", src_name, line, sym);
+        return 0;
+    }
+    *id = s->id;
+    return 1;
+}
+
+
+/*
+ * resolve_obj
+ *   DESCRIPTION: Translates an object symbol into an object identifier.
+ *   INPUTS: sym -- the symbol
+ *           line -- source line using the symbol(for error messages)
+ *   OUTPUTS: *id -- the identifier
+ *   RETURN VALUE: 1 on success, 0 if the object is not defined
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t resolve_obj(const char* sym, int32_t line, int32_t* id) {
+    symbol_t* s; /* symbol table entry */
+
+    s = lookup(&obj_syms, sym);
+    if (NULL == s->sym || !s->defined) {
+        fprintf(stderr, "%s:%d: undefined object %s\n", src_name, line, sym);
+        return 0;
+    }
+    *id = s->id;
+    return 1;
+}
+
+
+/*
+ * find_name
+ *   DESCRIPTION: Finds a name in a short list of names(flags, swaps,
+ *                verbs, and the like).
+ *   INPUTS: sym -- the name sought
+ *           name -- the list
+ *           n_names -- number of names in the list
+ *   OUTPUTS: none
+ *   RETURN VALUE: index of the name in the list, or -1 if it is absent
+ *   SIDE EFFECTS: none
+ */
+static int32_t find_name(const char* sym, const char* const* name, int32_t n_names) {
+    int32_t i; /* index over names */
+
+    for (i = 0; n_names > i; i++) {
+        if (0 == strcmp(sym, name[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/*
+ * compile_rule
+ *   DESCRIPTION: Resolves the symbols of a rule line and appends its
+ *                conditions and effects to the records.  After the verb
+ *                and words, a rule lists its conditions(each part name
+ *                followed by its arguments, and negated by a leading
+ *                '!'), then "->", its effects, its result, and an
+ *                optional status message.
+ *   INPUTS: rl -- the rule line
+ *   OUTPUTS: *rule -- the rule record
+ *            *room -- room of the rule's first RC_IN condition that is
+ *                     not negated, or RULE_ANY
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t compile_rule(const rule_line_t* rl, world_file_rule_t* rule, int32_t* room) {
+    char* const*       tok = rl->tok;  /* tokens of rule     */
+    const rule_part_t* p;              /* part being read    */
+    world_file_cond_t* c;              /* new condition      */
+    world_file_effect_t* e;            /* new effect         */
+    const char*        name;           /* part name          */
+    int32_t            neg;            /* condition negated  */
+    int32_t            t;              /* index over tokens  */
+    int32_t            ok;             /* arguments resolved */
+    char*              end;            /* end of a number    */
+
+    *room = RULE_ANY;
+    rule->cond = n_conds;
+    for (t = 2; rl->n_tok > t && 0 != strcmp(tok[t], "->"); t += 1 + p->n_args) {
+        neg = ('!' == tok[t][0]);
+        name = tok[t] + neg;
+        for (p = cond_part; NULL != p->name && 0 != strcmp(name, p->name); p++) { }
+        if (NULL == p->name || rl->n_tok <= t + p->n_args) {
+            fprintf(stderr, "%s:%d: bad condition %s\n", src_name, rl->line, tok[t]);
+            return 0;
+        }
+        if (NULL == (conds = grow(conds, n_conds, &cond_cap, sizeof (*conds)))) {
+            return 0;
+        }
+        c = &conds[n_conds++];
+        c->kind = p->kind | (neg ? RULE_NOT : 0);
+        c->b = R_INVENTORY;
+        switch (p->kind) {
+            case RC_IN:
+                ok = resolve_room(tok[t + 1], rl->line, &c->a) && R_NONE != c->a;
+                if (ok && !neg && RULE_ANY == *room) {
+                    *room = c->a;
+                }
+                break;
+            case RC_AT:
+                ok = resolve_obj(tok[t + 1], rl->line, &c->a) &&
+                     (1 == p->n_args || resolve_room(tok[t + 2], rl->line, &c->b));
+                break;
+            case RC_HERE:
+                ok = resolve_obj(tok[t + 1], rl->line, &c->a);
+                break;
+            default:
+                ok = (0 <= (c->a = find_name(tok[t + 1], named_flag, NUM_FLAGS)));
+                break;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%d: bad condition %s %s\n", src_name, rl->line, tok[t], tok[t + 1]);
+            return 0;
+        }
+    }
+    rule->n_conds = n_conds - rule->cond;
+    if (rl->n_tok == t) {
+        fprintf(stderr, "%s:%d: rule has no \"->\"\n", src_name, rl->line);
+        return 0;
+    }
+
+    rule->effect = n_effects;
+    for (t++; rl->n_tok > t && 0 > find_name(tok[t], result_name, N_RULE_RESULTS); t += 1 + p->n_args) {
+        for (p = effect_part; NULL != p->name && 0 != strcmp(tok[t], p->name); p++) { }
+        if (NULL == p->name || rl->n_tok <= t + p->n_args ||
+            (n_effects > rule->effect && RE_WIN == effects[n_effects - 1].kind)) {
+            fprintf(stderr, "%s:%d: bad effect %s\n", src_name, rl->line, tok[t]);
+            return 0;
+        }
+        if (NULL == (effects = grow(effects, n_effects, &effect_cap, sizeof (*effects)))) {
+            return 0;
+        }
+        e = &effects[n_effects++];
+        e->kind = p->kind;
+        e->a = e->b = e->c = e->d = 0;
+        switch (p->kind) {
+            case RE_GET: case RE_LOSE:
+                ok = resolve_obj(tok[t + 1], rl->line, &e->a);
+                break;
+            case RE_PUT:
+                e->c = strtol(tok[t + 3], &end, 10);
+                ok = ('\0' == *end && 0 <= e->c && 0xFFFF >= e->c);
+                e->d = strtol(tok[t + 4], &end, 10);
+                ok = (ok && '\0' == *end && 0 <= e->d && 0xFFFF >= e->d &&
+                      resolve_obj(tok[t + 1], rl->line, &e->a) &&
+                      resolve_room(tok[t + 2], rl->line, &e->b) && R_NONE != e->b);
+                break;
+            case RE_SET:
+                ok = (0 <= (e->a = find_name(tok[t + 1], named_flag, NUM_FLAGS)));
+                break;
+            case RE_SWAP:
+                ok = (0 <= (e->a = find_name(tok[t + 1], named_swap, N_SWAPS)));
+                break;
+            case RE_LINK:
+                ok = (resolve_room(tok[t + 1], rl->line, &e->a) && R_NONE != e->a &&
+                      resolve_room(tok[t + 2], rl->line, &e->b));
+                break;
+            case RE_GOTO:
+                ok = resolve_room(tok[t + 1], rl->line, &e->a) && R_NONE != e->a;
+                break;
+            default:
+                ok = 1;
+                break;
+        }
+        if (!ok) {
+            fprintf(stderr, "%s:%d: bad effect %s\n", src_name, rl->line, tok[t]);
+            return 0;
+        }
+    }
+    rule->n_effects = n_effects - rule->effect;
+    if (rl->n_tok == t) {
+        fprintf(stderr, "%s:%d: rule has no result\n", src_name, rl->line);
+        return 0;
+    }
+
+    rule->result = find_name(tok[t], result_name, N_RULE_RESULTS);
+    if (0 < rule->n_effects && RE_WIN == effects[n_effects - 1].kind && RR_CHANGE != rule->result) {
+        fprintf(stderr, "%s:%d: a win must change the room\n", src_name, rl->line);
+        return 0;
+    }
+    rule->status = -1;
+    if (rl->n_tok > ++t && 0 > (rule->status = add_string(tok[t++]))) {
+        return 0;
+    }
+    if (rl->n_tok != t) {
+        fprintf(stderr, "%s:%d: extra tokens after rule result\n", src_name, rl->line);
+        return 0;
+    }
+    return 1;
+}
+
+
+/*
+ * compare_keys
+ *   DESCRIPTION: Orders rule listings by verb, word, and room alone(for
+ *                qsort and bsearch).
+ *   INPUTS: a, b -- pointers to the listings
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative if a goes first, positive if b goes first, 0
+ *                 if they have the same key
+ *   SIDE EFFECTS: none
+ */
+static int compare_keys(const void* a, const void* b) {
+    const rule_ref_t* x = a; /* first listing  */
+    const rule_ref_t* y = b; /* second listing */
+
+    if (x->verb != y->verb) {
+        return (x->verb < y->verb ? -1 : 1);
+    }
+    if (x->word != y->word) {
+        return (x->word < y->word ? -1 : 1);
+    }
+    return (x->room < y->room ? -1 : (x->room > y->room));
+}
+
+
+/*
+ * compare_refs
+ *   DESCRIPTION: Orders rule listings by verb, word, room, and rule(for
+ *                qsort).
+ *   INPUTS: a, b -- pointers to the listings
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative if a goes first, positive if b goes first, 0
+ *                 if they are the same
+ *   SIDE EFFECTS: none
+ */
+static int compare_refs(const void* a, const void* b) {
+    const rule_ref_t* x = a; /* first listing  */
+    const rule_ref_t* y = b; /* second listing */
+    int                c;    /* order of keys  */
+
+    if (0 != (c = compare_keys(a, b))) {
+        return c;
+    }
+    return (x->rule < y->rule ? -1 : (x->rule > y->rule));
+}
+
+
+/*
+ * add_key
+ *   DESCRIPTION: Appends a key to a list of rule keys.
+ *   INPUTS: list -- pointer to the list(NULL if none allocated yet)
+ *           n -- pointer to number of keys in the list
+ *           cap -- pointer to capacity of the list
+ *           verb, word, room -- the key
+ *   OUTPUTS: *list, *n, *cap -- the longer list
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t add_key(rule_ref_t** list, int32_t* n, int32_t* cap,
+                       int32_t verb, int32_t word, int32_t room) {
+    if (NULL == (*list = grow(*list, *n, cap, sizeof ((*list)[0])))) {
+        return 0;
+    }
+    (*list)[*n].verb = verb;
+    (*list)[*n].word = word;
+    (*list)[*n].room = room;
+    (*list)[(*n)++].rule = 0;
+    return 1;
+}
+
+
+/*
+ * index_rules
+ *   DESCRIPTION: Builds the keys through which the game finds rules.  The
+ *                listings are grouped by key, and every key that the game
+ *                may look up first is given the whole list of rules that
+ *                apply to it, in source order: a word in a room is also
+ *                given the rules for that word anywhere and for any word
+ *                in that room, and so on.  A key is thus made for each
+ *                group, for each word of a group anywhere, and for each
+ *                word of a verb in each room with rules for any word.
+ *   INPUTS: refs -- the listings, sorted(compare_refs) without repeats
+ *           n_refs -- number of listings
+ *   OUTPUTS: *keys -- key records, sorted(dynamically allocated)
+ *            *n_keys -- number of key records
+ *            *krefs -- reference records, by key(dynamically allocated)
+ *            *n_krefs -- number of reference records
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t index_rules(const rule_ref_t* refs, int32_t n_refs,
+                           world_file_key_t** keys, int32_t* n_keys,
+                           world_file_ref_t** krefs, int32_t* n_krefs) {
+    rule_ref_t*        group;    /* keys of listings; rule is first */
+    rule_ref_t*        cand;     /* keys to make                    */
+    rule_ref_t         probe;    /* key being looked for            */
+    const rule_ref_t*  g;        /* group found                     */
+    world_file_key_t*  k;        /* key records                     */
+    world_file_ref_t*  kr;       /* reference records               */
+    int32_t            head[4];  /* next listing of each merged group */
+    int32_t            end[4];   /* end of each merged group        */
+    int32_t            n_groups; /* groups of listings              */
+    int32_t            n_cand, cand_cap; /* keys to make            */
+    int32_t            n_k, k_cap;       /* key records             */
+    int32_t            n_kr, kr_cap;     /* reference records       */
+    int32_t            i, j;     /* loop indices                    */
+    int32_t            m;        /* merged group with least rule    */
+    uint32_t           last;     /* rule last added to a list       */
+
+    /* Group the listings by key. */
+    if (NULL == (group = malloc((n_refs + 1) * sizeof (group[0])))) {
+        perror("allocate rule index");
+        return 0;
+    }
+    for (i = n_groups = 0; n_refs > i; i++) {
+        if (0 == n_groups || 0 != compare_keys(&group[n_groups - 1], &refs[i])) {
+            group[n_groups] = refs[i];
+            group[n_groups++].rule = i;
+        }
+    }
+
+    /*
+     * List the keys to make: each group's own, its word anywhere, and,
+     * for a room with rules for any word, each word of the verb there.
+     */
+    cand = NULL;
+    n_cand = cand_cap = 0;
+    for (i = 0; n_groups > i; i++) {
+        g = &group[i];
+        if (!add_key(&cand, &n_cand, &cand_cap, g->verb, g->word, g->room) ||
+            (RULE_ANY != g->word && RULE_ANY != g->room &&
+             !add_key(&cand, &n_cand, &cand_cap, g->verb, g->word, RULE_ANY))) {
+            return 0;
+        }
+        if (RULE_ANY != g->word || RULE_ANY == g->room) {
+            continue;
+        }
+        for (j = i + 1; n_groups > j && g->verb == group[j].verb; j++) {
+            if (RULE_ANY != group[j].word &&
+                !add_key(&cand, &n_cand, &cand_cap, g->verb, group[j].word, g->room)) {
+                return 0;
+            }
+        }
+    }
+    qsort(cand, n_cand, sizeof (cand[0]), compare_keys);
+
+    /* Merge the lists of the groups that apply to each key(if any do). */
+    k = NULL;
+    kr = NULL;
+    n_k = k_cap = n_kr = kr_cap = 0;
+    for (i = 0; n_cand > i; i++) {
+        if (0 < i && 0 == compare_keys(&cand[i - 1], &cand[i])) {
+            continue;
+        }
+        for (j = 0; 4 > j; j++) {
+            probe = cand[i];
+            probe.word = (j & 1 ? RULE_ANY : probe.word);
+            probe.room = (j & 2 ? RULE_ANY : probe.room);
+            g = bsearch(&probe, group, n_groups, sizeof (group[0]), compare_keys);
+            head[j] = end[j] = 0;
+            if (NULL != g) {
+                head[j] = g->rule;
+                end[j] = (group + n_groups - 1 == g ? n_refs : (int32_t)g[1].rule);
+            }
+        }
+        if (NULL == (k = grow(k, n_k, &k_cap, sizeof (k[0])))) {
+            return 0;
+        }
+        k[n_k].verb = cand[i].verb;
+        k[n_k].word = cand[i].word;
+        k[n_k].room = cand[i].room;
+        k[n_k].ref = n_kr;
+        k[n_k].n_refs = 0;
+        for (last = 0; 1; k[n_k].n_refs++) {
+            for (j = 0, m = -1; 4 > j; j++) {
+                while (end[j] > head[j] && 0 < k[n_k].n_refs && last >= refs[head[j]].rule) {
+                    head[j]++;
+                }
+                if (end[j] > head[j] && (-1 == m || refs[head[j]].rule < refs[head[m]].rule)) {
+                    m = j;
+                }
+            }
+            if (-1 == m) {
+                break;
+            }
+            if (NULL == (kr = grow(kr, n_kr, &kr_cap, sizeof (kr[0])))) {
+                return 0;
+            }
+            kr[n_kr++].rule = last = refs[head[m]++].rule;
+        }
+        if (0 < k[n_k].n_refs) {
+            n_k++;
+        }
+    }
+    free(group);
+    free(cand);
+    *keys = k;
+    *n_keys = n_k;
+    *krefs = kr;
+    *n_krefs = n_kr;
+    return 1;
+}
+
+
+/*
+ * compare_buckets
+ *   DESCRIPTION: Orders buckets of a hash by decreasing size(for
+ *                qsort).
+ *   INPUTS: a, b -- pointers to the bucket indices
+ *   OUTPUTS: none
+ *   RETURN VALUE: negative if a goes first, positive if b goes first
+ *   SIDE EFFECTS: none
+ */
+static int compare_buckets(const void* a, const void* b) {
+    int32_t i = *(const int32_t*)a; /* first bucket  */
+    int32_t j = *(const int32_t*)b; /* second bucket */
+
+    return (bucket_first[j + 1] - bucket_first[j]) -
+           (bucket_first[i + 1] - bucket_first[i]);
+}
+
+
+/*
+ * make_hash
+ *   DESCRIPTION: Generates a perfect hash of the words: no two
+ *                share a slot of the table.  They are spread over buckets
+ *                by their hash, and then the buckets, largest first, are
+ *                each given the first displacement that moves all of
+ *                their members into free slots.  The table starts at
+ *                twice the number of members and is doubled until this
+ *                succeeds.
+ *   INPUTS: h -- the hash of each member(all different)
+ *           n_words -- number of members
+ *           what -- what the members are(for error messages)
+ *   OUTPUTS: *table -- the hash records(dynamically allocated)
+ *            *size -- number of hash records
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t make_hash(const uint64_t* h, int32_t n_words, const char* what,
+                         world_file_hash_t** table, uint32_t* size) {
+    world_file_hash_t* t;        /* hash records                  */
+    int32_t*           member;   /* words, grouped by bucket      */
+    int32_t*           first;    /* first member of each bucket   */
+    int32_t*           order;    /* buckets, largest first        */
+    uint32_t           sz;       /* table size being tried        */
+    uint32_t           b;        /* loop index over buckets       */
+    uint32_t           d;        /* displacement being tried      */
+    int32_t            i;        /* loop index over words         */
+    int32_t            k;        /* bucket being placed           */
+    int32_t            n;        /* words in bucket being placed  */
+
+    for (sz = 16; sz < 2 * (uint32_t)n_words; sz *= 2) { }
+    if (NULL == (member = malloc((n_words + 1) * sizeof (member[0])))) {
+        perror("allocate hash");
+        return 0;
+    }
+
+    for (; MAX_HASH >= sz; sz *= 2) {
+        t = malloc(sz * sizeof (t[0]));
+        first = calloc(sz + 1, sizeof (first[0]));
+        order = malloc(sz * sizeof (order[0]));
+        if (NULL == t || NULL == first || NULL == order) {
+            perror("allocate hash");
+            return 0;
+        }
+
+        /* Group the words by bucket: bucket b holds first[b] to first[b + 1] - 1. */
+        for (i = 0; n_words > i; i++) {
+            first[HASH_BUCKET(h[i], sz)]++;
+        }
+        for (b = 1; sz > b; b++) {
+            first[b] += first[b - 1];
+        }
+        first[sz] = n_words;
+        for (i = 0; n_words > i; i++) {
+            member[--first[HASH_BUCKET(h[i], sz)]] = i;
+        }
+        for (b = 0; sz > b; b++) {
+            order[b] = b;
+            t[b].disp = 0;
+            t[b].id = -1;
+        }
+        bucket_first = first;
+        qsort(order, sz, sizeof (order[0]), compare_buckets);
+
+        /* Place the buckets, stopping at the first empty one. */
+        for (b = 0; sz > b; b++) {
+            k = order[b];
+            if (0 == (n = first[k + 1] - first[k])) {
+                break;
+            }
+            for (d = 0; MAX_DISP > d; d++) {
+                for (i = 0; n > i && -1 == t[HASH_SLOT(h[member[first[k] + i]], d, sz)].id; i++) {
+                    t[HASH_SLOT(h[member[first[k] + i]], d, sz)].id = member[first[k] + i];
+                }
+                if (n == i) {
+                    break;
+                }
+                while (0 < i--) {
+                    t[HASH_SLOT(h[member[first[k] + i]], d, sz)].id = -1;
+                }
+            }
+            if (MAX_DISP == d) {
+                break;
+            }
+            t[k].disp = d;
+        }
+        free(first);
+        free(order);
+        if (sz == b || 0 == n) {
+            free(member);
+            *table = t;
+            *size = sz;
+            return 1;
+        }
+        free(t);
+    }
+
+    fprintf(stderr, "%s: cannot make a perfect hash of the %s\n", src_name, what);
+    return 0;
+}
+
+
+/*
+ * add_string
+ *   DESCRIPTION: Appends a string to the output string table.
+ *   INPUTS: s -- the string
+ *   OUTPUTS: none
+ *   RETURN VALUE: offset of the string in the table, or -1 on failure
+ *   SIDE EFFECTS: prints an error message on failure
+ */
+static int32_t add_string(const char* s) {
+    int32_t len;  /* length of string including NUL */
+    int32_t off;  /* offset of string               */
+
+    len = strlen(s) + 1;
+    while (str_size + len > str_cap) {
+        if (NULL == (strings = grow(strings, str_cap, &str_cap, 1))) {
+            return -1;
+        }
+    }
+    off = str_size;
+    memcpy(strings + off, s, len);
+    str_size += len;
+    return off;
+}
+
+
+/*
+ * write_world
+ *   DESCRIPTION: Assigns identifiers to all rooms, objects, and words,
+ *                resolves their references, hashes the words, compiles
+ *                and indexes the rules, and writes the binary world file.
+ *   INPUTS: out -- the output file
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: prints error messages to stderr on failure
+ */
+static int32_t write_world(FILE* out) {
+    world_file_header_t hdr;    /* file header                */
+    world_file_room_t*  rooms;  /* room records, by id        */
+    world_file_obj_t*   objs;   /* object records, by id      */
+    world_file_swap_t   swaps[N_SWAPS]; /* swap records       */
+    world_file_word_t*  words;  /* word records, by id        */
+    world_file_hash_t*  hash;   /* word hash records          */
+    uint32_t            hash_size;      /* hash records       */
+    const char**        word;   /* words, by id               */
+    world_file_rule_t*  rules;  /* rule records, by id        */
+    rule_ref_t*         refs;   /* rule listings, by key      */
+    world_file_key_t*   keys;   /* key records, sorted        */
+    world_file_ref_t*   krefs;  /* reference records, by key  */
+    uint64_t*           h;      /* hash of each word          */
+    int32_t             n_refs;         /* rule listings      */
+    int32_t             n_keys;         /* keys so far        */
+    int32_t             verb;           /* verb of a rule     */
+    int32_t             room;           /* room of a rule     */
+    const char*         w;              /* word of a rule     */
+    int32_t             n_rooms;        /* rooms so far       */
+    int32_t             n_objs;         /* objects so far     */
+    int32_t             n_words;        /* words so far       */
+    int32_t             i, j;           /* loop indices       */
+    symbol_t*           s;              /* symbol table entry */
+    room_line_t*        r;              /* room being written */
+    obj_line_t*         o;              /* object being written */
+    int32_t             id;             /* identifier         */
+
+    /* Enter the names from world_ids.h, then number the other symbols. */
+    if (!init_table(&room_syms, N_NAMED_ROOMS + n_room_lines) ||
+        !init_table(&obj_syms, N_NAMED_OBJECTS + n_obj_lines)) {
+        return 0;
+    }
+    for (i = 0; N_NAMED_ROOMS > i; i++) {
+        s = lookup(&room_syms, named_room[i]);
+        s->sym = named_room[i];
+        s->id = i;
+    }
+    for (i = 0; N_NAMED_OBJECTS > i; i++) {
+        s = lookup(&obj_syms, named_obj[i]);
+        s->sym = named_obj[i];
+        s->id = i;
+    }
+    n_rooms = N_NAMED_ROOMS;
+    for (i = 0; n_room_lines > i; i++) {
+        s = lookup(&room_syms, room_line[i].sym);
+        if (NULL == s->sym) {
+            s->sym = room_line[i].sym;
+            s->id = n_rooms++;
+        } else if (s->defined) {
+            fprintf(stderr, "%s:%d: duplicate room %s\n", src_name, room_line[i].line, s->sym);
+            return 0;
+        }
+        s->defined = 1;
+    }
+    n_objs = N_NAMED_OBJECTS;
+    for (i = 0; n_obj_lines > i; i++) {
+        s = lookup(&obj_syms, obj_line[i].sym);
+        if (NULL == s->sym) {
+            s->sym = obj_line[i].sym;
+            s->id = n_objs++;
+        } else if (s->defined) {
+            fprintf(stderr, "%s:%d: duplicate object %s\n", src_name, obj_line[i].line, s->sym);
+            return 0;
+        }
+        s->defined = 1;
+    }
+
+    /*
+     * Enter the words from world_ids.h, then number the other keywords
+     * and the words of rules.
+     */
+    if (!init_table(&word_syms, N_NAMED_WORDS + n_obj_lines + n_rule_words)) {
+        return 0;
+    }
+    if (NULL == (word = malloc((N_NAMED_WORDS + n_obj_lines + n_rule_words) * sizeof (word[0])))) {
+        perror("allocate words");
+        return 0;
+    }
+    for (i = 0; N_NAMED_WORDS > i; i++) {
+        s = lookup(&word_syms, named_word[i]);
+        s->sym = word[i] = named_word[i];
+        s->id = i;
+    }
+    n_words = N_NAMED_WORDS;
+    for (i = 0; n_obj_lines > i; i++) {
+        s = lookup(&word_syms, obj_line[i].name);
+        if (NULL == s->sym) {
+            s->sym = word[n_words] = obj_line[i].name;
+            s->id = n_words++;
+        }
+    }
+    for (i = 0; n_rule_lines > i; i++) {
+        for (j = 0, w = rule_line[i].words; rule_line[i].n_words > j; j++, w += strlen(w) + 1) {
+            s = lookup(&word_syms, w);
+            if (0 != strcmp(w, "*") && NULL == s->sym) {
+                s->sym = word[n_words] = w;
+                s->id = n_words++;
+            }
+        }
+    }
+
+    /* Every name used by the game logic must be defined. */
+    for (i = 0; N_NAMED_ROOMS > i; i++) {
+        if (!lookup(&room_syms, named_room[i])->defined) {
+            fprintf(stderr, "%s: room %s is not defined\n", src_name, named_room[i]);
+            return 0;
+        }
+    }
+    for (i = 0; N_NAMED_OBJECTS > i; i++) {
+        if (!lookup(&obj_syms, named_obj[i])->defined) {
+            fprintf(stderr, "%s: object %s is not defined\n", src_name, named_obj[i]);
+            return 0;
+        }
+    }
+    for (i = 0; N_SWAPS > i; i++) {
+        if (NULL == swap_photo[i]) {
+            fprintf(stderr, "%s: swap %s is not defined\n", src_name, named_swap[i]);
+            return 0;
+        }
+    }
+    if (NULL == start_sym) {
+        fprintf(stderr, "%s: no start room\n", src_name);
+        return 0;
+    }
+
+    /* Build the records. */
+    rooms = calloc(n_rooms, sizeof (rooms[0]));
+    objs = calloc(n_objs, sizeof (objs[0]));
+    words = calloc(n_words, sizeof (words[0]));
+    if (NULL == rooms || NULL == objs || NULL == words) {
+        perror("allocate world records");
+        return 0;
+    }
+    for (i = 0; n_room_lines > i; i++) {
+        r = &room_line[i];
+        id = lookup(&room_syms, r->sym)->id;
+        if (0 > (rooms[id].name = add_string(r->name)) ||
+            0 > (rooms[id].photo = add_string(r->photo)) ||
+            !resolve_room(r->link[0], r->line, &rooms[id].left) ||
+            !resolve_room(r->link[1], r->line, &rooms[id].enter) ||
+            !resolve_room(r->link[2], r->line, &rooms[id].right)) {
+            return 0;
+        }
+    }
+    for (i = 0; n_obj_lines > i; i++) {
+        o = &obj_line[i];
+        id = lookup(&obj_syms, o->sym)->id;
+        if (0 > (objs[id].image = add_string(o->image)) ||
+            !resolve_room(o->room, o->line, &objs[id].room)) {
+            return 0;
+        }
+        objs[id].word = lookup(&word_syms, o->name)->id;
+        objs[id].x = o->x;
+        objs[id].y = o->y;
+    }
+    for (i = 0; n_words > i; i++) {
+        if (0 > (words[i].name = add_string(word[i]))) {
+            return 0;
+        }
+    }
+    if (NULL == (h = malloc((n_words + 1) * sizeof (h[0])))) {
+        perror("allocate hash");
+        return 0;
+    }
+    for (i = 0; n_words > i; i++) {
+        h[i] = WORD_HASH_INIT;
+        for (w = word[i]; '\0' != *w; w++) {
+            h[i] = WORD_HASH_STEP(h[i], *w);
+        }
+    }
+    if (!make_hash(h, n_words, "words", &hash, &hash_size)) {
+        return 0;
+    }
+    free(h);
+    for (j = 0; N_SWAPS > j; j++) {
+        if (0 > (swaps[j].photo = add_string(swap_photo[j]))) {
+            return 0;
+        }
+    }
+
+    /* Compile the rules, listing each under its verb, words, and room. */
+    rules = malloc((n_rule_lines + 1) * sizeof (rules[0]));
+    refs = malloc((n_rule_words + 1) * sizeof (refs[0]));
+    if (NULL == rules || NULL == refs) {
+        perror("allocate rules");
+        return 0;
+    }
+    for (i = n_refs = 0; n_rule_lines > i; i++) {
+        if (0 > (verb = find_name(rule_line[i].tok[0], named_verb, NUM_TC_VALUES))) {
+            fprintf(stderr, "%s:%d: unknown verb %s\n", src_name, rule_line[i].line, rule_line[i].tok[0]);
+            return 0;
+        }
+        if (!compile_rule(&rule_line[i], &rules[i], &room)) {
+            return 0;
+        }
+        for (j = 0, w = rule_line[i].words; rule_line[i].n_words > j; j++, w += strlen(w) + 1) {
+            refs[n_refs].verb = verb;
+            refs[n_refs].word = (0 == strcmp(w, "*") ? RULE_ANY : lookup(&word_syms, w)->id);
+            refs[n_refs].room = room;
+            refs[n_refs++].rule = i;
+        }
+    }
+
+    /* Sort the listings(dropping repeated words), then index them. */
+    qsort(refs, n_refs, sizeof (refs[0]), compare_refs);
+    for (i = j = 0; n_refs > i; i++) {
+        if (0 == j || 0 != compare_refs(&refs[j - 1], &refs[i])) {
+            refs[j++] = refs[i];
+        }
+    }
+    if (!index_rules(refs, j, &keys, &n_keys, &krefs, &n_refs)) {
+        return 0;
+    }
+
+    hdr.magic = WORLD_FILE_MAGIC;
+    hdr.version = WORLD_FILE_VERSION;
+    hdr.n_named_rooms = N_NAMED_ROOMS;
+    hdr.n_named_objects = N_NAMED_OBJECTS;
+    hdr.n_named_words = N_NAMED_WORDS;
+    hdr.n_flags = NUM_FLAGS;
+    hdr.n_verbs = NUM_TC_VALUES;
+    hdr.n_swaps = N_SWAPS;
+    hdr.n_rooms = n_rooms;
+    hdr.n_objects = n_objs;
+    hdr.n_words = n_words;
+    hdr.hash_size = hash_size;
+    hdr.n_rules = n_rule_lines;
+    hdr.n_conds = n_conds;
+    hdr.n_effects = n_effects;
+    hdr.n_keys = n_keys;
+    hdr.n_refs = n_refs;
+    if (!resolve_room(start_sym, start_line, &hdr.start)) {
+        return 0;
+    }
+    if (R_NONE == hdr.start) {
+        fprintf(stderr, "%s:%d: no start room\n", src_name, start_line);
+        return 0;
+    }
+    hdr.str_size = str_size;
+
+    if (1 != fwrite(&hdr, sizeof (hdr), 1, out) ||
+        n_rooms != fwrite(rooms, sizeof (rooms[0]), n_rooms, out) ||
+        n_objs != fwrite(objs, sizeof (objs[0]), n_objs, out) ||
+        N_SWAPS != fwrite(swaps, sizeof (swaps[0]), N_SWAPS, out) ||
+        n_words != fwrite(words, sizeof (words[0]), n_words, out) ||
+        hash_size != fwrite(hash, sizeof (hash[0]), hash_size, out) ||
+        n_rule_lines != fwrite(rules, sizeof (rules[0]), n_rule_lines, out) ||
+        n_conds != fwrite(conds, sizeof (conds[0]), n_conds, out) ||
+        n_effects != fwrite(effects, sizeof (effects[0]), n_effects, out) ||
+        n_keys != fwrite(keys, sizeof (keys[0]), n_keys, out) ||
+        n_refs != fwrite(krefs, sizeof (krefs[0]), n_refs, out) ||
+        str_size != fwrite(strings, 1, str_size, out)) {
+        perror("write world file");
+        return 0;
+    }
+    printf("%d rooms, %d objects, %d words(%u hash slots), %d rules(%d keys, "
+           "%d references), %d bytes of strings\n", n_rooms, n_objs, n_words,
+           hash_size, n_rule_lines, n_keys, n_refs, str_size);
+    return 1;
+}
+
+
+int main(int argc, char* argv[]) {
+    FILE*   in;
+    FILE*   out;
+    int32_t written;
+
+    // Check syntax of invocation.
+    if (3 != argc) {
+        fprintf(stderr, "usage: %s <world source> <world file>\n", argv[0]);
+        return 2;
+    }
+
+    // Read the whole source before touching the output file.
+    if (NULL == (in = fopen(argv[1], "r"))) {
+        perror("open world source");
+        return 2;
+    }
+    src_name = argv[1];
+    if (!read_source(in, argv[1])) {
+        fclose(in);
+        return 2;
+    }
+    (void)fclose(in);
+
+    if (NULL == (out = fopen(argv[2], "wb"))) {
+        perror("open world file");
+        return 2;
+    }
+    written = write_world(out);
+    if (EOF == fclose(out)) {
+        perror("close world file");
+        written = 0;
+    }
+    if (!written) {
+        (void)remove(argv[2]);
+    }
+    return (written ? 0 : 3);
+}
@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       5
+ * Version:       13
  * Creation Date: Fri Sep 10 09:59:17 2004
  * Filename:      modex.c
  * History:
@@ -38,41 +38,103 @@
  *        Modified for MP2 F11 adventure game.
  *    SL    5    Sat Sep 14 16:13:20 2011
  *        Split fill_palette by mode and cleaned up code for release.
+ *          6
+ *        Added linear framebuffer display for machines without VGA.
+ *          7
+ *        Added per-phase timing.
+ *          8
+ *        Status bar written where the split screen shows it.
+ *          9
+ *        Added a cache of lines pre-rendered just outside the view.
+ *          10
+ *        Added a test comparing serial and parallel room redraws.
+ *          11
+ *        Moved the view window into render contexts that share the frame.
+ *          12
+ *        Made the parallel redraw test a build flag, with a Makefile target.
+ *          13
+ *        Added a test comparing planar object drawing with line drawing.
  */
 
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/io.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include "fbdev.h"
 #include "modex.h"
 #include "text.h"
+#include "timing.h"
+
+
+/*
+ * If MODEX_USE_VGA is 0(as "make NO_VGA=1" builds), the VGA port accesses
+ * are compiled out (they are written for 32-bit x86), and frames are
+ * always presented through the framebuffer backend in fbdev.c.
+ * Otherwise, the display is chosen when the program starts by the
+ * MP2_DISPLAY environment variable: "vga" uses only the VGA, "fb" uses
+ * only /dev/fb0, and "mem" presents into memory without any display.  By
+ * default, the VGA is tried first, then the framebuffer.  If /dev/fb0
+ * cannot be used, fb_open says so and presents into memory.
+ */
+#ifndef MODEX_USE_VGA
+#define MODEX_USE_VGA 1
+#endif
+
+/*
+ * set to 1 and link with arena.o loader.o photo.o world.o workers.o
+ * fbdev.o text.o timing.o assert.o(instead of adventure.o) to check that
+ * room views redrawn by the worker threads match those drawn serially
+ * (see the test-redraw target in the Makefile)
+ */
+#ifndef TEST_PARALLEL_REDRAW
+#define TEST_PARALLEL_REDRAW 0
+#endif
+
+/*
+ * set to 1 and link as for TEST_PARALLEL_REDRAW to check that objects
+ * drawn into the planes by draw_planar_image match, byte for byte, those
+ * drawn line by line with the room photo(see the test-planar target in
+ * the Makefile)
+ */
+#ifndef TEST_PLANAR_IMAGE
+#define TEST_PLANAR_IMAGE 0
+#endif
+
+#if (TEST_PARALLEL_REDRAW == 1 || TEST_PLANAR_IMAGE == 1)
+#include "photo.h"
+#include "workers.h"
+#include "world.h"
+#endif
 
 
 /*
  * Calculate the image build buffer parameters. SCROLL_SIZE is the space
  * needed for one plane of an image. SCREEN_SIZE is the space needed for
- * all four planes. The extra +1 supports logical view x coordinates that
+ * all four planes(a render context smaller than the screen uses the same
+ * layout with its own dimensions). The extra +1 supports logical view x coordinates that
  * are not multiples of four. In these cases, some plane addresses are
  * shifted by 1 byte forward. The planes are stored in the build buffer
  * in reverse order to allow those planes that shift forward to do so
  * without running into planes that aren't shifted. For example, when
  * the leftmost x pixel in the logical view is 3 mod 4, planes 2, 1, and 0
  * are shifted forward, while plane 3 is not, so there is one unused byte
- * between the image of plane 3 and that of plane 2. BUILD_BUF_SIZE is
- * the size of the space allocated for building images. We add 20000 bytes
- * to reduce the number of memory copies required during scrolling.
- * Strictly speaking(try it), no extra space is necessary, but the minimum
- * means an extra 64kB memory copy with every scroll pixel. Finally,
- * BUILD_BASE_INIT places initial(or transferred) logical view in the
- * middle of the available buffer area.
+ * between the image of plane 3 and that of plane 2. The space allocated
+ * for building images adds BUILD_SLACK bytes to reduce the number of
+ * memory copies required during scrolling. Strictly speaking(try it), no
+ * extra space is necessary, but the minimum means an extra 64kB memory
+ * copy with every scroll pixel. The initial(or transferred) logical view
+ * is placed in the middle of the available buffer area.
  */
 #define SCROLL_SIZE        (SCROLL_X_WIDTH * SCROLL_Y_DIM)
 #define SCREEN_SIZE        (SCROLL_SIZE * 4 + 1)
-#define BUILD_BUF_SIZE     (SCREEN_SIZE + 20000)
-#define BUILD_BASE_INIT    ((BUILD_BUF_SIZE - SCREEN_SIZE) / 2)
+#define BUILD_SLACK        20000
+
+/* most render contexts that may exist at once */
+#define MAX_RENDER_CTXS    4
 
 #define STATUS_SIZE        (STATUS_X_WIDTH * STATUS_Y_DIM)
 #define PLANE_SIZE         (IMAGE_X_WIDTH * IMAGE_Y_DIM)
@@ -132,6 +194,31 @@ static unsigned short text_graphics[NUM_GRAPHICS_REGS] = {
 };
 
 
+#ifndef TEXT_RESTORE_PROGRAM
+/*
+ * Lines just outside the logical view window can be drawn ahead of time
+ * (see prefill_margin_line) into a cache of MARGIN_LINES rows above and
+ * below the window and as many columns to its left and right.  They
+ * can't be kept in the build buffer itself: the pixels just outside the
+ * window in one plane share addresses with pixels inside the window in
+ * another row or plane.  A row is stored with the logical coordinates
+ * (x,y) of its leftmost pixel, and a column with those of its top pixel,
+ * so a cached line is used only if the view has not since moved across
+ * it.  Everything cached is discarded whenever the room contents may
+ * have changed.
+ */
+#define MARGIN_LINES 8
+#else
+#define MARGIN_LINES 1
+#endif
+
+typedef struct {
+    int valid;                       /* holds a line                 */
+    int x, y;                        /* logical coords of first pixel */
+    unsigned char pix[SCROLL_X_DIM]; /* line image(columns use the
+                                        first SCROLL_Y_DIM bytes)    */
+} margin_line_t;
+
 /* local functions--see function headers for details */
 static int open_memory_and_ports();
 static void VGA_blank(int blank_bit);
@@ -144,13 +231,21 @@ static void fill_palette_text();
 static void write_font_data();
 static void set_text_mode_3(int clear_scr);
 static void copy_image(unsigned char* img, unsigned short scr_addr);
+static void check_fences(const render_ctx_t* ctx);
+static void get_planes(const render_ctx_t* ctx, const unsigned char* plane[4]);
+#ifndef TEXT_RESTORE_PROGRAM
+static margin_line_t* find_margin(margin_line_t* cache, int x, int y);
+static int margin_needed(const render_ctx_t* ctx, const margin_line_t* line, int horiz);
+static int prefill_line(render_ctx_t* ctx, margin_line_t* cache, int horiz, int x, int y);
+#endif
 
 /*Function that writes the current status and information into the status bar*/
 void fill_status_bar(char * string);
 
 
 /*
- * Images are built in this buffer, then copied to the video memory.
+ * Images are built in the build buffer of a render context, then copied
+ * to the video memory.
  * Copying to video memory with REP MOVSB is vastly faster than anything
  * else with emulation, probably because it is a single instruction
  * and translates to a native loop. It's also a pretty good technique
@@ -168,8 +263,16 @@ void fill_status_bar(char * string);
  * with plane 1 when plane 0 was offset by 1 from plane 1, i.e., when
  * displaying a one-pixel left shift.
  *
+ * Each render context has its own build buffer, view window, lines
+ * drawn ahead(see prefill_margin_line), and functions for getting the
+ * images of lines, which are passed the context's argument.  A context
+ * covers a rectangle of the frame, and show_screen copies every visible
+ * context to its rectangle, later contexts on top, so(for example) a
+ * small view can be shown within a larger one.  Each context scrolls
+ * independently, drawing only the lines that it exposes.
+ *
  * The memory fence(included when NDEBUG is not defined) allocates
- * the build buffer with extra space on each side. The extra space
+ * each build buffer with extra space on each side. The extra space
  * is filled with magic numbers(something unlikely to be written in
  * error), and the fence areas are checked for those magic values at
  * the end of the program to detect array access bugs(writes past
@@ -181,24 +284,48 @@ void fill_status_bar(char * string);
 #define MEM_FENCE_WIDTH 0
 #endif
 #define MEM_FENCE_MAGIC 0xF3
-static unsigned char build[BUILD_BUF_SIZE + 2 * MEM_FENCE_WIDTH];
-static int img3_off;            /* offset of upper left pixel  */
-static unsigned char* img3;     /* pointer to upper left pixel */
-static int show_x, show_y;      /* logical view coordinates    */
+struct render_ctx_t {
+    int frame_x, frame_y;    /* frame position of upper left pixel     */
+    int width, height;       /* size of view window in pixels          */
+    int x_width;             /* bytes in one row of a plane            */
+    int plane_size;          /* bytes in one plane                     */
+    int buf_size;            /* size of build buffer(without fences)   */
+    int base_init;           /* offset that centers the view in buffer */
+    unsigned char* build;    /* build buffer(with fences)              */
+    int img3_off;            /* offset of upper left pixel             */
+    unsigned char* img3;     /* pointer to upper left pixel            */
+    int show_x, show_y;      /* logical view coordinates               */
+    int visible;             /* shown by show_screen                   */
+
+    /*
+     * functions provided by the creator of the context and used to
+     * obtain graphic images of lines(pixels) to be mapped into the build
+     * buffer planes for display in mode X
+     */
+    line_fn_t horiz_line_fn;
+    line_fn_t vert_line_fn;
+    void* line_arg;
+
+    margin_line_t margin_row[2 * MARGIN_LINES]; /* rows above and below   */
+    margin_line_t margin_col[2 * MARGIN_LINES]; /* columns left and right */
+    int view_limit_x, view_limit_y; /* logical image size(0 if unknown)    */
+};
+
+/* render contexts in the order shown(later ones on top) */
+static render_ctx_t* ctx_list[MAX_RENDER_CTXS];
+static int n_ctxs = 0;
+
+/* the frame is combined here, plane by plane, when contexts overlap */
+static unsigned char frame[4][PLANE_SIZE];
 
 /* displayed video memory variables */
 static unsigned char* mem_image;    /* pointer to start of video memory */
 static unsigned short target_img;   /* offset of displayed screen image */
+static int use_fb;                  /* frames go to fbdev, not the VGA  */
 
 
-/*
- * functions provided by the caller to set_mode_X() and used to obtain
- * graphic images of lines(pixels) to be mapped into the build buffer
- * planes for display in mode X
- */
-static void(*horiz_line_fn)(int, int, unsigned char[SCROLL_X_DIM]);
-static void(*vert_line_fn)(int, int, unsigned char[SCROLL_Y_DIM]);
 
+#if (MODEX_USE_VGA == 1)
 
 /*
  * macro used to target a specific video plane or planes when writing
@@ -278,53 +405,55 @@ do {                                                    \
     );                                                  \
 } while (0)
 
+#else /* MODEX_USE_VGA == 0 */
+
+/* without VGA support, port accesses do nothing */
+#define SET_WRITE_MASK(mask_hi_bits)        do { } while (0)
+#define OUTB(port, val)                     do { } while (0)
+#define OUTW(port, val)                     do { } while (0)
+#define REP_OUTSW(port, source, count)      do { (void)(source); } while (0)
+#define REP_OUTSB(port, source, count)      do { (void)(source); } while (0)
+
+#endif /* MODEX_USE_VGA */
+
 
 /*
  * set_mode_X
- *     DESCRIPTION: Puts the VGA into mode X.
- *     INPUTS: horiz_fill_fn -- this function is used as a callback(by
- *                              draw_horiz_line) to obtain a graphical
- *                              image of a particular logical line for
- *                              drawing to the build buffer
- *             vert_fill_fn -- this function is used as a callback(by
- *                             draw_vert_line) to obtain a graphical
- *                             image of a particular logical line for
- *                             drawing to the build buffer
+ *     DESCRIPTION: Puts the VGA into mode X.  Nothing is drawn until a
+ *                  render context is made(see new_render_ctx).
+ *     INPUTS: none
  *     OUTPUTS: none
  *     RETURN VALUE: 0 on success, -1 on failure
- *     SIDE EFFECTS: initializes the logical view window; maps video memory
- *                   and obtains permission for VGA ports; clears video memory
+ *     SIDE EFFECTS: maps video memory and obtains permission for VGA
+ *                   ports(or opens the framebuffer instead); clears video
+ *                   memory
  */
-int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
-               void(*vert_fill_fn)(int, int, unsigned char[SCROLL_Y_DIM])) {
-    int i; /* loop index for filling memory fence with magic numbers */
-
-    /*
-     * Record callback functions for obtaining horizontal and vertical
-     * line images.
-     */
-    if (horiz_fill_fn == NULL || vert_fill_fn == NULL)
-        return -1;
-    horiz_line_fn = horiz_fill_fn;
-    vert_line_fn = vert_fill_fn;
-
-    /* Initialize the logical view window to position(0,0). */
-    show_x = show_y = 0;
-    img3_off = BUILD_BASE_INIT;
-    img3 = build + img3_off + MEM_FENCE_WIDTH;
-
-    /* Set up the memory fence on the build buffer. */
-    for (i = 0; i < MEM_FENCE_WIDTH; i++) {
-        build[i] = MEM_FENCE_MAGIC;
-        build[BUILD_BUF_SIZE + MEM_FENCE_WIDTH + i] = MEM_FENCE_MAGIC;
-    }
+int set_mode_X() {
+    char* display;  /* display requested through the environment */
 
     /* One display page goes at the start of video memory. */
     target_img = 0x0000;
 
-    /* Map video memory and obtain permission for VGA port access. */
-    if (open_memory_and_ports() == -1)
-        return -1;
+    /*
+     * Pick the display.  Without an explicit choice, fall back to the
+     * framebuffer if the VGA is not accessible.
+     */
+    display = getenv("MP2_DISPLAY");
+    use_fb = (MODEX_USE_VGA == 0 ||
+              (display != NULL && strcmp(display, "vga") != 0));
+    if (!use_fb && open_memory_and_ports() == -1) {
+        if (display != NULL)
+            return -1;
+        use_fb = 1;
+    }
+    if (use_fb) {
+        if (fb_open(display == NULL || strcmp(display, "mem") != 0) == -1) {
+            perror("open framebuffer");
+            return -1;
+        }
+        fill_palette_mode_x();
+        return 0;
+    }
 
     /*
      * The code below was produced by recording a call to set mode 0013h
@@ -359,26 +488,192 @@ int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
  *     OUTPUTS: none
  *     RETURN VALUE: none
  *     SIDE EFFECTS: restores font data to video memory; clears screens;
- *                   unmaps video memory; checks memory fence integrity
+ *                   unmaps video memory(or closes the framebuffer);
+ *                   checks memory fence integrity of every render context
  */
 void clear_mode_X() {
-    int i;     /* loop index for checking memory fence */
+    int i;     /* loop index over render contexts */
 
-    /* Put VGA into text mode, restore font data, and clear screens. */
-    set_text_mode_3(1);
+    if (use_fb) {
+        /* Clear and release the framebuffer. */
+        fb_clear();
+        fb_close();
+    }
+    else {
+        /* Put VGA into text mode, restore font data, and clear screens. */
+        set_text_mode_3(1);
 
-    /* Unmap video memory. */
-    (void)munmap(mem_image, VID_MEM_SIZE);
+        /* Unmap video memory. */
+        (void)munmap(mem_image, VID_MEM_SIZE);
+    }
+
+    /* Check validity of build buffer memory fences. */
+    for (i = 0; i < n_ctxs; i++) {
+        check_fences(ctx_list[i]);
+    }
+}
 
-    /* Check validity of build buffer memory fence.    Report breakage. */
+
+/*
+ * new_render_ctx
+ *     DESCRIPTION: Makes a render context, which shows a view window of
+ *                  the given size at a position in the frame, on top of
+ *                  the contexts made before it.  The context is visible,
+ *                  with its logical view window at(0,0).
+ *     INPUTS:(frame_x,frame_y) -- frame position of the upper left pixel
+ *                                 (frame_x must be divisible by 4)
+ *            (width,height) -- size of the view window in pixels(width
+ *                              must be divisible by 4); the window must
+ *                              fit within the SCROLL_X_DIM by
+ *                              SCROLL_Y_DIM frame
+ *             horiz_fill_fn -- this function is used as a callback(by
+ *                              draw_horiz_line) to obtain a graphical
+ *                              image of a particular logical line for
+ *                              drawing to the build buffer
+ *             vert_fill_fn -- this function is used as a callback(by
+ *                             draw_vert_line) to obtain a graphical
+ *                             image of a particular logical line for
+ *                             drawing to the build buffer
+ *             arg -- argument passed to the callbacks
+ *     OUTPUTS: none
+ *     RETURN VALUE: the new context, or NULL on failure
+ *     SIDE EFFECTS: allocates the context and its build buffer
+ */
+render_ctx_t* new_render_ctx(int frame_x, int frame_y, int width, int height,
+                             line_fn_t horiz_fill_fn, line_fn_t vert_fill_fn, void* arg) {
+    render_ctx_t* ctx;  /* new context                                       */
+    int i;              /* loop index for filling memory fence with magic numbers */
+
+    if (horiz_fill_fn == NULL || vert_fill_fn == NULL || n_ctxs == MAX_RENDER_CTXS ||
+        frame_x < 0 || frame_y < 0 || width <= 0 || height <= 0 ||
+        (frame_x & 3) != 0 || (width & 3) != 0 ||
+        frame_x + width > SCROLL_X_DIM || frame_y + height > SCROLL_Y_DIM)
+        return NULL;
+    if ((ctx = calloc(1, sizeof(*ctx))) == NULL)
+        return NULL;
+
+    ctx->frame_x = frame_x;
+    ctx->frame_y = frame_y;
+    ctx->width = width;
+    ctx->height = height;
+    ctx->x_width = width / 4;
+    ctx->plane_size = ctx->x_width * height;
+    ctx->buf_size = ctx->plane_size * 4 + 1 + BUILD_SLACK;
+    ctx->base_init = BUILD_SLACK / 2;
+    if ((ctx->build = calloc(ctx->buf_size + 2 * MEM_FENCE_WIDTH, 1)) == NULL) {
+        free(ctx);
+        return NULL;
+    }
+
+    /*
+     * Record callback functions for obtaining horizontal and vertical
+     * line images.
+     */
+    ctx->horiz_line_fn = horiz_fill_fn;
+    ctx->vert_line_fn = vert_fill_fn;
+    ctx->line_arg = arg;
+
+    /* Initialize the logical view window to position(0,0). */
+    ctx->show_x = ctx->show_y = 0;
+    ctx->img3_off = ctx->base_init;
+    ctx->img3 = ctx->build + ctx->img3_off + MEM_FENCE_WIDTH;
+    ctx->visible = 1;
+
+    /* Set up the memory fence on the build buffer. */
     for (i = 0; i < MEM_FENCE_WIDTH; i++) {
-        if (build[i] != MEM_FENCE_MAGIC) {
+        ctx->build[i] = MEM_FENCE_MAGIC;
+        ctx->build[ctx->buf_size + MEM_FENCE_WIDTH + i] = MEM_FENCE_MAGIC;
+    }
+
+    ctx_list[n_ctxs++] = ctx;
+    return ctx;
+}
+
+
+/*
+ * free_render_ctx
+ *     DESCRIPTION: Frees a render context, which is no longer shown.
+ *     INPUTS: ctx -- the context
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: checks memory fence integrity; frees memory
+ */
+void free_render_ctx(render_ctx_t* ctx) {
+    int i;  /* loop index over render contexts */
+
+    for (i = 0; i < n_ctxs && ctx_list[i] != ctx; i++);
+    if (i == n_ctxs)
+        return;
+    for (n_ctxs--; i < n_ctxs; i++) {
+        ctx_list[i] = ctx_list[i + 1];
+    }
+    check_fences(ctx);
+    free(ctx->build);
+    free(ctx);
+}
+
+
+/*
+ * show_render_ctx
+ *     DESCRIPTION: Shows or hides a render context.  Drawing into a hidden
+ *                  context is allowed.
+ *     INPUTS: ctx -- the context
+ *             visible -- 1 to show the context, 0 to hide it
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: changes what later calls to show_screen display
+ */
+void show_render_ctx(render_ctx_t* ctx, int visible) {
+    ctx->visible = visible;
+}
+
+
+/*
+ * render_ctx_width
+ *     DESCRIPTION: Gets the width of a render context's view window.
+ *     INPUTS: ctx -- the context
+ *     OUTPUTS: none
+ *     RETURN VALUE: the width in pixels
+ *     SIDE EFFECTS: none
+ */
+int render_ctx_width(const render_ctx_t* ctx) {
+    return ctx->width;
+}
+
+
+/*
+ * render_ctx_height
+ *     DESCRIPTION: Gets the height of a render context's view window.
+ *     INPUTS: ctx -- the context
+ *     OUTPUTS: none
+ *     RETURN VALUE: the height in pixels
+ *     SIDE EFFECTS: none
+ */
+int render_ctx_height(const render_ctx_t* ctx) {
+    return ctx->height;
+}
+
+
+/*
+ * check_fences
+ *     DESCRIPTION: Checks that the memory fences around a render context's
+ *                  build buffer are intact.
+ *     INPUTS: ctx -- the context
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: reports breakage to stdout
+ */
+static void check_fences(const render_ctx_t* ctx) {
+    int i;     /* loop index for checking memory fence */
+
+    for (i = 0; i < MEM_FENCE_WIDTH; i++) {
+        if (ctx->build[i] != MEM_FENCE_MAGIC) {
             puts("lower build fence was broken");
             break;
         }
     }
     for (i = 0; i < MEM_FENCE_WIDTH; i++) {
-        if (build[BUILD_BUF_SIZE + MEM_FENCE_WIDTH + i] != MEM_FENCE_MAGIC) {
+        if (ctx->build[ctx->buf_size + MEM_FENCE_WIDTH + i] != MEM_FENCE_MAGIC) {
             puts("upper build fence was broken");
             break;
         }
@@ -395,13 +690,14 @@ void clear_mode_X() {
  *                  window that are within the new screen to the appropriate
  *                  new location, so only data not previously on the screen
  *                  must be drawn before calling show_screen.
- *     INPUTS:(scr_x,scr_y) -- new upper left pixel of logical view window
+ *     INPUTS: ctx -- the render context
+ *            (scr_x,scr_y) -- new upper left pixel of logical view window
  *     OUTPUTS: none
  *     RETURN VALUE: none
  *     SIDE EFFECTS: may shift position of logical view window within build
  *                   buffer
  */
-void set_view_window(int scr_x, int scr_y) {
+void set_view_window(render_ctx_t* ctx, int scr_x, int scr_y) {
     int old_x, old_y;       /* old position of logical view window                              */
     int start_x, start_y;   /* starting position for copying from old to new                    */
     int end_x, end_y;       /* ending position for copying from old to new                      */
@@ -410,22 +706,23 @@ void set_view_window(int scr_x, int scr_y) {
     int i;                  /* copy loop index                                                  */
     unsigned char* start_addr;      /* starting memory address of copy                          */
     unsigned char* target_addr;     /* destination memory address for copy                      */
+    uint64_t start_time;            /* time at which the copy started                           */
 
     /* Record the old position. */
-    old_x = show_x;
-    old_y = show_y;
+    old_x = ctx->show_x;
+    old_y = ctx->show_y;
 
     /* Keep track of the new view window. */
-    show_x = scr_x;
-    show_y = scr_y;
+    ctx->show_x = scr_x;
+    ctx->show_y = scr_y;
 
     /*
      * If the new view window fits within the boundaries of the build
      * buffer, we need move nothing around.
      */
-    if (img3_off + (scr_x >> 2) + scr_y * SCROLL_X_WIDTH >= 0 &&
-        img3_off + 3 * SCROLL_SIZE + ((scr_x + SCROLL_X_DIM - 1) >> 2) +
-        (scr_y + SCROLL_Y_DIM - 1) * SCROLL_X_WIDTH < BUILD_BUF_SIZE)
+    if (ctx->img3_off + (scr_x >> 2) + scr_y * ctx->x_width >= 0 &&
+        ctx->img3_off + 3 * ctx->plane_size + ((scr_x + ctx->width - 1) >> 2) +
+        (scr_y + ctx->height - 1) * ctx->x_width < ctx->buf_size)
         return;
 
     /*
@@ -433,10 +730,10 @@ void set_view_window(int scr_x, int scr_y) {
      * of the old data need to be saved, and we can simply reposition the
      * valid window of the build buffer in the middle of that buffer.
      */
-    if (scr_x <= old_x - SCROLL_X_DIM || scr_x >= old_x + SCROLL_X_DIM ||
-        scr_y <= old_y - SCROLL_Y_DIM || scr_y >= old_y + SCROLL_Y_DIM) {
-        img3_off = BUILD_BASE_INIT -(scr_x >> 2) - scr_y * SCROLL_X_WIDTH;
-        img3 = build + img3_off + MEM_FENCE_WIDTH;
+    if (scr_x <= old_x - ctx->width || scr_x >= old_x + ctx->width ||
+        scr_y <= old_y - ctx->height || scr_y >= old_y + ctx->height) {
+        ctx->img3_off = ctx->base_init -(scr_x >> 2) - scr_y * ctx->x_width;
+        ctx->img3 = ctx->build + ctx->img3_off + MEM_FENCE_WIDTH;
         return;
     }
 
@@ -459,7 +756,7 @@ void set_view_window(int scr_x, int scr_y) {
         start_x = old_x;
         end_x = scr_x;
     }
-    end_x += SCROLL_X_DIM - 1;
+    end_x += ctx->width - 1;
     if (scr_y > old_y) {
         start_y = scr_y;
         end_y = old_y;
@@ -468,7 +765,7 @@ void set_view_window(int scr_x, int scr_y) {
         start_y = old_y;
         end_y = scr_y;
     }
-    end_y += SCROLL_Y_DIM - 1;
+    end_y += ctx->height - 1;
 
     /*
      * We now calculate the starting and ending addresses for the copy
@@ -476,18 +773,19 @@ void set_view_window(int scr_x, int scr_y) {
      * length to be copied is basically the ending offset minus the starting
      * offset plus one(plus the three screens in between planes 3 and 0).
      */
-    start_off = (start_x >> 2) + start_y * SCROLL_X_WIDTH;
-    start_addr = img3 + start_off;
-    length = (end_x >> 2) + end_y * SCROLL_X_WIDTH + 1 - start_off + 3 * SCROLL_SIZE;
-    img3_off = BUILD_BASE_INIT -(show_x >> 2) - show_y * SCROLL_X_WIDTH;
-    img3 = build + img3_off + MEM_FENCE_WIDTH;
-    target_addr = img3 + start_off;
+    start_off = (start_x >> 2) + start_y * ctx->x_width;
+    start_addr = ctx->img3 + start_off;
+    length = (end_x >> 2) + end_y * ctx->x_width + 1 - start_off + 3 * ctx->plane_size;
+    ctx->img3_off = ctx->base_init -(ctx->show_x >> 2) - ctx->show_y * ctx->x_width;
+    ctx->img3 = ctx->build + ctx->img3_off + MEM_FENCE_WIDTH;
+    target_addr = ctx->img3 + start_off;
 
     /*
      * Copy the relevant portion of the screen from the old location to the
      * new one.    The areas may overlap, so copy direction is important.
      *(You should be able to explain why!)
      */
+    start_time = timing_now();
     if (start_addr < target_addr) {
         for (i = length; i-- > 0; ) {
             target_addr[i] = start_addr[i];
@@ -498,39 +796,85 @@ void set_view_window(int scr_x, int scr_y) {
             target_addr[i] = start_addr[i];
         }
     }
+    timing_add(TM_VIEW_COPY, start_time);
 }
 
 
 /*
  * show_screen
- *     DESCRIPTION: Show the logical view window on the video display.
+ *     DESCRIPTION: Show the logical view windows of the visible render
+ *                  contexts on the video display.  A single context that
+ *                  covers the whole frame is copied directly; otherwise,
+ *                  the contexts are first combined in the frame buffer,
+ *                  later ones on top.
  *     INPUTS: none
  *     OUTPUTS: none
  *     RETURN VALUE: none
- *     SIDE EFFECTS: copies from the build buffer to video memory;
+ *     SIDE EFFECTS: copies from the build buffers to video memory;
  *                   shifts the VGA display source to point to the new image
  */
 void show_screen() {
-    unsigned char* addr;    /* source address for copy             */
-    int p_off;              /* plane offset of first display plane */
+    const unsigned char* plane[4]; /* display planes                  */
+    const unsigned char* src[4];   /* display planes of one context   */
+    render_ctx_t* ctx = NULL; /* context being combined            */
+    int n_shown;            /* number of visible contexts          */
     int i;                  /* loop index over video planes        */
+    int j;                  /* loop index over contexts            */
+    int row;                /* loop index over rows of a context   */
+    uint64_t start_time;    /* time at which the copy started      */
+
+    start_time = timing_now();
+
+    for (j = n_shown = 0; j < n_ctxs; j++) {
+        if (ctx_list[j]->visible) {
+            ctx = ctx_list[j];
+            n_shown++;
+        }
+    }
+    if (n_shown == 0) {
+        timing_add(TM_SHOW, start_time);
+        return;
+    }
+
+    if (n_shown == 1 && ctx->width == SCROLL_X_DIM && ctx->height == SCROLL_Y_DIM) {
+        get_planes(ctx, plane);
+    }
+    else {
+        /* Copy each context's rows into its rectangle of the frame. */
+        for (j = 0; j < n_ctxs; j++) {
+            ctx = ctx_list[j];
+            if (!ctx->visible)
+                continue;
+            get_planes(ctx, src);
+            for (i = 0; i < 4; i++) {
+                for (row = 0; row < ctx->height; row++) {
+                    memcpy(frame[i] + (ctx->frame_y + row) * SCROLL_X_WIDTH + (ctx->frame_x >> 2),
+                           src[i] + row * ctx->x_width, ctx->x_width);
+                }
+            }
+        }
+        for (i = 0; i < 4; i++) {
+            plane[i] = frame[i];
+        }
+    }
 
     /*
-     * Calculate offset of build buffer plane to be mapped into plane 0
-     * of display.
+     * The framebuffer takes all four planes at once and has no pages
+     * to flip between.
      */
-    p_off = (3 - (show_x & 3));
+    if (use_fb) {
+        fb_draw_planar(0, SCROLL_Y_DIM, plane, SCROLL_X_WIDTH);
+        timing_add(TM_SHOW, start_time);
+        return;
+    }
 
     /* Switch to the other target screen in video memory. */
     target_img ^= 0x4000;
 
-    /* Calculate the source address. */
-    addr = img3 + (show_x >> 2) + show_y * SCROLL_X_WIDTH;
-
     /* Draw to each plane in the video memory. */
     for (i = 0; i < 4; i++) {
         SET_WRITE_MASK(1 << (i + 8));
-        copy_image(addr + ((p_off - i + 4) & 3) * SCROLL_SIZE + (p_off < i), target_img+(STATUS_SIZE));
+        copy_image((unsigned char*)plane[i], target_img+(STATUS_SIZE));
     }
 
     /*
@@ -545,6 +889,38 @@ void show_screen() {
 
     OUTW(0x03D4, ((target_img+STATUS_SIZE) & 0xFF00) | 0x0C);
     OUTW(0x03D4, (((target_img+STATUS_SIZE) & 0x00FF) << 8) | 0x0D);
+
+    timing_add(TM_SHOW, start_time);
+}
+
+
+/*
+ * get_planes
+ *     DESCRIPTION: Finds the display planes of a render context's logical
+ *                  view window in its build buffer.
+ *     INPUTS: ctx -- the render context
+ *     OUTPUTS: plane -- pointers to the first row of each display plane;
+ *                       rows are ctx->x_width bytes apart
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: none
+ */
+static void get_planes(const render_ctx_t* ctx, const unsigned char* plane[4]) {
+    const unsigned char* addr; /* source address for copy             */
+    int p_off;                 /* plane offset of first display plane */
+    int i;                     /* loop index over video planes        */
+
+    /*
+     * Calculate offset of build buffer plane to be mapped into plane 0
+     * of display.
+     */
+    p_off = (3 - (ctx->show_x & 3));
+
+    /* Calculate the source address. */
+    addr = ctx->img3 + (ctx->show_x >> 2) + ctx->show_y * ctx->x_width;
+
+    for (i = 0; i < 4; i++) {
+        plane[i] = addr + ((p_off - i + 4) & 3) * ctx->plane_size + (p_off < i);
+    }
 }
 
 
@@ -554,9 +930,15 @@ void show_screen() {
  *     INPUTS: none
  *     OUTPUTS: none
  *     RETURN VALUE: none
- *     SIDE EFFECTS: fills all 256kB of VGA video memory with zeroes
+ *     SIDE EFFECTS: fills all 256kB of VGA video memory with zeroes(or
+ *                   clears the framebuffer)
  */
 void clear_screens() {
+    if (use_fb) {
+        fb_clear();
+        return;
+    }
+
     /* Write to all four planes at once. */
     SET_WRITE_MASK(0x0F00);
 
@@ -614,12 +996,22 @@ void fill_status_bar(char * string){
       unsigned char buffer[STATUS_X_DIM][STATUS_Y_DIM];     /*The buffer containing the entire graphic*/
       char plane_buffer[STATUS_X_WIDTH][STATUS_Y_DIM];      /*The buffer holding the data relevant to only one plane*/
       int i;                  /*index variable, used for iterating through the planes*/
+      uint64_t start_time = timing_now();   /*time at which drawing started*/
 
       /*Convert the string into a graphics format and save it in buffer*/
       text2graphics((char *)string, (char *)buffer);
 
-      /*Calculate the write address - the beginning of the vid mem buffer that is yet to be shown on screen*/
-      write_addr = (char *)(mem_image + (target_img^0x4000));
+      /*The framebuffer shows the status bar below the scrolling image*/
+      if(use_fb){
+            fb_draw_chunky(SCROLL_Y_DIM, STATUS_Y_DIM, (unsigned char *)buffer, STATUS_X_DIM);
+            timing_add(TM_STATUS, start_time);
+            return;
+      }
+
+      /*The split screen always shows the status bar from the start of video
+       *memory, so it stays put across page flips and need only be written
+       *when it changes*/
+      write_addr = (char *)mem_image;
 
       /*Iterate through the planes and write the data to video memory*/
       for(i=0; i<4; i++){
@@ -631,6 +1023,7 @@ void fill_status_bar(char * string){
             memcpy(write_addr, plane_buffer, STATUS_SIZE);
       }
 
+      timing_add(TM_STATUS, start_time);
       return;
 }
 
@@ -644,49 +1037,224 @@ void fill_status_bar(char * string){
 #ifndef TEXT_RESTORE_PROGRAM
 
 
+/*
+ * set_view_limits
+ *     DESCRIPTION: Records the size of the logical image(the room photo),
+ *                  outside of which no lines are drawn ahead of time, and
+ *                  discards any lines already drawn ahead.
+ *     INPUTS: ctx -- the render context
+ *             (width,height) -- size of the logical image in pixels
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: none
+ */
+void set_view_limits(render_ctx_t* ctx, int width, int height) {
+    ctx->view_limit_x = width;
+    ctx->view_limit_y = height;
+    discard_margins(ctx);
+}
+
+
+/*
+ * discard_margins
+ *     DESCRIPTION: Discards all lines drawn ahead of time.  Must be called
+ *                  whenever the images produced by the line functions may
+ *                  have changed.
+ *     INPUTS: ctx -- the render context
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: none
+ */
+void discard_margins(render_ctx_t* ctx) {
+    int i; /* loop index over cached lines */
+
+    for (i = 0; i < 2 * MARGIN_LINES; i++) {
+        ctx->margin_row[i].valid = 0;
+        ctx->margin_col[i].valid = 0;
+    }
+}
+
+
+/*
+ * prefill_margin_line
+ *     DESCRIPTION: Draws one line just outside the logical view window
+ *                  into the margin cache, nearest lines first.  Lines
+ *                  outside the logical image are skipped.
+ *     INPUTS: ctx -- the render context
+ *     OUTPUTS: none
+ *     RETURN VALUE: 1 if a line was drawn(more may remain), or 0 if every
+ *                   margin line is already cached
+ *     SIDE EFFECTS: none
+ */
+int prefill_margin_line(render_ctx_t* ctx) {
+    int d; /* distance of line from view window */
+
+    for (d = 1; d <= MARGIN_LINES; d++) {
+        if (prefill_line(ctx, ctx->margin_row, 1, ctx->show_x, ctx->show_y - d) ||
+            prefill_line(ctx, ctx->margin_row, 1, ctx->show_x, ctx->show_y + ctx->height - 1 + d) ||
+            prefill_line(ctx, ctx->margin_col, 0, ctx->show_x - d, ctx->show_y) ||
+            prefill_line(ctx, ctx->margin_col, 0, ctx->show_x + ctx->width - 1 + d, ctx->show_y)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * prefill_line
+ *     DESCRIPTION: Draws one line into the margin cache unless it is
+ *                  already there or lies outside the logical image.  The
+ *                  line replaces one that is no longer just outside the
+ *                  view window.
+ *     INPUTS: ctx -- the render context
+ *             cache -- margin_row or margin_col
+ *             horiz -- 1 for a row, or 0 for a column
+ *             (x,y) -- logical coordinates of the line's first pixel
+ *     OUTPUTS: none
+ *     RETURN VALUE: 1 if the line was drawn, or 0 if not
+ *     SIDE EFFECTS: none
+ */
+static int prefill_line(render_ctx_t* ctx, margin_line_t* cache, int horiz, int x, int y) {
+    int i; /* loop index over cached lines */
+
+    if ((horiz ? (0 > y || ctx->view_limit_y <= y) : (0 > x || ctx->view_limit_x <= x)) ||
+        NULL != find_margin(cache, x, y)) {
+        return 0;
+    }
+
+    /* A line is missing, so at least one cached line is not needed. */
+    for (i = 0; margin_needed(ctx, &cache[i], horiz); i++);
+    cache[i].valid = 1;
+    cache[i].x = x;
+    cache[i].y = y;
+    if (horiz) {
+        (*ctx->horiz_line_fn)(ctx->line_arg, x, y, ctx->width, cache[i].pix);
+    }
+    else {
+        (*ctx->vert_line_fn)(ctx->line_arg, x, y, ctx->height, cache[i].pix);
+    }
+    return 1;
+}
+
+
+/*
+ * find_margin
+ *     DESCRIPTION: Looks up a line in the margin cache.
+ *     INPUTS: cache -- margin_row or margin_col
+ *             (x,y) -- logical coordinates of the line's first pixel
+ *     OUTPUTS: none
+ *     RETURN VALUE: the cached line, or NULL if it is not cached
+ *     SIDE EFFECTS: none
+ */
+static margin_line_t* find_margin(margin_line_t* cache, int x, int y) {
+    int i; /* loop index over cached lines */
+
+    for (i = 0; i < 2 * MARGIN_LINES; i++) {
+        if (cache[i].valid && x == cache[i].x && y == cache[i].y) {
+            return &cache[i];
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * margin_needed
+ *     DESCRIPTION: Checks whether a cached line is one of those just
+ *                  outside the current logical view window.
+ *     INPUTS: ctx -- the render context
+ *             line -- the cached line
+ *             horiz -- 1 for a row, or 0 for a column
+ *     OUTPUTS: none
+ *     RETURN VALUE: 1 if the line is needed, or 0 if it may be replaced
+ *     SIDE EFFECTS: none
+ */
+static int margin_needed(const render_ctx_t* ctx, const margin_line_t* line, int horiz) {
+    int lo, hi; /* first and last pixel of window along the line's axis */
+    int at;     /* position of the line along that axis                 */
+
+    if (!line->valid) {
+        return 0;
+    }
+    if (horiz) {
+        if (ctx->show_x != line->x) {
+            return 0;
+        }
+        at = line->y;
+        lo = ctx->show_y;
+        hi = ctx->show_y + ctx->height - 1;
+    }
+    else {
+        if (ctx->show_y != line->y) {
+            return 0;
+        }
+        at = line->x;
+        lo = ctx->show_x;
+        hi = ctx->show_x + ctx->width - 1;
+    }
+    return ((lo > at && lo - MARGIN_LINES <= at) ||
+            (hi < at && hi + MARGIN_LINES >= at));
+}
+
+
 /*
  * draw_vert_line
  *     DESCRIPTION: Draw a vertical map line into the build buffer. The
  *                  line should be offset from the left side of the logical
  *                  view window screen by the given number of pixels.
- *     INPUTS: x -- the 0-based pixel column number of the line to be drawn
+ *     INPUTS: ctx -- the render context
+ *             x -- the 0-based pixel column number of the line to be drawn
  *                  within the logical view window (equivalent to the number
  *                  of pixels from the leftmost pixel to the line to be
  *                  drawn)
  *     OUTPUTS: none
- *     RETURN VALUE: Returns 0 on success. If x is outside of the valid
+ *     RETURN VALUE: Returns 0 on success, or 1 if the line came from the
+ *                   margin cache. If x is outside of the valid
  *                   SCROLL range, the function returns -1.
  *     SIDE EFFECTS: draws into the build buffer
  */
-int draw_vert_line(int x) {
+int draw_vert_line(render_ctx_t* ctx, int x) {
       unsigned char buf[SCROLL_Y_DIM];    /*The buffer that holds the line to be written*/
+      const unsigned char * src;          /*The line to be written(buf or cached)*/
+      margin_line_t * line;               /*The line drawn ahead of time, if any*/
       unsigned char * addr;               /*The address where to write the line*/
       int plane;  /*The plane in which the memory is written into*/
       int i;      /*index, used for iterating through all bytes of the line*/
+      uint64_t start_time;    /*time at which drawing started*/
 
       /*Ensure our x value is within the bounds of the screen*/
-      if(x < 0 || x > SCROLL_X_DIM){
+      if(x < 0 || x > ctx->width){
             return -1;
       }
 
+      start_time = timing_now();
+
       /*Update x to be the logical address on the screen*/
-      x += show_x;
+      x += ctx->show_x;
 
       /*Calculate which plane the line resides on*/
       plane = (3-(x&3));
 
-      /*Grab the line to be written from video memory*/
-      (*vert_line_fn)(x, show_y, buf);
+      /*Grab the line to be written, unless it was drawn ahead of time*/
+      if(NULL != (line = find_margin(ctx->margin_col, x, ctx->show_y))){
+            src = line->pix;
+      }
+      else{
+            (*ctx->vert_line_fn)(ctx->line_arg, x, ctx->show_y, ctx->height, buf);
+            src = buf;
+      }
 
       /*Calculate the address where to write the line*/
-      addr = img3 + (x >> 2) + (show_y * SCROLL_X_WIDTH);
+      addr = ctx->img3 + (x >> 2) + (ctx->show_y * ctx->x_width);
 
       /*Iterate through the line bytes and load them into the appropriate plane of vid mem*/
-      for(i = 0; i < SCROLL_Y_DIM; i++){
-            addr[SCROLL_SIZE*plane + i*SCROLL_X_WIDTH] = buf[i];
+      for(i = 0; i < ctx->height; i++){
+            addr[ctx->plane_size*plane + i*ctx->x_width] = src[i];
       }
 
-      return 0;
+      timing_add(TM_LINE_FILL, start_time);
+      return (src != buf);
 }
 
 
@@ -695,47 +1263,136 @@ int draw_vert_line(int x) {
  *     DESCRIPTION: Draw a horizontal map line into the build buffer. The
  *                  line should be offset from the top of the logical view
  *                  window screen by the given number of pixels.
- *     INPUTS: y -- the 0-based pixel row number of the line to be drawn
+ *     INPUTS: ctx -- the render context
+ *             y -- the 0-based pixel row number of the line to be drawn
  *                  within the logical view window (equivalent to the number
  *                  of pixels from the top pixel to the line to be drawn)
  *     OUTPUTS: none
- *     RETURN VALUE: Returns 0 on success. If y is outside of the valid
+ *     RETURN VALUE: Returns 0 on success, or 1 if the line came from the
+ *                   margin cache. If y is outside of the valid
  *                   SCROLL range, the function returns -1.
  *     SIDE EFFECTS: draws into the build buffer
  */
-int draw_horiz_line(int y) {
+int draw_horiz_line(render_ctx_t* ctx, int y) {
     unsigned char buf[SCROLL_X_DIM]; /* buffer for graphical image of line                            */
+    const unsigned char* src;        /* image of line(buf or cached)                                  */
+    margin_line_t* line;             /* line drawn ahead of time, if any                              */
     unsigned char* addr;             /* address of first pixel in build buffer (without plane offset) */
     int p_off;                       /* offset of plane of first pixel                                */
     int i;                           /* loop index over pixels                                        */
+    uint64_t start_time;             /* time at which drawing started                                 */
 
     /* Check whether requested line falls in the logical view window. */
-    if (y < 0 || y >= SCROLL_Y_DIM)
+    if (y < 0 || y >= ctx->height)
     return -1;
 
+    start_time = timing_now();
+
     /* Adjust y to the logical row value. */
-    y += show_y;
+    y += ctx->show_y;
 
-    /* Get the image of the line. */
-    (*horiz_line_fn)(show_x, y, buf);
+    /* Get the image of the line, unless it was drawn ahead of time. */
+    if (NULL != (line = find_margin(ctx->margin_row, ctx->show_x, y))) {
+        src = line->pix;
+    }
+    else {
+        (*ctx->horiz_line_fn)(ctx->line_arg, ctx->show_x, y, ctx->width, buf);
+        src = buf;
+    }
 
     /* Calculate starting address in build buffer. */
-    addr = img3 + (show_x >> 2) + y * SCROLL_X_WIDTH;
+    addr = ctx->img3 + (ctx->show_x >> 2) + y * ctx->x_width;
 
     /* Calculate plane offset of first pixel. */
-    p_off = (3 - (show_x & 3));
+    p_off = (3 - (ctx->show_x & 3));
 
     /* Copy image data into appropriate planes in build buffer. */
-    for (i = 0; i < SCROLL_X_DIM; i++) {
-        addr[p_off * SCROLL_SIZE] = buf[i];
+    for (i = 0; i < ctx->width; i++) {
+        addr[p_off * ctx->plane_size] = src[i];
         if (--p_off < 0) {
             p_off = 3;
             addr++;
         }
     }
+    timing_add(TM_LINE_FILL, start_time);
 
     /* Return success. */
-    return 0;
+    return (src != buf);
+}
+
+
+/*
+ * draw_planar_image
+ *     DESCRIPTION: Draw a planar image(typically an object) into the build
+ *                  buffer, clipped to the logical view window.  Opaque
+ *                  pixels are merged into each plane four bytes at a time
+ *                  under the image's masks.  Clipping is done separately
+ *                  for each plane, since the addresses just outside the
+ *                  window in one plane belong to other rows and planes.
+ *     INPUTS: ctx -- the render context
+ *            (x,y) -- logical pixel coordinates of the upper left corner of
+ *                     the image; x & 3 must match the phase of the image
+ *             im -- the image
+ *     OUTPUTS: none
+ *     RETURN VALUE: none
+ *     SIDE EFFECTS: draws into the build buffer
+ */
+void draw_planar_image(render_ctx_t* ctx, int x, int y, const planar_image_t* im) {
+    int row_lo, row_hi;         /* rows of image within window        */
+    int col_lo, col_hi;         /* addresses of plane within window   */
+    int base;                   /* address of image's left edge       */
+    int plane;                  /* pixel x & 3 for the plane          */
+    int row;                    /* loop index over image rows         */
+    int i;                      /* loop index over bytes in a row     */
+    const unsigned char* src;   /* row of image data                  */
+    const unsigned char* msk;   /* row of image mask                  */
+    unsigned char* dst;         /* row in build buffer                */
+    uint32_t d, s, m;           /* four bytes of build, data, mask    */
+    uint64_t start_time;        /* time at which drawing started      */
+
+    start_time = timing_now();
+
+    /* Clip rows to the window. */
+    row_lo = (ctx->show_y > y ? ctx->show_y - y : 0);
+    row_hi = (ctx->show_y + ctx->height < y + im->height ?
+              ctx->show_y + ctx->height - y : im->height);
+    base = (x >> 2);
+
+    for (plane = 0; plane < 4; plane++) {
+        /*
+         * Clip the plane's addresses so that every pixel drawn lies in
+         * [show_x, show_x + width).  Address a holds the pixel at
+         * 4a + plane, so the bounds round inward.
+         */
+        col_lo = ((ctx->show_x - plane + 3) >> 2) - base;
+        col_hi = ((ctx->show_x + ctx->width - 1 - plane) >> 2) + 1 - base;
+        if (col_lo < 0)
+            col_lo = 0;
+        if (col_hi > im->width)
+            col_hi = im->width;
+        if (col_lo >= col_hi)
+            continue;
+
+        for (row = row_lo; row < row_hi; row++) {
+            src = im->data[plane] + row * im->width;
+            msk = im->mask[plane] + row * im->width;
+            dst = ctx->img3 + (3 - plane) * ctx->plane_size + (y + row) * ctx->x_width + base;
+
+            /* Merge four bytes at a time, then any left over. */
+            for (i = col_lo; i + 4 <= col_hi; i += 4) {
+                memcpy(&d, dst + i, 4);
+                memcpy(&s, src + i, 4);
+                memcpy(&m, msk + i, 4);
+                d = (d & ~m) | s;
+                memcpy(dst + i, &d, 4);
+            }
+            for (; i < col_hi; i++) {
+                dst[i] = (dst[i] & ~msk[i]) | src[i];
+            }
+        }
+    }
+
+    timing_add(TM_LINE_FILL, start_time);
 }
 
 #endif /* !defined(TEXT_RESTORE_PROGRAM) */
@@ -753,6 +1410,11 @@ int draw_horiz_line(int y) {
 static int open_memory_and_ports() {
     int mem_fd;    /* file descriptor for physical memory image */
 
+#if (MODEX_USE_VGA == 0)
+    fputs("VGA support not compiled in\n", stderr);
+    return -1;
+#endif
+
     /* Obtain permission to access ports 0x03C0 through 0x03DA. */
     if (ioperm(0x03C0, 0x03DA - 0x03C0 + 1, 1) == -1) {
         perror("set port permissions");
@@ -793,6 +1455,7 @@ static void VGA_blank(int blank_bit) {
      */
     blank_bit = ((blank_bit & 1) << 5);
 
+#if (MODEX_USE_VGA == 1)
     asm volatile("                                                      \n\
         movb $0x01, %%al        /* Set sequencer index to 1 */          \n\
         movw $0x03C4, %%dx                                              \n\
@@ -812,6 +1475,7 @@ static void VGA_blank(int blank_bit) {
         : "g"(blank_bit)
         : "eax", "edx", "memory"
     );
+#endif
 }
 
 
@@ -872,6 +1536,7 @@ static void set_CRTC_registers(unsigned short table[NUM_CRTC_REGS]) {
  */
 static void set_attr_registers(unsigned char table[NUM_ATTR_REGS * 2]) {
     /* Reset attribute register to write index next rather than data. */
+#if (MODEX_USE_VGA == 1)
     asm volatile("          \n\
         inb (%%dx), %%al    \n\
         "
@@ -879,6 +1544,7 @@ static void set_attr_registers(unsigned char table[NUM_ATTR_REGS * 2]) {
         : "d"(0x03DA)
         : "eax", "memory"
     );
+#endif
     REP_OUTSB(0x03C0, table, NUM_ATTR_REGS * 2);
 }
 
@@ -900,6 +1566,10 @@ static void set_graphics_registers(unsigned short table[NUM_GRAPHICS_REGS]) {
 * into memory that were generated by the octree algorithm.
 */
 void set_palette(unsigned char * new_palette){
+      if(use_fb){
+            fb_set_palette(64, 192, new_palette);
+            return;
+      }
       /*Start writing at value 64*/
       OUTB(0x03C8, 0x40);
       /*Copy the rest of the values*/
@@ -953,6 +1623,11 @@ static void fill_palette_mode_x() {
         {0x3F, 0x3F, 0x2A}, {0x3F, 0x3F, 0x3F}
     };
 
+    if (use_fb) {
+        fb_set_palette(0, 64, &palette_RGB[0][0]);
+        return;
+    }
+
     /* Start writing at color 0. */
     OUTB(0x03C8, 0x00);
 
@@ -1087,6 +1762,7 @@ static void copy_image(unsigned char* img, unsigned short scr_addr) {
      * implemented using ISA-specific features like those below,
      * but the code here provides an example of x86 string moves
      */
+#if (MODEX_USE_VGA == 1)
     asm volatile("                                                  \n\
         cld                                                         \n\
         movl $16000, %%ecx                                          \n\
@@ -1096,6 +1772,7 @@ static void copy_image(unsigned char* img, unsigned short scr_addr) {
         : "S"(img), "D"(mem_image + scr_addr)
         : "eax", "ecx", "memory"
     );
+#endif
 }
 
 
@@ -1127,3 +1804,221 @@ int main() {
 }
 
 #endif
+
+
+#if (TEST_PARALLEL_REDRAW == 1 || TEST_PLANAR_IMAGE == 1)
+
+/* number of room moves made by the tests */
+#define TEST_MOVES 40
+
+/*
+ * show_status
+ *   DESCRIPTION: Stands in for the game's status display.
+ *   INPUTS: s -- status message(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void show_status(const char* s) {
+}
+
+#endif
+
+
+#if (TEST_PARALLEL_REDRAW == 1)
+
+/*
+ * main -- for the parallel redraw test
+ *     DESCRIPTION: Walks through the rooms of the world, redrawing the
+ *                  view at several positions in each, first serially and
+ *                  then with worker threads, and compares the build
+ *                  buffers.  A small second context is then drawn at
+ *                  the same position and compared with the top left
+ *                  corner of the main view.
+ *     INPUTS: none
+ *     OUTPUTS: number of mismatched views to stdout
+ *     RETURN VALUE: 0 if every view matched, 1 on a mismatch, 3 on setup
+ *                   failure
+ */
+int main() {
+    room_view_t    view = {NULL, NULL, 1, 1};  /* the main view        */
+    room_view_t    small = {NULL, NULL, 1, 1}; /* the small view       */
+    unsigned char* serial;  /* copy of a build buffer         */
+    const unsigned char* plane[4]; /* planes of the main view  */
+    const unsigned char* corner[4];/* planes of the small view */
+    room_t* room;   /* current room                   */
+    int32_t move;   /* loop index over room moves     */
+    int     pos;    /* loop index over view positions */
+    int     x, y;   /* view position                  */
+    int     views;  /* views compared                 */
+    int     bad;    /* views that did not match       */
+    int     i;      /* loop index over planes         */
+    int     row;    /* loop index over small view rows */
+
+    if (0 != set_mode_X() || !build_world(WORLD_FILE) ||
+        NULL == (view.ctx = new_render_ctx(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM,
+                                           fill_horiz_buffer, fill_vert_buffer,
+                                           &view)) ||
+        NULL == (small.ctx = new_render_ctx(0, 0, 128, 72, fill_horiz_buffer,
+                                            fill_vert_buffer, &small)) ||
+        NULL == (serial = malloc(view.ctx->buf_size + 2 * MEM_FENCE_WIDTH))) {
+        return 3;
+    }
+
+    views = bad = 0;
+    room = start_in_room();
+    for (move = 0; move < TEST_MOVES; move++) {
+        prep_room(&view, room);
+        prep_room(&small, room);
+        for (pos = 0; pos < 4; pos++) {
+            x = (pos * 37) % (room_photo_width(room) - SCROLL_X_DIM + 1);
+            y = (pos * 23) % (room_photo_height(room) - SCROLL_Y_DIM + 1);
+            set_view_window(view.ctx, x, y);
+
+            redraw_room_view(&view);
+            memcpy(serial, view.ctx->build,
+                   view.ctx->buf_size + 2 * MEM_FENCE_WIDTH);
+            (void)workers_start(3);
+            redraw_room_view(&view);
+            workers_stop(NULL);
+
+            views++;
+            if (0 != memcmp(serial, view.ctx->build,
+                            view.ctx->buf_size + 2 * MEM_FENCE_WIDTH)) {
+                printf("mismatch in %s at (%d,%d)\n", room_name(room), x, y);
+                bad++;
+            }
+
+            /* The small view should match the corner of the main one. */
+            set_view_window(small.ctx, x, y);
+            redraw_room_view(&small);
+            get_planes(view.ctx, plane);
+            get_planes(small.ctx, corner);
+            views++;
+            for (i = 0; i < 4 * small.ctx->height; i++) {
+                row = i / 4;
+                if (0 != memcmp(plane[i & 3] + row * view.ctx->x_width,
+                                corner[i & 3] + row * small.ctx->x_width,
+                                small.ctx->x_width)) {
+                    printf("small view mismatch in %s at (%d,%d)\n",
+                           room_name(room), x, y);
+                    bad++;
+                    break;
+                }
+            }
+        }
+        if (TC_CHANGE_ROOM != try_to_move_right(&room) &&
+            TC_CHANGE_ROOM != try_to_enter(&room)) {
+            (void)try_to_move_left(&room);
+        }
+    }
+    free(serial);
+    free_render_ctx(small.ctx);
+    free_render_ctx(view.ctx);
+    clear_mode_X();
+
+    printf("%d of %d views mismatched\n", bad, views);
+    return (0 == bad ? 0 : 1);
+}
+
+#endif
+
+
+#if (TEST_PLANAR_IMAGE == 1)
+
+/*
+ * main -- for the planar image test
+ *     DESCRIPTION: Walks through the rooms of the world.  For each object
+ *                  in a room, places a small view(so that it fits inside
+ *                  the photo) so that the object crosses its left and top
+ *                  edges, and then its right and bottom edges, at each of
+ *                  eight offsets(every phase of the object against the
+ *                  window, and of the window against the planes).  Each
+ *                  view is drawn by redraw_room_view, which draws the
+ *                  objects with draw_planar_image, and again line by line
+ *                  with the objects composited into each line, each time
+ *                  over the same filler, and the whole build buffers are
+ *                  compared.
+ *     INPUTS: none
+ *     OUTPUTS: number of mismatched views to stdout
+ *     RETURN VALUE: 0 if every view matched, 1 on a mismatch, 3 on setup
+ *                   failure
+ */
+int main() {
+    room_view_t      view = {NULL, NULL, 1, 1}; /* the view             */
+    unsigned char*   planar;  /* copy of the build buffer            */
+    const obj_rec_t* rec;     /* objects in the room                 */
+    room_t* room;    /* current room                         */
+    int32_t n_obj;   /* number of objects in the room        */
+    int32_t move;    /* loop index over room moves           */
+    int32_t obj;     /* loop index over objects              */
+    int     edge;    /* 0 for the left edge, 1 for the right */
+    int     off;     /* loop index over x offsets            */
+    int     x, y;    /* view position                        */
+    int     x_max;   /* largest view x in the room           */
+    int     y_max;   /* largest view y in the room           */
+    int     row;     /* loop index over view rows            */
+    int     views;   /* views compared                       */
+    int     bad;     /* views that did not match             */
+
+    if (0 != set_mode_X() || !build_world(WORLD_FILE) ||
+        NULL == (view.ctx = new_render_ctx(0, 0, 64, 16, fill_horiz_buffer,
+                                           fill_vert_buffer, &view)) ||
+        NULL == (planar = malloc(view.ctx->buf_size + 2 * MEM_FENCE_WIDTH))) {
+        return 3;
+    }
+
+    views = bad = 0;
+    room = start_in_room();
+    for (move = 0; move < TEST_MOVES; move++) {
+        prep_room(&view, room);
+        x_max = room_photo_width(room) - view.ctx->width;
+        y_max = room_photo_height(room) - view.ctx->height;
+        n_obj = room_objects(room, &rec);
+        for (obj = 0; obj < n_obj; obj++) {
+            for (edge = 0; edge < 2; edge++) {
+                for (off = 0; off < 8; off++) {
+                    x = rec[obj].x + off - 4 +
+                        (edge ? rec[obj].w - view.ctx->width : 0);
+                    x = (x < 0 ? 0 : (x > x_max ? x_max : x));
+                    y = rec[obj].y + off - 4 +
+                        (edge ? rec[obj].h - view.ctx->height : 0);
+                    y = (y < 0 ? 0 : (y > y_max ? y_max : y));
+                    set_view_window(view.ctx, x, y);
+
+                    /*
+                     * Start both from the same filler, so that stray
+                     * writes outside the window show up too.
+                     */
+                    memset(view.ctx->build + MEM_FENCE_WIDTH, 0x5A, view.ctx->buf_size);
+                    redraw_room_view(&view);
+                    memcpy(planar, view.ctx->build,
+                           view.ctx->buf_size + 2 * MEM_FENCE_WIDTH);
+                    memset(view.ctx->build + MEM_FENCE_WIDTH, 0x5A, view.ctx->buf_size);
+                    for (row = 0; row < view.ctx->height; row++) {
+                        (void)draw_horiz_line(view.ctx, row);
+                    }
+
+                    views++;
+                    if (0 != memcmp(planar, view.ctx->build,
+                                    view.ctx->buf_size + 2 * MEM_FENCE_WIDTH)) {
+                        printf("mismatch in %s at (%d,%d)\n", room_name(room), x, y);
+                        bad++;
+                    }
+                }
+            }
+        }
+        if (TC_CHANGE_ROOM != try_to_move_right(&room) &&
+            TC_CHANGE_ROOM != try_to_enter(&room)) {
+            (void)try_to_move_left(&room);
+        }
+    }
+    free(planar);
+    free_render_ctx(view.ctx);
+    clear_mode_X();
+
+    printf("%d of %d views mismatched\n", bad, views);
+    return (0 == bad ? 0 : 1);
+}
+
+#endif
@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       4
+ * Version:       5
  * Creation Date: Thu Sep 9 23:08:21 2004
  * Filename:      modex.h
  * History:
@@ -35,6 +35,8 @@
  *        Modified for MP2 F11 adventure game.
  *    SL    4    Sat Sep 14 16:26:25 2011
  *        Split fill_palette by mode and cleaned up code for release.
+ *          5
+ *        Moved the view window into render contexts.
  */
 
 #ifndef MODEX_H
@@ -114,17 +116,40 @@
  * is drawn. Other data are left untouched in most cases.
  */
 
-/* configure VGA for mode X; initializes logical view to (0, 0) */
-extern int set_mode_X(void(*horiz_fill_fn)(int, int, unsigned char[SCROLL_X_DIM]),
-                      void(*vert_fill_fn)(int, int, unsigned char[SCROLL_Y_DIM]));
+/*
+ * A render context draws one view window into its own build buffer and
+ * shows it in a rectangle of the frame(see modex.c).  Its line functions
+ * fill buf with the n pixels of the line starting at logical pixel (x,y)
+ * and are passed the argument given when the context was made.
+ */
+typedef struct render_ctx_t render_ctx_t;
+typedef void (*line_fn_t)(void* arg, int x, int y, int n, unsigned char* buf);
+
+/* configure VGA for mode X */
+extern int set_mode_X(void);
 
 /* return to text mode */
 extern void clear_mode_X();
 
+/* make a render context for a rectangle of the frame(NULL on failure) */
+extern render_ctx_t* new_render_ctx(int frame_x, int frame_y, int width, int height,
+                                    line_fn_t horiz_fill_fn, line_fn_t vert_fill_fn,
+                                    void* arg);
+
+/* free a render context */
+extern void free_render_ctx(render_ctx_t* ctx);
+
+/* show(visible = 1) or hide(visible = 0) a render context */
+extern void show_render_ctx(render_ctx_t* ctx, int visible);
+
+/* get the size of a render context's view window */
+extern int render_ctx_width(const render_ctx_t* ctx);
+extern int render_ctx_height(const render_ctx_t* ctx);
+
 /* set logical view window coordinates */
-extern void set_view_window(int scr_x, int scr_y);
+extern void set_view_window(render_ctx_t* ctx, int scr_x, int scr_y);
 
-/* show the logical view window on the monitor */
+/* show the logical view windows of the visible contexts on the monitor */
 extern void show_screen();
 
 /* clear the video memory in mode X */
@@ -133,10 +158,45 @@ extern void clear_screens();
 extern void fill_status_bar(char * string);
 
 /* draw a horizontal line at vertical pixel y within the logical view window */
-extern int draw_horiz_line(int y);
+extern int draw_horiz_line(render_ctx_t* ctx, int y);
 
 /* draw a vertical line at horizontal pixel x within the logical view window */
-extern int draw_vert_line(int x);
+extern int draw_vert_line(render_ctx_t* ctx, int x);
+
+/*
+ * The lines just outside the logical view window can be drawn ahead of
+ * time, when there is nothing else to do; draw_horiz_line and
+ * draw_vert_line then copy them rather than calling the line functions.
+ * The cached lines must be discarded whenever the line images change.
+ */
+
+/* record the logical image size(and discard lines drawn ahead) */
+extern void set_view_limits(render_ctx_t* ctx, int width, int height);
+
+/* discard lines drawn ahead */
+extern void discard_margins(render_ctx_t* ctx);
+
+/* draw one line ahead; returns 1 if one was drawn, 0 if all are done */
+extern int prefill_margin_line(render_ctx_t* ctx);
+
+/*
+ * An image stored by plane for blitting straight into the build buffer.
+ * The image must be drawn at a logical x coordinate with(x & 3) equal to
+ * the phase for which it was made.  Plane i holds the pixels that land at
+ * logical x coordinates with(x & 3) == i: each row of data[i] and mask[i]
+ * holds width bytes, starting at address(x >> 2) of the image's left edge.
+ * Mask bytes are 0xFF for opaque pixels and 0x00 for transparent ones;
+ * data bytes are 0x00 wherever the mask is 0x00.
+ */
+typedef struct {
+    int                  width;   /* bytes per row in each plane */
+    int                  height;  /* rows                        */
+    const unsigned char* data[4]; /* pixel data for each plane   */
+    const unsigned char* mask[4]; /* opaque pixels in each plane */
+} planar_image_t;
+
+/* draw a planar image with its upper left pixel at logical pixel (x,y) */
+extern void draw_planar_image(render_ctx_t* ctx, int x, int y, const planar_image_t* im);
 
 extern void set_palette(unsigned char * new_palette);
 
@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       3
+ * Version:       10
  * Creation Date: Fri Sep 9 21:44:10 2011
  * Filename:      photo.c
  * History:
@@ -33,20 +33,81 @@
  *        Completed initial implementation of functions.
  *    SL    3    Wed Sep 14 21:49:44 2011
  *        Cleaned up code for distribution.
+ *          4
+ *        Split full-view redraws across the drawing worker threads.
+ *          5
+ *        Drew rooms through room views, one per render context.
+ *          6
+ *        Drew objects from each room's array of object records.
+ *          7
+ *        Shared photos and images loaded from the same file.
+ *          8
+ *        Placed photos and images in an arena sized from their file headers,
+ *        decoded with a scratch arena, and added free_assets.
+ *          9
+ *        Read photos and images from a mapped asset pack when one is open.
+ *          10
+ *        Added preload_assets, which reads every file at once and decodes
+ *        each as its read finishes.
  */
 
 
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "arena.h"
 #include "assert.h"
+#include "loader.h"
 #include "modex.h"
 #include "photo.h"
 #include "photo_headers.h"
 #include "world.h"
+#include "timing.h"
 #include "types.h"
+#include "workers.h"
 
 
-/* types local to this file(declared in types.h) */
+/* types local to this file(declared in types.h, except asset_t) */
+
+/*
+ * A photo or image shared by everything that loads the same file(see
+ * load_photo and load_obj_image).  The shared assets are kept in a hash
+ * table by file name.
+ */
+typedef struct asset_t asset_t;
+struct asset_t {
+    asset_t* next;  /* next asset in the same hash chain     */
+    void*    data;  /* the photo_t or image_t(NULL until read) */
+    int32_t  photo; /* 1 for a photo, 0 for an image         */
+    uint32_t refs;  /* loads not yet released                */
+    uint32_t size;  /* bytes held by the photo or image      */
+    char*    name;  /* file name(held after the structure)   */
+};
+
+#define ASSET_BUCKETS 256  /* chains in the asset hash table(a power of 2) */
+
+/*
+ * set to 0 to keep the asset arena(see reserve_photo) off huge pages,
+ * which make fewer TLB misses while drawing but may round the arena up
+ * to 2 MB
+ */
+#ifndef PHOTO_USE_HUGE_PAGES
+#define PHOTO_USE_HUGE_PAGES 1
+#endif
+
+/*
+ * set to 0 to leave out preload_assets, so that each photo and image is
+ * read and decoded only when first loaded; at run time, MP2_LOADER=off
+ * does the same, and MP2_LOADER=threads keeps the loader off io_uring
+ */
+#ifndef PHOTO_ASYNC_LOAD
+#define PHOTO_ASYNC_LOAD 1
+#endif
 
 /*
  * A room photo.  Note that you must write the code that selects the
@@ -60,6 +121,7 @@ struct photo_t {
     photo_header_t hdr;            /* defines height and width */
     uint8_t        palette[192][3];     /* optimized palette colors */
     uint8_t*       img;                 /* pixel data               */
+    asset_t*       asset;               /* sharing(NULL if none)    */
 };
 
 /*
@@ -74,20 +136,63 @@ struct photo_t {
 struct image_t {
     photo_header_t hdr;  /* defines height and width */
     uint8_t*       img;  /* pixel data               */
+
+    /*
+     * The same image stored by plane for drawing with draw_planar_image,
+     * once for each phase(the value of x & 3 at the image's left edge).
+     * All of the planar data are held in planar_mem.
+     */
+    planar_image_t planar[4];
+    uint8_t*       planar_mem;
+    asset_t*       asset;  /* sharing(NULL if none) */
 };
 
 
-/* file-scope variables */
+void gen_color_pallette(uint16_t * raw_color_data, photo_t * p);
+static asset_t* add_asset(const char* fname, uint32_t bucket, int32_t photo);
+static void* asset_alloc(size_t size);
+static void asset_free(void* p);
+static void destroy_image(image_t* img);
+static void destroy_photo(photo_t* p);
+static uint32_t drop_asset(asset_t* a);
+static asset_t* find_asset(const char* fname, uint32_t* bucket);
+static uint32_t image_bytes(uint32_t width, uint32_t height);
+static uint32_t photo_bytes(uint32_t width, uint32_t height);
+static int32_t reserve_asset(const char* fname, int32_t photo);
+static void close_pack(void);
+static photo_t* decode_photo(FILE* in);
+static image_t* decode_obj_image(FILE* in);
+static const pack_entry_t* find_in_pack(const char* fname);
+static FILE* open_asset(const char* fname);
+static int32_t make_planar_images(image_t* img);
+static void draw_rows(void* view, int lo, int hi);
+
+
+/* shared photos and images, by file name */
+static asset_t* asset_table[ASSET_BUCKETS];
+static uint32_t n_shared_loads;   /* loads that found a shared asset  */
+static uint64_t shared_bytes;     /* memory those loads did not take  */
 
 /*
- * The room currently shown on the screen.  This value is not known to
- * the mode X code, but is needed when filling buffers in callbacks from
- * that code(fill_horiz_buffer/fill_vert_buffer).  The value is set
- * by calling prep_room.
+ * Photos and images are placed in asset_arena, which is made when the
+ * first is read, with room for all of those reserved until then; any
+ * that do not fit come from malloc.  Decoding a photo takes temporary
+ * space from scratch_arena, which is reset after each photo.
  */
-static const room_t* cur_room = NULL;
+static arena_t* asset_arena;
+static size_t   reserved_bytes;   /* room wanted in asset_arena       */
+static arena_t* scratch_arena;
 
-void gen_color_pallette(uint16_t * raw_color_data, photo_t * p);
+/* the asset pack(see open_pack), or NULL if none is open */
+static const uint8_t*      pack_map;
+static size_t              pack_size;   /* bytes mapped            */
+static const pack_entry_t* pack_ent;    /* table of contents       */
+static uint32_t            pack_files;  /* number of entries       */
+static const char*         pack_str;    /* file names              */
+static int                 pack_fd;     /* the pack, for preloading */
+
+/* how the last preload_assets went */
+static preload_stats_t preload;
 
 /*
  * fill_horiz_buffer
@@ -99,43 +204,52 @@ void gen_color_pallette(uint16_t * raw_color_data, photo_t * p);
  *                Note that this routine draws both the room photo and
  *                the objects in the room.
  *
- *   INPUTS:(x,y) -- leftmost pixel of line to be drawn
+ *   INPUTS: arg -- the room view(a room_view_t*) being drawn
+ *          (x,y) -- leftmost pixel of line to be drawn
+ *           n -- number of pixels in the line
  *   OUTPUTS: buf -- buffer holding image data for the line
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
-    int            idx;   /* loop index over pixels in the line          */
-    object_t*      obj;   /* loop index over objects in the current room */
-    int            imgx;  /* loop index over pixels in object image      */
-    int            yoff;  /* y offset into object image                  */
-    uint8_t        pixel; /* pixel from object image                     */
-    const photo_t* view;  /* room photo                                  */
-    int32_t        obj_x; /* object x position                           */
-    int32_t        obj_y; /* object y position                           */
-    const image_t* img;   /* object image                                */
+void fill_horiz_buffer(void* arg, int x, int y, int n, unsigned char* buf) {
+    const room_view_t* rv = arg; /* room view being drawn                */
+    int              idx;   /* loop index over pixels in the line        */
+    const obj_rec_t* rec;   /* loop index over objects in the room       */
+    int32_t          n_obj; /* objects left to draw                      */
+    int              imgx;  /* loop index over pixels in object image    */
+    int              yoff;  /* y offset into object image                */
+    uint8_t          pixel; /* pixel from object image                   */
+    const photo_t*   view;  /* room photo                                */
+    int32_t          obj_x; /* object x position                         */
+    int32_t          obj_y; /* object y position                         */
+    int32_t          obj_w; /* object width                              */
 
     /* Get pointer to current photo of current room. */
-    view = room_photo(cur_room);
+    view = room_photo(rv->room);
 
-    /* Loop over pixels in line. */
-    for (idx = 0; idx < SCROLL_X_DIM; idx++) {
-        buf[idx] = (0 <= x + idx && view->hdr.width > x + idx ? view->img[view->hdr.width * y + x + idx] : 0);
+    /* Loop over pixels in line(black if the photo is not shown). */
+    for (idx = 0; idx < n; idx++) {
+        buf[idx] = (rv->photo && 0 <= x + idx && view->hdr.width > x + idx ? view->img[view->hdr.width * y + x + idx] : 0);
     }
 
-    /* Loop over objects in the current room. */
-    for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
-        obj_x = obj_get_x(obj);
-        obj_y = obj_get_y(obj);
-        img = obj_image(obj);
+    /*
+     * Loop over objects in the current room(unless drawn separately).
+     * The records hold each object's size, so only the images of the
+     * objects on the line are read.
+     */
+    n_obj = (rv->objects ? room_objects(rv->room, &rec) : 0);
+    for (; 0 < n_obj; n_obj--, rec++) {
+        obj_x = rec->x;
+        obj_y = rec->y;
+        obj_w = rec->w;
 
         /* Is object outside of the line we're drawing? */
-        if (y < obj_y || y >= obj_y + img->hdr.height || x + SCROLL_X_DIM <= obj_x || x >= obj_x + img->hdr.width) {
+        if (y < obj_y || y >= obj_y + rec->h || x + n <= obj_x || x >= obj_x + obj_w) {
             continue;
         }
 
         /* The y offset of drawing is fixed. */
-        yoff = (y - obj_y) * img->hdr.width;
+        yoff = (y - obj_y) * obj_w;
 
         /*
          * The x offsets depend on whether the object starts to the left
@@ -151,8 +265,8 @@ void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
         }
 
         /* Copy the object's pixel data. */
-        for (; SCROLL_X_DIM > idx && img->hdr.width > imgx; idx++, imgx++) {
-            pixel = img->img[yoff + imgx];
+        for (; n > idx && obj_w > imgx; idx++, imgx++) {
+            pixel = rec->img->img[yoff + imgx];
 
             /* Don't copy transparent pixels. */
             if (OBJ_CLR_TRANSP != pixel) {
@@ -173,39 +287,44 @@ void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]) {
  *                Note that this routine draws both the room photo and
  *                the objects in the room.
  *
- *   INPUTS:(x,y) -- top pixel of line to be drawn
+ *   INPUTS: arg -- the room view(a room_view_t*) being drawn
+ *          (x,y) -- top pixel of line to be drawn
+ *           n -- number of pixels in the line
  *   OUTPUTS: buf -- buffer holding image data for the line
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
-    int            idx;   /* loop index over pixels in the line          */
-    object_t*      obj;   /* loop index over objects in the current room */
-    int            imgy;  /* loop index over pixels in object image      */
-    int            xoff;  /* x offset into object image                  */
-    uint8_t        pixel; /* pixel from object image                     */
-    const photo_t* view;  /* room photo                                  */
-    int32_t        obj_x; /* object x position                           */
-    int32_t        obj_y; /* object y position                           */
-    const image_t* img;   /* object image                                */
+void fill_vert_buffer(void* arg, int x, int y, int n, unsigned char* buf) {
+    const room_view_t* rv = arg; /* room view being drawn                */
+    int              idx;   /* loop index over pixels in the line        */
+    const obj_rec_t* rec;   /* loop index over objects in the room       */
+    int32_t          n_obj; /* objects left to draw                      */
+    int              imgy;  /* loop index over pixels in object image    */
+    int              xoff;  /* x offset into object image                */
+    uint8_t          pixel; /* pixel from object image                   */
+    const photo_t*   view;  /* room photo                                */
+    int32_t          obj_x; /* object x position                         */
+    int32_t          obj_y; /* object y position                         */
+    int32_t          obj_w; /* object width                              */
 
     /* Get pointer to current photo of current room. */
-    view = room_photo(cur_room);
+    view = room_photo(rv->room);
 
-    /* Loop over pixels in line. */
-    for (idx = 0; idx < SCROLL_Y_DIM; idx++) {
-        buf[idx] = (0 <= y + idx && view->hdr.height > y + idx ? view->img[view->hdr.width *(y + idx) + x] : 0);
+    /* Loop over pixels in line(black if the photo is not shown). */
+    for (idx = 0; idx < n; idx++) {
+        buf[idx] = (rv->photo && 0 <= y + idx && view->hdr.height > y + idx ? view->img[view->hdr.width *(y + idx) + x] : 0);
     }
 
-    /* Loop over objects in the current room. */
-    for (obj = room_contents_iterate(cur_room); NULL != obj; obj = obj_next(obj)) {
-        obj_x = obj_get_x(obj);
-        obj_y = obj_get_y(obj);
-        img = obj_image(obj);
+    /* Loop over objects in the current room(unless drawn separately). */
+    n_obj = (rv->objects ? room_objects(rv->room, &rec) : 0);
+    for (; 0 < n_obj; n_obj--, rec++) {
+        obj_x = rec->x;
+        obj_y = rec->y;
+        obj_w = rec->w;
 
         /* Is object outside of the line we're drawing? */
-        if (x < obj_x || x >= obj_x + img->hdr.width ||
-            y + SCROLL_Y_DIM <= obj_y || y >= obj_y + img->hdr.height) {
+        if (x < obj_x || x >= obj_x + obj_w ||
+            y + n <= obj_y || y >= obj_y + rec->h) {
             continue;
         }
 
@@ -226,8 +345,8 @@ void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
         }
 
         /* Copy the object's pixel data. */
-        for (; SCROLL_Y_DIM > idx && img->hdr.height > imgy; idx++, imgy++) {
-            pixel = img->img[xoff + img->hdr.width * imgy];
+        for (; n > idx && rec->h > imgy; idx++, imgy++) {
+            pixel = rec->img->img[xoff + obj_w * imgy];
 
             /* Don't copy transparent pixels. */
             if (OBJ_CLR_TRANSP != pixel) {
@@ -238,6 +357,56 @@ void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]) {
 }
 
 
+/*
+ * redraw_room_view
+ *   DESCRIPTION: Draws every line of a room view's logical view window.
+ *                The room photo is drawn line by line without objects
+ *                (with the rows split among the drawing worker threads,
+ *                if any), after which each object is drawn directly into
+ *                the build buffer planes.
+ *   INPUTS: rv -- the room view
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the view's build buffer
+ */
+void redraw_room_view(room_view_t* rv) {
+    const obj_rec_t* rec;   /* loop index over objects in the room */
+    int32_t          n_obj; /* objects left to draw                */
+
+    /* The objects may have changed, so lines drawn ahead may be wrong. */
+    discard_margins(rv->ctx);
+
+    rv->objects = 0;
+    workers_run(draw_rows, rv, render_ctx_height(rv->ctx));
+    rv->objects = 1;
+
+    for (n_obj = room_objects(rv->room, &rec); 0 < n_obj; n_obj--, rec++) {
+        draw_planar_image(rv->ctx, rec->x, rec->y, &rec->img->planar[rec->x & 3]);
+    }
+}
+
+
+/*
+ * draw_rows
+ *   DESCRIPTION: Draws a range of rows of a room view's logical view
+ *                window.  Each row writes different bytes of the build
+ *                buffer, so ranges may be drawn in parallel.
+ *   INPUTS: view -- the room view(a room_view_t*)
+ *           lo -- first row to draw
+ *           hi -- row after the last row to draw
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the view's build buffer
+ */
+static void draw_rows(void* view, int lo, int hi) {
+    const room_view_t* rv = view; /* room view being drawn */
+
+    for (; lo < hi; lo++) {
+        (void)draw_horiz_line(rv->ctx, lo);
+    }
+}
+
+
 /*
  * image_height
  *   DESCRIPTION: Get height of object image in pixels.
@@ -291,21 +460,28 @@ uint32_t photo_width(const photo_t* p) {
 
 /*
  * prep_room
- *   DESCRIPTION: Prepare a new room for display.  You might want to set
- *                up the VGA palette registers according to the color
- *                palette that you chose for this room.
- *   INPUTS: r -- pointer to the new room
+ *   DESCRIPTION: Prepare a new room for display in a room view.  If the
+ *                view shows the room photo, the VGA palette registers are
+ *                set up according to the color palette chosen for the
+ *                photo(only one view should show photos, since all views
+ *                share the palette).
+ *   INPUTS: rv -- the room view
+ *           r -- pointer to the new room
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: changes recorded cur_room for this file
+ *   SIDE EFFECTS: changes the room recorded in the view
  */
-void prep_room(const room_t* r) {
+void prep_room(room_view_t* rv, const room_t* r) {
     /* Record the current room. */
-    cur_room = r;
+    rv->room = r;
     /*Get a pointer to the current room and use it to set the pallette*/
     photo_t * photo_struct = room_photo(r);
     /*Write the palette data to video memory*/
-    set_palette((unsigned char *)photo_struct->palette);
+    if (rv->photo) {
+        set_palette((unsigned char *)photo_struct->palette);
+    }
+    /*Lines are drawn ahead only within the photo*/
+    set_view_limits(rv->ctx, photo_struct->hdr.width, photo_struct->hdr.height);
 }
 
 
@@ -320,7 +496,27 @@ void prep_room(const room_t* r) {
  *   SIDE EFFECTS: dynamically allocates memory for the image
  */
 image_t* read_obj_image(const char* fname) {
-    FILE*    in;        /* input file               */
+    FILE* in; /* input file */
+
+    if (NULL == (in = open_asset(fname))) {
+        return NULL;
+    }
+    return decode_obj_image(in);
+}
+
+
+/*
+ * decode_obj_image
+ *   DESCRIPTION: Read size and pixel data in 2:2:2 RGB format from an
+ *                open image file and create an image structure from it.
+ *   INPUTS: in -- the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to newly allocated image on success, or NULL
+ *                 on failure
+ *   SIDE EFFECTS: dynamically allocates memory for the image; closes
+ *                 the file
+ */
+static image_t* decode_obj_image(FILE* in) {
     image_t* img = NULL;    /* image structure          */
     uint16_t x;            /* index over image columns */
     uint16_t y;            /* index over image rows    */
@@ -331,23 +527,20 @@ image_t* read_obj_image(const char* fname) {
      * sanity checks on it, and allocate space to hold the image pixels.
      * If anything fails, clean up as necessary and return NULL.
      */
-    if (NULL == (in = fopen(fname, "r+b")) ||
-        NULL == (img = malloc(sizeof (*img))) ||
+    if (NULL == (img = asset_alloc(sizeof (*img))) ||
         NULL != (img->img = NULL) || /* false clause for initialization */
         1 != fread(&img->hdr, sizeof (img->hdr), 1, in) ||
         MAX_OBJECT_WIDTH < img->hdr.width ||
         MAX_OBJECT_HEIGHT < img->hdr.height ||
-        NULL == (img->img = malloc
+        NULL == (img->img = asset_alloc
         (img->hdr.width * img->hdr.height * sizeof (img->img[0])))) {
         if (NULL != img) {
             if (NULL != img->img) {
-                free(img->img);
+                asset_free(img->img);
             }
-            free(img);
-        }
-        if (NULL != in) {
-            (void)fclose(in);
+            asset_free(img);
         }
+        (void)fclose(in);
         return NULL;
     }
 
@@ -366,8 +559,8 @@ image_t* read_obj_image(const char* fname) {
              * return NULL.
              */
             if (1 != fread(&pixel, sizeof (pixel), 1, in)) {
-                free(img->img);
-                free(img);
+                asset_free(img->img);
+                asset_free(img);
                 (void)fclose(in);
                 return NULL;
             }
@@ -377,12 +570,82 @@ image_t* read_obj_image(const char* fname) {
         }
     }
 
+    /* Make the planar copies of the image. */
+    if (!make_planar_images(img)) {
+        asset_free(img->img);
+        asset_free(img);
+        (void)fclose(in);
+        return NULL;
+    }
+
     /* All done.  Return success. */
+    img->asset = NULL;
     (void)fclose(in);
     return img;
 }
 
 
+/*
+ * make_planar_images
+ *   DESCRIPTION: Make four planar copies of an object image, one for each
+ *                phase(value of x & 3 at which the image starts).  In the
+ *                copy for phase ph, pixel i of a row lands in plane
+ *                (ph + i) & 3 at byte (ph + i) >> 2.
+ *   INPUTS: img -- the image, with pixel data already read
+ *   OUTPUTS: img -- planar and planar_mem filled in
+ *   RETURN VALUE: 1 on success, 0 if memory runs out
+ *   SIDE EFFECTS: dynamically allocates memory for the copies
+ */
+static int32_t make_planar_images(image_t* img) {
+    int32_t  width[4];  /* bytes per plane row for each phase */
+    int32_t  total;     /* bytes needed for all copies        */
+    uint8_t* mem;       /* next unused byte of planar_mem     */
+    uint8_t  pixel;     /* one pixel from the image           */
+    int32_t  ph;        /* loop index over phases             */
+    int32_t  plane;     /* loop index over planes             */
+    int32_t  x, y;      /* loop indices over image pixels     */
+    int32_t  off;       /* offset of pixel within its plane   */
+    uint8_t* data[4];   /* pixel data for each plane          */
+    uint8_t* mask[4];   /* opaque pixels for each plane       */
+
+    /* Each phase needs data and mask bytes for four planes. */
+    for (ph = 0, total = 0; ph < 4; ph++) {
+        width[ph] = (ph + img->hdr.width + 3) / 4;
+        total += 2 * 4 * width[ph] * img->hdr.height;
+    }
+    if (NULL == (img->planar_mem = asset_alloc(total))) {
+        return 0;
+    }
+    (void)memset(img->planar_mem, 0, total);
+
+    for (ph = 0, mem = img->planar_mem; ph < 4; ph++) {
+        img->planar[ph].width = width[ph];
+        img->planar[ph].height = img->hdr.height;
+        for (plane = 0; plane < 4; plane++) {
+            img->planar[ph].data[plane] = data[plane] = mem;
+            mem += width[ph] * img->hdr.height;
+            img->planar[ph].mask[plane] = mask[plane] = mem;
+            mem += width[ph] * img->hdr.height;
+        }
+
+        /* Copy the opaque pixels; transparent ones stay zero. */
+        for (y = 0; img->hdr.height > y; y++) {
+            for (x = 0; img->hdr.width > x; x++) {
+                pixel = img->img[img->hdr.width * y + x];
+                if (OBJ_CLR_TRANSP == pixel) {
+                    continue;
+                }
+                plane = (ph + x) & 3;
+                off = width[ph] * y + ((ph + x) >> 2);
+                data[plane][off] = pixel;
+                mask[plane][off] = 0xFF;
+            }
+        }
+    }
+    return 1;
+}
+
+
 /*
  * read_photo
  *   DESCRIPTION: Read size and pixel data in 5:6:5 RGB format from a
@@ -398,7 +661,28 @@ image_t* read_obj_image(const char* fname) {
  *   SIDE EFFECTS: dynamically allocates memory for the photo
  */
 photo_t* read_photo(const char* fname) {
-    FILE*    in;    /* input file               */
+    FILE* in; /* input file */
+
+    if (NULL == (in = open_asset(fname))) {
+        return NULL;
+    }
+    return decode_photo(in);
+}
+
+
+/*
+ * decode_photo
+ *   DESCRIPTION: Read size and pixel data in 5:6:5 RGB format from an
+ *                open photo file and create a photo structure from it,
+ *                with its palette.
+ *   INPUTS: in -- the file
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to newly allocated photo on success, or NULL
+ *                 on failure
+ *   SIDE EFFECTS: dynamically allocates memory for the photo; closes the
+ *                 file
+ */
+static photo_t* decode_photo(FILE* in) {
     photo_t* p = NULL;    /* photo structure          */
     uint16_t x;        /* index over image columns */
     uint16_t y;        /* index over image rows    */
@@ -409,28 +693,34 @@ photo_t* read_photo(const char* fname) {
      * sanity checks on it, and allocate space to hold the photo pixels.
      * If anything fails, clean up as necessary and return NULL.
      */
-    if (NULL == (in = fopen(fname, "r+b")) ||
-        NULL == (p = malloc(sizeof (*p))) ||
+    if (NULL == (p = asset_alloc(sizeof (*p))) ||
         NULL != (p->img = NULL) || /* false clause for initialization */
         1 != fread(&p->hdr, sizeof (p->hdr), 1, in) ||
         MAX_PHOTO_WIDTH < p->hdr.width ||
         MAX_PHOTO_HEIGHT < p->hdr.height ||
-        NULL == (p->img = malloc
+        NULL == (p->img = asset_alloc
         (p->hdr.width * p->hdr.height * sizeof (p->img[0])))) {
         if (NULL != p) {
             if (NULL != p->img) {
-                free(p->img);
+                asset_free(p->img);
             }
-            free(p);
-        }
-        if (NULL != in) {
-            (void)fclose(in);
+            asset_free(p);
         }
+        (void)fclose(in);
         return NULL;
     }
 
-    /*Generate an array to store the raw color data*/
-    uint16_t * raw_color_data = malloc(sizeof(pixel) * p->hdr.height * p->hdr.width);
+    /*Get scratch space to store the raw color data*/
+    if (NULL == scratch_arena) {
+        scratch_arena = arena_create(MAX_PHOTO_WIDTH * MAX_PHOTO_HEIGHT * sizeof (pixel), 0);
+    }
+    uint16_t * raw_color_data = (NULL == scratch_arena ? NULL :
+                                 arena_alloc(scratch_arena, sizeof(pixel) * p->hdr.height * p->hdr.width));
+    if (NULL == raw_color_data) {
+        destroy_photo(p);
+        (void)fclose(in);
+        return NULL;
+    }
 
     /*
      * Loop over rows from bottom to top.  Note that the file is stored
@@ -447,8 +737,8 @@ photo_t* read_photo(const char* fname) {
              * return NULL.
              */
             if (1 != fread(&pixel, sizeof (pixel), 1, in)) {
-                free(p->img);
-                free(p);
+                arena_reset(scratch_arena);
+                destroy_photo(p);
                 (void)fclose(in);
                 return NULL;
             }
@@ -473,14 +763,699 @@ photo_t* read_photo(const char* fname) {
 
     /*Generate the color pallette and free the raw color data*/
     gen_color_pallette(raw_color_data, p);
-    /*Free the raw color data array because we no longer need it*/
-    free(raw_color_data);
+    /*Give back the scratch space because we no longer need it*/
+    arena_reset(scratch_arena);
 
     /* All done.  Return success. */
+    p->asset = NULL;
     (void)fclose(in);
     return p;
 }
 
+
+/*
+ * add_asset
+ *   DESCRIPTION: Adds a file to the shared photos and images, with nothing
+ *                read yet.
+ *   INPUTS: fname -- the file name
+ *           bucket -- the hash chain for the name(from find_asset)
+ *           photo -- 1 for a photo, 0 for an image
+ *   OUTPUTS: none
+ *   RETURN VALUE: the asset(with no loads), or NULL if memory runs out
+ *   SIDE EFFECTS: dynamically allocates memory for the asset
+ */
+static asset_t* add_asset(const char* fname, uint32_t bucket, int32_t photo) {
+    asset_t* a; /* new asset */
+
+    if (NULL == (a = malloc(sizeof (*a) + strlen(fname) + 1))) {
+        return NULL;
+    }
+    a->data = NULL;
+    a->photo = photo;
+    a->refs = 0;
+    a->size = 0;
+    a->name = strcpy((char*)(a + 1), fname);
+    a->next = asset_table[bucket];
+    asset_table[bucket] = a;
+    return a;
+}
+
+
+/*
+ * asset_alloc
+ *   DESCRIPTION: Allocates memory for part of a photo or image, from the
+ *                asset arena if there is room(making the arena the first
+ *                time, if anything has been reserved), else from malloc.
+ *   INPUTS: size -- bytes wanted
+ *   OUTPUTS: none
+ *   RETURN VALUE: the memory, or NULL on failure
+ *   SIDE EFFECTS: may map the asset arena
+ */
+static void* asset_alloc(size_t size) {
+    void* p; /* the memory */
+
+    if (NULL == asset_arena && 0 != reserved_bytes) {
+        asset_arena = arena_create(reserved_bytes, PHOTO_USE_HUGE_PAGES);
+        reserved_bytes = 0;
+    }
+    if (NULL != asset_arena && NULL != (p = arena_alloc(asset_arena, size))) {
+        return p;
+    }
+    return malloc(size);
+}
+
+
+/*
+ * asset_free
+ *   DESCRIPTION: Frees memory from asset_alloc.  Memory in the asset arena
+ *                is kept until free_assets.
+ *   INPUTS: p -- the memory
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void asset_free(void* p) {
+    if (!arena_owns(asset_arena, p)) {
+        free(p);
+    }
+}
+
+
+/*
+ * close_pack
+ *   DESCRIPTION: Closes the asset pack, if one is open.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: unmaps and closes the pack
+ */
+static void close_pack() {
+    if (NULL != pack_map) {
+        (void)munmap((void*)pack_map, pack_size);
+        (void)close(pack_fd);
+        pack_map = NULL;
+        pack_files = 0;
+    }
+}
+
+
+/*
+ * destroy_image
+ *   DESCRIPTION: Frees an object image.
+ *   INPUTS: img -- the image
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void destroy_image(image_t* img) {
+    asset_free(img->planar_mem);
+    asset_free(img->img);
+    asset_free(img);
+}
+
+
+/*
+ * destroy_photo
+ *   DESCRIPTION: Frees a room photo.
+ *   INPUTS: p -- the photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void destroy_photo(photo_t* p) {
+    asset_free(p->img);
+    asset_free(p);
+}
+
+
+/*
+ * drop_asset
+ *   DESCRIPTION: Releases one load of a shared photo or image.
+ *   INPUTS: a -- the asset
+ *   OUTPUTS: none
+ *   RETURN VALUE: loads left, or 0 after the last load
+ *   SIDE EFFECTS: after the last load, unlinks and frees the asset(but
+ *                 not its photo or image, which the caller frees)
+ */
+static uint32_t drop_asset(asset_t* a) {
+    asset_t** find;   /* loop index over pointers to assets in chain */
+    uint32_t  bucket; /* hash chain of asset                         */
+
+    if (1 < a->refs) {
+        n_shared_loads--;
+        shared_bytes -= a->size;
+        return --a->refs;
+    }
+    (void)find_asset(a->name, &bucket);
+    for (find = &asset_table[bucket]; a != *find; find = &(*find)->next) {
+    }
+    *find = a->next;
+    free(a);
+    return 0;
+}
+
+
+/*
+ * find_asset
+ *   DESCRIPTION: Looks up a shared photo or image by file name.
+ *   INPUTS: fname -- the file name
+ *   OUTPUTS: bucket -- the hash chain for the name
+ *   RETURN VALUE: the asset, or NULL if the file is not known
+ *   SIDE EFFECTS: none
+ */
+static asset_t* find_asset(const char* fname, uint32_t* bucket) {
+    uint32_t    h; /* FNV-1a hash of name     */
+    const char* s; /* index over name         */
+    asset_t*    a; /* index over hash chain   */
+
+    for (h = 2166136261U, s = fname; '\0' != *s; s++) {
+        h = (h ^ (uint8_t)*s) * 16777619U;
+    }
+    *bucket = h & (ASSET_BUCKETS - 1);
+    for (a = asset_table[*bucket]; NULL != a; a = a->next) {
+        if (0 == strcmp(a->name, fname)) {
+            return a;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * find_in_pack
+ *   DESCRIPTION: Looks up a file in the asset pack by binary search.
+ *   INPUTS: fname -- the file name
+ *   OUTPUTS: none
+ *   RETURN VALUE: the file's entry, or NULL if no pack is open or the
+ *                 pack does not hold the file
+ *   SIDE EFFECTS: none
+ */
+static const pack_entry_t* find_in_pack(const char* fname) {
+    uint32_t lo, hi; /* entries still to search   */
+    uint32_t mid;    /* entry compared            */
+    int      cmp;    /* result of comparison      */
+
+    for (lo = 0, hi = pack_files; lo < hi; ) {
+        mid = lo + (hi - lo) / 2;
+        if (0 == (cmp = strcmp(fname, pack_str + pack_ent[mid].name))) {
+            return &pack_ent[mid];
+        }
+        if (0 > cmp) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return NULL;
+}
+
+
+/*
+ * free_assets
+ *   DESCRIPTION: Frees every shared photo and image at once, along with
+ *                the arenas, whether or not their loads were released,
+ *                and closes the asset pack.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: photos and images from load_photo and load_obj_image
+ *                 must no longer be used
+ */
+void free_assets() {
+    asset_t* a;      /* asset being freed          */
+    uint32_t bucket; /* index over hash chains     */
+
+    for (bucket = 0; ASSET_BUCKETS > bucket; bucket++) {
+        while (NULL != (a = asset_table[bucket])) {
+            asset_table[bucket] = a->next;
+            if (NULL != a->data && a->photo) {
+                destroy_photo(a->data);
+            } else if (NULL != a->data) {
+                destroy_image(a->data);
+            }
+            free(a);
+        }
+    }
+    arena_destroy(asset_arena);
+    arena_destroy(scratch_arena);
+    close_pack();
+    asset_arena = scratch_arena = NULL;
+    reserved_bytes = 0;
+    n_shared_loads = 0;
+    shared_bytes = 0;
+}
+
+
+/*
+ * image_bytes
+ *   DESCRIPTION: Get the memory taken by an object image of a given size,
+ *                in the asset arena.
+ *   INPUTS: width, height -- image size in pixels
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of bytes
+ *   SIDE EFFECTS: none
+ */
+static uint32_t image_bytes(uint32_t width, uint32_t height) {
+    uint32_t total; /* bytes for the planar copies */
+    int32_t  ph;    /* index over phases           */
+
+    /* See make_planar_images. */
+    for (ph = 0, total = 0; 4 > ph; ph++) {
+        total += 2 * 4 * ((ph + width + 3) / 4) * height;
+    }
+    return ARENA_ROUND(sizeof (image_t)) + ARENA_ROUND(width * height) + ARENA_ROUND(total);
+}
+
+
+/*
+ * load_obj_image
+ *   DESCRIPTION: Loads an object image, sharing it with any other loads
+ *                of the same file.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: none
+ *   RETURN VALUE: the image, or NULL on failure
+ *   SIDE EFFECTS: reads and shares the image the first time(unless
+ *                 preloaded); counts the memory saved by the later loads
+ */
+image_t* load_obj_image(const char* fname) {
+    asset_t* a;      /* shared asset                  */
+    uint32_t bucket; /* hash chain for the file name  */
+    image_t* img;    /* the image                     */
+
+    if (NULL != (a = find_asset(fname, &bucket)) && NULL != a->data) {
+        if (0 < a->refs++) {
+            n_shared_loads++;
+            shared_bytes += a->size;
+        }
+        return a->data;
+    }
+    if (NULL == (img = read_obj_image(fname))) {
+        return NULL;
+    }
+    if (NULL == a && NULL == (a = add_asset(fname, bucket, 0))) {
+        destroy_image(img);
+        return NULL;
+    }
+    a->data = img;
+    a->refs = 1;
+    a->size = image_bytes(img->hdr.width, img->hdr.height);
+    img->asset = a;
+    return img;
+}
+
+
+/*
+ * load_photo
+ *   DESCRIPTION: Loads a room photo, sharing it with any other loads of
+ *                the same file.
+ *   INPUTS: fname -- file name for input
+ *   OUTPUTS: none
+ *   RETURN VALUE: the photo, or NULL on failure
+ *   SIDE EFFECTS: reads and shares the photo the first time(unless
+ *                 preloaded); counts the memory saved by the later loads
+ */
+photo_t* load_photo(const char* fname) {
+    asset_t* a;      /* shared asset                  */
+    uint32_t bucket; /* hash chain for the file name  */
+    photo_t* p;      /* the photo                     */
+
+    if (NULL != (a = find_asset(fname, &bucket)) && NULL != a->data) {
+        if (0 < a->refs++) {
+            n_shared_loads++;
+            shared_bytes += a->size;
+        }
+        return a->data;
+    }
+    if (NULL == (p = read_photo(fname))) {
+        return NULL;
+    }
+    if (NULL == a && NULL == (a = add_asset(fname, bucket, 1))) {
+        destroy_photo(p);
+        return NULL;
+    }
+    a->data = p;
+    a->refs = 1;
+    a->size = photo_bytes(p->hdr.width, p->hdr.height);
+    p->asset = a;
+    return p;
+}
+
+
+/*
+ * open_asset
+ *   DESCRIPTION: Opens a photo or image file for reading: the copy in the
+ *                asset pack, if one is open and holds the file, or else
+ *                the file itself.
+ *   INPUTS: fname -- the file name
+ *   OUTPUTS: none
+ *   RETURN VALUE: the open file, or NULL on failure
+ *   SIDE EFFECTS: none
+ */
+static FILE* open_asset(const char* fname) {
+    const pack_entry_t* e; /* the file's entry in the pack */
+
+    if (NULL != (e = find_in_pack(fname))) {
+        return fmemopen((void*)(pack_map + e->offset), e->size, "rb");
+    }
+    return fopen(fname, "rb");
+}
+
+
+/*
+ * open_pack
+ *   DESCRIPTION: Maps an asset pack(see photo_headers.h), from which the
+ *                photos and images it holds are then read.  Files not in
+ *                the pack are still read from their own files.  Any pack
+ *                already open is closed first.
+ *   INPUTS: fname -- the pack file name
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 if the pack is missing or bad
+ *   SIDE EFFECTS: maps the pack and keeps it open(for preload_assets);
+ *                 prints a message if the pack is bad
+ */
+int32_t open_pack(const char* fname) {
+    int                  fd;   /* pack file descriptor */
+    struct stat          st;   /* pack file status     */
+    void*                map;  /* the mapping          */
+    const pack_header_t* hdr;  /* pack header          */
+    const pack_entry_t*  ent;  /* table of contents    */
+    const char*          str;  /* file names           */
+    uint32_t             i;    /* index over entries   */
+
+    close_pack();
+    if (-1 == (fd = open(fname, O_RDONLY))) {
+        return 0;
+    }
+    if (-1 == fstat(fd, &st) || sizeof (*hdr) > (size_t)st.st_size ||
+        MAP_FAILED == (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))) {
+        fprintf(stderr, "Can't map asset pack %s.\n", fname);
+        (void)close(fd);
+        return 0;
+    }
+
+    /* Check the header, the names, and the bounds of every file. */
+    hdr = map;
+    ent = (const pack_entry_t*)(hdr + 1);
+    str = (const char*)(ent + hdr->n_files);
+    if (PACK_MAGIC != hdr->magic || PACK_VERSION != hdr->version ||
+        ((size_t)st.st_size - sizeof (*hdr)) / sizeof (*ent) < hdr->n_files ||
+        (size_t)st.st_size - sizeof (*hdr) - hdr->n_files * sizeof (*ent) < hdr->str_size ||
+        (0 != hdr->n_files && (0 == hdr->str_size || '\0' != str[hdr->str_size - 1]))) {
+        i = 0;
+    } else {
+        for (i = 0; hdr->n_files > i; i++) {
+            if (hdr->str_size <= ent[i].name || (uint64_t)st.st_size < ent[i].offset ||
+                (uint64_t)st.st_size - ent[i].offset < ent[i].size ||
+                (0 < i && 0 <= strcmp(str + ent[i - 1].name, str + ent[i].name))) {
+                break;
+            }
+        }
+        i = (hdr->n_files == i);
+    }
+    if (!i) {
+        fprintf(stderr, "Asset pack %s is corrupt.\n", fname);
+        (void)munmap(map, st.st_size);
+        (void)close(fd);
+        return 0;
+    }
+
+    pack_fd = fd;
+    pack_map = map;
+    pack_size = st.st_size;
+    pack_ent = ent;
+    pack_files = hdr->n_files;
+    pack_str = str;
+    return 1;
+}
+
+
+/*
+ * photo_bytes
+ *   DESCRIPTION: Get the memory taken by a room photo of a given size, in
+ *                the asset arena.
+ *   INPUTS: width, height -- photo size in pixels
+ *   OUTPUTS: none
+ *   RETURN VALUE: the number of bytes
+ *   SIDE EFFECTS: none
+ */
+static uint32_t photo_bytes(uint32_t width, uint32_t height) {
+    return ARENA_ROUND(sizeof (photo_t)) + ARENA_ROUND(width * height);
+}
+
+
+/*
+ * preload_assets
+ *   DESCRIPTION: Reads every reserved photo and image not yet loaded, all
+ *                at once through a loader(see loader.h), and decodes each
+ *                as its read finishes, so that decoding overlaps the
+ *                reads still in flight.  Files in the asset pack are read
+ *                from the pack.  The file named first is read first, and
+ *                the time until it is decoded is kept as the time to the
+ *                first room.  Files that cannot be read or decoded are
+ *                left for load_photo and load_obj_image, which report
+ *                them.
+ *   INPUTS: first -- the file to read first(such as the starting room's
+ *                    photo), or NULL
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: decodes files into the shared photos and images, with
+ *                 no loads yet; records how it went(see preload_stats)
+ */
+void preload_assets(const char* first) {
+    const char*         how;    /* MP2_LOADER setting             */
+    uint64_t            start;  /* time preloading started        */
+    asset_t**           todo;   /* the assets to read             */
+    load_req_t*         req;    /* their reads                    */
+    int32_t             n;      /* number of reads                */
+    int32_t             i;      /* index over reads               */
+    uint32_t            bucket; /* index over hash chains         */
+    asset_t*            a;      /* an asset                       */
+    const pack_entry_t* e;      /* its entry in the pack          */
+    struct stat         st;     /* status of its own file         */
+    load_req_t          swap;   /* read being moved to the front  */
+    loader_t*           l;      /* the loader                     */
+    const uint8_t*      buf;    /* data read                      */
+    FILE*               in;     /* the data, as a file            */
+    photo_t*            p;      /* a photo decoded                */
+    image_t*            img;    /* an image decoded               */
+
+    (void)memset(&preload, 0, sizeof (preload));
+    preload.method = "none";
+    how = getenv("MP2_LOADER");
+    if (!PHOTO_ASYNC_LOAD || (NULL != how && 0 == strcmp(how, "off"))) {
+        return;
+    }
+    start = timing_now();
+
+    for (bucket = n = 0; ASSET_BUCKETS > bucket; bucket++) {
+        for (a = asset_table[bucket]; NULL != a; a = a->next) {
+            n++;
+        }
+    }
+    todo = malloc((0 == n ? 1 : n) * sizeof (todo[0]));
+    req = malloc((0 == n ? 1 : n) * sizeof (req[0]));
+    if (NULL == todo || NULL == req) {
+        free(todo);
+        free(req);
+        return;
+    }
+
+    /* Find where each file is, putting the first one first. */
+    for (bucket = n = 0; ASSET_BUCKETS > bucket; bucket++) {
+        for (a = asset_table[bucket]; NULL != a; a = a->next) {
+            if (NULL != a->data) {
+                continue;
+            }
+            if (NULL != (e = find_in_pack(a->name))) {
+                req[n].fd = pack_fd;
+                req[n].offset = e->offset;
+                req[n].size = e->size;
+            } else if (-1 == (req[n].fd = open(a->name, O_RDONLY))) {
+                continue;
+            } else if (-1 == fstat(req[n].fd, &st) || UINT32_MAX < (uint64_t)st.st_size) {
+                (void)close(req[n].fd);
+                continue;
+            } else {
+                req[n].offset = 0;
+                req[n].size = st.st_size;
+            }
+            todo[n] = a;
+            if (NULL != first && 0 == strcmp(first, a->name)) {
+                swap = req[n];
+                req[n] = req[0];
+                req[0] = swap;
+                todo[n] = todo[0];
+                todo[0] = a;
+            }
+            n++;
+        }
+    }
+
+    /* Decode each file as its read finishes. */
+    if (0 < n && NULL != (l = loader_start(req, n, NULL == how || 0 != strcmp(how, "threads")))) {
+        while (loader_next(l, &i, &buf)) {
+            a = todo[i];
+            if (NULL == buf || NULL == (in = fmemopen((void*)buf, req[i].size, "rb"))) {
+                continue;
+            }
+            if (a->photo && NULL != (p = decode_photo(in))) {
+                p->asset = a;
+                a->data = p;
+                a->size = photo_bytes(p->hdr.width, p->hdr.height);
+            } else if (!a->photo && NULL != (img = decode_obj_image(in))) {
+                img->asset = a;
+                a->data = img;
+                a->size = image_bytes(img->hdr.width, img->hdr.height);
+            } else {
+                continue;
+            }
+            a->refs = 0;
+            preload.n_files++;
+            preload.bytes += req[i].size;
+            if (NULL != first && 0 == i) {
+                preload.first_ns = timing_now() - start;
+            }
+        }
+        preload.method = loader_method(l);
+        preload.depth = loader_depth(l);
+        loader_finish(l);
+    }
+
+    for (i = 0; n > i; i++) {
+        if (NULL == pack_map || pack_fd != req[i].fd) {
+            (void)close(req[i].fd);
+        }
+    }
+    free(todo);
+    free(req);
+    preload.total_ns = timing_now() - start;
+}
+
+
+/*
+ * preload_stats
+ *   DESCRIPTION: Reports how the last preload_assets went.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the loader used, queue depth reached, files and bytes
+ *                 read, and times taken
+ *   SIDE EFFECTS: none
+ */
+const preload_stats_t* preload_stats() {
+    return &preload;
+}
+
+
+/*
+ * release_obj_image
+ *   DESCRIPTION: Releases an object image from read_obj_image or one load
+ *                of it by load_obj_image.
+ *   INPUTS: img -- the image
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the image when nothing else holds it
+ */
+void release_obj_image(image_t* img) {
+    if (NULL != img->asset && 0 < drop_asset(img->asset)) {
+        return;
+    }
+    destroy_image(img);
+}
+
+
+/*
+ * release_photo
+ *   DESCRIPTION: Releases a room photo from read_photo or one load of it
+ *                by load_photo.
+ *   INPUTS: p -- the photo
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees the photo when nothing else holds it
+ */
+void release_photo(photo_t* p) {
+    if (NULL != p->asset && 0 < drop_asset(p->asset)) {
+        return;
+    }
+    destroy_photo(p);
+}
+
+
+/*
+ * reserve_asset
+ *   DESCRIPTION: Reserves room in the asset arena for a photo or image
+ *                file, once for each file, by the size in its header.
+ *   INPUTS: fname -- the file name
+ *           photo -- 1 for a photo, 0 for an image
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 if the header cannot be read or memory
+ *                 runs out
+ *   SIDE EFFECTS: adds the file to the shared photos and images
+ */
+static int32_t reserve_asset(const char* fname, int32_t photo) {
+    FILE*          in;     /* input file                    */
+    photo_header_t hdr;    /* file header                   */
+    uint32_t       bucket; /* hash chain for the file name  */
+    asset_t*       a;      /* the new asset                 */
+
+    if (NULL != find_asset(fname, &bucket)) {
+        return 1;
+    }
+    if (NULL == (in = open_asset(fname))) {
+        return 0;
+    }
+    if (1 != fread(&hdr, sizeof (hdr), 1, in) ||
+        NULL == (a = add_asset(fname, bucket, photo))) {
+        (void)fclose(in);
+        return 0;
+    }
+    (void)fclose(in);
+    reserved_bytes += (photo ? photo_bytes(hdr.width, hdr.height) :
+                       image_bytes(hdr.width, hdr.height));
+    return 1;
+}
+
+
+/*
+ * reserve_obj_image
+ *   DESCRIPTION: Reserves room in the asset arena for an object image.
+ *   INPUTS: fname -- the file name
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 if the header cannot be read or memory
+ *                 runs out
+ *   SIDE EFFECTS: adds the file to the shared photos and images
+ */
+int32_t reserve_obj_image(const char* fname) {
+    return reserve_asset(fname, 0);
+}
+
+
+/*
+ * reserve_photo
+ *   DESCRIPTION: Reserves room in the asset arena for a room photo.
+ *   INPUTS: fname -- the file name
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 if the header cannot be read or memory
+ *                 runs out
+ *   SIDE EFFECTS: adds the file to the shared photos and images
+ */
+int32_t reserve_photo(const char* fname) {
+    return reserve_asset(fname, 1);
+}
+
+
+/*
+ * shared_asset_savings
+ *   DESCRIPTION: Reports what sharing photos and images has saved.
+ *   INPUTS: none
+ *   OUTPUTS: n_loads -- loads that found the file already loaded
+ *   RETURN VALUE: bytes of memory those loads did not need
+ *   SIDE EFFECTS: none
+ */
+uint64_t shared_asset_savings(uint32_t* n_loads) {
+    *n_loads = n_shared_loads;
+    return shared_bytes;
+}
+
 /* inverse_cmp is a comparison function used by qsort
  * later in the program.it returns -1 when a > b and 1 otherwise.
  * It is inverted so that when the array is sorted, the largest
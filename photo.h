@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       3
+ * Version:       8
  * Creation Date: Fri Sep 9 21:45:34 2011
  * Filename:      photo.h
  * History:
@@ -33,6 +33,16 @@
  *        Completed initial implementation.
  *    SL    3    Wed Sep 14 21:56:08 2011
  *        Cleaned up code for distribution.
+ *          4
+ *        Added room views for drawing through render contexts.
+ *          5
+ *        Added shared loading of photos and images.
+ *          6
+ *        Added reserve_photo, reserve_obj_image, and free_assets.
+ *          7
+ *        Added asset packs.
+ *          8
+ *        Added preload_assets.
  */
 #ifndef PHOTO_H
 #define PHOTO_H
@@ -78,11 +88,27 @@
 #define LEVEL2_VIDMEM_OFFSET 128
 #define LEVEL4_COLORS_USED 128
 
-/* Fill a buffer with the pixels for a horizontal line of current room. */
-extern void fill_horiz_buffer(int x, int y, unsigned char buf[SCROLL_X_DIM]);
+/*
+ * A room view shows a room through a render context, and is the argument
+ * for the context's line functions(fill_horiz_buffer and fill_vert_buffer).
+ * Set up ctx and photo, then choose the room with prep_room.
+ */
+typedef struct room_view_t room_view_t;
+struct room_view_t {
+    render_ctx_t* ctx;     /* context drawing the view                     */
+    const room_t* room;    /* room shown(set by prep_room)                 */
+    int32_t       photo;   /* 1 to show the room photo, 0 for objects only */
+    int32_t       objects; /* 0 while redraw_room_view draws the objects   */
+};
+
+/* Fill a buffer with the pixels for a horizontal line of a room view. */
+extern void fill_horiz_buffer(void* arg, int x, int y, int n, unsigned char* buf);
 
-/* Fill a buffer with the pixels for a vertical line of current room. */
-extern void fill_vert_buffer(int x, int y, unsigned char buf[SCROLL_Y_DIM]);
+/* Fill a buffer with the pixels for a vertical line of a room view. */
+extern void fill_vert_buffer(void* arg, int x, int y, int n, unsigned char* buf);
+
+/* Draw the whole view window, drawing objects directly into the planes. */
+extern void redraw_room_view(room_view_t* rv);
 
 /* Get height of object image in pixels. */
 extern uint32_t image_height(const image_t* im);
@@ -97,10 +123,10 @@ extern uint32_t photo_height(const photo_t* p);
 extern uint32_t photo_width(const photo_t* p);
 
 /*
- * Prepare room for display(record pointer for use by callbacks, set up
- * VGA palette, etc.).
+ * Prepare room for display in a room view(record pointer for use by
+ * callbacks, set up VGA palette, etc.).
  */
-extern void prep_room(const room_t* r);
+extern void prep_room(room_view_t* rv, const room_t* r);
 
 /* Read object image from a file into a dynamically allocated structure. */
 extern image_t* read_obj_image(const char* fname);
@@ -109,11 +135,67 @@ extern image_t* read_obj_image(const char* fname);
 extern photo_t* read_photo(const char* fname);
 
 /*
- * N.B.  I'm aware that Valgrind and similar tools will report the fact that
- * I chose not to bother freeing image data before terminating the program.
- * It's probably a bad habit, but ... maybe in a future release (FIXME).
- * (The data are needed until the program terminates, and all data are freed
- * when a program terminates.)
+ * Load a room photo or object image, reading each file only once: later
+ * loads of the same file name share the first.  Release each load(or a
+ * photo or image from read_photo or read_obj_image) when done with it;
+ * the last release frees the photo or image.  Not for use by more than
+ * one thread at a time.
+ */
+extern photo_t* load_photo(const char* fname);
+extern image_t* load_obj_image(const char* fname);
+extern void release_photo(photo_t* p);
+extern void release_obj_image(image_t* img);
+
+/*
+ * Reserve room for a photo or image file before loading anything: the
+ * first load makes one arena big enough for every file reserved(from
+ * the sizes in their headers), and every photo or image read goes in it
+ * while there is room.  Returns 1 on success, or 0 if the file's header
+ * cannot be read.
+ */
+extern int32_t reserve_photo(const char* fname);
+extern int32_t reserve_obj_image(const char* fname);
+
+/*
+ * Free every photo and image loaded, and the arena, at once(at the end
+ * of the game), and close the asset pack.  None may be used afterward.
+ */
+extern void free_assets();
+
+/* the asset pack read by default(built from images/ by mkpack) */
+#define PACK_FILE "images.pack"
+
+/*
+ * Map an asset pack(see photo_headers.h), from which photos and images
+ * are then read; those not in the pack are read from their own files.
+ * Returns 1 on success, or 0 if the pack is missing or bad.
+ */
+extern int32_t open_pack(const char* fname);
+
+/*
+ * Read every photo and image reserved but not yet loaded, all at once,
+ * decoding each as its read finishes(see loader.h); the file named first
+ * (or NULL) is read first.  Loads of the files then find them decoded.
+ * Files that fail are left to be read when loaded.
+ */
+extern void preload_assets(const char* first);
+
+/* how the last preload_assets went */
+typedef struct preload_stats_t {
+    const char* method;   /* loader used("none" if none)            */
+    int32_t     depth;    /* most reads in flight at once           */
+    uint32_t    n_files;  /* files read and decoded                 */
+    uint64_t    bytes;    /* bytes read                             */
+    uint64_t    first_ns; /* time until the first file was decoded  */
+    uint64_t    total_ns; /* time until every file was decoded      */
+} preload_stats_t;
+
+extern const preload_stats_t* preload_stats(void);
+
+/*
+ * Get the number of loads that shared a photo or image loaded before,
+ * and return the bytes of memory they saved.
  */
+extern uint64_t shared_asset_savings(uint32_t* n_loads);
 
 #endif /* PHOTO_H */
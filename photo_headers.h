@@ -23,12 +23,14 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       1
+ * Version:       2
  * Creation Date: Wed Sep 14 10:08:14 2011
  * Filename:      photo_headers.h
  * History:
  *    SL    1    Wed Sep 14 10:08:14 2011
  *        Extracted from mp2photo.c for unification purposes.
+ *          2
+ *        Added the asset pack file format.
  */
 
 #ifndef PHOTO_HEADERS_H
@@ -81,4 +83,33 @@ struct photo_header_t {
     uint16_t height;    /* image height in pixels */
 };
 
+/*
+ * Asset pack file(written by mkpack, mapped by open_pack in photo.c):
+ * room photo and object image files gathered into one, so that the game
+ * can map them all at once instead of opening each.  The file starts with
+ * a pack_header_t, followed by n_files pack_entry_t sorted by file name
+ * (in strcmp order), then str_size bytes of NUL-terminated file names.
+ * The contents of each file follow, unchanged, each starting at a
+ * multiple of PACK_ALIGN bytes from the start of the pack.
+ */
+#define PACK_MAGIC   0x4B434150  /* "PACK" in a little-endian word */
+#define PACK_VERSION 1
+#define PACK_ALIGN   64          /* alignment of file contents     */
+
+typedef struct pack_header_t pack_header_t;
+struct pack_header_t {
+    uint32_t magic;     /* PACK_MAGIC                     */
+    uint32_t version;   /* PACK_VERSION                   */
+    uint32_t n_files;   /* number of entries              */
+    uint32_t str_size;  /* bytes of file names            */
+};
+
+typedef struct pack_entry_t pack_entry_t;
+struct pack_entry_t {
+    uint64_t offset;    /* start of contents in the pack  */
+    uint64_t size;      /* bytes of contents              */
+    uint32_t name;      /* offset of name in file names   */
+    uint32_t pad;       /* zero(keeps entries aligned)    */
+};
+
 #endif /* PHOTO_HEADERS_H */
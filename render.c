@@ -0,0 +1,552 @@
+/* tab:4
+ *
+ * render.c - render thread for the adventure game
+ *
+ * Version:       3
+ * Filename:      render.c
+ * History:
+ *    1    First written.
+ *    2    Added a picture-in-picture inventory view.
+ *    3    Moved drawing margin lines ahead onto the render thread.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "modex.h"
+#include "photo.h"
+#include "render.h"
+#include "text.h"
+#include "world.h"
+
+
+/* maximum length of text shown in the status bar */
+#define RENDER_TEXT_LEN    (STATUS_X_DIM / FONT_WIDTH)
+
+/* number of requests that fit in the queue; must be a power of two */
+#define RENDER_QUEUE_LEN   64
+
+/* size of the inventory view, shown in the lower right of the main view */
+#define INV_X_DIM          128
+#define INV_Y_DIM          72
+
+/* types of request sent to the render thread */
+typedef enum {
+    RQ_ENTER_ROOM, /* prepare and draw a new room    */
+    RQ_SCROLL,     /* move the view window           */
+    RQ_REDRAW,     /* draw the whole view again      */
+    RQ_INVENTORY,  /* show or hide the inventory     */
+    RQ_STATUS,     /* fill the status bar            */
+    RQ_FRAME,      /* show the view on the display   */
+    RQ_PREFILL,    /* draw margin lines when idle    */
+    RQ_SYNC,       /* wake the game thread           */
+    RQ_QUIT        /* stop the render thread         */
+} request_type_t;
+
+/* one request to the render thread */
+typedef struct {
+    request_type_t type;                   /* kind of request            */
+    const room_t*  room;                   /* room entered(RQ_ENTER_ROOM) or
+                                              inventory(RQ_INVENTORY)     */
+    int            x, y;                   /* new view(RQ_SCROLL)         */
+    char           text[RENDER_TEXT_LEN + 1]; /* status text(RQ_STATUS)   */
+} request_t;
+
+
+/* local functions--see function headers for details */
+static void carry_out(const request_t* rq);
+static void draw_exposed_lines(int x, int y);
+static void show_inventory(const room_t* r);
+static void send_request(request_t* rq, int may_drop);
+static void* render_thread(void* ignore);
+
+
+/*
+ * The request queue has a single producer(the game thread) and a single
+ * consumer(the render thread), so it needs no lock.  The producer alone
+ * writes q_tail, and the consumer alone writes q_head; each index only
+ * increases(wrapping through RENDER_QUEUE_LEN using a mask).  Stores to
+ * an index use release semantics so that the request contents are
+ * visible before the index update, and loads of the other side's index
+ * use acquire semantics.  The consumer sleeps on q_sem, which is posted
+ * once per request.
+ */
+static request_t q_slot[RENDER_QUEUE_LEN];
+static unsigned int q_head;  /* next request to carry out */
+static unsigned int q_tail;  /* next free slot            */
+static sem_t q_sem;          /* counts queued requests    */
+static sem_t sync_sem;       /* posted for each RQ_SYNC   */
+
+static pthread_t render_thread_id;
+static int running = 0;      /* is the render thread running? */
+static int dropped = 0;      /* requests dropped(queue full)  */
+static int prefill = 0;      /* margin lines may be missing(owned
+                                by the render thread)          */
+
+/*
+ * Scrolls that exposed at least one line, and those among them for which
+ * every exposed line had been drawn ahead of time(see modex.h).
+ */
+static unsigned int scrolls = 0;
+static unsigned int margin_scrolls = 0;
+
+/* view window last set by a request(owned by the rendering side) */
+static int view_x, view_y;
+
+/*
+ * The main view shows the player's room.  The inventory view, if shown,
+ * draws the objects in the inventory(without its photo, whose palette
+ * would clash with the main view's) in a smaller render context on top
+ * of the main one.  It is hidden while the player is in the inventory.
+ * Both are owned by the rendering side.
+ */
+static room_view_t main_view = {NULL, NULL, 1, 1};
+static room_view_t inv_view = {NULL, NULL, 0, 1};
+static int inv_shown = 0;    /* has the inventory view been requested? */
+
+
+/*
+ * render_open
+ *   DESCRIPTION: Makes the render context for the main view.  Must be
+ *                called after mode X is set, before any other request.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: allocates memory
+ */
+int render_open() {
+    if (NULL == main_view.ctx &&
+        NULL == (main_view.ctx = new_render_ctx(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM,
+                                                fill_horiz_buffer, fill_vert_buffer,
+                                                &main_view))) {
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * render_start
+ *   DESCRIPTION: Starts the render thread.  Requests made afterward are
+ *                queued for that thread.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: creates a thread
+ */
+int render_start() {
+    if (running) {
+        return 0;
+    }
+    q_head = q_tail = 0;
+    if (0 != sem_init(&q_sem, 0, 0) || 0 != sem_init(&sync_sem, 0, 0)) {
+        perror("sem_init");
+        return -1;
+    }
+    if (0 != pthread_create(&render_thread_id, NULL, render_thread, NULL)) {
+        return -1;
+    }
+    running = 1;
+    return 0;
+}
+
+
+/*
+ * render_stop
+ *   DESCRIPTION: Stops the render thread after it carries out all queued
+ *                requests.  Used as a cleanup method(see assert.h).
+ *   INPUTS: none(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: joins the render thread; later requests are carried out
+ *                 by the caller
+ */
+void render_stop(void* ignore) {
+    request_t rq; /* request to stop */
+
+    if (!running) {
+        return;
+    }
+    rq.type = RQ_QUIT;
+    send_request(&rq, 0);
+    (void)pthread_join(render_thread_id, NULL);
+    running = 0;
+    (void)sem_destroy(&q_sem);
+    (void)sem_destroy(&sync_sem);
+    if (0 != dropped) {
+        fprintf(stderr, "render: %d requests dropped\n", dropped);
+    }
+    if (0 != scrolls) {
+        fprintf(stderr, "render: %u of %u scrolls(%.1f%%) drawn ahead\n",
+                margin_scrolls, scrolls, 100.0 * margin_scrolls / scrolls);
+    }
+}
+
+
+/*
+ * render_enter_room
+ *   DESCRIPTION: Prepares the palette and photo drawing for a room and
+ *                draws it with the view window at(0,0).
+ *   INPUTS: r -- the room entered
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer(possibly later)
+ */
+void render_enter_room(const room_t* r) {
+    request_t rq; /* request to send */
+
+    rq.type = RQ_ENTER_ROOM;
+    rq.room = r;
+    send_request(&rq, 0);
+}
+
+
+/*
+ * render_scroll
+ *   DESCRIPTION: Moves the view window, then draws the lines exposed by
+ *                the move.
+ *   INPUTS: (x,y) -- new upper left pixel of the view window
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer(possibly later)
+ */
+void render_scroll(int x, int y) {
+    request_t rq; /* request to send */
+
+    rq.type = RQ_SCROLL;
+    rq.x = x;
+    rq.y = y;
+    send_request(&rq, 0);
+}
+
+
+/*
+ * render_redraw
+ *   DESCRIPTION: Draws all lines of the view window, and of the inventory
+ *                view if it is shown.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer(possibly later)
+ */
+void render_redraw() {
+    request_t rq; /* request to send */
+
+    rq.type = RQ_REDRAW;
+    send_request(&rq, 0);
+}
+
+
+/*
+ * render_inventory
+ *   DESCRIPTION: Shows or hides the inventory view, a small view of the
+ *                objects in the inventory on top of the lower right of
+ *                the main view.
+ *   INPUTS: r -- the inventory room, or NULL to hide the view
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the inventory view's build buffer(possibly
+ *                 later)
+ */
+void render_inventory(const room_t* r) {
+    request_t rq; /* request to send */
+
+    rq.type = RQ_INVENTORY;
+    rq.room = r;
+    send_request(&rq, 0);
+}
+
+
+/*
+ * render_status
+ *   DESCRIPTION: Changes the status bar text.  The caller sends only
+ *                changes, so the request is never dropped.
+ *   INPUTS: s -- the new text(only the first RENDER_TEXT_LEN characters
+ *                are used)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to the display(possibly later)
+ */
+void render_status(const char* s) {
+    request_t rq; /* request to send */
+
+    rq.type = RQ_STATUS;
+    strncpy(rq.text, s, RENDER_TEXT_LEN);
+    rq.text[RENDER_TEXT_LEN] = '\0';
+    send_request(&rq, 0);
+}
+
+
+/*
+ * render_frame
+ *   DESCRIPTION: Shows the view window on the display.  If the render
+ *                thread has fallen so far behind that its queue is full,
+ *                the frame is dropped; the next frame shows the same
+ *                build buffer contents anyway.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: writes to the display(possibly later)
+ */
+void render_frame() {
+    request_t rq; /* request to send */
+
+    rq.type = RQ_FRAME;
+    send_request(&rq, 1);
+}
+
+
+/*
+ * render_sync
+ *   DESCRIPTION: Waits until every request made so far has been carried
+ *                out, after which the game thread may change the world
+ *                safely.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may block
+ */
+void render_sync() {
+    request_t rq; /* request to send */
+
+    if (!running) {
+        return;
+    }
+    rq.type = RQ_SYNC;
+    send_request(&rq, 0);
+    while (0 != sem_wait(&sync_sem));
+}
+
+
+/*
+ * render_prefill_margins
+ *   DESCRIPTION: Idle task(see idle.h) that draws lines just outside the
+ *                view window ahead of time.  If the render thread is
+ *                running, asks it to draw them whenever it has nothing
+ *                else queued, which never makes the caller wait;
+ *                otherwise, draws one line.
+ *   INPUTS: none(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if more lines may remain, or 0 if all are drawn(or
+ *                 left to the render thread)
+ *   SIDE EFFECTS: none
+ */
+int32_t render_prefill_margins(void* ignore) {
+    request_t rq; /* request to send */
+
+    if (!running) {
+        return prefill_margin_line(main_view.ctx);
+    }
+    rq.type = RQ_PREFILL;
+    send_request(&rq, 1);
+    return 0;
+}
+
+
+/*
+ * send_request
+ *   DESCRIPTION: Carries out a request immediately if the render thread
+ *                is not running; otherwise, queues the request.  If the
+ *                queue is full, droppable requests are discarded, and
+ *                the caller waits for space for other requests.
+ *   INPUTS: rq -- the request
+ *           may_drop -- non-zero if the request may be discarded
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may block
+ */
+static void send_request(request_t* rq, int may_drop) {
+    unsigned int tail; /* our slot index */
+
+    if (!running) {
+        carry_out(rq);
+        return;
+    }
+
+    tail = q_tail;
+    while (RENDER_QUEUE_LEN == tail - __atomic_load_n(&q_head, __ATOMIC_ACQUIRE)) {
+        if (may_drop) {
+            dropped++;
+            return;
+        }
+        (void)sched_yield();
+    }
+    q_slot[tail & (RENDER_QUEUE_LEN - 1)] = *rq;
+    __atomic_store_n(&q_tail, tail + 1, __ATOMIC_RELEASE);
+    (void)sem_post(&q_sem);
+}
+
+
+/*
+ * render_thread
+ *   DESCRIPTION: Function executed by the render thread.  Carries out
+ *                requests in order until asked to stop.
+ *   INPUTS: none(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: draws into the build buffer and to the display
+ */
+static void* render_thread(void* ignore) {
+    request_t rq;      /* copy of request being carried out */
+    unsigned int head; /* index of request                  */
+
+    while (1) {
+        while (0 != sem_wait(&q_sem));
+
+        /*
+         * Carry out everything queued so far.  Posts for requests
+         * handled here leave extra counts on q_sem, which only cause
+         * us to find the queue empty later.
+         */
+        for (head = q_head; head != __atomic_load_n(&q_tail, __ATOMIC_ACQUIRE); head++) {
+            rq = q_slot[head & (RENDER_QUEUE_LEN - 1)];
+            __atomic_store_n(&q_head, head + 1, __ATOMIC_RELEASE);
+
+            if (RQ_QUIT == rq.type) {
+                return NULL;
+            }
+            if (RQ_SYNC == rq.type) {
+                /* The world may change until the next RQ_PREFILL. */
+                prefill = 0;
+                (void)sem_post(&sync_sem);
+                continue;
+            }
+            carry_out(&rq);
+        }
+
+        /*
+         * Draw margin lines one at a time until they are all drawn or
+         * another request arrives, which is then handled first.
+         */
+        while (prefill && head == __atomic_load_n(&q_tail, __ATOMIC_ACQUIRE)) {
+            prefill = prefill_margin_line(main_view.ctx);
+        }
+    }
+}
+
+
+/*
+ * carry_out
+ *   DESCRIPTION: Carries out one request.
+ *   INPUTS: rq -- the request
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer and/or to the display
+ */
+static void carry_out(const request_t* rq) {
+    switch (rq->type) {
+        case RQ_ENTER_ROOM:
+            view_x = view_y = 0;
+            set_view_window(main_view.ctx, view_x, view_y);
+            prep_room(&main_view, rq->room);
+            redraw_room_view(&main_view);
+            show_inventory(inv_view.room);
+            break;
+        case RQ_SCROLL:
+            draw_exposed_lines(rq->x, rq->y);
+            break;
+        case RQ_REDRAW:
+            redraw_room_view(&main_view);
+            show_inventory(inv_view.room);
+            break;
+        case RQ_INVENTORY:
+            inv_shown = (NULL != rq->room);
+            show_inventory(rq->room);
+            break;
+        case RQ_STATUS:
+            fill_status_bar((char*)rq->text);
+            break;
+        case RQ_FRAME:
+            show_screen();
+            break;
+        case RQ_PREFILL:
+            prefill = 1;
+            break;
+        default:
+            break;
+    }
+}
+
+
+/*
+ * draw_exposed_lines
+ *   DESCRIPTION: Moves the view window and draws the rows and columns
+ *                that were not visible in the old view.
+ *   INPUTS: (x,y) -- new upper left pixel of the view window
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the build buffer
+ */
+static void draw_exposed_lines(int x, int y) {
+    int dx, dy; /* motion of view window              */
+    int i;      /* index over lines                   */
+    int ahead;  /* all lines were drawn ahead(so far) */
+
+    dx = x - view_x;
+    dy = y - view_y;
+    view_x = x;
+    view_y = y;
+    set_view_window(main_view.ctx, view_x, view_y);
+
+    /* A long jump exposes everything. */
+    if (dx <= -SCROLL_X_DIM || dx >= SCROLL_X_DIM ||
+        dy <= -SCROLL_Y_DIM || dy >= SCROLL_Y_DIM) {
+        redraw_room_view(&main_view);
+        return;
+    }
+
+    /* Rows at the top or bottom, then columns at the left or right. */
+    ahead = 1;
+    for (i = 0; i < -dy; i++) {
+        ahead &= (1 == draw_horiz_line(main_view.ctx, i));
+    }
+    for (i = 1; i <= dy; i++) {
+        ahead &= (1 == draw_horiz_line(main_view.ctx, SCROLL_Y_DIM - i));
+    }
+    for (i = 0; i < -dx; i++) {
+        ahead &= (1 == draw_vert_line(main_view.ctx, i));
+    }
+    for (i = 1; i <= dx; i++) {
+        ahead &= (1 == draw_vert_line(main_view.ctx, SCROLL_X_DIM - i));
+    }
+
+    if (0 != dx || 0 != dy) {
+        scrolls++;
+        margin_scrolls += ahead;
+    }
+}
+
+
+/*
+ * show_inventory
+ *   DESCRIPTION: Shows the inventory view, if it has been requested and
+ *                the main view is not showing the inventory already, and
+ *                draws it; otherwise hides it.  The view's render context
+ *                is made the first time that it is needed.
+ *   INPUTS: r -- the inventory room(NULL if not requested)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: draws into the inventory view's build buffer
+ */
+static void show_inventory(const room_t* r) {
+    if (!inv_shown || NULL == r || main_view.room == r) {
+        if (NULL != inv_view.ctx) {
+            show_render_ctx(inv_view.ctx, 0);
+        }
+        return;
+    }
+    if (NULL == inv_view.ctx &&
+        NULL == (inv_view.ctx = new_render_ctx(SCROLL_X_DIM - INV_X_DIM,
+                                               SCROLL_Y_DIM - INV_Y_DIM,
+                                               INV_X_DIM, INV_Y_DIM,
+                                               fill_horiz_buffer, fill_vert_buffer,
+                                               &inv_view))) {
+        return;
+    }
+    prep_room(&inv_view, r);
+    redraw_room_view(&inv_view);
+    show_render_ctx(inv_view.ctx, 1);
+}
@@ -0,0 +1,73 @@
+/* tab:4
+ *
+ * render.h - header file for the adventure game render thread
+ *
+ * Version:       3
+ * Filename:      render.h
+ * History:
+ *    1    First written.
+ *    2    Added a picture-in-picture inventory view.
+ *    3    Moved drawing margin lines ahead onto the render thread.
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+
+#include "world.h"
+
+
+/*
+ * NOTES
+ *
+ * All drawing into the mode X build buffer and all copies to the display
+ * are done by the functions below.  Once render_start has been called,
+ * the functions only queue a request for a dedicated render thread and
+ * return immediately, so that a slow video memory upload never delays the
+ * game thread.  Before render_start(or after render_stop), each request
+ * is carried out immediately by the calling thread.
+ *
+ * Requests must all come from a single thread(the game thread).  The
+ * render thread reads the world(room contents) while drawing, so the game
+ * thread must call render_sync before changing the world.
+ */
+
+/* make the main view after mode X is set; returns 0 on success, -1 on failure */
+extern int render_open(void);
+
+/* start the render thread; returns 0 on success, -1 on failure */
+extern int render_start(void);
+
+/* finish outstanding requests and stop the render thread */
+extern void render_stop(void* ignore);
+
+/* prepare for a newly entered room and draw it with the view at(0,0) */
+extern void render_enter_room(const room_t* r);
+
+/* move the view window to(x,y), drawing any newly exposed lines */
+extern void render_scroll(int x, int y);
+
+/* draw every line of the current view(and the inventory view) again */
+extern void render_redraw(void);
+
+/* show the inventory room r in a small view on top of the main one(NULL hides it) */
+extern void render_inventory(const room_t* r);
+
+/* change the text in the status bar */
+extern void render_status(const char* s);
+
+/* show the current view on the display */
+extern void render_frame(void);
+
+/* wait until all requests made so far have been carried out */
+extern void render_sync(void);
+
+/*
+ * idle task(see idle.h): draw lines just outside the view ahead of time,
+ * on the render thread whenever it has nothing else queued if it is
+ * running; returns 1 if more may remain, or 0 if all are drawn(or left
+ * to the render thread)
+ */
+extern int32_t render_prefill_margins(void* ignore);
+
+#endif /* RENDER_H */
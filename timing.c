@@ -0,0 +1,313 @@
+/* tab:4
+ *
+ * timing.c - per-phase tick timing histograms
+ *
+ * Version:       3
+ * Filename:      timing.c
+ * History:
+ *    1    First written.
+ *    2    Added a phase for idle tasks.
+ *    3    Added a histogram of input latency.
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "timing.h"
+
+
+/*
+ * Histograms use logarithmic buckets, each split into 2^TM_SUB_BITS
+ * linear sub-buckets, so that any recorded value is within 25% of
+ * its bucket's lower bound.  Values below 2^TM_SUB_BITS nanoseconds
+ * get a bucket each.  TM_NUM_BUCKETS covers every 64-bit value.
+ */
+#define TM_SUB_BITS     2
+#define TM_SUB_COUNT    (1 << TM_SUB_BITS)
+#define TM_NUM_BUCKETS  ((64 - TM_SUB_BITS + 1) * TM_SUB_COUNT)
+
+/* histogram of per-tick times for one phase(or of input latencies) */
+typedef struct {
+    uint64_t count;                  /* values recorded       */
+    uint64_t max;                    /* largest value         */
+    uint32_t bucket[TM_NUM_BUCKETS]; /* values in each bucket */
+} histogram_t;
+
+
+/* local functions--see function headers for details */
+static int bucket_of(uint64_t val);
+static uint64_t bucket_low(int idx);
+static void hist_add(histogram_t* h, uint64_t val);
+static void hist_print(const char* name, const histogram_t* h);
+static uint64_t percentile(const histogram_t* h, int pct);
+static void request_dump(int sig);
+
+
+/* names of the phases, in tm_phase_t order */
+static const char* const phase_name[NUM_TM_PHASES] = {
+    "input", "typed", "line fill", "view copy", "show", "status", "idle",
+    "background"
+};
+
+/*
+ * Time accumulated by each phase during the current tick, along with the
+ * number of times the phase ran.  Updated atomically, since the render
+ * thread adds time to some phases while the game thread runs others.
+ */
+static uint64_t tick_ns[NUM_TM_PHASES];
+static uint32_t tick_runs[NUM_TM_PHASES];
+
+/* per-phase histograms(touched only by the game thread) */
+static histogram_t hist[NUM_TM_PHASES];
+
+/*
+ * times from reading each command to carrying it out, one value per
+ * command(touched only by the game thread)
+ */
+static histogram_t latency;
+
+/* set by the SIGUSR1 handler */
+static volatile sig_atomic_t dump_requested = 0;
+
+
+/*
+ * timing_init
+ *   DESCRIPTION: Installs a SIGUSR1 handler that asks for the histograms
+ *                to be printed at the end of the current tick.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: changes the SIGUSR1 disposition
+ */
+int timing_init() {
+    struct sigaction sa; /* signal action for SIGUSR1 */
+
+    memset(&sa, 0, sizeof (sa));
+    sa.sa_handler = request_dump;
+    sa.sa_flags = SA_RESTART;
+    (void)sigemptyset(&sa.sa_mask);
+    if (-1 == sigaction(SIGUSR1, &sa, NULL)) {
+        perror("sigaction SIGUSR1");
+        return -1;
+    }
+    return 0;
+}
+
+
+/*
+ * timing_now
+ *   DESCRIPTION: Reads the monotonic clock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: current time in nanoseconds
+ *   SIDE EFFECTS: none
+ */
+uint64_t timing_now() {
+    struct timespec ts; /* current time */
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/*
+ * timing_add
+ *   DESCRIPTION: Charges the time elapsed since start to a phase of the
+ *                current tick.
+ *   INPUTS: phase -- the phase to charge
+ *           start -- starting time from timing_now
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timing_add(tm_phase_t phase, uint64_t start) {
+    (void)__atomic_fetch_add(&tick_ns[phase], timing_now() - start, __ATOMIC_RELAXED);
+    (void)__atomic_fetch_add(&tick_runs[phase], 1, __ATOMIC_RELAXED);
+}
+
+
+/*
+ * timing_end_tick
+ *   DESCRIPTION: Records the time spent in each phase that ran during the
+ *                tick, then starts a new tick.  Prints the histograms if
+ *                SIGUSR1 has arrived since the last tick.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: may print to stderr
+ */
+void timing_end_tick() {
+    int i; /* loop index over phases */
+
+    for (i = 0; i < NUM_TM_PHASES; i++) {
+        if (0 == __atomic_exchange_n(&tick_runs[i], 0, __ATOMIC_RELAXED)) {
+            continue;
+        }
+        hist_add(&hist[i], __atomic_exchange_n(&tick_ns[i], 0, __ATOMIC_RELAXED));
+    }
+
+    if (dump_requested) {
+        dump_requested = 0;
+        timing_dump();
+    }
+}
+
+
+/*
+ * timing_latency
+ *   DESCRIPTION: Records the input latency of a command being carried
+ *                out: the time since its keystrokes(or Tux controller
+ *                buttons) were read.
+ *   INPUTS: read_time -- time at which the command was read(from
+ *                        timing_now, or the same clock)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void timing_latency(uint64_t read_time) {
+    hist_add(&latency, timing_now() - read_time);
+}
+
+
+/*
+ * timing_dump
+ *   DESCRIPTION: Prints the number of ticks in which each phase ran and
+ *                the 50th, 95th, and 99th percentile and maximum time per
+ *                tick, in microseconds, and then the same for the input
+ *                latency of each command.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to stderr
+ */
+void timing_dump() {
+    int i; /* loop index over phases */
+
+    fprintf(stderr, "%-10s %8s %10s %10s %10s %10s\n",
+            "phase", "ticks", "p50(us)", "p95(us)", "p99(us)", "max(us)");
+    for (i = 0; i < NUM_TM_PHASES; i++) {
+        hist_print(phase_name[i], &hist[i]);
+    }
+    fprintf(stderr, "%-10s %8s\n", "", "commands");
+    hist_print("latency", &latency);
+}
+
+
+/*
+ * hist_add
+ *   DESCRIPTION: Adds a value to a histogram.
+ *   INPUTS: h -- the histogram
+ *           val -- the value, in nanoseconds
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void hist_add(histogram_t* h, uint64_t val) {
+    h->bucket[bucket_of(val)]++;
+    h->count++;
+    if (h->max < val) {
+        h->max = val;
+    }
+}
+
+
+/*
+ * hist_print
+ *   DESCRIPTION: Prints one row of the table printed by timing_dump.
+ *   INPUTS: name -- name of the row
+ *           h -- the histogram
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: prints to stderr
+ */
+static void hist_print(const char* name, const histogram_t* h) {
+    fprintf(stderr, "%-10s %8llu %10.1f %10.1f %10.1f %10.1f\n",
+            name, (unsigned long long)h->count,
+            percentile(h, 50) / 1000.0,
+            percentile(h, 95) / 1000.0,
+            percentile(h, 99) / 1000.0,
+            h->max / 1000.0);
+}
+
+
+/*
+ * bucket_of
+ *   DESCRIPTION: Finds the histogram bucket for a value.
+ *   INPUTS: val -- the value
+ *   OUTPUTS: none
+ *   RETURN VALUE: bucket index
+ *   SIDE EFFECTS: none
+ */
+static int bucket_of(uint64_t val) {
+    int msb; /* index of most significant bit set */
+
+    if (TM_SUB_COUNT > val) {
+        return (int)val;
+    }
+    msb = 63 - __builtin_clzll(val);
+    return (msb - TM_SUB_BITS + 1) * TM_SUB_COUNT +
+           (int)((val >> (msb - TM_SUB_BITS)) & (TM_SUB_COUNT - 1));
+}
+
+
+/*
+ * bucket_low
+ *   DESCRIPTION: Finds the smallest value that falls in a bucket.
+ *   INPUTS: idx -- bucket index
+ *   OUTPUTS: none
+ *   RETURN VALUE: the smallest value in the bucket
+ *   SIDE EFFECTS: none
+ */
+static uint64_t bucket_low(int idx) {
+    int shift; /* position of the bucket's sub-bucket bits */
+
+    if (TM_SUB_COUNT > idx) {
+        return idx;
+    }
+    shift = idx / TM_SUB_COUNT - 1;
+    return (uint64_t)(TM_SUB_COUNT + idx % TM_SUB_COUNT) << shift;
+}
+
+
+/*
+ * percentile
+ *   DESCRIPTION: Estimates a percentile of a histogram as the lower bound
+ *                of the bucket holding it(never more than the maximum).
+ *   INPUTS: h -- the histogram
+ *           pct -- the percentile(0 to 100)
+ *   OUTPUTS: none
+ *   RETURN VALUE: estimated value, or 0 if the histogram is empty
+ *   SIDE EFFECTS: none
+ */
+static uint64_t percentile(const histogram_t* h, int pct) {
+    uint64_t rank; /* number of values at or below the percentile */
+    uint64_t seen; /* number of values in buckets checked so far  */
+    int i;         /* loop index over buckets                     */
+
+    if (0 == h->count) {
+        return 0;
+    }
+    rank = (h->count * pct + 99) / 100;
+    for (i = 0, seen = 0; i < TM_NUM_BUCKETS; i++) {
+        if (rank <= (seen += h->bucket[i])) {
+            return (bucket_low(i) < h->max ? bucket_low(i) : h->max);
+        }
+    }
+    return h->max;
+}
+
+
+/*
+ * request_dump
+ *   DESCRIPTION: SIGUSR1 handler; asks for the histograms to be printed
+ *                by the game thread at the end of the current tick.
+ *   INPUTS: sig -- the signal number(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void request_dump(int sig) {
+    dump_requested = 1;
+}
@@ -0,0 +1,66 @@
+/* tab:4
+ *
+ * timing.h - header file for per-phase tick timing
+ *
+ * Version:       3
+ * Filename:      timing.h
+ * History:
+ *    1    First written.
+ *    2    Added a phase for idle tasks.
+ *    3    Added a histogram of input latency.
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+
+#include <stdint.h>
+
+
+/*
+ * NOTES
+ *
+ * Each game loop tick is split into the phases below.  Code that runs a
+ * phase brackets it with timing_now and timing_add; the time is added to
+ * a per-tick total for the phase(safely from any thread).  At the end of
+ * each tick, the game thread calls timing_end_tick, which moves the tick
+ * totals of every phase that ran during the tick into a histogram for the
+ * phase.  The histograms are printed by timing_dump(at exit) and also
+ * whenever the program receives SIGUSR1.  Separately, the game thread
+ * calls timing_latency as it carries out each command, giving the time
+ * at which the command was read, and the delays are kept in one more
+ * histogram.
+ */
+
+/* phases of a tick */
+typedef enum {
+    TM_INPUT,      /* reading commands            */
+    TM_TYPED,      /* executing typed commands    */
+    TM_LINE_FILL,  /* drawing lines(fill + copy)  */
+    TM_VIEW_COPY,  /* moving the view window      */
+    TM_SHOW,       /* copying to the display      */
+    TM_STATUS,     /* drawing the status bar      */
+    TM_IDLE,       /* waiting for the next tick   */
+    TM_BACKGROUND, /* idle tasks(see idle.h)      */
+    NUM_TM_PHASES
+} tm_phase_t;
+
+/* install the SIGUSR1 handler; returns 0 on success, -1 on failure */
+extern int timing_init(void);
+
+/* current monotonic time in nanoseconds */
+extern uint64_t timing_now(void);
+
+/* add the time since start(from timing_now) to a phase */
+extern void timing_add(tm_phase_t phase, uint64_t start);
+
+/* record the tick totals in the histograms(game thread only) */
+extern void timing_end_tick(void);
+
+/* record the time since a command was read(game thread only) */
+extern void timing_latency(uint64_t read_time);
+
+/* print percentiles for every phase and for input latency to stderr */
+extern void timing_dump(void);
+
+#endif /* TIMING_H */
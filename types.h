@@ -23,12 +23,14 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       1
+ * Version:       2
  * Creation Date: Sun Sep 11 09:58:17 2011
  * Filename:      types.h
  * History:
  *    SL    1    Sun Sep 11 09:58:17 2011
  *        First written.
+ *          2
+ *        Added worlds for game sessions.
  */
 
 #ifndef TYPES_H
@@ -41,5 +43,6 @@ typedef struct image_t image_t;
 /* types defined in world.h */
 typedef struct room_t room_t;
 typedef struct object_t object_t;
+typedef struct world_t world_t;
 
 #endif /* TYPES_H */
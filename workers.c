@@ -0,0 +1,196 @@
+/* tab:4
+ *
+ * workers.c - drawing worker thread pool
+ *
+ * Version:       1
+ * Filename:      workers.c
+ * History:
+ *    1    First written.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "workers.h"
+
+
+/* largest number of worker threads */
+#define MAX_WORKERS   8
+
+/* items handed out at a time(rows share cache lines at chunk edges) */
+#define CHUNK_ITEMS   8
+
+
+/* local functions--see function headers for details */
+static void do_chunks(void);
+static void* worker_thread(void* gen);
+
+
+/*
+ * The current job is described by job_fn, job_arg, and job_items, and
+ * is identified by job_gen, which increases with each job.  All are
+ * protected by pool_lock; workers wait on start_cv for job_gen to change
+ * (or for stopping to be set).  Chunks are claimed by atomically adding
+ * CHUNK_ITEMS to next_item.  Each worker increments n_finished under
+ * pool_lock when it runs out of chunks, and the caller waits on done_cv
+ * until every worker has finished, so no worker touches the job after
+ * workers_run returns.
+ */
+static pthread_t worker_id[MAX_WORKERS];
+static int n_workers = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cv = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cv = PTHREAD_COND_INITIALIZER;
+static unsigned int job_gen = 0;
+static work_fn_t job_fn;
+static void* job_arg;
+static int job_items;
+static int next_item;
+static int n_finished;
+static int stopping = 0;
+
+
+/*
+ * workers_start
+ *   DESCRIPTION: Starts a pool of worker threads.
+ *   INPUTS: n -- number of threads(at most MAX_WORKERS are started)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 0 on success, -1 on failure
+ *   SIDE EFFECTS: creates threads
+ */
+int workers_start(int n) {
+    if (0 != n_workers) {
+        return 0;
+    }
+    if (MAX_WORKERS < n) {
+        n = MAX_WORKERS;
+    }
+    stopping = 0;
+    for (; n_workers < n; n_workers++) {
+        if (0 != pthread_create(&worker_id[n_workers], NULL, worker_thread,
+                                (void*)(uintptr_t)job_gen)) {
+            workers_stop(NULL);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * workers_stop
+ *   DESCRIPTION: Stops the worker threads.  Used as a cleanup method(see
+ *                assert.h).
+ *   INPUTS: none(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: joins the worker threads; later jobs are done serially
+ */
+void workers_stop(void* ignore) {
+    int i; /* loop index over workers */
+
+    (void)pthread_mutex_lock(&pool_lock);
+    stopping = 1;
+    (void)pthread_cond_broadcast(&start_cv);
+    (void)pthread_mutex_unlock(&pool_lock);
+    for (i = 0; i < n_workers; i++) {
+        (void)pthread_join(worker_id[i], NULL);
+    }
+    n_workers = 0;
+}
+
+
+/*
+ * workers_run
+ *   DESCRIPTION: Calls a function on every item in a range, splitting the
+ *                range into chunks done in parallel by the calling thread
+ *                and the worker threads.
+ *   INPUTS: fn -- function to call on each chunk
+ *           arg -- argument passed to fn
+ *           n_items -- number of items
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: returns after fn has finished with every chunk
+ */
+void workers_run(work_fn_t fn, void* arg, int n_items) {
+    /* The serial fallback. */
+    if (0 == n_workers || CHUNK_ITEMS >= n_items) {
+        (*fn)(arg, 0, n_items);
+        return;
+    }
+
+    /* Post the job and wake the workers. */
+    (void)pthread_mutex_lock(&pool_lock);
+    job_fn = fn;
+    job_arg = arg;
+    job_items = n_items;
+    next_item = 0;
+    n_finished = 0;
+    job_gen++;
+    (void)pthread_cond_broadcast(&start_cv);
+    (void)pthread_mutex_unlock(&pool_lock);
+
+    /* Help out, then wait for the workers to finish their chunks. */
+    do_chunks();
+    (void)pthread_mutex_lock(&pool_lock);
+    while (n_workers != n_finished) {
+        (void)pthread_cond_wait(&done_cv, &pool_lock);
+    }
+    (void)pthread_mutex_unlock(&pool_lock);
+}
+
+
+/*
+ * do_chunks
+ *   DESCRIPTION: Claims and does chunks of the current job until none
+ *                are left.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: calls the job function
+ */
+static void do_chunks() {
+    int lo; /* first item of chunk */
+    int hi; /* item after chunk    */
+
+    while (job_items > (lo = __atomic_fetch_add(&next_item, CHUNK_ITEMS, __ATOMIC_RELAXED))) {
+        hi = lo + CHUNK_ITEMS;
+        (*job_fn)(job_arg, lo, (hi < job_items ? hi : job_items));
+    }
+}
+
+
+/*
+ * worker_thread
+ *   DESCRIPTION: Function executed by each worker thread.  Waits for a
+ *                job, helps with it, and reports when it is done.
+ *   INPUTS: gen -- job_gen when the thread was created; any later job
+ *                  is new, even if posted before the thread first runs
+ *   OUTPUTS: none
+ *   RETURN VALUE: NULL
+ *   SIDE EFFECTS: calls job functions
+ */
+static void* worker_thread(void* gen) {
+    unsigned int seen_gen = (uintptr_t)gen; /* last job done */
+
+    (void)pthread_mutex_lock(&pool_lock);
+    while (1) {
+        while (!stopping && seen_gen == job_gen) {
+            (void)pthread_cond_wait(&start_cv, &pool_lock);
+        }
+        if (stopping) {
+            break;
+        }
+        seen_gen = job_gen;
+        (void)pthread_mutex_unlock(&pool_lock);
+
+        do_chunks();
+
+        (void)pthread_mutex_lock(&pool_lock);
+        if (n_workers == ++n_finished) {
+            (void)pthread_cond_signal(&done_cv);
+        }
+    }
+    (void)pthread_mutex_unlock(&pool_lock);
+    return NULL;
+}
@@ -0,0 +1,42 @@
+/* tab:4
+ *
+ * workers.h - header file for the drawing worker thread pool
+ *
+ * Version:       1
+ * Filename:      workers.h
+ * History:
+ *    1    First written.
+ */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+
+/*
+ * NOTES
+ *
+ * workers_run splits a range of items(such as the rows of the view
+ * window) into chunks and hands them out to a pool of worker threads
+ * started by workers_start.  The calling thread works on chunks too, and
+ * workers_run returns only after every chunk is done, so the caller may
+ * use the results at once.  The function given must be safe to call from
+ * several threads at once on different chunks.  Without a pool(before
+ * workers_start, with no workers, or after workers_stop), workers_run
+ * simply calls the function once for the whole range.
+ *
+ * Only one thread may call workers_run at a time.
+ */
+
+/* a function that works on the items lo to hi - 1 */
+typedef void (*work_fn_t)(void* arg, int lo, int hi);
+
+/* start n worker threads; returns 0 on success, -1 on failure */
+extern int workers_start(int n);
+
+/* stop the worker threads(used as a cleanup function) */
+extern void workers_stop(void* ignore);
+
+/* call fn on items 0 to n_items - 1, in parallel chunks if possible */
+extern void workers_run(work_fn_t fn, void* arg, int n_items);
+
+#endif /* WORKERS_H */
@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:        1
+ * Version:        17
  * Creation Date:   Wed Sep 14 02:19:41 2011
  * Filename:        world.c
  * History:
@@ -31,148 +31,126 @@
  *        Completed initial implementation.
  *    SL    2    Thu Sep 15 00:31:40 2011
  *        Cleaned up code for distribution.
+ *          3
+ *        Loaded the world layout from a binary world file.
+ *          4
+ *        Added a benchmark of scaling with world size.
+ *          5
+ *        Added snapshots of the world state.
+ *          6
+ *        Moved the world state into per-session worlds.
+ *          7
+ *        Added inventory_room; drew benchmark views through a render context.
+ *          8
+ *        Compared typed nouns as interned words.
+ *          9
+ *        Carried out typed commands by rules from the world file.
+ *         10
+ *        Placed objects where they overlap no others, by occupancy grids.
+ *         11
+ *        Kept each room's objects in a dense array of records for drawing.
+ *         12
+ *        Loaded each photo and image file once, sharing it among its users.
+ *         13
+ *        Reserved one arena for the photos and images; added free_world.
+ *         14
+ *        Read the photos and images from the asset pack, if there is one.
+ *         15
+ *        Preloaded every photo and image at once, starting room first.
+ *         16
+ *        Saved room links in snapshots, rejected duplicate objects when
+ *        loading them, and added a resume test.
+ *         17
+ *        Indexed the rule keys by verb and word, hashing only those
+ *        for rooms.
  */
 
 
+#include <fcntl.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "assert.h"
 #include "photo.h"
 #include "world.h"
+#include "world_ids.h"
 
 
-/* parameters defined for this file */
-
-/* room identifiers */
-enum {
-    R_NONE = -1,
-
-    /* Area 0: The Backpack */
-    R_INVENTORY,
-
-    /* Area 1: Everitt and Green Street */
-    R_IN_391LAB,    /* inside the 391 lab               */
-    R_BY_391LAB,    /* outside of the 391 lab           */
-    R_IN_IEEE,      /* inside the IEEE/HKN office       */
-    R_BY_IEEE,      /* outside of the IEEE/HKN office   */
-    R_IN_395LAB,    /* inside the 395 lab               */
-    R_BY_395LAB,    /* outside of the 395 lab           */
-    R_EVT_STAIR,    /* Everitt Lab's eastern stairwell  */
-    R_IN_CLEANR,    /* inside the cleanroom             */
-    R_BY_CLEANR,    /* outside of the cleanroom         */
-    R_EVRT_VEND,    /* near the Everitt vending machine */
-    R_ALMAMATER,    /* near the Alma Mater statue       */
-    R_IN_COCOMR,    /* inside of Cocomero               */
-    R_BY_COCOMR,    /* just outside of Cocomero         */
-    R_BY_ZAS,       /* across from the ruins of Za's    */
-    R_EAST_EVRT,    /* East entrance of Everitt Lab     */
-    R_EVRT_BSMT,    /* entrance to Everitt Lab basement */
-
-    /* Area 2: Bardeen Quad and Environs */
-    R_WEST_BONE,    /* looking West along the Boneyard   */
-    R_CIRCLE_N,     /* Boneyard Bridge looking North     */
-    R_CIRCLE_SW,    /* Boneyard Bridge looking Southwest */
-    R_EAST_BONE,    /* looking East along the Boneyard   */
-    R_BARDEEN,      /* Bardeen Quad                      */
-    R_LIB_BACK,     /* rear of Grainger library          */
-    R_RESERVE,      /* Grainger reserve desk             */
-    R_TALBOT_NW,    /* looking Northwest at Talbot       */
-    R_TALBOT_SW,    /* looking Southwest at Talbot       */
-    R_TALBOT,       /* inside Talbot Laboratory          */
-    R_SPRINGFLD,    /* looking West along Springfield    */
-    R_CARIBOU,      /* the Caribou coffee shop           */
-    R_KENNEY,       /* Kenney Gym                        */
-    R_DCL,          /* Digital Computer Laboratory       */
-    R_LIB_FRONT,    /* front of Grainger library         */
-
-    /* Area 3: CSL and Environs */
-    R_KENNEY_E,     /* East of Kenney Gym                */
-    R_NEWMARK,      /* Newmark Laboratory                */
-    R_MNTL_NW,      /* looking Northwest at MNTL         */
-    R_MNTL_SW,      /* looking Southwest at MNTL         */
-    R_MNTLLOBBY,    /* the lobby of MNTL                 */
-    R_MNTL_LAB1,    /* a laboratory within MNTL (#1)     */
-    R_MNTL_LAB2,    /* a laboratory within MNTL (#2)     */
-    R_MNTL_LAB3,    /* a laboratory within MNTL (#3)     */
-    R_CSL_VIEW,     /* Coordinated Science Laboratory    */
-    R_CSL_DOOR,     /* the CSL main entrance             */
-    R_CSL_LOBBY,    /* in the CSL lobby                  */
-    R_CSL_UPPER,    /* on an upper floor of CSL          */
-    R_CSLLOUNGE,    /* in the new CSL lounge area        */
-    R_BECK_LOT,     /* the Beckman Circle parking lot    */
-    R_BECKMAN,      /* the Beckman Institute             */
-    R_BECK_DOOR,    /* Beckman main entrance             */
-    R_BECKLOBBY,    /* in the lobby of Beckman           */
-    R_BECK_MRI,     /* an MRI machine ... somewhere      */
-
-    /* Area 4: The Rest of the World, Featuring the Remote Sensing Lab */
-    R_GARAGE,       /* the campus parking structure      */
-    R_CAR_SITE,     /* the (fictitious) ECE391 car       */
-    R_ALLERTON,     /* the Allerton mansion              */
-    R_FU_DOGS,      /* the Fu dogs at Allerton           */
-    R_STATUE,       /* a statue near the Fu dogs         */
-    R_SUNSINGER,    /* the Allerton Sun Singer statue    */
-    R_WILLARD,      /* Willard Airport fountain view     */
-    R_WILL_SIDE,    /* side view of Willard and tower    */
-    R_REM_PLANE,    /* a sensor-laden plane              */
-    R_COCKPIT,      /* cockpit of remote sensing plane   */
-    R_OVER_WILL,    /* flying above Willard Airport      */
-    R_AIR_RIO,      /* view of Rio de Janeiro from air   */
-    R_REM_ICE,      /* the ice fields near rem. sen. lab */
-    R_REM_LAB,      /* part of a remote sensing lab      */
-
-    N_ROOMS
-};
+/*
+ * set to 1 and link with arena.o loader.o photo.o modex.o workers.o
+ * fbdev.o text.o timing.o assert.o(instead of adventure.o) to measure
+ * startup time, memory use, and room entry latency for a world file(see
+ * the bench-world target in the Makefile)
+ */
+#ifndef TEST_WORLD_SCALING
+#define TEST_WORLD_SCALING 0
+#endif
 
-/* object identifiers */
-enum {
-    O_NONE = -1,
-
-    O_BOARD,      /* a motorized mountain board                 */
-    O_JETPACK,    /* Buzz Lightyear: to Infinity ...            */
-    O_TUX,        /* Tux: our mascot                            */
-    O_MP2,        /* the MP2 specification (covers mode X)      */
-    O_BOOK_C,     /* the C programming language                 */
-    O_BOOK_WODE,  /* stories by P.G. Wodehouse                  */
-    O_GPS_BAD,    /* a malfunctioning GPS device                */
-    O_GPS_GOOD,   /* a working GPS device                       */
-    O_GPS_SPEC,   /* GPS chip data sheet (specifications)       */
-    O_BUNNYSUIT,  /* a pink bunny suit                          */
-    O_BATT_EMPTY, /* an uncharged car battery                   */
-    O_BATT_FULL,  /* a fully charged car battery                */
-    O_BATT_CAR,   /* battery as it appears in the car           */
-    O_MTN_DEW,    /* a bottle of dew                            */
-    O_FISH,       /* a fish to lure penguins                    */
-    O_ICARD,      /* an I-card                                  */
-    O_CAR_KEY,    /* the keys to a car                          */
-    O_ROBOT_DEAD, /* a buggy lockpicking robot                  */
-    O_ROBOT_LIVE, /* lockpicking robot with new control program */
-    O_MIMO_CARD,  /* a MIMO card for planes                     */
-
-    N_OBJECTS
-};
+/*
+ * set to 1 and link as for TEST_WORLD_SCALING to measure how many game
+ * sessions one core can play(see the bench-sessions target in the
+ * Makefile)
+ */
+#ifndef TEST_SESSIONS
+#define TEST_SESSIONS 0
+#endif
 
-/* flag identifiers for recording the player's accomplishments */
-enum {
-    FLAG_HAS_EATEN,    /* player has eaten something         */
-    FLAG_WEARING_SUIT, /* player is wearing a bunny suit     */
-    FLAG_CAR_OPEN,     /* player has managed to open the car */
-    FLAG_CAR_FIXED,    /* player has fixed the car           */
-    FLAG_LURED_TUX,    /* player has lured Tux to their side */
-    NUM_FLAGS
-};
+/*
+ * set to 1 and link as for TEST_WORLD_SCALING to measure how the time to
+ * fill a line of a room view grows with the objects in the room(see the
+ * bench-lines target in the Makefile)
+ */
+#ifndef TEST_LINE_FILL
+#define TEST_LINE_FILL 0
+#endif
 
-/* identifiers for rooms with photo swapping */
-enum {
-    SWAP_CIRCLE,    /* Boneyard Creek Bridge photo swap */
-    SWAP_CAR,       /* open/closed hood                 */
-    N_SWAPS
-};
+/*
+ * set to 1 and link as for TEST_WORLD_SCALING to check that a game saved
+ * in the inventory view resumes correctly(see the test-resume target in
+ * the Makefile)
+ */
+#ifndef TEST_RESUME
+#define TEST_RESUME 0
+#endif
+
+#if (TEST_WORLD_SCALING == 1 || TEST_SESSIONS == 1 || TEST_LINE_FILL == 1 || TEST_RESUME == 1)
+#include <stdio.h>
+#include <time.h>
+#endif
+
+#if (TEST_SESSIONS == 1)
+#include "workers.h"
+#endif
 
 
 /* types local to this file(declared in types.h) */
 
+/*
+ * An occupancy grid of a room: a bit for each cell of its photo that some
+ * object covers, one 64-bit word for each row of cells.  Cells are
+ * GRID_CELL_Y pixels high and as many pixels wide(a power of two, at
+ * least GRID_CELL_X) as it takes to fit a row in a word.  Placement finds
+ * free space with a few word operations per row of cells, so its cost
+ * depends on the size of the photo, not the number of objects.
+ */
+typedef struct grid_t grid_t;
+struct grid_t {
+    int32_t   width;    /* photo width in pixels             */
+    int32_t   x_shift;  /* log2 of cell width in pixels      */
+    int32_t   cols;     /* cells in a row(at most 64)        */
+    int32_t   rows;     /* rows of cells                     */
+    uint64_t* row;      /* occupied cells of each row(bit c) */
+};
+
+#define GRID_CELL_X        8   /* least width of a cell in pixels */
+#define GRID_CELL_X_SHIFT  3
+#define GRID_CELL_Y        8   /* height of a cell in pixels      */
+#define GRID_CELL_Y_SHIFT  3
+
 /*
  * The structure representing a room in the world. The backpack/inventory
  * is also a 'room'(#0, R_INVENTORY).
@@ -184,6 +162,10 @@ struct room_t {
     room_t*     left;       /* room to the "left"             */
     room_t*     enter;      /* doors, etc.                    */
     room_t*     right;      /* room to the "right"            */
+    grid_t*     grid;       /* occupancy grid(NULL until used) */
+    obj_rec_t*  recs;       /* contents in drawing order       */
+    int32_t     n_recs;     /* number of records in use        */
+    int32_t     max_recs;   /* number of records allocated     */
 };
 
 /*
@@ -192,246 +174,500 @@ struct room_t {
  * all the same bottle!).  Sorry.
  */
 struct object_t {
-    const char*  name;        /* name of object                 */
+    int32_t      word;        /* id of object's keyword         */
     object_t*    next;        /* linked list of room contents   */
     room_t*      loc;         /* in what 'room'?                */
     uint16_t     x, y;        /* location within room photo     */
+    uint16_t     w, h;        /* size of image(for placement)   */
     image_t*     img;         /* image for use in room          */
 };
 
 /*
- * This local structure is used to specify room connectivity and data
- * in a reasonably manageable way. The array entries in the database
- * specify the room id, name, filename, and connections to other
- * rooms by symbolic name.  Since there are many rooms, trying to
- * keep the order between the enumeration of symbolic names and the
- * array entries can be tricky.  Instead, we associate array entries
- * with specific symbolic names using the id field.  Thus, you can
- * reorder the entries in the room_data array without affecting their
- * meaning.
- */
-typedef struct room_data_t room_data_t;
-struct room_data_t {
-    int32_t           id;        /* id of room being described    */
-    const char* const name;      /* name of room                  */
-    const char* const filename;  /* file name for room photo      */
-    int32_t           left;      /* id of room to 'left'          */
-    int32_t           enter;     /* id of room reached by 'enter' */
-    int32_t           right;     /* id of room to 'right'         */
+ * A snapshot of the world state(see save_world_state) is a world_state_t
+ * followed by one room_state_t for each room(links change during play,
+ * such as the inventory's way back to the room it was entered from) and
+ * one obj_state_t for each object.  The objects are listed room by room,
+ * in the order of each room's contents, and then those in no room, so
+ * that restoring them in reverse order by inserting each at the head of
+ * its room's list rebuilds every list in its original order.
+ */
+typedef struct world_state_t world_state_t;
+struct world_state_t {
+    uint32_t n_rooms;                          /* must match world       */
+    uint32_t n_objects;                        /* must match world       */
+    int32_t  where;                            /* player's room          */
+    int32_t  swap_room[N_SWAPS];               /* room showing swap photo */
+    uint32_t flags[(NUM_FLAGS + 31) / 32];     /* accomplishment flags   */
 };
 
-/* the room connectivity data */
-static const room_data_t room_data[N_ROOMS] = {
-    /* Area 0: The Backpack */
-    { R_INVENTORY, "Inventory", "images/backpack.photo", R_NONE, R_NONE, R_NONE },
-
-    /* Area 1: Everitt and Green Street */
-    { R_IN_391LAB, "391 Lab",          "images/391lab.photo",     R_NONE,      R_BY_391LAB, R_NONE      },
-    { R_BY_391LAB, "Outside of 391",   "images/outside391.photo", R_BY_ZAS,    R_IN_391LAB, R_BY_IEEE   },
-    { R_IN_IEEE,   "IEEE Office",      "images/ieee.photo",       R_NONE,      R_BY_IEEE,   R_NONE      },
-    { R_BY_IEEE,   "Outside IEEE",     "images/byieee.photo",     R_BY_391LAB, R_IN_IEEE,   R_BY_395LAB },
-    { R_IN_395LAB, "395 Lab",          "images/395lab.photo",     R_NONE,      R_BY_395LAB, R_NONE      },
-    { R_BY_395LAB, "Outside of 395",   "images/outside395.photo", R_BY_IEEE,   R_NONE,      R_EVT_STAIR },
-    { R_EVT_STAIR, "Everitt Stairs",   "images/evtstair.photo",   R_BY_395LAB, R_EAST_EVRT, R_BY_CLEANR },
-    { R_IN_CLEANR, "In Cleanroom",     "images/cleanr.photo",     R_NONE,      R_BY_CLEANR, R_NONE      },
-    { R_BY_CLEANR, "By the Cleanroom", "images/outclean.photo",   R_EVT_STAIR, R_NONE,      R_EVRT_VEND },
-    { R_EVRT_VEND, "Vending Machine",  "images/vend.photo",       R_BY_CLEANR, R_EVRT_BSMT, R_NONE      },
-    { R_ALMAMATER, "Alma Mater",       "images/almamater.photo",  R_EAST_EVRT, R_EAST_EVRT, R_BY_COCOMR },
-    { R_IN_COCOMR, "Cocomero",         "images/incoco.photo",     R_NONE,      R_BY_COCOMR, R_NONE      },
-    { R_BY_COCOMR, "Near Cocomero",    "images/bycoco.photo",     R_ALMAMATER, R_IN_COCOMR, R_BY_ZAS    },
-    { R_BY_ZAS,    "The Ruins",        "images/ruins.photo",      R_BY_COCOMR, R_NONE,      R_NONE      },
-    { R_EAST_EVRT, "East of Everitt",  "images/eeast.photo",      R_ALMAMATER, R_EVT_STAIR, R_EVRT_BSMT },
-    { R_EVRT_BSMT, "Basement Entry",   "images/basement.photo",   R_EAST_EVRT, R_EVRT_VEND, R_CIRCLE_SW },
-
-    /* Area 2: Bardeen Quad and Environs */
-    { R_WEST_BONE, "Boneyard Creek",     "images/bonew.photo",         R_CIRCLE_SW, R_NONE,      R_CIRCLE_N  },
-    { R_CIRCLE_N,  "Boneyard Bridge",    "images/circlen1.photo",      R_WEST_BONE, R_TALBOT_NW, R_EAST_BONE },
-    { R_CIRCLE_SW, "Boneyard Bridge",    "images/circlesw.photo",      R_EAST_BONE, R_EVRT_BSMT, R_CIRCLE_N  },
-    { R_EAST_BONE, "Boneyard Creek",     "images/bonee.photo",         R_CIRCLE_N,  R_NONE,      R_CIRCLE_SW },
-    { R_BARDEEN,   "Bardeen Quad",       "images/bardeen.photo",       R_LIB_BACK,  R_EAST_BONE, R_TALBOT_SW },
-    { R_LIB_BACK,  "Grainger Library",   "images/graingerback.photo",  R_DCL,       R_RESERVE,   R_BARDEEN   },
-    { R_RESERVE,   "Grainger Reserves",  "images/reserve.photo",       R_NONE,      R_LIB_BACK,  R_LIB_FRONT },
-    { R_TALBOT_NW, "Talbot Lab",         "images/talbotnw.photo",      R_CIRCLE_SW, R_TALBOT,    R_TALBOT_SW },
-    { R_TALBOT_SW, "Talbot Lab",         "images/talbotsw.photo",      R_TALBOT_NW, R_TALBOT,    R_SPRINGFLD },
-    { R_TALBOT,    "Talbot Lab",         "images/talbot.photo",        R_NONE,      R_TALBOT_NW, R_NONE      },
-    { R_SPRINGFLD, "Springfield Avenue", "images/springfield.photo",   R_TALBOT_SW, R_CARIBOU,   R_KENNEY    },
-    { R_CARIBOU,   "Caribou",            "images/caribou.photo",       R_NONE,      R_SPRINGFLD, R_NONE      },
-    { R_KENNEY,    "Kenney Gym",         "images/kenney.photo",        R_SPRINGFLD, R_NONE,      R_DCL       },
-    { R_DCL,       "DCL",                "images/dcl.photo",           R_KENNEY,    R_KENNEY_E,  R_LIB_FRONT },
-    { R_LIB_FRONT, "Grainger Library",   "images/graingerfront.photo", R_DCL,       R_RESERVE,   R_TALBOT_SW },
-
-    /* Area 3: CSL and Environs */
-    { R_KENNEY_E,  "East of Kenney",      "images/kenneye.photo",   R_DCL,       R_DCL,       R_NEWMARK   },
-    { R_NEWMARK,   "Newmark Lab",         "images/newmark.photo",   R_MNTL_NW,   R_NONE,      R_KENNEY_E  },
-    { R_MNTL_NW,   "MNTL",                "images/mntlnw.photo",    R_NEWMARK,   R_MNTLLOBBY, R_CSL_VIEW  },
-    { R_MNTL_SW,   "MNTL",                "images/mntlsw.photo",    R_MNTL_NW,   R_MNTLLOBBY, R_BECKMAN   },
-    { R_MNTLLOBBY, "Lobby of MNTL",       "images/mntllobby.photo", R_MNTL_LAB1, R_MNTL_SW,   R_MNTL_LAB2 },
-    { R_MNTL_LAB1, "Kevin's Lab in MNTL", "images/mntllab1.photo",  R_NONE,      R_NONE,      R_MNTLLOBBY },
-    { R_MNTL_LAB2, "MNTL Laser Lab",      "images/mntllab2.photo",  R_MNTLLOBBY, R_MNTL_LAB3, R_NONE      },
-    { R_MNTL_LAB3, "MNTL Laser Lab",      "images/mntllab3.photo",  R_NONE,      R_MNTL_LAB2, R_NONE      },
-    { R_CSL_VIEW,  "CSL",                 "images/csl.photo",       R_BECK_LOT,  R_CSL_DOOR,  R_MNTL_NW   },
-    { R_CSL_DOOR,  "CSL Main Entrance",   "images/csldoor.photo",   R_BECK_LOT,  R_NONE,      R_MNTL_NW   },
-    { R_CSL_LOBBY, "CSL Lobby",           "images/csllobby.photo",  R_CSL_UPPER, R_CSL_DOOR,  R_NONE      },
-    { R_CSL_UPPER, "Upper Floor of CSL",  "images/cslupper.photo",  R_NONE,      R_CSLLOUNGE, R_CSL_LOBBY },
-    { R_CSLLOUNGE, "CSL Lounge",          "images/csllounge.photo", R_NONE,      R_CSL_UPPER, R_NONE      },
-    { R_BECK_LOT,  "Beckman Circle Lot",  "images/becklot.photo",   R_BECKMAN,   R_GARAGE,    R_CSL_VIEW  },
-    { R_BECKMAN,   "Beckman Institute",   "images/beckman.photo",   R_MNTL_SW,   R_BECK_DOOR, R_BECK_LOT  },
-    { R_BECK_DOOR, "Beckman Institute",   "images/beckdoor.photo",  R_MNTL_SW,   R_NONE,      R_BECK_LOT  },
-    { R_BECKLOBBY, "Beckman Lobby",       "images/becklobby.photo", R_NONE,      R_BECK_MRI,  R_BECK_DOOR },
-    { R_BECK_MRI,  "An MRI Lab",          "images/beckmri.photo",   R_NONE,      R_BECKLOBBY, R_NONE      },
-
-    /* Area 4: The Rest of the World, Featuring the Remote Sensing Lab */
-    { R_GARAGE,    "Campus Parking",      "images/garage.photo",      R_BECK_LOT,  R_CAR_SITE,  R_NONE      },
-    { R_CAR_SITE,  "Use Someone's Car?",  "images/carclosed.photo",   R_NONE,      R_GARAGE,    R_NONE      },
-    { R_ALLERTON,  "Allerton Mansion",    "images/allerton.photo",    R_FU_DOGS,   R_NONE,      R_SUNSINGER },
-    { R_FU_DOGS,   "Fu Dog Statues",      "images/fudogs.photo",      R_NONE,      R_STATUE,    R_ALLERTON  },
-    { R_STATUE,    "A Tall Statue",       "images/statue.photo",      R_NONE,      R_FU_DOGS,   R_NONE      },
-    { R_SUNSINGER, "The Sun Singer",      "images/sunsinger.photo",   R_ALLERTON,  R_NONE,      R_NONE      },
-    { R_WILLARD,   "Willard Airport",     "images/willard.photo",     R_NONE,      R_WILL_SIDE, R_NONE      },
-    { R_WILL_SIDE, "Willard Tower",       "images/willardside.photo", R_REM_PLANE, R_NONE,      R_WILLARD   },
-    { R_REM_PLANE, "Sensor-Laden Plane",  "images/rsenseplane.photo", R_COCKPIT,   R_NONE,      R_WILL_SIDE },
-    { R_COCKPIT,   "Plane Cockpit",       "images/cockpit.photo",     R_NONE,      R_NONE,      R_REM_PLANE },
-    { R_OVER_WILL, "Flying over Willard", "images/overwillard.photo", R_NONE,      R_COCKPIT,   R_AIR_RIO   },
-    { R_AIR_RIO,   "Rio de Janeiro",      "images/riofromair.photo",  R_OVER_WILL, R_NONE,      R_REM_ICE   },
-    { R_REM_ICE,   "Ice Fields",          "images/rsenseice.photo",   R_AIR_RIO,   R_REM_LAB,   R_NONE      },
-    { R_REM_LAB,   "Remote Sensing Lab",  "images/rsenselab.photo",   R_NONE,      R_REM_ICE,   R_NONE      }
+/*
+ * The state of one game session.  Each world has its own rooms and
+ * objects, since playing changes their contents, locations, and photos,
+ * but all worlds share the names, photos, and images read by build_world,
+ * which never change.  Flags are coded as bit vectors using an array of
+ * 32-bit words.  It's overkill for this game, but it's nice not to worry
+ * about the number of flags...
+ */
+struct world_t {
+    room_t*   room;                                /* rooms(by id)         */
+    object_t* object;                              /* objects(by id)       */
+    uint32_t  player_flags[(NUM_FLAGS + 31) / 32]; /* accomplishment flags */
+    photo_t*  swap_photo[N_SWAPS];                 /* swapping photos      */
+    room_t*   swap_room[N_SWAPS];                  /* showing swap photo   */
+    unsigned  seed;                                /* random number state  */
 };
 
+/* move a room or object pointer from one world's array to another's */
+#define REBASE(p, from, to) (NULL == (p) ? NULL : (to) + ((p) - (from)))
+
+/* convert between a room pointer(or NULL) and its id(or R_NONE) */
+#define ROOM_ID(r) (NULL == (r) ? R_NONE : (int32_t)((r) - world->room))
+#define ROOM_AT(id) (R_NONE == (id) ? NULL : &world->room[id])
+
+/* check an identifier read from the world file against a count */
+#define IN_RANGE(id, n) (0 <= (id) && (int64_t)(n) > (id))
 
 /*
- * get_room_name
- * DESCRIPTION:   Given a room_t structer, it returns a pointer to the
- *                string of the name of the room.
- * INPUTS:        room_t * room - A pointer to a room whose name is desired
- * OUTPUTS:       returns a pointer to the string of the room's name
- * SIDE EFFECTS:  none
+ * The rules that a typed verb and word find, unless the room has a key
+ * of its own.  A word with keys for the verb always has one for any room
+ * (see world_ids.h), whose rules are given; for other words(and W_NONE),
+ * those of the verb's key for any word and any room are given, if it has
+ * one.  The set of rooms in room_set starting at word rooms has a bit
+ * for each room with a key for the verb and the word given in word(the
+ * word, or RULE_ANY); the key for the player's room, if there is one,
+ * then comes first.  Finding the rules for a command thus takes one
+ * load, and a lookup in key_slot only in rooms with keys.
  */
-char * get_room_name(room_t * room){
-      /*return a pointer to the room's name*/
-      return (char *)room->name;
-}
+typedef struct cmd_rules_t cmd_rules_t;
+struct cmd_rules_t {
+    uint32_t code;    /* its rules, from this word of rule_code          */
+    uint32_t n_rules; /* number of its rules(0 for none)                */
+    int32_t  word;    /* word of its room keys, or RULE_ANY             */
+    uint32_t rooms;   /* its rooms with keys, from this word of room_set */
+};
 
 /*
- * This local structure is used to specify object information in a
- * reasonably manageable way.  The array entries in the database specify
- * the object id, name, filename, starting room(if any), and starting
- * location * within that room(if not random).  We use this approach for
- * the same * reason as with the rooms: to avoid the need to match the
- * order between the enumeration of symbolic names and the array entries.
+ * A key of the rules for a room, hashed by RULE_KEY_BITS into key_slot
+ * (with linear probing, at most half full) when the world is built.
+ * Keys are also made for the rooms that rules for any room leave out
+ * (see index_keys).
  */
-typedef struct obj_data_t obj_data_t;
-struct obj_data_t {
-    int32_t id;                 /* object identifier                   */
-    const char* const name;     /* object keyword                      */
-    const char* const filename; /* object image file name              */
-    int32_t room;               /* starting room or R_NONE             */
-    int32_t x;                  /* starting x position (-1 for random) */
-    int32_t y;                  /* starting y position                 */
+typedef struct key_slot_t key_slot_t;
+struct key_slot_t {
+    uint64_t bits;    /* RULE_KEY_BITS of the key, or 0 if empty */
+    uint32_t code;    /* its rules, from this word of rule_code  */
+    uint32_t n_rules; /* number of its rules                     */
 };
 
-/* the object positioning data */
-static const obj_data_t obj_data[N_OBJECTS] = {
-    { O_BOARD, "board", "images/board.obj", R_IN_IEEE, -1, -1},
-    { O_JETPACK, "jetpack", "images/jetpack.obj", R_TALBOT, -1, -1},
-    { O_TUX, "tux", "images/tux.obj", R_REM_LAB, 250, 100},
-    { O_MP2, "mp2", "images/mp2.obj", R_CSLLOUNGE, -1, -1},
-    { O_BOOK_C, "book", "images/book.obj", R_NONE, -1, -1},
-    { O_BOOK_WODE, "book", "images/book2.obj", R_NONE, -1, -1},
-    { O_GPS_BAD, "gps", "images/gpsbad.obj", R_TALBOT, -1, -1},
-    { O_GPS_GOOD, "gps", "images/gpsgood.obj", R_NONE, -1, -1},
-    { O_GPS_SPEC, "spec", "images/gpsspec.obj", R_CSL_UPPER, -1, -1},
-    { O_BUNNYSUIT, "bunnysuit", "images/bunnysuit.obj", R_ALMAMATER, 230, 250},
-    { O_BATT_EMPTY, "battery", "images/battery.obj", R_NONE, -1, -1},
-    { O_BATT_FULL, "battery", "images/battery.obj", R_NONE, -1, -1},
-    { O_BATT_CAR, "battery", "images/batteryincar.obj", R_NONE, -1, -1},
-    { O_MTN_DEW, "dew", "images/dew.obj", R_NONE, -1, -1},
-    { O_FISH, "fish", "images/fish.obj", R_EAST_BONE, 80, 260},
-    { O_ICARD, "Icard", "images/icard.obj", R_BARDEEN, -1, -1},
-    { O_CAR_KEY, "key", "images/key.obj", R_CARIBOU, -1, -1},
-    { O_ROBOT_DEAD, "robot", "images/robot.obj", R_MNTL_LAB3, -1, -1},
-    { O_ROBOT_LIVE, "robot", "images/robot.obj", R_NONE, -1, -1},
-    { O_MIMO_CARD, "mimo", "images/mimo.obj", R_STATUE, -1, -1}
+/*
+ * A rule as typed_cmd tries it.  The rules of each key are packed into
+ * rule_code in order when the world is built, each followed by its
+ * conditions and then its effects, so that trying them reads memory in
+ * one place, in order(the world file keeps rules, conditions, and
+ * effects apart).  Conditions on the player's room that are known where
+ * the key is found are left out(see pack_rules).
+ */
+typedef struct rule_t rule_t;
+struct rule_t {
+    uint32_t n_conds;   /* conditions following(all hold)   */
+    uint32_t n_effects; /* effects following them(in order) */
+    int32_t  result;    /* RR_* result                      */
+    int32_t  status;    /* status message, or -1 for none   */
 };
 
+/* the conditions and effects of a rule in rule_code, and the rule after it */
+#define RULE_CONDS(r)   ((const world_file_cond_t*)((r) + 1))
+#define RULE_EFFECTS(r) ((const world_file_effect_t*)(RULE_CONDS(r) + (r)->n_conds))
+#define NEXT_RULE(r)    ((const rule_t*)(RULE_EFFECTS(r) + (r)->n_effects))
+
 /*
- * Some rooms alternate between two photos. For these rooms, we load the
- * image data for both photos once, but need an extra pointer in order to
- * keep track of the photo currently swapped out. We use these swap data
- * to name and describe these extra photos.
+ * a rule key packed into 64 bits(words and rooms are fewer than 2^28),
+ * and its slot in key_slot, from the high bits of a multiplicative hash
  */
-typedef struct swap_data_t swap_data_t;
-struct swap_data_t {
-    int32_t id;
-    const char* const filename;
+#define RULE_KEY_BITS(verb, word, room)                              \
+    (((uint64_t)(verb) << 56) | ((uint64_t)((word) + 1) << 28) |     \
+     (uint64_t)((room) + 1))
+#define KEY_SLOT(bits, shift) ((uint32_t)(((bits) * 0x9E3779B97F4A7C15ULL) >> (shift)))
+
+typedef struct room_state_t room_state_t;
+struct room_state_t {
+    int32_t left;   /* room to the left, or R_NONE  */
+    int32_t enter;  /* room entered, or R_NONE      */
+    int32_t right;  /* room to the right, or R_NONE */
 };
 
-/* the swap photo descriptions */
-static const swap_data_t swap_data[N_SWAPS] = {
-    { SWAP_CIRCLE, "images/circlen2.photo"},   /* alternate for Boneyard */
-    { SWAP_CAR,    "images/caropen.photo" }    /* open/closed car photos */
+typedef struct obj_state_t obj_state_t;
+struct obj_state_t {
+    int32_t  id;    /* object identifier        */
+    int32_t  room;  /* object's room, or R_NONE */
+    uint16_t x, y;  /* location within room     */
 };
 
+/*
+ * get_room_name
+ * DESCRIPTION:   Given a room_t structer, it returns a pointer to the
+ *                string of the name of the room.
+ * INPUTS:        room_t * room - A pointer to a room whose name is desired
+ * OUTPUTS:       returns a pointer to the string of the room's name
+ * SIDE EFFECTS:  none
+ */
+char * get_room_name(room_t * room){
+      /*return a pointer to the room's name*/
+      return (char *)room->name;
+}
 
 /* functions local to this file--see function headers for details */
+static int32_t apply_rule(room_t** rptr, const rule_t* rule);
+static int32_t check_rules(const world_file_header_t* hdr, const world_file_rule_t* rules,
+                           const world_file_cond_t* conds, const world_file_effect_t* effects,
+                           const world_file_key_t* keys, const world_file_ref_t* refs);
+static int32_t copy_world(world_t* dst, const world_t* src);
+static void delete_record(room_t* r, int32_t pos);
 static void do_photo_swap(room_t* r, int32_t which);
-static object_t* find_in_room(const room_t* r, const char* arg);
+static object_t* find_in_room(const room_t* r, int32_t word);
+static const key_slot_t* find_key(int32_t verb, int32_t word, int32_t room);
+static void free_rooms(world_t* w);
+static int32_t grid_find(const grid_t* g, int32_t w, int32_t h, int32_t y_lo, int32_t y_hi,
+                         int32_t x_pick, int32_t y_pick, int32_t* x, int32_t* y);
+static int32_t grid_is_free(const grid_t* g, int32_t x, int32_t y, int32_t w, int32_t h);
+static void grid_mark(grid_t* g, const object_t* o);
+static uint64_t grid_span(const grid_t* g, int32_t x, int32_t y, int32_t w, int32_t h,
+                          int32_t* r0, int32_t* r1);
+static void grid_unmark(const room_t* r, const object_t* o);
+static void hash_key(const world_file_key_t* k, int32_t room, uint32_t code, uint32_t n_rules,
+                     const uint32_t* rooms);
+static int32_t index_keys(const world_file_header_t* hdr, const world_file_rule_t* rules,
+                          const world_file_cond_t* conds, const world_file_effect_t* effects,
+                          const world_file_key_t* keys, const world_file_ref_t* refs);
 static void insert_object_at(object_t* o, room_t* r, int32_t x, int32_t y);
 static void insert_object(object_t* o, room_t* r);
+static uint64_t list_size(const world_file_key_t* k, const world_file_rule_t* rules,
+                          const world_file_cond_t* conds, const world_file_ref_t* refs,
+                          uint32_t* n_room_conds);
 static void move_object_to_inventory(object_t* obj);
-static object_t* obj_special_get(room_t* r, const char* arg);
+static object_t* obj_special_get(room_t* r, int32_t word);
+static uint32_t pack_rules(const world_file_key_t* k, int32_t room, const world_file_rule_t* rules,
+                           const world_file_cond_t* conds, const world_file_effect_t* effects,
+                           const world_file_ref_t* refs, uint32_t* code);
 static int32_t player_flag_is_set(int32_t fnum);
 static void player_set_flag(int32_t fnum);
 static void remove_object(object_t* o);
+static grid_t* room_grid(room_t* r);
+static int32_t rule_holds(const rule_t* rule, const room_t* r);
+static tc_action_t typed_cmd_drop(room_t** rptr, int32_t word);
+static tc_action_t typed_cmd_get(room_t** rptr, int32_t word);
+static tc_action_t typed_cmd_inventory(room_t** rptr, int32_t word);
 
 
 /* file-scope variables */
+
+static int32_t  n_rooms;      /* number of rooms(same in every world)   */
+static int32_t  n_objects;    /* number of objects(same in every world) */
+static int32_t  start_id;     /* player starts in this room             */
+static world_t  start_world;  /* every world as first built             */
+static world_t  first_world;  /* world played by build_world's caller   */
+static const void* world_map;  /* the mapped world file                 */
+static size_t   world_map_size; /* its size in bytes                    */
+
+/* the words and their perfect hash(in the world file mapping; see world_ids.h) */
+static const world_file_word_t* word_rec;  /* words, by id         */
+static const world_file_hash_t* word_hash; /* hash records         */
+static uint32_t                 hash_size; /* number of hash records */
+static int32_t                  n_words;   /* number of words      */
+static const char*              word_str;  /* world file strings   */
+
+/* the rules, by key(see cmd_rules_t) */
+static cmd_rules_t* cmd_rules; /* by verb and word          */
+static key_slot_t*  key_slot;  /* keys for rooms, hashed    */
+static uint32_t     key_mask;  /* key slots less one        */
+static uint32_t     key_shift; /* 64 less log2(slots)       */
+static uint32_t*    rule_code; /* rules packed(see rule_t)  */
+static uint64_t*    room_set;  /* sets of rooms, a bit each */
+
+/*
+ * The world on which the calling thread acts.  Every thread starts with
+ * the first world; a thread running sessions switches between their
+ * worlds with world_use.
+ */
+static __thread world_t* world = &first_world;
+
+/*
+ * apply_rule
+ *   DESCRIPTION: Fires a rule: shows its status message and makes its
+ *                effects, in order.
+ *   INPUTS: *rptr -- player's current room
+ *           rule -- the rule
+ *   OUTPUTS: *rptr -- possibly new room for player(NULL if the player wins)
+ *   RETURN VALUE: the rule's result(an RR_* value)
+ *   SIDE EFFECTS: may move objects, set flags, swap photos, change room
+ *                 links, and show status messages
+ */
+static int32_t apply_rule(room_t** rptr, const rule_t* rule) {
+    const world_file_effect_t* e; /* effect being made */
+    uint32_t                   n; /* effects left      */
+
+    if (-1 != rule->status) {
+        show_status(word_str + rule->status);
+    }
+    for (e = RULE_EFFECTS(rule), n = rule->n_effects; 0 < n; n--, e++) {
+        switch (e->kind) {
+            case RE_GET:
+                move_object_to_inventory(&world->object[e->a]);
+                break;
+            case RE_LOSE:
+                remove_object(&world->object[e->a]);
+                break;
+            case RE_PUT:
+                insert_object_at(&world->object[e->a], &world->room[e->b], e->c, e->d);
+                break;
+            case RE_SET:
+                player_set_flag(e->a);
+                break;
+            case RE_SWAP:
+                do_photo_swap(*rptr, e->a);
+                break;
+            case RE_LINK:
+                world->room[e->a].enter = (R_NONE == e->b ? NULL : &world->room[e->b]);
+                break;
+            case RE_GOTO:
+                *rptr = &world->room[e->a];
+                break;
+            default: /* RE_WIN */
+                *rptr = NULL;
+                break;
+        }
+    }
+    return rule->result;
+}
+
+
+/*
+ * check_rules
+ *   DESCRIPTION: Checks that the rules of a world file refer only to
+ *                records, rooms, objects, words, flags, swaps, and
+ *                strings that exist, that a win ends its rule and
+ *                changes the room, and that the keys are sorted and list
+ *                their rules in increasing order, so that typed_cmd can
+ *                use the rules without further checks.
+ *   INPUTS: hdr -- the world file header
+ *           rules, conds, effects, keys, refs -- the rule records
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the rules are sound, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t check_rules(const world_file_header_t* hdr, const world_file_rule_t* rules,
+                           const world_file_cond_t* conds, const world_file_effect_t* effects,
+                           const world_file_key_t* keys, const world_file_ref_t* refs) {
+    const world_file_rule_t*   u;   /* rule being checked      */
+    const world_file_cond_t*   c;   /* condition being checked */
+    const world_file_effect_t* e;   /* effect being checked    */
+    const world_file_key_t*    k;   /* key being checked       */
+    uint32_t                   idx; /* index over records      */
+    uint32_t                   j;   /* index within a record   */
+    int32_t                    ok;  /* record is sound         */
+
+    for (idx = 0, u = rules; hdr->n_rules > idx; idx++, u++) {
+        if (hdr->n_conds < u->cond || hdr->n_conds - u->cond < u->n_conds ||
+            hdr->n_effects < u->effect || hdr->n_effects - u->effect < u->n_effects ||
+            !IN_RANGE(u->result, N_RULE_RESULTS) ||
+            (-1 != u->status && !IN_RANGE(u->status, hdr->str_size))) {
+            return 0;
+        }
+        for (j = 0; u->n_effects > j; j++) {
+            if (RE_WIN == effects[u->effect + j].kind &&
+                (u->n_effects != j + 1 || RR_CHANGE != u->result)) {
+                return 0;
+            }
+        }
+    }
+    for (idx = 0, c = conds; hdr->n_conds > idx; idx++, c++) {
+        switch (c->kind & ~RULE_NOT) {
+            case RC_IN:
+                ok = IN_RANGE(c->a, hdr->n_rooms);
+                break;
+            case RC_AT:
+                ok = (IN_RANGE(c->a, hdr->n_objects) &&
+                      (R_NONE == c->b || IN_RANGE(c->b, hdr->n_rooms)));
+                break;
+            case RC_HERE:
+                ok = IN_RANGE(c->a, hdr->n_objects);
+                break;
+            case RC_FLAG:
+                ok = IN_RANGE(c->a, NUM_FLAGS);
+                break;
+            default:
+                ok = 0;
+                break;
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+    for (idx = 0, e = effects; hdr->n_effects > idx; idx++, e++) {
+        switch (e->kind) {
+            case RE_GET: case RE_LOSE:
+                ok = IN_RANGE(e->a, hdr->n_objects);
+                break;
+            case RE_PUT:
+                ok = (IN_RANGE(e->a, hdr->n_objects) && IN_RANGE(e->b, hdr->n_rooms) &&
+                      IN_RANGE(e->c, 0x10000) && IN_RANGE(e->d, 0x10000));
+                break;
+            case RE_SET:
+                ok = IN_RANGE(e->a, NUM_FLAGS);
+                break;
+            case RE_SWAP:
+                ok = IN_RANGE(e->a, N_SWAPS);
+                break;
+            case RE_LINK:
+                ok = (IN_RANGE(e->a, hdr->n_rooms) &&
+                      (R_NONE == e->b || IN_RANGE(e->b, hdr->n_rooms)));
+                break;
+            case RE_GOTO:
+                ok = IN_RANGE(e->a, hdr->n_rooms);
+                break;
+            default:
+                ok = (RE_WIN == e->kind);
+                break;
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+    for (idx = 0, k = keys; hdr->n_keys > idx; idx++, k++) {
+        if (!IN_RANGE(k->verb, NUM_TC_VALUES) ||
+            (RULE_ANY != k->word && !IN_RANGE(k->word, hdr->n_words)) ||
+            (RULE_ANY != k->room && !IN_RANGE(k->room, hdr->n_rooms)) ||
+            0 == k->n_refs || hdr->n_refs < k->ref || hdr->n_refs - k->ref < k->n_refs) {
+            return 0;
+        }
+        if (0 < idx && (k[-1].verb > k->verb ||
+                        (k[-1].verb == k->verb && (k[-1].word > k->word ||
+                         (k[-1].word == k->word && k[-1].room >= k->room))))) {
+            return 0;
+        }
+        for (j = 0; k->n_refs > j; j++) {
+            if (hdr->n_rules <= refs[k->ref + j].rule ||
+                (0 < j && refs[k->ref + j - 1].rule >= refs[k->ref + j].rule)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+
+/*
+ * copy_world
+ *   DESCRIPTION: Makes a world that is a copy of another, with its own
+ *                rooms and objects but the same photos and images.
+ *   INPUTS: src -- the world to copy
+ *   OUTPUTS: dst -- the copy(its seed is left unchanged)
+ *   RETURN VALUE: 1 on success, or 0 on failure
+ *   SIDE EFFECTS: allocates dst's rooms, objects, and object records
+ */
+static int32_t copy_world(world_t* dst, const world_t* src) {
+    int32_t idx;    /* index over rooms, objects, and swaps */
+    int32_t n;      /* records in a room                    */
+
+    dst->room = malloc(n_rooms * sizeof (dst->room[0]));
+    dst->object = malloc(n_objects * sizeof (dst->object[0]));
+    if (NULL == dst->room || NULL == dst->object) {
+        free(dst->room);
+        free(dst->object);
+        return 0;
+    }
+    (void)memcpy(dst->room, src->room, n_rooms * sizeof (dst->room[0]));
+    (void)memcpy(dst->object, src->object, n_objects * sizeof (dst->object[0]));
+
+    /* Point the links into the copy. */
+    for (idx = 0; n_rooms > idx; idx++) {
+        dst->room[idx].contents = REBASE(src->room[idx].contents, src->object, dst->object);
+        dst->room[idx].left = REBASE(src->room[idx].left, src->room, dst->room);
+        dst->room[idx].enter = REBASE(src->room[idx].enter, src->room, dst->room);
+        dst->room[idx].right = REBASE(src->room[idx].right, src->room, dst->room);
+        dst->room[idx].grid = NULL;
+        dst->room[idx].recs = NULL;
+        dst->room[idx].max_recs = 0;
+    }
+    for (idx = 0; n_rooms > idx; idx++) {
+        if (0 < (n = src->room[idx].n_recs)) {
+            if (NULL == (dst->room[idx].recs = malloc(n * sizeof (dst->room[idx].recs[0])))) {
+                free_rooms(dst);
+                free(dst->object);
+                return 0;
+            }
+            (void)memcpy(dst->room[idx].recs, src->room[idx].recs, n * sizeof (dst->room[idx].recs[0]));
+            dst->room[idx].max_recs = n;
+        }
+    }
+    for (idx = 0; n_objects > idx; idx++) {
+        dst->object[idx].next = REBASE(src->object[idx].next, src->object, dst->object);
+        dst->object[idx].loc = REBASE(src->object[idx].loc, src->room, dst->room);
+    }
+    for (idx = 0; N_SWAPS > idx; idx++) {
+        dst->swap_photo[idx] = src->swap_photo[idx];
+        dst->swap_room[idx] = REBASE(src->swap_room[idx], src->room, dst->room);
+    }
+    (void)memcpy(dst->player_flags, src->player_flags, sizeof (dst->player_flags));
+    return 1;
+}
+
+
 /*
- * Flags are coded as bit vectors using an array of 32-bit words.  It's
- * overkill for this game, but it's nice not to worry about the number of
- * flags...
+ * delete_record
+ *   DESCRIPTION: Deletes one of a room's object records, keeping the
+ *                others in order.
+ *   INPUTS: r -- the room
+ *           pos -- index of the record(the object's position in the
+ *                  room's contents list)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
  */
-static room_t   room[N_ROOMS];                       /* rooms                */
-static object_t object[N_OBJECTS];                   /* objects              */
-static uint32_t player_flags[(NUM_FLAGS + 31) / 32]; /* accomplishment flags */
-static photo_t* swap_photo[N_SWAPS];                 /* swapping photos      */
+static void delete_record(room_t* r, int32_t pos) {
+    r->n_recs--;
+    (void)memmove(&r->recs[pos], &r->recs[pos + 1], (r->n_recs - pos) * sizeof (r->recs[0]));
+}
 
 
 /*
  * do_photo_swap
  *   DESCRIPTION: Swap a room photo with another stored image.
+ *                Swapping the same photo into the same room again
+ *                restores the original.
  *   INPUTS: r -- the room into which the photo is swapped
  *           which -- index into array of stored photos
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: none
+ *   SIDE EFFECTS: records which room is showing the stored photo
  */
 static void do_photo_swap(room_t* r, int32_t which) {
     photo_t* tmp;    /* temporary variable to help with swap */
 
     /* Swap the photos. */
     tmp               = r->view;
-    r->view           = swap_photo[which];
-    swap_photo[which] = tmp;
+    r->view                  = world->swap_photo[which];
+    world->swap_photo[which] = tmp;
+    world->swap_room[which]  = (NULL == world->swap_room[which] ? r : NULL);
 }
 
 
 /*
  * find_in_room
- *   DESCRIPTION: Find an object by name in a room.  The name must match
- *                exactly, although the match is not sensitive to case.
+ *   DESCRIPTION: Find an object by keyword in a room.
  *   INPUTS: r -- the room in which to look
- *           arg -- the name of the object(a string)
+ *           word -- id of the object's keyword
  *   OUTPUTS: none
  *   RETURN VALUE: a pointer to a matching object, or NULL if none is found
  *   SIDE EFFECTS: none
  */
-static object_t* find_in_room(const room_t* r, const char* arg) {
+static object_t* find_in_room(const room_t* r, int32_t word) {
     object_t* obj;    /* index over room contents */
 
     /* Loop over objects in room. */
     for (obj = r->contents; NULL != obj; obj = obj->next) {
         /* If we find a matching object, return it. */
-        if (0 == strcasecmp(arg, obj->name)) {
+        if (word == obj->word) {
             return obj;
         }
     }
@@ -442,209 +678,838 @@ static object_t* find_in_room(const room_t* r, const char* arg) {
 
 
 /*
- * insert_object_at
- *   DESCRIPTION: Place an object at a specific(x,y) location in a room.
- *                The location refers to the placement of the object in
- *                the room's photo.
- *   INPUTS: o -- the object being placed
- *           r -- the room
- *           x -- the x position for the object
- *           y -- the y position for the object
+ * find_key
+ *   DESCRIPTION: Finds a key of the rules for a room in key_slot.
+ *   INPUTS: verb -- the verb
+ *           word -- the word, or RULE_ANY
+ *           room -- the room
  *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: takes the object out of its current location
+ *   RETURN VALUE: the key's slot, or NULL if there is no such key
+ *   SIDE EFFECTS: none
  */
-static void insert_object_at(object_t* o, room_t* r, int32_t x, int32_t y) {
-    /* Remove object from its current room, if any. */
-    remove_object(o);
-
-    /* Position the object within the new room. */
-    o->x = x;
-    o->y = y;
-
-    /* Now add the object to the new room's contents. */
-    o->loc = r;
-    o->next = r->contents;
-    r->contents = o;
+static const key_slot_t* find_key(int32_t verb, int32_t word, int32_t room) {
+    uint64_t          bits; /* the key, packed */
+    const key_slot_t* k;    /* slot probed     */
+
+    bits = RULE_KEY_BITS(verb, word, room);
+    for (k = &key_slot[KEY_SLOT(bits, key_shift)]; 0 != k->bits;
+         k = &key_slot[(k - key_slot + 1) & key_mask]) {
+        if (bits == k->bits) {
+            return k;
+        }
+    }
+    return NULL;
 }
 
 
 /*
- * insert_object
- *   DESCRIPTION: Insert object at a random position within a room.
- *   INPUTS: o -- the object being placed
- *           r -- the room
+ * free_rooms
+ *   DESCRIPTION: Frees the rooms of a world, with their occupancy grids
+ *                and object records.
+ *   INPUTS: w -- the world
  *   OUTPUTS: none
  *   RETURN VALUE: none
- *   SIDE EFFECTS: takes the object out of its current location; sets
- *                 the position of the object within the new room
- *                 randomly
+ *   SIDE EFFECTS: frees memory
  */
-static void insert_object(object_t* o, room_t* r) {
-    int32_t space;   /* room photo height in pixels            */
-    int32_t range;   /* number of pixels in placement interval */
-    int32_t xpos;    /* x position selected                    */
-    int32_t ypos;    /* y position selected                    */
-    int32_t img_ht;  /* object image height in pixels          */
+static void free_rooms(world_t* w) {
+    int32_t idx;    /* index over rooms */
 
+    for (idx = 0; n_rooms > idx; idx++) {
+        free(w->room[idx].grid);
+        free(w->room[idx].recs);
+    }
+    free(w->room);
+}
 
-    /* Choose a random x location. */
-    range = photo_width(r->view) - image_width(o->img);
-    xpos = (0 >= range ? 0 : (rand() % range));
 
-    /* Place in the lowest quarter of the roo photo if the object fits... */
-    space = photo_height(r->view);
-    img_ht = image_height(o->img);
-    range = space / 4 - img_ht;
-    if (0 >= range) {
-        /* Doesn't fit: try not to let the object fall off the bottom. */
-        range = space - img_ht;
-        ypos = (0 >= range ? 0 : (rand() % range));
+/*
+ * grid_find
+ *   DESCRIPTION: Finds a free place for a w x h object in a room's
+ *                occupancy grid, with its top edge at or below y_lo and
+ *                its bottom edge above y_hi.  Places start at cell
+ *                edges.  The search starts at a row of cells and a
+ *                column chosen by y_pick and x_pick and wraps around,
+ *                so that random picks give random places.
+ *   INPUTS: g -- the grid
+ *           w, h -- object width and height in pixels
+ *           y_lo, y_hi -- range of rows of pixels allowed
+ *           x_pick, y_pick -- random numbers to choose the place
+ *   OUTPUTS: *x, *y -- the place found
+ *   RETURN VALUE: 1 if a place was found, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t grid_find(const grid_t* g, int32_t w, int32_t h, int32_t y_lo, int32_t y_hi,
+                         int32_t x_pick, int32_t y_pick, int32_t* x, int32_t* y) {
+    int32_t  cw;      /* cells covered across        */
+    int32_t  ch;      /* rows of cells covered       */
+    int32_t  c_max;   /* last column to start at     */
+    int32_t  r_min;   /* first row to start at       */
+    int32_t  r_max;   /* last row to start at        */
+    int32_t  r;       /* row being tried             */
+    int32_t  n;       /* rows left to try            */
+    int32_t  k;       /* index over rows covered     */
+    int32_t  len;     /* length of free runs found   */
+    int32_t  step;    /* length added to runs        */
+    uint64_t busy;    /* cells covered in any row    */
+    uint64_t start;   /* columns starting a free run */
+    uint64_t pick;    /* free runs at or after pick  */
+
+    if (0 >= w || 0 >= h || g->width < w || y_hi - y_lo < h) {
+        return 0;
     }
-    else {
-        ypos = (0 >= range ? 0 : (rand() % range) + (3 * space) / 4);
+    cw = ((w - 1) >> g->x_shift) + 1;
+    ch = ((h - 1) >> GRID_CELL_Y_SHIFT) + 1;
+    c_max = (g->width - w) >> g->x_shift;
+    c_max = (g->cols - cw < c_max ? g->cols - cw : c_max);
+    r_min = (y_lo + GRID_CELL_Y - 1) >> GRID_CELL_Y_SHIFT;
+    r_max = (y_hi - h) >> GRID_CELL_Y_SHIFT;
+    r_max = (g->rows - ch < r_max ? g->rows - ch : r_max);
+    if (0 > c_max || r_min > r_max) {
+        return 0;
     }
 
-    /* Now put the object into the room at the chosen location. */
-    insert_object_at(o, r, xpos, ypos);
+    r = r_min + y_pick % (r_max - r_min + 1);
+    for (n = r_max - r_min + 1; 0 < n; n--, r = (r_max == r ? r_min : r + 1)) {
+        /* Free runs of cw cells start where cells c to c + cw - 1 are free. */
+        for (busy = 0, k = 0; ch > k; k++) {
+            busy |= g->row[r + k];
+        }
+        for (start = ~busy, len = 1; cw > len; len += step) {
+            step = (cw - len < len ? cw - len : len);
+            start &= start >> step;
+        }
+        start &= ~0ULL >> (63 - c_max);
+        if (0 != start) {
+            pick = start & (~0ULL << (x_pick % (c_max + 1)));
+            *x = __builtin_ctzll(0 != pick ? pick : start) << g->x_shift;
+            *y = r << GRID_CELL_Y_SHIFT;
+            return 1;
+        }
+    }
+    return 0;
 }
 
 
 /*
- * move_object_to_inventory
- *   DESCRIPTION: Move an object into the player's inventory.  Try to
- *                place objects on a 3x3 grid for clarity, but place
- *                randomly if necessary.
- *   INPUTS: obj -- the object
+ * grid_is_free
+ *   DESCRIPTION: Checks whether a w x h object at (x, y) would cover only
+ *                free cells of a room's occupancy grid.
+ *   INPUTS: g -- the grid
+ *           x, y -- position of the object in pixels
+ *           w, h -- object width and height in pixels
  *   OUTPUTS: none
- *   RETURN VALUE: none
- *   SIDE EFFECTS: takes the object out of its current location
+ *   RETURN VALUE: 1 if the cells are free, 0 if not
+ *   SIDE EFFECTS: none
  */
-static void move_object_to_inventory(object_t* obj) {
-    object_t* conf; /* loop index over possible conflicts for a space */
-    int32_t   x;    /* loop index for 3x3 grid x positions            */
-    int32_t   y;    /* loop index for 3x3 grid y positions            */
-
-    /*
-     * This approach is asymptotically slow(N^2), but there shouldn't be
-     * much in inventory, so it doesn't matter.
-     */
-    for (y = 10; 160 >= y; y += 50) {
-        for (x = 10; 210 >= x; x += 100) {
-            for (conf = room[R_INVENTORY].contents; NULL != conf; conf = conf->next) {
-                if (x == conf->x && y == conf->y) {
-                    break;
-                }
-            }
-            if (NULL == conf) {
-                insert_object_at(obj, &room[R_INVENTORY], x, y);
-                return;
-            }
+static int32_t grid_is_free(const grid_t* g, int32_t x, int32_t y, int32_t w, int32_t h) {
+    uint64_t mask;  /* cells covered in each row */
+    int32_t  r0;    /* first row covered         */
+    int32_t  r1;    /* last row covered          */
+
+    mask = grid_span(g, x, y, w, h, &r0, &r1);
+    for (; 0 != mask && r1 >= r0; r0++) {
+        if (0 != (g->row[r0] & mask)) {
+            return 0;
         }
     }
-
-    /* Give up: place randomly in bottom quarter like a room. */
-    insert_object(obj, &room[R_INVENTORY]);
+    return 1;
 }
 
 
 /*
- * obj_special_get
- *   DESCRIPTION: Handle special effects "get" commands, in which a player
- *                gets an object that is not represented as an object_t in
- *                the room's contents.
- *   INPUTS: r -- the room in which the "get" is performed
- *           arg -- the name of the object sought
+ * grid_mark
+ *   DESCRIPTION: Marks the cells that an object covers in a room's
+ *                occupancy grid.
+ *   INPUTS: g -- the grid
+ *           o -- the object
  *   OUTPUTS: none
- *   RETURN VALUE: an object to be gotten by the player, or NULL for nothing
- *   SIDE EFFECTS: may move objects or show status messages
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
  */
-static object_t* obj_special_get(room_t* r, const char* arg) {
-    /* Get a book from the Grainger reference desk... */
-    if (&room[R_RESERVE] == r && 0 == strcasecmp("book", arg)) {
-        /* can only get it once... */
-        if (player_flag_is_set(FLAG_HAS_EATEN)) {
-            if (NULL == object[O_BOOK_C].loc) {
-                show_status("You check out the C book.");
-                return &object[O_BOOK_C];
-            }
-        }
-        else {
-            if (NULL == object[O_BOOK_WODE].loc) {
-                show_status("Here's a nice Wodehouse collection.");
-                return &object[O_BOOK_WODE];
-            }
-        }
-    }
-
-    /* Pick up the car battery... */
-    if (&room[R_CAR_SITE] == r && object[O_BATT_CAR].loc == r) {
-        remove_object(&object[O_BATT_CAR]);
-        return &object[O_BATT_EMPTY];
+static void grid_mark(grid_t* g, const object_t* o) {
+    uint64_t mask;  /* cells covered in each row */
+    int32_t  r0;    /* first row covered         */
+    int32_t  r1;    /* last row covered          */
+
+    mask = grid_span(g, o->x, o->y, o->w, o->h, &r0, &r1);
+    for (; 0 != mask && r1 >= r0; r0++) {
+        g->row[r0] |= mask;
     }
-
-    /* That's all, folks! */
-    return NULL;
 }
 
 
 /*
- * player_flag_is_set
- *   DESCRIPTION: Checks whether the player has accomplished a specified task.
- *   INPUTS: fnum -- the accomplishment identifier(a FLAG_*)
- *   OUTPUTS: none
- *   RETURN VALUE: 1 if the player has accomplished the task, 0 if not
+ * grid_span
+ *   DESCRIPTION: Finds the cells of a room's occupancy grid that a w x h
+ *                object at (x, y) covers, ignoring any outside the grid.
+ *   INPUTS: g -- the grid
+ *           x, y -- position of the object in pixels
+ *           w, h -- object width and height in pixels
+ *   OUTPUTS: *r0, *r1 -- first and last rows of cells covered
+ *   RETURN VALUE: the cells covered in each of those rows(0 if none)
  *   SIDE EFFECTS: none
  */
-static int32_t player_flag_is_set(int32_t fnum) {
-    return (0 != (player_flags[fnum / 32] & (1UL << (fnum % 32))));
+static uint64_t grid_span(const grid_t* g, int32_t x, int32_t y, int32_t w, int32_t h,
+                          int32_t* r0, int32_t* r1) {
+    int32_t c0;  /* first column covered */
+    int32_t c1;  /* last column covered  */
+
+    if (0 >= w || 0 >= h) {
+        return 0;
+    }
+    c0 = x >> g->x_shift;
+    c1 = (x + w - 1) >> g->x_shift;
+    c1 = (g->cols <= c1 ? g->cols - 1 : c1);
+    *r0 = y >> GRID_CELL_Y_SHIFT;
+    *r1 = (y + h - 1) >> GRID_CELL_Y_SHIFT;
+    *r1 = (g->rows <= *r1 ? g->rows - 1 : *r1);
+    if (c0 > c1 || *r0 > *r1) {
+        return 0;
+    }
+    return (~0ULL >> (63 - (c1 - c0))) << c0;
 }
 
 
 /*
- * player_set_flag
- *   DESCRIPTION: Sets the flag indicating that the player has accomplished
- *                a specified task.
- *   INPUTS: fnum -- the accomplishment identifier(a FLAG_*)
+ * grid_unmark
+ *   DESCRIPTION: Clears the cells that an object covered in its room's
+ *                occupancy grid, if the room has one, except those that
+ *                the other objects in the room also cover.
+ *   INPUTS: r -- the room
+ *           o -- the object(no longer in the room's contents)
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
-static void player_set_flag(int32_t fnum) {
-    player_flags[fnum / 32] |= (1UL << (fnum % 32));
+static void grid_unmark(const room_t* r, const object_t* o) {
+    grid_t*         g;      /* the room's grid                   */
+    const object_t* other;  /* loop index over objects in room   */
+    uint64_t        mask;   /* cells covered in each row         */
+    uint64_t        omask;  /* cells another object covers       */
+    int32_t         r0, r1; /* rows covered by the object        */
+    int32_t         o0, o1; /* rows covered by another object    */
+    int32_t         row;    /* index over rows                   */
+
+    if (NULL == (g = r->grid) ||
+        0 == (mask = grid_span(g, o->x, o->y, o->w, o->h, &r0, &r1))) {
+        return;
+    }
+    for (row = r0; r1 >= row; row++) {
+        g->row[row] &= ~mask;
+    }
+
+    /* Objects may overlap(when placed by the world file or when no room is left). */
+    for (other = r->contents; NULL != other; other = other->next) {
+        omask = grid_span(g, other->x, other->y, other->w, other->h, &o0, &o1);
+        if (0 != (omask & mask)) {
+            for (row = (r0 > o0 ? r0 : o0); r1 >= row && o1 >= row; row++) {
+                g->row[row] |= omask;
+            }
+        }
+    }
 }
 
 
 /*
- * remove_object
- *   DESCRIPTION: Take an object out of its current location, leaving it
- *                in limbo(NULL location).
- *   INPUTS: o -- the object
+ * hash_key
+ *   DESCRIPTION: Adds a key of the rules for a room to key_slot, and the
+ *                room to the set of rooms with keys for the key's verb
+ *                and word.
+ *   INPUTS: k -- the key, or the key for any room with its verb and word
+ *           room -- the room
+ *           code -- its rules, from this word of rule_code
+ *           n_rules -- number of its rules
+ *           rooms -- start of each verb and word's set in room_set,
+ *                    indexed as cmd_rules is
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: fills a slot of key_slot(which must have one free);
+ *                 adds the room to a set in room_set
+ */
+static void hash_key(const world_file_key_t* k, int32_t room, uint32_t code, uint32_t n_rules,
+                     const uint32_t* rooms) {
+    key_slot_t* slot; /* slot probed     */
+    uint64_t    bits; /* the key, packed */
+
+    bits = RULE_KEY_BITS(k->verb, k->word, room);
+    for (slot = &key_slot[KEY_SLOT(bits, key_shift)]; 0 != slot->bits;
+         slot = &key_slot[(slot - key_slot + 1) & key_mask]);
+    slot->bits = bits;
+    slot->code = code;
+    slot->n_rules = n_rules;
+    room_set[rooms[k->verb * (n_words + 1) + k->word + 1] + room / 64] |= (1ULL << (room % 64));
+}
+
+
+/*
+ * index_keys
+ *   DESCRIPTION: Packs the rules listed by each key into rule_code,
+ *                hashing the keys for rooms into key_slot and filling
+ *                cmd_rules from the keys for any room, and makes keys
+ *                for the rooms that those keys' rules leave out(see
+ *                cmd_rules_t).
+ *   INPUTS: hdr -- the world file header
+ *           rules, conds, effects, keys, refs -- the rule records
+ *                                                (checked by check_rules)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 on success, 0 on failure
+ *   SIDE EFFECTS: allocates memory(freed by free_world); prints an error
+ *                 message on failure
+ */
+static int32_t index_keys(const world_file_header_t* hdr, const world_file_rule_t* rules,
+                          const world_file_cond_t* conds, const world_file_effect_t* effects,
+                          const world_file_key_t* keys, const world_file_ref_t* refs) {
+    const world_file_key_t*  k;       /* key being indexed              */
+    const world_file_rule_t* u;       /* one of its rules               */
+    const world_file_cond_t* cnd;     /* condition on the player's room */
+    cmd_rules_t*             row;     /* rules of the verb, by word     */
+    cmd_rules_t*             c;       /* rules of verb and word         */
+    uint32_t*                rooms;   /* sets in room_set, as cmd_rules */
+    uint64_t                 need;    /* words of rule_code needed      */
+    uint64_t                 spare;   /* words left for keys made       */
+    uint64_t                 size;    /* words for a key's rules        */
+    uint64_t                 n_room;  /* most keys for rooms            */
+    uint32_t                 n_in;    /* leading conditions on rooms    */
+    uint32_t                 n_slots; /* number of key slots            */
+    uint32_t                 n_sets;  /* sets of rooms(one empty)       */
+    uint32_t                 n_set;   /* words of room_set in a set     */
+    uint32_t                 code;    /* next free word of rule_code    */
+    uint32_t                 first;   /* first word of a key's rules    */
+    uint32_t                 n;       /* rules packed for a key         */
+    uint32_t                 left;    /* conditions left in a rule      */
+    uint32_t                 j;       /* index over a key's rules       */
+    int32_t                  idx;     /* index over records             */
+
+    /*
+     * Size rule_code for the rules of every key, with as much space
+     * again for keys made below, key_slot for the keys for rooms and
+     * the most keys that can be made, and room_set for a set of rooms
+     * for each verb and word with keys.
+     */
+    n_set = hdr->n_rooms / 64 + 1;
+    for (idx = 0, need = n_room = 0, n_sets = 1, k = keys; (int32_t)hdr->n_keys > idx; idx++, k++) {
+        need += list_size(k, rules, conds, refs, &n_in);
+        n_room += (RULE_ANY != k->room ? 1 : n_in);
+        if (0 == idx || k[-1].verb != k->verb || k[-1].word != k->word) {
+            n_sets++;
+        }
+    }
+    if (UINT32_MAX / 2 <= need || ((uint64_t)1 << 30) < n_room || UINT32_MAX / n_set <= n_sets) {
+        fprintf(stderr, "Too many rules to index.\n");
+        return 0;
+    }
+    for (n_slots = 2, key_shift = 63; 2 * n_room > n_slots; n_slots *= 2, key_shift--);
+    key_mask = n_slots - 1;
+    cmd_rules = calloc(NUM_TC_VALUES * (n_words + 1), sizeof (cmd_rules[0]));
+    rooms = calloc(NUM_TC_VALUES * (n_words + 1), sizeof (rooms[0]));
+    key_slot = calloc(n_slots, sizeof (key_slot[0]));
+    rule_code = malloc((2 * need + 1) * sizeof (rule_code[0]));
+    room_set = calloc(n_sets * n_set, sizeof (room_set[0]));
+    if (NULL == cmd_rules || NULL == rooms || NULL == key_slot || NULL == rule_code ||
+        NULL == room_set) {
+        perror("allocate rule keys");
+        free(rooms);
+        return 0;
+    }
+    for (idx = 0; NUM_TC_VALUES * (n_words + 1) > idx; idx++) {
+        cmd_rules[idx].word = RULE_ANY;
+    }
+
+    /*
+     * The player is in a key's room whenever its rules are tried, so
+     * leading conditions on that room(with which most rules limited to
+     * a room start) are known.  The first set of rooms stays empty.
+     */
+    for (idx = 0, code = 0, n_sets = 1, k = keys; (int32_t)hdr->n_keys > idx; idx++, k++) {
+        if (0 == rooms[k->verb * (n_words + 1) + k->word + 1]) {
+            rooms[k->verb * (n_words + 1) + k->word + 1] = n_sets++ * n_set;
+        }
+        if (RULE_ANY != k->room) {
+            first = code;
+            n = pack_rules(k, k->room, rules, conds, effects, refs, &code);
+            hash_key(k, k->room, first, n, rooms);
+        }
+    }
+
+    /*
+     * A key for any room is found only in rooms without keys of their
+     * own for its verb and word.  So each room named by the leading
+     * conditions of its rules(as in "!in R_EVRT_VEND") is given a key
+     * too, while rule_code has space, and those conditions are then
+     * known wherever the key for any room is found.  The keys are
+     * sorted, so the one for any word(RULE_ANY) comes first for each
+     * verb; it gives every word of the verb its rules, which the keys
+     * for a word then replace.
+     */
+    for (idx = 0, spare = need, k = keys; (int32_t)hdr->n_keys > idx; idx++, k++) {
+        row = &cmd_rules[k->verb * (n_words + 1)];
+        c = &row[k->word + 1];
+        /* A word may have keys only for rooms, so set it from every key. */
+        c->word = k->word;
+        if (RULE_ANY != k->room) {
+            continue;
+        }
+        size = list_size(k, rules, conds, refs, &n_in);
+        if (n_in * size <= spare) {
+            spare -= n_in * size;
+            for (j = 0; k->n_refs > j; j++) {
+                u = &rules[refs[k->ref + j].rule];
+                for (cnd = &conds[u->cond], left = u->n_conds;
+                     0 < left && RC_IN == (cnd->kind & ~RULE_NOT); left--, cnd++) {
+                    if (NULL == find_key(k->verb, k->word, cnd->a)) {
+                        first = code;
+                        n = pack_rules(k, cnd->a, rules, conds, effects, refs, &code);
+                        hash_key(k, cnd->a, first, n, rooms);
+                    }
+                }
+            }
+        }
+        c->code = code;
+        c->n_rules = pack_rules(k, RULE_ANY, rules, conds, effects, refs, &code);
+        if (RULE_ANY == k->word) {
+            for (c++; c < &row[n_words + 1]; c++) {
+                *c = row[0];
+            }
+        }
+    }
+
+    /* Give each verb and word the set of rooms for its key's word. */
+    for (idx = 0, c = cmd_rules; NUM_TC_VALUES * (n_words + 1) > idx; idx++, c++) {
+        c->rooms = rooms[idx - idx % (n_words + 1) + c->word + 1];
+    }
+    free(rooms);
+    return 1;
+}
+
+
+/*
+ * insert_object_at
+ *   DESCRIPTION: Place an object at a specific(x,y) location in a room.
+ *                The location refers to the placement of the object in
+ *                the room's photo.
+ *   INPUTS: o -- the object being placed
+ *           r -- the room
+ *           x -- the x position for the object
+ *           y -- the y position for the object
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes the object out of its current location; may
+ *                 grow the room's object records(and panics if it
+ *                 cannot)
+ */
+static void insert_object_at(object_t* o, room_t* r, int32_t x, int32_t y) {
+    obj_rec_t* recs;    /* room's records, after growing */
+    int32_t    max;     /* number of records allocated   */
+
+    /* Remove object from its current room, if any. */
+    remove_object(o);
+
+    /* Position the object within the new room. */
+    o->x = x;
+    o->y = y;
+
+    /* Now add the object to the new room's contents. */
+    o->loc = r;
+    o->next = r->contents;
+    r->contents = o;
+    if (NULL != r->grid) {
+        grid_mark(r->grid, o);
+    }
+
+    /* Its record goes first too, so that it is drawn first(beneath the others). */
+    if (r->max_recs == r->n_recs) {
+        max = (0 == r->max_recs ? 4 : 2 * r->max_recs);
+        if (NULL == (recs = realloc(r->recs, max * sizeof (recs[0])))) {
+            PANIC("cannot grow object records");
+        }
+        r->recs = recs;
+        r->max_recs = max;
+    }
+    (void)memmove(&r->recs[1], &r->recs[0], r->n_recs * sizeof (r->recs[0]));
+    r->recs[0].x = o->x;
+    r->recs[0].y = o->y;
+    r->recs[0].w = o->w;
+    r->recs[0].h = o->h;
+    r->recs[0].img = o->img;
+    r->n_recs++;
+}
+
+
+/*
+ * insert_object
+ *   DESCRIPTION: Insert object at a random position within a room, where
+ *                it overlaps no other object: in the lowest quarter of
+ *                the room photo if there is space, else anywhere.  If
+ *                there is no space, or no occupancy grid can be made,
+ *                the object goes at a random position as though the room
+ *                were empty.
+ *   INPUTS: o -- the object being placed
+ *           r -- the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes the object out of its current location; sets
+ *                 the position of the object within the new room
+ *                 randomly
+ */
+static void insert_object(object_t* o, room_t* r) {
+    grid_t* g;       /* room's occupancy grid                  */
+    int32_t space;   /* room photo height in pixels            */
+    int32_t range;   /* number of pixels in placement interval */
+    int32_t xpos;    /* x position selected                    */
+    int32_t ypos;    /* y position selected                    */
+    int32_t img_wd;  /* object image width in pixels           */
+    int32_t img_ht;  /* object image height in pixels          */
+    int32_t x_pick;  /* random number for x position           */
+    int32_t y_pick;  /* random number for y position           */
+
+    /* Take it out first, so that it does not get in its own way. */
+    remove_object(o);
+    img_wd = o->w;
+    img_ht = o->h;
+    space = photo_height(r->view);
+    x_pick = rand_r(&world->seed);
+    y_pick = rand_r(&world->seed);
+
+    /* Look for free space, in the lowest quarter first. */
+    if (NULL != (g = room_grid(r)) &&
+        (grid_find(g, img_wd, img_ht, (3 * space) / 4, space, x_pick, y_pick, &xpos, &ypos) ||
+         grid_find(g, img_wd, img_ht, 0, space, x_pick, y_pick, &xpos, &ypos))) {
+        insert_object_at(o, r, xpos, ypos);
+        return;
+    }
+
+    /* Choose a random x location. */
+    range = photo_width(r->view) - img_wd;
+    xpos = (0 >= range ? 0 : (x_pick % range));
+
+    /* Place in the lowest quarter of the roo photo if the object fits... */
+    range = space / 4 - img_ht;
+    if (0 >= range) {
+        /* Doesn't fit: try not to let the object fall off the bottom. */
+        range = space - img_ht;
+        ypos = (0 >= range ? 0 : (y_pick % range));
+    }
+    else {
+        ypos = (0 >= range ? 0 : (y_pick % range) + (3 * space) / 4);
+    }
+
+    /* Now put the object into the room at the chosen location. */
+    insert_object_at(o, r, xpos, ypos);
+}
+
+
+/*
+ * list_size
+ *   DESCRIPTION: Finds the space that the rules listed by a key can take
+ *                in rule_code, and counts their leading conditions on
+ *                the player's room(RC_IN, negated or not).
+ *   INPUTS: k -- the key
+ *           rules, conds, refs -- the rule records
+ *   OUTPUTS: *n_room_conds -- the number of such conditions
+ *   RETURN VALUE: the space, in words of rule_code
+ *   SIDE EFFECTS: none
+ */
+static uint64_t list_size(const world_file_key_t* k, const world_file_rule_t* rules,
+                          const world_file_cond_t* conds, const world_file_ref_t* refs,
+                          uint32_t* n_room_conds) {
+    const world_file_rule_t* u;    /* rule listed       */
+    const world_file_cond_t* c;    /* condition checked */
+    uint64_t                 size; /* bytes needed      */
+    uint32_t                 left; /* conditions left   */
+    uint32_t                 j;    /* index over rules  */
+
+    *n_room_conds = 0;
+    for (j = 0, size = 0; k->n_refs > j; j++) {
+        u = &rules[refs[k->ref + j].rule];
+        size += sizeof (rule_t) + (uint64_t)u->n_conds * sizeof (conds[0]) +
+                (uint64_t)u->n_effects * sizeof (world_file_effect_t);
+        for (c = &conds[u->cond], left = u->n_conds;
+             0 < left && RC_IN == (c->kind & ~RULE_NOT); left--, c++) {
+            (*n_room_conds)++;
+        }
+    }
+    return size / sizeof (uint32_t);
+}
+
+
+/*
+ * move_object_to_inventory
+ *   DESCRIPTION: Move an object into the player's inventory.  Try to
+ *                place objects on a 3x3 grid for clarity, in the first
+ *                spot where they overlap nothing(checked against the
+ *                inventory's occupancy grid), but place randomly if
+ *                necessary.
+ *   INPUTS: obj -- the object
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: takes the object out of its current location
+ */
+static void move_object_to_inventory(object_t* obj) {
+    room_t*       inv;  /* the inventory                        */
+    const grid_t* g;    /* the inventory's occupancy grid       */
+    int32_t       x;    /* loop index for 3x3 grid x positions  */
+    int32_t       y;    /* loop index for 3x3 grid y positions  */
+
+    inv = &world->room[R_INVENTORY];
+    remove_object(obj);
+    if (NULL != (g = room_grid(inv))) {
+        for (y = 10; 160 >= y; y += 50) {
+            for (x = 10; 210 >= x; x += 100) {
+                if (grid_is_free(g, x, y, obj->w, obj->h)) {
+                    insert_object_at(obj, inv, x, y);
+                    return;
+                }
+            }
+        }
+    }
+
+    /* Give up: place randomly in bottom quarter like a room. */
+    insert_object(obj, inv);
+}
+
+
+/*
+ * obj_special_get
+ *   DESCRIPTION: Handle special effects "get" commands, in which a player
+ *                gets an object that is not represented as an object_t in
+ *                the room's contents.
+ *   INPUTS: r -- the room in which the "get" is performed
+ *           word -- id of the word naming the object sought
+ *   OUTPUTS: none
+ *   RETURN VALUE: an object to be gotten by the player, or NULL for nothing
+ *   SIDE EFFECTS: may move objects or show status messages
+ */
+static object_t* obj_special_get(room_t* r, int32_t word) {
+    /* Get a book from the Grainger reference desk... */
+    if (&world->room[R_RESERVE] == r && W_BOOK == word) {
+        /* can only get it once... */
+        if (player_flag_is_set(FLAG_HAS_EATEN)) {
+            if (NULL == world->object[O_BOOK_C].loc) {
+                show_status("You check out the C book.");
+                return &world->object[O_BOOK_C];
+            }
+        }
+        else {
+            if (NULL == world->object[O_BOOK_WODE].loc) {
+                show_status("Here's a nice Wodehouse collection.");
+                return &world->object[O_BOOK_WODE];
+            }
+        }
+    }
+
+    /* Pick up the car battery... */
+    if (&world->room[R_CAR_SITE] == r && world->object[O_BATT_CAR].loc == r) {
+        remove_object(&world->object[O_BATT_CAR]);
+        return &world->object[O_BATT_EMPTY];
+    }
+
+    /* That's all, folks! */
+    return NULL;
+}
+
+
+/*
+ * pack_rules
+ *   DESCRIPTION: Packs the rules listed by a key into rule_code(see
+ *                rule_t) as they are tried in a given room, or in any
+ *                room without a key of its own for the key's verb and
+ *                word.  Leading conditions on the player's room that are
+ *                known there are left out if they hold, along with the
+ *                whole rule if they do not.  The keys for rooms must be
+ *                in key_slot before the rules of a key for any room are
+ *                packed.
+ *   INPUTS: k -- the key
+ *           room -- the room, or RULE_ANY
+ *           rules, conds, effects, refs -- the rule records
+ *           *code -- next free word of rule_code
+ *   OUTPUTS: *code -- next free word after the rules packed
+ *   RETURN VALUE: the number of rules packed
+ *   SIDE EFFECTS: none
+ */
+static uint32_t pack_rules(const world_file_key_t* k, int32_t room, const world_file_rule_t* rules,
+                           const world_file_cond_t* conds, const world_file_effect_t* effects,
+                           const world_file_ref_t* refs, uint32_t* code) {
+    const world_file_rule_t* u;     /* rule listed             */
+    const world_file_cond_t* c;     /* its first condition left */
+    rule_t*                  r;     /* the rule, packed        */
+    uint32_t                 left;  /* conditions left         */
+    uint32_t                 j;     /* index over rules        */
+    uint32_t                 n;     /* rules packed            */
+    int32_t                  holds; /* known conditions hold   */
+
+    for (j = n = 0; k->n_refs > j; j++) {
+        /*
+         * RULE_ANY matches no room, and is taken for the rooms with keys
+         * of their own, where such rules are not tried.
+         */
+        u = &rules[refs[k->ref + j].rule];
+        for (c = &conds[u->cond], left = u->n_conds, holds = 1;
+             holds && 0 < left && RC_IN == (c->kind & ~RULE_NOT) &&
+             (RULE_ANY != room || NULL != find_key(k->verb, k->word, c->a)); left--, c++) {
+            holds = ((room == c->a) == (RC_IN == c->kind));
+        }
+        if (holds) {
+            r = (rule_t*)&rule_code[*code];
+            r->n_conds = left;
+            r->n_effects = u->n_effects;
+            r->result = u->result;
+            r->status = u->status;
+            (void)memcpy((void*)RULE_CONDS(r), c, left * sizeof (*c));
+            (void)memcpy((void*)RULE_EFFECTS(r), &effects[u->effect],
+                         u->n_effects * sizeof (effects[0]));
+            *code = (const uint32_t*)NEXT_RULE(r) - rule_code;
+            n++;
+        }
+    }
+    return n;
+}
+
+
+/*
+ * player_flag_is_set
+ *   DESCRIPTION: Checks whether the player has accomplished a specified task.
+ *   INPUTS: fnum -- the accomplishment identifier(a FLAG_*)
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if the player has accomplished the task, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t player_flag_is_set(int32_t fnum) {
+    return (0 != (world->player_flags[fnum / 32] & (1UL << (fnum % 32))));
+}
+
+
+/*
+ * player_set_flag
+ *   DESCRIPTION: Sets the flag indicating that the player has accomplished
+ *                a specified task.
+ *   INPUTS: fnum -- the accomplishment identifier(a FLAG_*)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+static void player_set_flag(int32_t fnum) {
+    world->player_flags[fnum / 32] |= (1UL << (fnum % 32));
+}
+
+
+/*
+ * remove_object
+ *   DESCRIPTION: Take an object out of its current location, leaving it
+ *                in limbo(NULL location).
+ *   INPUTS: o -- the object
  *   OUTPUTS: none
  *   RETURN VALUE: none
  *   SIDE EFFECTS: none
  */
 static void remove_object(object_t* o) {
     object_t** find;    /* loop index over pointers to objects in room */
+    int32_t    pos;     /* position of object in room's contents       */
 
     /* Is object already in limbo? */
     if (NULL != o->loc) {
 
         /* Remove from previous room(with safety check)... */
-        for (find = &o->loc->contents; NULL != *find; find = &(*find)->next) {
+        for (find = &o->loc->contents, pos = 0; NULL != *find; find = &(*find)->next, pos++) {
             if (o == *find) {
-                /* We found the predecessor! Unlink the object. */
+                /* We found the predecessor! Unlink the object and its record. */
                 *find = o->next;
+                delete_record(o->loc, pos);
                 break;
             }
         }
 
+        /* An empty room needs no grid until something is placed in it. */
+        if (NULL == o->loc->contents) {
+            free(o->loc->grid);
+            o->loc->grid = NULL;
+        } else {
+            grid_unmark(o->loc, o);
+        }
+
         /* Mark the object's location as NULL. */
         o->loc = NULL;
     }
 }
 
 
+/*
+ * room_grid
+ *   DESCRIPTION: Finds a room's occupancy grid, making it from the
+ *                room's contents the first time it is needed.  The grid
+ *                covers the photo the room shows when it is made.
+ *   INPUTS: r -- the room
+ *   OUTPUTS: none
+ *   RETURN VALUE: the grid, or NULL if it cannot be made
+ *   SIDE EFFECTS: allocates the grid
+ */
+static grid_t* room_grid(room_t* r) {
+    grid_t*         g;     /* the grid                         */
+    const object_t* o;     /* loop index over objects in room  */
+    int32_t         shift; /* log2 of cell width               */
+    int32_t         rows;  /* rows of cells                    */
+
+    if (NULL != r->grid) {
+        return r->grid;
+    }
+    for (shift = GRID_CELL_X_SHIFT; 64 < ((int32_t)(photo_width(r->view) - 1) >> shift) + 1; shift++) {
+    }
+    rows = ((photo_height(r->view) - 1) >> GRID_CELL_Y_SHIFT) + 1;
+    if (NULL == (g = malloc(sizeof (*g) + rows * sizeof (g->row[0])))) {
+        return NULL;
+    }
+    g->width = photo_width(r->view);
+    g->x_shift = shift;
+    g->cols = ((g->width - 1) >> shift) + 1;
+    g->rows = rows;
+    g->row = (uint64_t*)(g + 1);
+    (void)memset(g->row, 0, rows * sizeof (g->row[0]));
+    for (o = r->contents; NULL != o; o = o->next) {
+        grid_mark(g, o);
+    }
+    r->grid = g;
+    return g;
+}
+
+
+/*
+ * rule_holds
+ *   DESCRIPTION: Checks whether all of a rule's conditions hold.
+ *   INPUTS: rule -- the rule
+ *           r -- player's current room
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if they hold, 0 if not
+ *   SIDE EFFECTS: none
+ */
+static int32_t rule_holds(const rule_t* rule, const room_t* r) {
+    const world_file_cond_t* c;     /* condition being checked */
+    uint32_t                 n;     /* conditions left         */
+    const room_t*            loc;   /* location of an object   */
+    int32_t                  holds; /* condition holds         */
+
+    for (c = RULE_CONDS(rule), n = rule->n_conds; 0 < n; n--, c++) {
+        switch (c->kind & ~RULE_NOT) {
+            case RC_IN:
+                holds = (&world->room[c->a] == r);
+                break;
+            case RC_AT:
+                holds = (world->object[c->a].loc == (R_NONE == c->b ? NULL : &world->room[c->b]));
+                break;
+            case RC_HERE:
+                loc = world->object[c->a].loc;
+                holds = (&world->room[R_INVENTORY] == loc || r == loc);
+                break;
+            default: /* RC_FLAG */
+                holds = player_flag_is_set(c->a);
+                break;
+        }
+        if (holds == (0 != (c->kind & RULE_NOT))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
 /*
  * obj_get_x
  *   DESCRIPTION: Get x position of object within containing room.
@@ -713,6 +1578,22 @@ object_t* room_contents_iterate(const room_t* r) {
 }
 
 
+/*
+ * room_objects
+ *   DESCRIPTION: Get the records of the objects in a room, in the order
+ *                of its contents(the order in which they are drawn).
+ *                The records are good until the room's contents change.
+ *   INPUTS: r -- pointer to the room
+ *   OUTPUTS: recs -- the first record
+ *   RETURN VALUE: the number of records(0 when the room is empty)
+ *   SIDE EFFECTS: none
+ */
+int32_t room_objects(const room_t* r, const obj_rec_t** recs) {
+    *recs = r->recs;
+    return r->n_recs;
+}
+
+
 /*
  * room_name
  *   DESCRIPTION: Get name for a room.
@@ -768,125 +1649,531 @@ uint32_t room_photo_width(const room_t* r) {
  * build_world
  *   DESCRIPTION: Builds and connects the rooms, creates objects, and
  *                reads in all image data(could be done lazily with
- *                caching instead).
- *   INPUTS: none
+ *                caching instead).  The layout comes from a binary world
+ *                file(see world_ids.h), which is mapped into memory and
+ *                kept mapped, since room and object names point into it.
+ *                The work done is linear in the numbers of rooms and
+ *                objects.
+ *   INPUTS: fname -- name of the world file
  *   OUTPUTS: none
  *   RETURN VALUE: 1 on success, or 0 on failure
  *   SIDE EFFECTS: prints error messages to stderr on failure
  */
-int32_t build_world() {
-    int32_t idx;    /* index over data arrays   */
-    int32_t which;    /* id for current data item */
-
-    /* Clear all accomplishment flags. */
-    (void)memset(player_flags, 0, sizeof (player_flags));
+int32_t build_world(const char* fname) {
+    int                        fd;      /* world file descriptor     */
+    struct stat                st;      /* world file status         */
+    const uint8_t*             map;     /* mapping of world file     */
+    const world_file_header_t* hdr;     /* file header               */
+    const world_file_room_t*   rdata;   /* room records              */
+    const world_file_obj_t*    odata;   /* object records            */
+    const world_file_swap_t*   sdata;   /* swap records              */
+    const world_file_word_t*   wdata;   /* word records              */
+    const world_file_hash_t*   hdata;   /* word hash records         */
+    const world_file_rule_t*   udata;   /* rule records              */
+    const world_file_cond_t*   cdata;   /* condition records         */
+    const world_file_effect_t* edata;   /* effect records            */
+    const world_file_key_t*    kdata;   /* key records               */
+    const world_file_ref_t*    fdata;   /* reference records         */
+    const char*                str;     /* string table              */
+    size_t                     size;    /* expected file size        */
+    int32_t                    idx;     /* index over records        */
+    int32_t                    link[3]; /* neighbors of current room */
+    int32_t                    i;       /* index over neighbors      */
+
+    /* Map the world file. */
+    if (-1 == (fd = open(fname, O_RDONLY))) {
+        perror(fname);
+        return 0;
+    }
+    if (-1 == fstat(fd, &st) || sizeof (*hdr) > (size_t)st.st_size) {
+        fprintf(stderr, "World file %s is too short.\n", fname);
+        (void)close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void)close(fd);
+    if (MAP_FAILED == map) {
+        perror("map world file");
+        return 0;
+    }
 
-    /* Clear room data to enable sanity check for duplication. */
-    (void)memset(room, 0, sizeof (room));
+    /* Check that the file fits this program and is complete. */
+    hdr = (const world_file_header_t*)map;
+    size = sizeof (*hdr) + hdr->n_rooms * sizeof (*rdata) +
+           hdr->n_objects * sizeof (*odata) + N_SWAPS * sizeof (*sdata) +
+           hdr->n_words * sizeof (*wdata) + hdr->hash_size * sizeof (*hdata) +
+           hdr->n_rules * sizeof (*udata) + hdr->n_conds * sizeof (*cdata) +
+           hdr->n_effects * sizeof (*edata) + hdr->n_keys * sizeof (*kdata) +
+           hdr->n_refs * sizeof (*fdata) + hdr->str_size;
+    if (WORLD_FILE_MAGIC != hdr->magic || WORLD_FILE_VERSION != hdr->version ||
+        N_NAMED_ROOMS != hdr->n_named_rooms || N_NAMED_OBJECTS != hdr->n_named_objects ||
+        N_NAMED_WORDS != hdr->n_named_words || NUM_FLAGS != hdr->n_flags ||
+        NUM_TC_VALUES != hdr->n_verbs || N_SWAPS != hdr->n_swaps ||
+        (size_t)st.st_size < hdr->n_rooms || (size_t)st.st_size < hdr->n_objects ||
+        (size_t)st.st_size < hdr->n_words || (size_t)st.st_size < hdr->hash_size ||
+        (size_t)st.st_size < hdr->n_rules || (size_t)st.st_size < hdr->n_conds ||
+        (size_t)st.st_size < hdr->n_effects || (size_t)st.st_size < hdr->n_keys ||
+        (size_t)st.st_size < hdr->n_refs ||
+        N_NAMED_ROOMS > hdr->n_rooms || N_NAMED_OBJECTS > hdr->n_objects ||
+        N_NAMED_WORDS > hdr->n_words || hdr->n_words > hdr->hash_size ||
+        0 != (hdr->hash_size & (hdr->hash_size - 1)) || size != (size_t)st.st_size ||
+        0 == hdr->str_size || 0 > hdr->start || hdr->n_rooms <= (uint32_t)hdr->start) {
+        fprintf(stderr, "World file %s does not match this program.\n", fname);
+        (void)munmap((void*)map, st.st_size);
+        return 0;
+    }
+    rdata = (const world_file_room_t*)(hdr + 1);
+    odata = (const world_file_obj_t*)(rdata + hdr->n_rooms);
+    sdata = (const world_file_swap_t*)(odata + hdr->n_objects);
+    wdata = (const world_file_word_t*)(sdata + N_SWAPS);
+    hdata = (const world_file_hash_t*)(wdata + hdr->n_words);
+    udata = (const world_file_rule_t*)(hdata + hdr->hash_size);
+    cdata = (const world_file_cond_t*)(udata + hdr->n_rules);
+    edata = (const world_file_effect_t*)(cdata + hdr->n_conds);
+    kdata = (const world_file_key_t*)(edata + hdr->n_effects);
+    fdata = (const world_file_ref_t*)(kdata + hdr->n_keys);
+    str = (const char*)(fdata + hdr->n_refs);
 
-    /* Loop over room data. */
-    for (idx = 0; N_ROOMS > idx; idx++) {
+    /*
+     * Every string in the table ends with a NUL, so checking the last
+     * byte makes any offset within the table safe to use.
+     */
+    if ('\0' != str[hdr->str_size - 1]) {
+        fprintf(stderr, "World file %s is corrupt.\n", fname);
+        (void)munmap((void*)map, st.st_size);
+        return 0;
+    }
 
-        /* Set the room id. */
-        which = room_data[idx].id;
+    /* The rest of the file is used in place, until free_world. */
+    world_map = map;
+    world_map_size = st.st_size;
 
-        /* Check for bad and duplicate ids. */
-        if (0 > which || N_ROOMS <= which) {
-            fputs("Bad index in room data.\n", stderr);
+    /* The words and their hash are used in place. */
+    for (idx = 0; (int32_t)hdr->n_words > idx; idx++) {
+        if (hdr->str_size <= wdata[idx].name) {
+            fprintf(stderr, "Bad string in word %d.\n", idx);
             return 0;
         }
-        if (NULL != room[which].name) {
-            fprintf(stderr, "Duplicate index %d in room data.\n", which);
-            return 0;
-        }
-
-        /* Set up the room. */
-        room[which].name = room_data[idx].name;
-        room[which].view = read_photo(room_data[idx].filename);
-        if (NULL == room[which].view) {
-            fprintf(stderr, "Can't read room photo %s.\n", room_data[idx].filename);
+    }
+    for (idx = 0; (int32_t)hdr->hash_size > idx; idx++) {
+        if (-1 > hdata[idx].id || (int32_t)hdr->n_words <= hdata[idx].id) {
+            fprintf(stderr, "Bad word hash in world file %s.\n", fname);
             return 0;
         }
-        room[which].contents = NULL;
-        room[which].left  = (R_NONE == room_data[idx].left ? NULL : &room[room_data[idx].left]);
-        room[which].enter = (R_NONE == room_data[idx].enter ? NULL : &room[room_data[idx].enter]);
-        room[which].right = (R_NONE == room_data[idx].right ? NULL : &room[room_data[idx].right]);
+    }
+    word_rec = wdata;
+    word_hash = hdata;
+    hash_size = hdr->hash_size;
+    n_words = hdr->n_words;
+    word_str = str;
+
+    /* So are the rules, once checked. */
+    if (!check_rules(hdr, udata, cdata, edata, kdata, fdata)) {
+        fprintf(stderr, "Bad rules in world file %s.\n", fname);
+        return 0;
+    }
+    if (!index_keys(hdr, udata, cdata, edata, kdata, fdata)) {
+        return 0;
     }
 
-    /* Clear object data to enable sanity check for duplication. */
-    (void)memset(object, 0, sizeof (object));
-
-    /* Loop over object data. */
-    for (idx = 0; N_OBJECTS > idx; idx++) {
+    /*
+     * Build the starting world, which is kept so that more worlds can be
+     * made from it later.  Clear all accomplishment flags.
+     */
+    world = &start_world;
+    world->seed = rand();
+    (void)memset(world->player_flags, 0, sizeof (world->player_flags));
+
+    /* Allocate the rooms and objects. */
+    n_rooms = hdr->n_rooms;
+    n_objects = hdr->n_objects;
+    world->room = calloc(n_rooms, sizeof (world->room[0]));
+    world->object = calloc(n_objects, sizeof (world->object[0]));
+    if (NULL == world->room || NULL == world->object) {
+        perror("allocate world");
+        return 0;
+    }
+    start_id = hdr->start;
+
+    /*
+     * Read the photos and images from the asset pack if there is one(or
+     * from their own files if not).  Reserve room for them first, so
+     * that they are all placed together in one arena(see reserve_photo).
+     * Bad strings and unreadable files are reported below.
+     */
+    (void)open_pack(PACK_FILE);
+    for (idx = 0; n_rooms > idx; idx++) {
+        if (hdr->str_size > rdata[idx].photo) {
+            (void)reserve_photo(str + rdata[idx].photo);
+        }
+    }
+    for (idx = 0; n_objects > idx; idx++) {
+        if (hdr->str_size > odata[idx].image) {
+            (void)reserve_obj_image(str + odata[idx].image);
+        }
+    }
+    for (idx = 0; N_SWAPS > idx; idx++) {
+        if (hdr->str_size > sdata[idx].photo) {
+            (void)reserve_photo(str + sdata[idx].photo);
+        }
+    }
 
-        /* Set the object id. */
-        which = obj_data[idx].id;
+    /*
+     * Read them all at once, decoding each as it arrives; the starting
+     * room's photo is read first, so that it is ready soonest.
+     */
+    preload_assets(IN_RANGE(start_id, n_rooms) && hdr->str_size > rdata[start_id].photo ?
+                   str + rdata[start_id].photo : NULL);
 
-        /* Check for bad and duplicate ids. */
-        if (0 > which || N_OBJECTS <= which) {
-            fputs("Bad index in object data.\n", stderr);
+    /* Loop over room data. */
+    for (idx = 0; n_rooms > idx; idx++) {
+        link[0] = rdata[idx].left;
+        link[1] = rdata[idx].enter;
+        link[2] = rdata[idx].right;
+        for (i = 0; 3 > i; i++) {
+            if (R_NONE > link[i] || n_rooms <= link[i]) {
+                fprintf(stderr, "Bad room link in room %d.\n", idx);
+                return 0;
+            }
+        }
+        if (hdr->str_size <= rdata[idx].name || hdr->str_size <= rdata[idx].photo) {
+            fprintf(stderr, "Bad string in room %d.\n", idx);
             return 0;
         }
-        if (NULL != object[which].name) {
-            fprintf(stderr, "Duplicate index %d in object data.\n", which);
+
+        /* Set up the room. */
+        world->room[idx].name = str + rdata[idx].name;
+        world->room[idx].view = load_photo(str + rdata[idx].photo);
+        if (NULL == world->room[idx].view) {
+            fprintf(stderr, "Can't read room photo %s.\n", str + rdata[idx].photo);
+            return 0;
+        }
+        world->room[idx].contents = NULL;
+        world->room[idx].grid = NULL;
+        world->room[idx].recs = NULL;
+        world->room[idx].n_recs = 0;
+        world->room[idx].max_recs = 0;
+        world->room[idx].left  = (R_NONE == link[0] ? NULL : &world->room[link[0]]);
+        world->room[idx].enter = (R_NONE == link[1] ? NULL : &world->room[link[1]]);
+        world->room[idx].right = (R_NONE == link[2] ? NULL : &world->room[link[2]]);
+    }
+
+    /* Loop over object data. */
+    for (idx = 0; n_objects > idx; idx++) {
+        if (R_NONE > odata[idx].room || n_rooms <= odata[idx].room ||
+            0 > odata[idx].word || (int32_t)hdr->n_words <= odata[idx].word ||
+            hdr->str_size <= odata[idx].image) {
+            fprintf(stderr, "Bad data for object %d.\n", idx);
             return 0;
         }
 
         /* Set up the object. */
-        object[which].name = obj_data[idx].name;
-        object[which].img = read_obj_image(obj_data[idx].filename);
-        if (NULL == object[which].img) {
-            fprintf(stderr, "Can't read object photo %s.\n", obj_data[idx].filename);
+        world->object[idx].word = odata[idx].word;
+        world->object[idx].img = load_obj_image(str + odata[idx].image);
+        if (NULL == world->object[idx].img) {
+            fprintf(stderr, "Can't read object photo %s.\n", str + odata[idx].image);
             return 0;
         }
-        object[which].next = NULL;
-        object[which].loc = NULL;
-        object[which].x = 0;
-        object[which].y = 0;
+        world->object[idx].w = image_width(world->object[idx].img);
+        world->object[idx].h = image_height(world->object[idx].img);
+        world->object[idx].next = NULL;
+        world->object[idx].loc = NULL;
+        world->object[idx].x = 0;
+        world->object[idx].y = 0;
 
         /* Insert it into a room if necessary. */
-        if (R_NONE != obj_data[idx].room) {
-            if (-1 != obj_data[idx].x) {
-                insert_object_at(&object[which], &room[obj_data[idx].room], obj_data[idx].x, obj_data[idx].y);
+        if (R_NONE != odata[idx].room) {
+            if (-1 != odata[idx].x) {
+                insert_object_at(&world->object[idx], &world->room[odata[idx].room], odata[idx].x, odata[idx].y);
             }
             else {
-                insert_object(&object[which], &room[obj_data[idx].room]);
+                insert_object(&world->object[idx], &world->room[odata[idx].room]);
             }
         }
     }
 
-    /* Clear swap photo data to enable sanity check for duplication. */
-    (void)memset(swap_photo, 0, sizeof (swap_photo));
-
     /* Loop over swap photo data. */
     for (idx = 0; N_SWAPS > idx; idx++) {
-
-        /* Set the swap photo id. */
-        which = swap_data[idx].id;
-
-        /* Check for bad and duplicate ids. */
-        if (0 > which || N_SWAPS <= which) {
-            fputs("Bad index in swap data.\n", stderr);
-            return 0;
-        }
-        if (NULL != swap_photo[which]) {
-            fprintf(stderr, "Duplicate index %d in swap data.\n", which);
+        if (hdr->str_size <= sdata[idx].photo) {
+            fprintf(stderr, "Bad data for swap %d.\n", idx);
             return 0;
         }
 
         /* Read in the swap photo. */
-        swap_photo[which] = read_photo(swap_data[idx].filename);
-        if (NULL == swap_photo[which]) {
-            fprintf(stderr, "Can't read room photo %s.\n", swap_data[idx].filename);
+        world->swap_photo[idx] = load_photo(str + sdata[idx].photo);
+        world->swap_room[idx] = NULL;
+        if (NULL == world->swap_photo[idx]) {
+            fprintf(stderr, "Can't read room photo %s.\n", str + sdata[idx].photo);
             return 0;
         }
     }
 
+    /* Make the first world to play in. */
+    world = &first_world;
+    world->seed = rand();
+    if (!copy_world(world, &start_world)) {
+        perror("allocate world");
+        return 0;
+    }
+
     /* Everything worked! */
     return 1;
 }
 
 
+/*
+ * world_state_size
+ *   DESCRIPTION: Get the size of a snapshot of the world state.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the size in bytes(fixed once the world is built)
+ *   SIDE EFFECTS: none
+ */
+uint32_t world_state_size() {
+    return sizeof (world_state_t) + n_rooms * sizeof (room_state_t) +
+           n_objects * sizeof (obj_state_t);
+}
+
+
+/*
+ * save_world_state
+ *   DESCRIPTION: Takes a snapshot of the world state: the player's room
+ *                and accomplishments, the links between rooms, the
+ *                location of every object, and which photos are swapped.
+ *                The work done is linear in the numbers of rooms and
+ *                objects, with no allocation.
+ *   INPUTS: where -- the player's room
+ *   OUTPUTS: buf -- the snapshot(world_state_size bytes)
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void save_world_state(void* buf, const room_t* where) {
+    world_state_t* ws = buf;                        /* snapshot header  */
+    room_state_t*  rs = (room_state_t*)(ws + 1);    /* room links       */
+    obj_state_t*   os = (obj_state_t*)(rs + n_rooms); /* object states  */
+    int32_t        n;                               /* objects saved    */
+    int32_t        idx;                             /* index over rooms */
+    object_t*      obj;                             /* index over objs  */
+
+    ws->n_rooms = n_rooms;
+    ws->n_objects = n_objects;
+    ws->where = where - world->room;
+    for (idx = 0; N_SWAPS > idx; idx++) {
+        ws->swap_room[idx] = ROOM_ID(world->swap_room[idx]);
+    }
+    (void)memcpy(ws->flags, world->player_flags, sizeof (ws->flags));
+    for (idx = 0; n_rooms > idx; idx++) {
+        rs[idx].left = ROOM_ID(world->room[idx].left);
+        rs[idx].enter = ROOM_ID(world->room[idx].enter);
+        rs[idx].right = ROOM_ID(world->room[idx].right);
+    }
+
+    /* Objects in rooms, in list order... */
+    for (n = idx = 0; n_rooms > idx; idx++) {
+        for (obj = world->room[idx].contents; NULL != obj; obj = obj->next, n++) {
+            os[n].id = obj - world->object;
+            os[n].room = idx;
+            os[n].x = obj->x;
+            os[n].y = obj->y;
+        }
+    }
+
+    /* ...then those in limbo. */
+    for (idx = 0; n_objects > idx; idx++) {
+        if (NULL == world->object[idx].loc) {
+            os[n].id = idx;
+            os[n].room = R_NONE;
+            os[n].x = world->object[idx].x;
+            os[n].y = world->object[idx].y;
+            n++;
+        }
+    }
+}
+
+
+/*
+ * load_world_state
+ *   DESCRIPTION: Restores the world state from a snapshot taken by
+ *                save_world_state in a world built from the same world
+ *                file.  The snapshot is checked completely before
+ *                anything is changed.
+ *   INPUTS: buf -- the snapshot
+ *           size -- its size in bytes
+ *   OUTPUTS: none
+ *   RETURN VALUE: the player's room, or NULL if the snapshot does not
+ *                 fit this world(the world is then unchanged)
+ *   SIDE EFFECTS: moves objects, swaps photos, sets accomplishments, and
+ *                 relinks rooms
+ */
+room_t* load_world_state(const void* buf, uint32_t size) {
+    const world_state_t* ws = buf;                    /* snapshot header  */
+    const room_state_t*  rs;                          /* room links       */
+    const obj_state_t*   os;                          /* object states    */
+    uint8_t*             seen;                        /* objects listed   */
+    int32_t              idx;                         /* loop index       */
+
+    /* Check the snapshot. */
+    if (world_state_size() != size || n_rooms != ws->n_rooms ||
+        n_objects != ws->n_objects || 0 > ws->where || n_rooms <= ws->where) {
+        return NULL;
+    }
+    rs = (const room_state_t*)(ws + 1);
+    os = (const obj_state_t*)(rs + n_rooms);
+    for (idx = 0; N_SWAPS > idx; idx++) {
+        if (R_NONE > ws->swap_room[idx] || n_rooms <= ws->swap_room[idx]) {
+            return NULL;
+        }
+    }
+    for (idx = 0; n_rooms > idx; idx++) {
+        if (R_NONE > rs[idx].left || n_rooms <= rs[idx].left ||
+            R_NONE > rs[idx].enter || n_rooms <= rs[idx].enter ||
+            R_NONE > rs[idx].right || n_rooms <= rs[idx].right) {
+            return NULL;
+        }
+    }
+
+    /* Every object must be listed exactly once. */
+    if (NULL == (seen = calloc(n_objects + 1, 1))) {
+        return NULL;
+    }
+    for (idx = 0; n_objects > idx; idx++) {
+        if (0 > os[idx].id || n_objects <= os[idx].id || seen[os[idx].id] ||
+            R_NONE > os[idx].room || n_rooms <= os[idx].room) {
+            free(seen);
+            return NULL;
+        }
+        seen[os[idx].id] = 1;
+    }
+    free(seen);
+
+    /* Put back the original photos, then swap in the saved ones. */
+    for (idx = 0; N_SWAPS > idx; idx++) {
+        if (NULL != world->swap_room[idx]) {
+            do_photo_swap(world->swap_room[idx], idx);
+        }
+        if (R_NONE != ws->swap_room[idx]) {
+            do_photo_swap(&world->room[ws->swap_room[idx]], idx);
+        }
+    }
+
+    (void)memcpy(world->player_flags, ws->flags, sizeof (world->player_flags));
+    for (idx = 0; n_rooms > idx; idx++) {
+        world->room[idx].left = ROOM_AT(rs[idx].left);
+        world->room[idx].enter = ROOM_AT(rs[idx].enter);
+        world->room[idx].right = ROOM_AT(rs[idx].right);
+    }
+
+    /* Empty every room, then rebuild the contents lists(and grids, when needed). */
+    for (idx = 0; n_rooms > idx; idx++) {
+        world->room[idx].contents = NULL;
+        free(world->room[idx].grid);
+        world->room[idx].grid = NULL;
+        world->room[idx].n_recs = 0;
+    }
+    for (idx = 0; n_objects > idx; idx++) {
+        world->object[idx].loc = NULL;
+        world->object[idx].next = NULL;
+    }
+    for (idx = n_objects; 0 < idx--; ) {
+        if (R_NONE != os[idx].room) {
+            insert_object_at(&world->object[os[idx].id], &world->room[os[idx].room], os[idx].x, os[idx].y);
+        } else {
+            world->object[os[idx].id].x = os[idx].x;
+            world->object[os[idx].id].y = os[idx].y;
+        }
+    }
+
+    return &world->room[ws->where];
+}
+
+
+/*
+ * world_create
+ *   DESCRIPTION: Makes a new world for a game session, in the state in
+ *                which build_world left the first world.  The new world
+ *                shares the photos and images of the others.
+ *   INPUTS: seed -- seed for the world's random choices
+ *   OUTPUTS: none
+ *   RETURN VALUE: the new world, or NULL on failure
+ *   SIDE EFFECTS: allocates memory
+ */
+world_t* world_create(unsigned seed) {
+    world_t* w;    /* new world */
+
+    if (NULL == (w = malloc(sizeof (*w)))) {
+        return NULL;
+    }
+    if (!copy_world(w, &start_world)) {
+        free(w);
+        return NULL;
+    }
+    w->seed = seed;
+    return w;
+}
+
+
+/*
+ * world_destroy
+ *   DESCRIPTION: Frees a world made by world_create.  No thread may be
+ *                using the world.
+ *   INPUTS: w -- the world
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees memory
+ */
+void world_destroy(world_t* w) {
+    free_rooms(w);
+    free(w->object);
+    free(w);
+}
+
+
+/*
+ * free_world
+ *   DESCRIPTION: Frees everything build_world made: the first world, the
+ *                photos and images, and the mapping of the world file.
+ *                Worlds made by world_create must be destroyed first.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: frees memory; no room or object may be used afterward
+ */
+void free_world() {
+    free_rooms(&start_world);
+    free(start_world.object);
+    free_rooms(&first_world);
+    free(first_world.object);
+    free_assets();
+    free(cmd_rules);
+    free(key_slot);
+    free(rule_code);
+    free(room_set);
+    cmd_rules = NULL;
+    key_slot = NULL;
+    rule_code = NULL;
+    room_set = NULL;
+    if (NULL != world_map) {
+        (void)munmap((void*)world_map, world_map_size);
+        world_map = NULL;
+    }
+}
+
+
+/*
+ * world_use
+ *   DESCRIPTION: Selects the world on which the calling thread's calls
+ *                to the functions in this file act.  A world must not
+ *                be used by two threads at once.
+ *   INPUTS: w -- the world, or NULL for the first world
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void world_use(world_t* w) {
+    world = (NULL == w ? &first_world : w);
+}
+
+
 /*
  * start_in_room
  *   DESCRIPTION: Get a pointer to the room in which the player begins
@@ -897,7 +2184,49 @@ int32_t build_world() {
  *   SIDE EFFECTS: none
  */
 room_t* start_in_room() {
-    return &room[R_EAST_EVRT];
+    return &world->room[start_id];
+}
+
+
+/*
+ * find_word
+ *   DESCRIPTION: Interns a typed word: finds the identifier of the word in
+ *                the world(a word named in world_ids.h or an object
+ *                keyword), ignoring case.  The word's hash picks the one
+ *                word that can match, so the cost does not grow with the
+ *                number of words.
+ *   INPUTS: s -- the word
+ *   OUTPUTS: none
+ *   RETURN VALUE: the word's identifier, or W_NONE if it is not a word
+ *   SIDE EFFECTS: none
+ */
+int32_t find_word(const char* s) {
+    uint64_t    h;    /* hash of word      */
+    const char* c;    /* scan pointer      */
+    int32_t     id;   /* word in its slot  */
+
+    for (h = WORD_HASH_INIT, c = s; '\0' != *c; c++) {
+        h = WORD_HASH_STEP(h, *c);
+    }
+    id = word_hash[HASH_SLOT(h, word_hash[HASH_BUCKET(h, hash_size)].disp, hash_size)].id;
+    if (-1 == id || 0 != strcasecmp(s, word_str + word_rec[id].name)) {
+        return W_NONE;
+    }
+    return id;
+}
+
+
+/*
+ * inventory_room
+ *   DESCRIPTION: Get a pointer to the 'room' holding the player's
+ *                inventory.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: pointer to the inventory room
+ *   SIDE EFFECTS: none
+ */
+room_t* inventory_room() {
+    return &world->room[R_INVENTORY];
 }
 
 
@@ -910,7 +2239,7 @@ room_t* start_in_room() {
  *   SIDE EFFECTS: none
  */
 int32_t player_has_board() {
-    return (&room[R_INVENTORY] == object[0].loc);
+    return (&world->room[R_INVENTORY] == world->object[0].loc);
 }
 
 
@@ -923,7 +2252,7 @@ int32_t player_has_board() {
  *   SIDE EFFECTS: none
  */
 int32_t player_has_jetpack() {
-    return (&room[R_INVENTORY] == object[1].loc);
+    return (&world->room[R_INVENTORY] == world->object[1].loc);
 }
 
 
@@ -946,13 +2275,13 @@ tc_action_t try_to_move_left(room_t** rptr) {
         *rptr = r->left;
 
         /* When entering the Boneyard Circle, choose picture randomly. */
-        if (&room[R_CIRCLE_N] == *rptr && 0 == (rand() % 2)) {
+        if (&world->room[R_CIRCLE_N] == *rptr && 0 == (rand_r(&world->seed) % 2)) {
             do_photo_swap(*rptr, SWAP_CIRCLE);
         }
         return TC_CHANGE_ROOM;
     }
 
-    if (&room[0] == r) {
+    if (&world->room[0] == r) {
         /* Give a hint as to how to get out of inventory. */
         show_status("Push 'home' or type 'inventory'.");
     }
@@ -983,7 +2312,7 @@ tc_action_t try_to_enter(room_t** rptr) {
         *rptr = r->enter;
 
         /* When entering the Boneyard Circle, choose picture randomly. */
-        if (&room[R_CIRCLE_N] == *rptr && 0 == (rand() % 2)) {
+        if (&world->room[R_CIRCLE_N] == *rptr && 0 == (rand_r(&world->seed) % 2)) {
             do_photo_swap(*rptr, SWAP_CIRCLE);
         }
         return TC_CHANGE_ROOM;
@@ -994,46 +2323,46 @@ tc_action_t try_to_enter(room_t** rptr) {
      * conditions are met, and give hints when the conditions are
      * not met.
      */
-    if (&room[R_BY_CLEANR] == r) {
+    if (&world->room[R_BY_CLEANR] == r) {
         if (player_flag_is_set(FLAG_WEARING_SUIT)) {
-            *rptr = &room[R_IN_CLEANR];
+            *rptr = &world->room[R_IN_CLEANR];
             return TC_CHANGE_ROOM;
         }
         show_status("You're not wearing a bunnysuit!");
         return TC_ALLOW_EDIT;
     }
-    if (&room[R_BY_395LAB] == r) {
-        if (object[O_ICARD].loc == &room[R_INVENTORY]) {
+    if (&world->room[R_BY_395LAB] == r) {
+        if (world->object[O_ICARD].loc == &world->room[R_INVENTORY]) {
             show_status("You swiped your Icard.");
-            *rptr = &room[R_IN_395LAB];
+            *rptr = &world->room[R_IN_395LAB];
             return TC_CHANGE_ROOM;
         }
         show_status("You need a valid Icard.");
         return TC_ALLOW_EDIT;
     }
-    if (&room[R_CSL_DOOR] == r) {
-        if (object[O_ICARD].loc == &room[R_INVENTORY]) {
+    if (&world->room[R_CSL_DOOR] == r) {
+        if (world->object[O_ICARD].loc == &world->room[R_INVENTORY]) {
             show_status("You swiped your Icard.");
-            *rptr = &room[R_CSL_LOBBY];
+            *rptr = &world->room[R_CSL_LOBBY];
             return TC_CHANGE_ROOM;
         }
         show_status("You need a valid Icard.");
         return TC_ALLOW_EDIT;
     }
-    if (&room[R_BECK_DOOR] == r) {
-        if (object[O_ROBOT_LIVE].loc == &room[R_INVENTORY]) {
+    if (&world->room[R_BECK_DOOR] == r) {
+        if (world->object[O_ROBOT_LIVE].loc == &world->room[R_INVENTORY]) {
             show_status("The robot hand picked the lock!");
-            *rptr = &room[R_BECKLOBBY];
+            *rptr = &world->room[R_BECKLOBBY];
             return TC_CHANGE_ROOM;
         }
-        if (object[O_ROBOT_DEAD].loc == &room[R_INVENTORY]) {
+        if (world->object[O_ROBOT_DEAD].loc == &world->room[R_INVENTORY]) {
             show_status("Flash the robot's code again.");
             return TC_ALLOW_EDIT;
         }
         show_status("Complex lock! Find a nanotech robot.");
         return TC_ALLOW_EDIT;
     }
-    if (&room[R_MNTL_LAB1] == r) {
+    if (&world->room[R_MNTL_LAB1] == r) {
         /* Get advice from Kevin. */
         static const char* const advice[8] = {
             "Kevin says, \"Andres' board is FAST!\"",
@@ -1045,10 +2374,10 @@ tc_action_t try_to_enter(room_t** rptr) {
             "Kevin asks, \"Maybe you need a Dew?\"",
             "Kevin: \"A magnet can charge a battery.\""
         };
-        show_status(advice[(rand() % 8)]);
+        show_status(advice[(rand_r(&world->seed) % 8)]);
         return TC_ALLOW_EDIT;
     }
-    if (&room[R_COCKPIT] == r) {
+    if (&world->room[R_COCKPIT] == r) {
         show_status("A MIMO transmitter card is missing!");
         return TC_ALLOW_EDIT;
     }
@@ -1078,13 +2407,13 @@ tc_action_t try_to_move_right(room_t** rptr) {
         *rptr = r->right;
 
         /* When entering the Boneyard Circle, choose picture randomly. */
-        if (&room[R_CIRCLE_N] == *rptr && 0 == (rand() % 2)) {
+        if (&world->room[R_CIRCLE_N] == *rptr && 0 == (rand_r(&world->seed) % 2)) {
             do_photo_swap(*rptr, SWAP_CIRCLE);
         }
         return TC_CHANGE_ROOM;
     }
 
-    if (&room[0] == r) {
+    if (&world->room[0] == r) {
         /* Give a hint as to how to get out of inventory. */
         show_status("Push 'home' or type 'inventory'.");
     }
@@ -1097,178 +2426,66 @@ tc_action_t try_to_move_right(room_t** rptr) {
 
 
 /*
- * typed_cmd_buy
- *   DESCRIPTION: Execute the typed command "buy," which allows the player
- *                to simulate purchase of objects(sometimes obtaining an
- *                a real object, sometimes an accomplishment flag).
+ * typed_cmd
+ *   DESCRIPTION: Execute a typed command.  The first rule in the world
+ *                file for the verb and word whose conditions hold fires
+ *                (see world.txt).  The world file lists under each key
+ *                that can be found first--the word or any word, with the
+ *                room or any room, in that order--every rule that may
+ *                apply there, and cmd_rules picks the one list to try
+ *                with at most one hash lookup, so the time taken does
+ *                not depend on the number of rules in the world.  If no
+ *                rule fires, or the rule fired passes, the verb's
+ *                built-in action follows.
  *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to buy
- *   OUTPUTS: *rptr -- possibly new room for player
+ *           verb -- the verb(a TC_* value)
+ *           word -- id of the word typed after the verb, or W_NONE
+ *   OUTPUTS: *rptr -- possibly new room for player(NULL if the player wins)
  *   RETURN VALUE: indicates types of action taken(see header file)
  *   SIDE EFFECTS: may move objects, show status messages, change player's room
  */
-tc_action_t typed_cmd_buy(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
-
-    /* Set current room. */
-    r = *rptr;
-
-    /* Buy a Dew! */
-    if (0 == strcasecmp("dew", arg)) {
-        if (&room[R_EVRT_VEND] != r) {
-            show_status("Great idea! But... where?");
-            return TC_DISCARD_TEXT;
-        }
-        if (object[O_MTN_DEW].loc == &room[R_INVENTORY] || object[O_MTN_DEW].loc == r) {
-            show_status("Slow down! One at a time...");
-            return TC_DISCARD_TEXT;
-        }
-        if (NULL != object[O_MTN_DEW].loc) {
-            show_status("Last one get stolen? Ok... here we go...");
-        }
-        else {
-            show_status("You buy a Dew.");
-        }
-        move_object_to_inventory(&object[O_MTN_DEW]);
-        return TC_REDRAW_ROOM;
+tc_action_t typed_cmd(room_t** rptr, int32_t verb, int32_t word) {
+    static const tc_action_t action[RR_PASS] = {
+        TC_ALLOW_EDIT, TC_DISCARD_TEXT, TC_REDRAW_ROOM, TC_CHANGE_ROOM
+    };
+    const cmd_rules_t* c;      /* rules for verb and word */
+    const key_slot_t*  k;      /* key for the room        */
+    const rule_t*      rule;   /* rule being tried        */
+    uint32_t           left;   /* rules left to try       */
+    int32_t            result; /* result of rule fired    */
+    uint32_t           room;   /* id of player's room     */
+
+    /* Find the rules(see cmd_rules_t), and try them in order. */
+    c = &cmd_rules[verb * (n_words + 1) + word + 1];
+    rule = (const rule_t*)&rule_code[c->code];
+    left = c->n_rules;
+    room = *rptr - world->room;
+    if (0 != (room_set[c->rooms + room / 64] & (1ULL << (room % 64))) &&
+        NULL != (k = find_key(verb, c->word, room))) {
+        rule = (const rule_t*)&rule_code[k->code];
+        left = k->n_rules;
     }
-
-    /* Buy some yogurt. */
-    if (0 == strcasecmp("yogurt", arg)) {
-        if (&room[R_IN_COCOMR] != r) {
-            show_status("Cocomero doesn't deliver here.");
-        }
-        else if (player_flag_is_set(FLAG_HAS_EATEN)) {
-            show_status("You're not hungry.");
-        }
-        else {
-            player_set_flag(FLAG_HAS_EATEN);
-            show_status("So tasty and delicious!");
+    for (; 0 < left; rule = NEXT_RULE(rule), left--) {
+        if (0 == rule->n_conds || rule_holds(rule, *rptr)) {
+            if (RR_PASS != (result = apply_rule(rptr, rule))) {
+                return action[result];
+            }
+            break;
         }
-        return TC_DISCARD_TEXT;
-    }
-
-    /* The player got too imaginative. */
-    show_status("Sorry, purchasing options are limited.");
-    return TC_ALLOW_EDIT;
-}
-
-
-/*
- * typed_cmd_charge
- *   DESCRIPTION: Execute the typed command "charge".
- *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to charge
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
- */
-tc_action_t typed_cmd_charge(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
-
-    /* Set current room. */
-    r = *rptr;
-
-    /* Only the battery can be charged. */
-    if (0 != strcasecmp("battery", arg)) {
-        show_status("Electronic devices aren't (always) toys!");
-        return TC_ALLOW_EDIT;
-    }
-    if (object[O_BATT_EMPTY].loc != &room[R_INVENTORY] &&
-        object[O_BATT_EMPTY].loc != r &&
-        object[O_BATT_FULL].loc != &room[R_INVENTORY] &&
-        object[O_BATT_FULL].loc != r) {
-        show_status("What battery?");
-        return TC_DISCARD_TEXT;
-    }
-    if (&room[R_BECK_MRI] != r) {
-        show_status("Find a bigger magnet.");
-        return TC_DISCARD_TEXT;
-    }
-    if (object[O_BATT_FULL].loc == &room[R_INVENTORY] || object[O_BATT_FULL].loc == r) {
-        show_status("Don't overdo it.");
-        return TC_DISCARD_TEXT;
-    }
-    remove_object(&object[O_BATT_EMPTY]);
-    move_object_to_inventory(&object[O_BATT_FULL]);
-    show_status("Wow! That's a strong magnet!");
-    return TC_REDRAW_ROOM;
-}
-
-/*
- * typed_cmd_do
- *   DESCRIPTION: Execute the typed command "do," which allows the player
- *                to do certain things...like their 391 MP2!
- *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to do
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
- */
-tc_action_t typed_cmd_do(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
-
-    /* Set current room. */
-    r = *rptr;
-
-    if (&room[R_IN_391LAB] != r) {
-        show_status("You can't 'do' anything here.");
-        return TC_ALLOW_EDIT;
-    }
-    if (0 != strcasecmp("391", arg) &&
-        0 != strcasecmp("mp2", arg)) {
-        show_status("Doing the 391 MP2 is more important!");
-        return TC_ALLOW_EDIT;
     }
-    if (object[O_BOOK_C].loc != &room[R_INVENTORY]) {
-        show_status("You'd better get a book from Grainger.");
-        return TC_DISCARD_TEXT;
-    }
-    if (object[O_MP2].loc != &room[R_INVENTORY]) {
-        show_status("Web's down. Bring your own MP2.");
-        return TC_DISCARD_TEXT;
-    }
-    if (object[O_TUX].loc != &room[R_IN_391LAB]) {
-        show_status("You'd have better luck if Tux were here.");
-        return TC_DISCARD_TEXT;
-    }
-
-    /* The player wins the game! */
-    *rptr = NULL;
-    return TC_CHANGE_ROOM;
-}
-
-
-/*
- * typed_cmd_drink
- *   DESCRIPTION: Execute the typed command "drink," which allows the player
- *                to drink objects.
- *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to drink
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
- */
-tc_action_t typed_cmd_drink(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
-
-    /* Set current room. */
-    r = *rptr;
 
-    /* All you can drink is Dew... */
-    if (0 != strcasecmp("dew", arg)) {
-        show_status("That sounds less refreshing than Dew.");
-        return TC_ALLOW_EDIT;
-    }
-    if (object[O_MTN_DEW].loc != &room[R_INVENTORY] &&
-        object[O_MTN_DEW].loc != r) {
-        show_status("Uh-oh. Hadewcinations. Buy one soon!");
-        return TC_DISCARD_TEXT;
+    /* Carry out the built-in action, if any. */
+    switch (verb) {
+        case TC_DROP:
+            return typed_cmd_drop(rptr, word);
+        case TC_GET:
+            return typed_cmd_get(rptr, word);
+        case TC_INVENTORY:
+            return typed_cmd_inventory(rptr, word);
+        default:
+            show_status("Nothing happens.");
+            return TC_ALLOW_EDIT;
     }
-    remove_object(&object[O_MTN_DEW]);
-    show_status("Ahhhhhhhhhhhhhhhh........... nother?");
-    /* NOT a bug.  Sorry, Dew doesn't count as a food. */
-    return TC_REDRAW_ROOM;
 }
 
 
@@ -1278,12 +2495,12 @@ tc_action_t typed_cmd_drink(room_t** rptr, const char* arg) {
  *                to drop objects from their inventory into the room in
  *                which they're standing.
  *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to drop
+ *           word -- id of word naming object to drop
  *   OUTPUTS: *rptr -- possibly new room for player
  *   RETURN VALUE: indicates types of action taken(see header file)
  *   SIDE EFFECTS: may move objects, show status messages, change player's room
  */
-tc_action_t typed_cmd_drop(room_t** rptr, const char* arg) {
+static tc_action_t typed_cmd_drop(room_t** rptr, int32_t word) {
     room_t*   r;    /* current room                        */
     object_t* obj;      /* object being dropped                */
     room_t*   dest;    /* destination room for dropped object */
@@ -1292,7 +2509,7 @@ tc_action_t typed_cmd_drop(room_t** rptr, const char* arg) {
     r = *rptr;
 
     /* Search for object to drop--it must be in the player's inventory. */
-    obj = find_in_room(&room[R_INVENTORY], arg);
+    obj = find_in_room(&world->room[R_INVENTORY], word);
 
     /* No luck--say so. */
     if (NULL == obj) {
@@ -1304,8 +2521,8 @@ tc_action_t typed_cmd_drop(room_t** rptr, const char* arg) {
      * Issue a warning to player if they seem to be trying to make use
      * of certain objects(as a hint).
      */
-    if ((&object[O_BATT_FULL] == obj && &room[R_CAR_SITE] == r) ||
-        (&object[O_MIMO_CARD] == obj && &room[R_REM_PLANE] == r)) {
+    if ((&world->object[O_BATT_FULL] == obj && &world->room[R_CAR_SITE] == r) ||
+        (&world->object[O_MIMO_CARD] == obj && &world->room[R_REM_PLANE] == r)) {
         show_status("You may want to install it instead.");
     }
 
@@ -1313,115 +2530,23 @@ tc_action_t typed_cmd_drop(room_t** rptr, const char* arg) {
      * If player is looking at inventory, object goes into the room in
      * which they're standing.
      */
-    dest = (&room[R_INVENTORY] == r ? room[R_INVENTORY].enter : r);
+    dest = (&world->room[R_INVENTORY] == r ? world->room[R_INVENTORY].enter : r);
     insert_object(obj, dest);
     return TC_REDRAW_ROOM;
 }
 
 
-/*
- * typed_cmd_fix
- *   DESCRIPTION: Execute the typed command "fix," which allows the player
- *                to fix objects.
- *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to fix
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
- */
-tc_action_t typed_cmd_fix(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
-
-    /* Set current room. */
-    r = *rptr;
-
-    /* Only the GPS can be fixed. */
-    if (0 != strcasecmp("gps", arg)) {
-        show_status("In the game, you're not as capable.");
-        return TC_ALLOW_EDIT;
-    }
-    if (object[O_GPS_GOOD].loc == &room[R_INVENTORY] ||
-        object[O_GPS_GOOD].loc == r) {
-        show_status("It's working fine.");
-        return TC_DISCARD_TEXT;
-    }
-    if (object[O_GPS_BAD].loc != &room[R_INVENTORY] &&
-        object[O_GPS_BAD].loc != r) {
-        show_status("Do you have a GPS?");
-        return TC_DISCARD_TEXT;
-    }
-    if (&room[R_IN_CLEANR] != r) {
-        show_status("You'd better go to the cleanroom.");
-        return TC_DISCARD_TEXT;
-    }
-    if (object[O_GPS_SPEC].loc != &room[R_INVENTORY] &&
-        object[O_GPS_SPEC].loc != r) {
-        show_status("Maybe you'd better get a spec?");
-        return TC_DISCARD_TEXT;
-    }
-    remove_object(&object[O_GPS_BAD]);
-    remove_object(&object[O_GPS_SPEC]);
-    move_object_to_inventory(&object[O_GPS_GOOD]);
-    show_status("All done -- wow, you're good!");
-    return TC_CHANGE_ROOM;
-}
-
-
-/*
- * typed_cmd_flash
- *   DESCRIPTION: Execute the typed command "flash," which allows the player
- *                to flash objects with code and so forth.
- *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to flash
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
- */
-tc_action_t typed_cmd_flash(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
-
-    /* Set current room. */
-    r = *rptr;
-
-    /* Only the robot can be flashed. */
-    if (0 != strcasecmp("robot", arg)) {
-        show_status("Don't waste your time.");
-        return TC_ALLOW_EDIT;
-    }
-    if (object[O_ROBOT_DEAD].loc != &room[R_INVENTORY] &&
-        object[O_ROBOT_DEAD].loc != r &&
-        object[O_ROBOT_LIVE].loc != &room[R_INVENTORY] &&
-        object[O_ROBOT_LIVE].loc != r) {
-        show_status("Maybe get the robot first?");
-        return TC_DISCARD_TEXT;
-    }
-    if (&room[R_IN_395LAB] != r) {
-        show_status("With spit and a lemon? Try the lab.");
-        return TC_DISCARD_TEXT;
-    }
-    if (object[O_ROBOT_LIVE].loc == &room[R_INVENTORY] ||
-        object[O_ROBOT_LIVE].loc == r) {
-        show_status("You flash the robot's ROM again.");
-        return TC_DISCARD_TEXT;
-    }
-    remove_object(&object[O_ROBOT_DEAD]);
-    move_object_to_inventory(&object[O_ROBOT_LIVE]);
-    show_status("You flash it with a lockpicking code.");
-    return TC_REDRAW_ROOM;
-}
-
-
 /*
  * typed_cmd_get
  *   DESCRIPTION: Execute the typed command "get," which allows the player
  *                to move objects in a room into their inventory.
  *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to get
+ *           word -- id of word naming object to get
  *   OUTPUTS: *rptr -- possibly new room for player
  *   RETURN VALUE: indicates types of action taken(see header file)
  *   SIDE EFFECTS: may move objects, show status messages, change player's room
  */
-tc_action_t typed_cmd_get(room_t** rptr, const char* arg) {
+static tc_action_t typed_cmd_get(room_t** rptr, int32_t word) {
     room_t*   r;    /* current room                  */
     room_t*   src;    /* source room for object search */
     object_t* obj;    /* object being sought           */
@@ -1433,11 +2558,11 @@ tc_action_t typed_cmd_get(room_t** rptr, const char* arg) {
      * If player is looking at inventory, source room for object search
      * is the room in which they're standing.
      */
-    src = (&room[R_INVENTORY] == r ? room[R_INVENTORY].enter : r);
+    src = (&world->room[R_INVENTORY] == r ? world->room[R_INVENTORY].enter : r);
 
     /* Try a special effect search followed by a normal search. */
-    if (NULL == (obj = obj_special_get(src, arg))) {
-        obj = find_in_room(src, arg);
+    if (NULL == (obj = obj_special_get(src, word))) {
+        obj = find_in_room(src, word);
     }
     if (NULL == obj) {
         show_status("You see no such thing here.");
@@ -1445,7 +2570,7 @@ tc_action_t typed_cmd_get(room_t** rptr, const char* arg) {
     }
 
     /* The player can't grab Tux! */
-    if (&object[O_TUX] == obj && !player_flag_is_set(FLAG_LURED_TUX)) {
+    if (&world->object[O_TUX] == obj && !player_flag_is_set(FLAG_LURED_TUX)) {
         show_status("Tux must choose you! Try using a fish.");
         return TC_DISCARD_TEXT;
     }
@@ -1457,330 +2582,620 @@ tc_action_t typed_cmd_get(room_t** rptr, const char* arg) {
 
 
 /*
- * typed_cmd_go
- *   DESCRIPTION: Execute the typed command "go," which allows the player
- *                to go from one place to another using room features.
+ * typed_cmd_inventory
+ *   DESCRIPTION: Execute the typed command "inventory," which moves the
+ *                player to their inventory(room #0, or R_INVENTORY) in
+ *                order to inspect their carried objects. The current
+ *                room is saved in the inventory room's 'enter' direction.
+ *
+ *                Typing 'inventory' from the inventory view returns the
+ *                player to the room in which they're standing.
+ *
  *   INPUTS: *rptr -- player's current room
- *           arg -- name of location to which to go
- *   OUTPUTS: *rptr -- possibly new room for player
+ *           word -- takes no argument, so this parameter should be
+ *                   W_NONE(we don't check)
+ *   OUTPUTS: *rptr -- new room for player
  *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
+ *   SIDE EFFECTS: changes player's room
  */
-tc_action_t typed_cmd_go(room_t** rptr, const char* arg) {
+static tc_action_t typed_cmd_inventory(room_t** rptr, int32_t word) {
     room_t* r;    /* current room */
 
     /* Set current room. */
     r = *rptr;
 
-    /* Try to go to Allerton Mansion. */
-    if (0 == strcasecmp("allerton", arg)) {
-        if (&room[R_ALLERTON] == r) {
-            show_status("Kazam! You're at Allerton!");
-            return TC_DISCARD_TEXT;
-        }
-        if (&room[R_WILLARD] != r && &room[R_CAR_SITE] != r) {
-            show_status("That's quite a hike.");
-            return TC_DISCARD_TEXT;
-        }
-        if (!player_flag_is_set(FLAG_CAR_FIXED)) {
-            if (player_flag_is_set(FLAG_CAR_OPEN)) {
-                show_status("The car isn't working.");
-            }
-            else {
-                show_status("Do you want to use that car?");
-            }
-            return TC_DISCARD_TEXT;
-        }
-        if (object[O_GPS_GOOD].loc != &room[R_INVENTORY]) {
-            if (object[O_GPS_BAD].loc == &room[R_INVENTORY]) {
-                show_status("That's a long road with a broken GPS.");
-            }
-            else {
-                show_status("You'll need a GPS to find that place.");
-            }
-            return TC_DISCARD_TEXT;
-        }
-        show_status("You drive to Allerton Park.");
-        *rptr = &room[R_ALLERTON];
-        return TC_CHANGE_ROOM;
+    if (&world->room[R_INVENTORY] == r) {
+        /* Return from inventory to previous room. */
+        *rptr = r->enter;
     }
-
-    /* Try to go to Willard Airport. */
-    if (0 == strcasecmp("willard", arg) || 0 == strcasecmp("airport", arg)) {
-        if (&room[R_WILLARD] == r) {
-            show_status("Kazap! You're at Willard!");
-            return TC_DISCARD_TEXT;
-        }
-        if (&room[R_ALLERTON] != r && &room[R_CAR_SITE] != r) {
-            show_status("That's quite a hike.");
-            return TC_DISCARD_TEXT;
-        }
-        if (!player_flag_is_set(FLAG_CAR_FIXED)) {
-            if (player_flag_is_set(FLAG_CAR_OPEN)) {
-                show_status("The car isn't working.");
-            }
-            else {
-                show_status("Do you want to use that car?");
-            }
-            return TC_DISCARD_TEXT;
-        }
-        show_status("You drive to Willard Airport.");
-        *rptr = &room[R_WILLARD];
-        return TC_CHANGE_ROOM;
+    else {
+        /* Record current room and enter inventory view. */
+        world->room[R_INVENTORY].enter = r;
+        *rptr = &world->room[R_INVENTORY];
     }
+    return TC_CHANGE_ROOM;
+}
 
-    /* Try to go to campus. */
-    if (0 == strcasecmp("campus", arg)) {
-        if (&room[R_CAR_SITE] == r) {
-            show_status("Kazar! You're on campus!");
-            return TC_DISCARD_TEXT;
-        }
-        if (&room[R_ALLERTON] != r && &room[R_WILLARD] != r) {
-            show_status("That's quite a hike.");
-            return TC_DISCARD_TEXT;
-        }
-        show_status("You drive back to campus.");
-        *rptr = &room[R_CAR_SITE];
-        return TC_CHANGE_ROOM;
-    }
 
-    /* Location unrecognized. Say so. */
-    show_status("The game map lacks certain places.");
-    return TC_ALLOW_EDIT;
+#if (TEST_WORLD_SCALING == 1 || TEST_SESSIONS == 1 || TEST_LINE_FILL == 1 || TEST_RESUME == 1)
+
+/*
+ * show_status
+ *   DESCRIPTION: Stands in for the game's status display.
+ *   INPUTS: s -- status message(ignored)
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: none
+ */
+void show_status(const char* s) {
 }
 
+#endif
+
+
+#if (TEST_WORLD_SCALING == 1 || TEST_SESSIONS == 1 || TEST_LINE_FILL == 1)
 
 /*
- * typed_cmd_install
- *   DESCRIPTION: Execute the typed command "install," which allows the player
- *                to install objects.
- *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to install
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
+ * now_usec
+ *   DESCRIPTION: Reads the monotonic clock.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the time in microseconds
+ *   SIDE EFFECTS: none
  */
-tc_action_t typed_cmd_install(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
+static double now_usec() {
+    struct timespec ts; /* current time */
 
-    /* Set current room. */
-    r = *rptr;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
 
-    /* Try to install a battery. */
-    if (0 == strcasecmp("battery", arg)) {
-        if (object[O_BATT_EMPTY].loc != &room[R_INVENTORY] &&
-            object[O_BATT_EMPTY].loc != r &&
-            object[O_BATT_FULL].loc != &room[R_INVENTORY] &&
-            object[O_BATT_FULL].loc != r) {
-            show_status("What battery?");
-            return TC_DISCARD_TEXT;
-        }
-        if (&room[R_CAR_SITE] != r) {
-            show_status("Do you see the car?");
-            return TC_DISCARD_TEXT;
-        }
-        if (object[O_BATT_EMPTY].loc == &room[R_INVENTORY] ||
-            object[O_BATT_EMPTY].loc == r) {
-            show_status("You want to install a dead battery?");
-            return TC_DISCARD_TEXT;
-        }
-        remove_object(&object[O_BATT_FULL]);
-        player_set_flag(FLAG_CAR_FIXED);
-        do_photo_swap(r, SWAP_CAR);
-        show_status("Nice work! Now you can use it!");
-        return TC_CHANGE_ROOM;
+#endif
+
+
+#if (TEST_WORLD_SCALING == 1)
+
+/* number of moves made while measuring room entry */
+#define TEST_MOVES 2000
+
+/*
+ * main -- for the world scaling benchmark
+ *     DESCRIPTION: Builds the world from a world file, then wanders from
+ *                  room to room, entering each as the game does(prepare
+ *                  the room, redraw the view, and show it).  Prints the
+ *                  time taken by build_world, the resident set size, the
+ *                  memory saved by sharing photos and images, and the
+ *                  room entry latency.
+ *     INPUTS: argv[1] -- the world file
+ *     OUTPUTS: one line of results to stdout
+ *     RETURN VALUE: 0 on success, 2 on bad arguments, 3 on failure
+ */
+int main(int argc, char* argv[]) {
+    room_view_t view = {NULL, NULL, 1, 1}; /* the view  */
+    room_t* r;          /* current room                */
+    int32_t move;       /* loop index over moves       */
+    int32_t entries;    /* rooms entered               */
+    double  start;      /* start time of current step  */
+    double  build_time; /* time taken by build_world   */
+    double  t;          /* time taken by a room entry  */
+    double  total;      /* total room entry time       */
+    double  worst;      /* longest room entry          */
+    long    rss;        /* resident pages              */
+    FILE*   f;          /* /proc/self/statm            */
+    uint64_t saved;     /* bytes saved by sharing      */
+    uint32_t n_shared;  /* loads that were shared      */
+    const preload_stats_t* pre; /* how preloading went */
+
+    if (2 != argc) {
+        fprintf(stderr, "usage: %s <world file>\n", argv[0]);
+        return 2;
     }
+    if (0 != set_mode_X()) {
+        return 3;
+    }
+    if (NULL == (view.ctx = new_render_ctx(0, 0, SCROLL_X_DIM, SCROLL_Y_DIM,
+                                           fill_horiz_buffer, fill_vert_buffer,
+                                           &view))) {
+        clear_mode_X();
+        return 3;
+    }
+    srand(1);
 
-    /* Try to install a MIMO transmitter card. */
-    if (0 == strcasecmp("mimo", arg) || 0 == strcasecmp("card", arg) ||
-        0 == strcasecmp("transmitter", arg)) {
-        if (object[O_MIMO_CARD].loc != &room[R_INVENTORY] &&
-            object[O_MIMO_CARD].loc != r) {
-            show_status("Do you have one of those?");
-            return TC_DISCARD_TEXT;
-        }
-        if (&room[R_COCKPIT] != r) {
-            show_status("Nothing here needs that.");
-            return TC_DISCARD_TEXT;
+    start = now_usec();
+    if (!build_world(argv[1])) {
+        clear_mode_X();
+        return 3;
+    }
+    build_time = now_usec() - start;
+
+    rss = 0;
+    if (NULL != (f = fopen("/proc/self/statm", "r"))) {
+        if (1 != fscanf(f, "%*d %ld", &rss)) {
+            rss = 0;
         }
-        remove_object(&object[O_MIMO_CARD]);
-        room[R_COCKPIT].enter = &room[R_OVER_WILL];
-        show_status("Ready for takeoff, captain!");
-        return TC_REDRAW_ROOM;
+        (void)fclose(f);
     }
 
-    /* There's nothing else that can be installed. */
-    show_status("What are you playing at?");
-    return TC_ALLOW_EDIT;
+    r = start_in_room();
+    total = worst = 0;
+    for (move = entries = 0; TEST_MOVES > move; move++) {
+        switch (rand() % 3) {
+            case 0:  (void)try_to_move_left(&r); break;
+            case 1:  (void)try_to_enter(&r); break;
+            default: (void)try_to_move_right(&r); break;
+        }
+        start = now_usec();
+        prep_room(&view, r);
+        set_view_window(view.ctx, 0, 0);
+        redraw_room_view(&view);
+        show_screen();
+        t = now_usec() - start;
+        total += t;
+        worst = (t > worst ? t : worst);
+        entries++;
+    }
+    free_render_ctx(view.ctx);
+    clear_mode_X();
+
+    saved = shared_asset_savings(&n_shared);
+    printf("%6d rooms %7d objects: build_world %9.1f ms, RSS %8ld kB(%7u loads shared, "
+           "%8lu kB saved), room entry %7.1f us mean %8.1f us worst\n", n_rooms, n_objects,
+           build_time / 1e3, rss * (sysconf(_SC_PAGESIZE) / 1024), n_shared, (unsigned long)(saved / 1024),
+           total / entries, worst);
+    pre = preload_stats();
+    printf("%6d rooms: preloaded %u files(%lu kB) by %s, queue depth %d, first room %.1f ms, "
+           "all %.1f ms\n", n_rooms, pre->n_files, (unsigned long)(pre->bytes / 1024), pre->method,
+           pre->depth, pre->first_ns / 1e6, pre->total_ns / 1e6);
+    free_world();
+    return 0;
 }
 
+#endif
 
-/*
- * typed_cmd_inventory
- *   DESCRIPTION: Execute the typed command "inventory," which moves the
- *                player to their inventory(room #0, or R_INVENTORY) in
- *                order to inspect their carried objects. The current
- *                room is saved in the inventory room's 'enter' direction.
- *
- *                Typing 'inventory' from the inventory view returns the
- *                player to the room in which they're standing.
- *
- *   INPUTS: *rptr -- player's current room
- *           arg -- takes no argument, so this parameter should be an
- *                  empty string(we don't check)
- *   OUTPUTS: *rptr -- new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: changes player's room
- */
-tc_action_t typed_cmd_inventory(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
 
-    /* Set current room. */
-    r = *rptr;
+#if (TEST_SESSIONS == 1)
 
-    if (&room[R_INVENTORY] == r) {
-        /* Return from inventory to previous room. */
-        *rptr = r->enter;
-    }
-    else {
-        /* Record current room and enter inventory view. */
-        room[R_INVENTORY].enter = r;
-        *rptr = &room[R_INVENTORY];
+#define TEST_TICKS     200  /* ticks played by each session             */
+#define TICKS_PER_SEC  20   /* game ticks per second(50 ms each)        */
+
+/* one headless game session */
+typedef struct test_session_t test_session_t;
+struct test_session_t {
+    world_t* w;      /* session's world              */
+    room_t*  where;  /* player's room                */
+    unsigned seed;   /* random state for commands    */
+};
+
+/* typed commands tried by the sessions, with their arguments */
+typedef struct test_cmd_t test_cmd_t;
+struct test_cmd_t {
+    int32_t     verb; /* command  */
+    const char* arg;  /* argument */
+};
+static const test_cmd_t test_cmd[] = {
+    {TC_BUY, "dew"},        {TC_BUY, "yogurt"},
+    {TC_DRINK, "dew"},      {TC_WEAR, "bunnysuit"},
+    {TC_USE, "fish"},       {TC_USE, "key"},
+    {TC_FIX, "car"},        {TC_CHARGE, "battery"},
+    {TC_FLASH, "robot"},    {TC_INSTALL, "card"},
+    {TC_INVENTORY, ""},     {TC_SIGH, ""},
+    {TC_GET, "book"},       {TC_DO, "mp2"}
+};
+#define N_TEST_CMDS ((int32_t)(sizeof (test_cmd) / sizeof (test_cmd[0])))
+
+/* the arguments, interned once(as the game does for each typed command) */
+static int32_t test_word[N_TEST_CMDS];
+
+/*
+ * play_tick
+ *   DESCRIPTION: Plays one tick of some sessions: each session takes one
+ *                random command, as a player might at most each tick.
+ *                Used with workers_run.
+ *   INPUTS: arg -- the array of sessions
+ *           lo, hi -- play sessions lo to hi - 1
+ *   OUTPUTS: none
+ *   RETURN VALUE: none
+ *   SIDE EFFECTS: changes the sessions' worlds; changes the calling
+ *                 thread's world
+ */
+static void play_tick(void* arg, int lo, int hi) {
+    test_session_t* s;    /* current session        */
+    object_t*       obj;  /* object gotten or dropped */
+    int32_t         pick; /* command chosen         */
+
+    for (s = (test_session_t*)arg + lo; hi > lo; lo++, s++) {
+        world_use(s->w);
+        pick = rand_r(&s->seed) % (5 + N_TEST_CMDS);
+        switch (pick) {
+            case 0: (void)try_to_move_left(&s->where); break;
+            case 1: (void)try_to_enter(&s->where); break;
+            case 2: (void)try_to_move_right(&s->where); break;
+            case 3:
+                if (NULL != (obj = room_contents_iterate(s->where))) {
+                    (void)typed_cmd(&s->where, TC_GET, obj->word);
+                }
+                break;
+            case 4:
+                if (NULL != (obj = room_contents_iterate(&s->w->room[R_INVENTORY]))) {
+                    (void)typed_cmd(&s->where, TC_DROP, obj->word);
+                }
+                break;
+            default:
+                (void)typed_cmd(&s->where, test_cmd[pick - 5].verb, test_word[pick - 5]);
+                break;
+        }
     }
-    return TC_CHANGE_ROOM;
 }
 
+/*
+ * cpu_usec
+ *   DESCRIPTION: Reads the CPU time used by all threads of the process.
+ *   INPUTS: none
+ *   OUTPUTS: none
+ *   RETURN VALUE: the time in microseconds
+ *   SIDE EFFECTS: none
+ */
+static double cpu_usec() {
+    struct timespec ts; /* CPU time used */
+
+    (void)clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
 
 /*
- * typed_cmd_sigh
- *   DESCRIPTION: Execute the typed command "sigh," which allows the player
- *                to show their respects for many a vanished site.  Ouch,
- *                sorry WS.
- *   INPUTS: *rptr -- player's current room
- *           arg -- takes no argument, so this parameter should be an
- *                  empty string(we don't check)
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
+ * main -- for the game session benchmark
+ *     DESCRIPTION: Builds the world once, then plays many headless
+ *                  sessions, each in its own world, for TEST_TICKS ticks
+ *                  on a pool of threads.  Does so first with one thread
+ *                  and then with the requested number.  Prints the cost
+ *                  of making a session, its memory, the CPU time per
+ *                  session per tick, and the resulting number of sessions
+ *                  one core could play at full speed.  Also prints a
+ *                  checksum of the final world states, which must not
+ *                  depend on the number of threads.
+ *     INPUTS: argv[1] -- the world file
+ *             argv[2] -- number of sessions(optional)
+ *             argv[3] -- number of threads(optional)
+ *     OUTPUTS: results to stdout
+ *     RETURN VALUE: 0 on success, 2 on bad arguments, 3 on failure
  */
-tc_action_t typed_cmd_sigh(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
+int main(int argc, char* argv[]) {
+    int32_t         n_sessions = 1000; /* sessions played          */
+    int32_t         n_threads;         /* threads in pool          */
+    int32_t         threads;           /* threads in this run      */
+    test_session_t* sess;              /* the sessions             */
+    uint8_t*        snap;              /* snapshot of a world      */
+    uint32_t        sum;               /* checksum of final states */
+    int32_t         tick;              /* loop index over ticks    */
+    int32_t         idx;               /* loop index over sessions */
+    uint32_t        i;                 /* index over snapshot      */
+    double          start;             /* start time of a step     */
+    double          make_time;         /* time to make sessions    */
+    double          wall;              /* elapsed time of play     */
+    double          cpu;               /* CPU time of play         */
+
+    n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (2 > argc || 4 < argc ||
+        (3 <= argc && 0 >= (n_sessions = atoi(argv[2]))) ||
+        (4 <= argc && 0 >= (n_threads = atoi(argv[3])))) {
+        fprintf(stderr, "usage: %s <world file> [sessions] [threads]\n", argv[0]);
+        return 2;
+    }
+    if (0 != set_mode_X()) {
+        return 3;
+    }
+    srand(1);
+    start = now_usec();
+    if (!build_world(argv[1])) {
+        clear_mode_X();
+        return 3;
+    }
+    printf("%d rooms %d objects: build_world %.1f ms, %u bytes per world\n",
+           n_rooms, n_objects, (now_usec() - start) / 1e3,
+           (unsigned)(sizeof (world_t) + n_rooms * sizeof (room_t) +
+                      n_objects * sizeof (object_t)));
+    for (idx = 0; N_TEST_CMDS > idx; idx++) {
+        test_word[idx] = find_word(test_cmd[idx].arg);
+    }
 
-    /* Set current room. */
-    r = *rptr;
-    if (&room[R_BY_ZAS] != r) {
-        show_status("MP2 got you down? Take a break!");
+    sess = malloc(n_sessions * sizeof (sess[0]));
+    snap = malloc(world_state_size());
+    if (NULL == sess || NULL == snap) {
+        perror("allocate sessions");
+        clear_mode_X();
+        return 3;
     }
-    else {
-        show_status("So sad... you lose your appetite.");
-        player_set_flag(FLAG_HAS_EATEN);
+
+    for (threads = 1; ; threads = n_threads) {
+        /* Make the sessions. */
+        start = now_usec();
+        for (idx = 0; n_sessions > idx; idx++) {
+            if (NULL == (sess[idx].w = world_create(idx))) {
+                perror("world_create");
+                clear_mode_X();
+                return 3;
+            }
+            world_use(sess[idx].w);
+            sess[idx].where = start_in_room();
+            sess[idx].seed = idx;
+        }
+        make_time = now_usec() - start;
+
+        /* Play them. */
+        if (1 < threads && 0 != workers_start(threads - 1)) {
+            clear_mode_X();
+            return 3;
+        }
+        start = now_usec();
+        cpu = cpu_usec();
+        for (tick = 0; TEST_TICKS > tick; tick++) {
+            workers_run(play_tick, sess, n_sessions);
+        }
+        cpu = cpu_usec() - cpu;
+        wall = now_usec() - start;
+        workers_stop(NULL);
+
+        /* Check the results, then throw the sessions away. */
+        sum = 2166136261U;
+        for (idx = 0; n_sessions > idx; idx++) {
+            world_use(sess[idx].w);
+            save_world_state(snap, sess[idx].where);
+            for (i = 0; world_state_size() > i; i++) {
+                sum = (sum ^ snap[i]) * 16777619U;
+            }
+            world_destroy(sess[idx].w);
+        }
+        world_use(NULL);
+
+        printf("%2d threads %6d sessions: make %6.2f us each, play %6.3f us CPU "
+               "per session-tick, %8.0f session-ticks/s, %7.0f sessions per core "
+               "at %d ticks/s, checksum %08x\n", threads, n_sessions,
+               make_time / n_sessions, cpu / ((double)n_sessions * TEST_TICKS),
+               (double)n_sessions * TEST_TICKS / (wall / 1e6),
+               1e6 * n_sessions * TEST_TICKS / cpu / TICKS_PER_SEC, TICKS_PER_SEC, sum);
+        if (threads == n_threads) {
+            break;
+        }
     }
-    return TC_DISCARD_TEXT;
+    clear_mode_X();
+    free(snap);
+    free(sess);
+    free_world();
+    return 0;
 }
 
+#endif
+
+
+#if (TEST_LINE_FILL == 1)
+
+#define TEST_FILL_PASSES 100 /* passes over the photo for each count */
 
 /*
- * typed_cmd_use
- *   DESCRIPTION: Execute the typed command "use," which allows the player
- *                to use objects in a room or in their inventory.
- *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to use
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
+ * main -- for the line fill benchmark
+ *     DESCRIPTION: Builds the world from a world file, then puts 1, 16,
+ *                  and 256 objects in turn into the starting room(taking
+ *                  them from wherever they are) and fills every line of
+ *                  its photo, across and down, as a render context does
+ *                  while the view scrolls.  Prints the time per line.
+ *     INPUTS: argv[1] -- the world file(with at least 256 objects)
+ *     OUTPUTS: one line of results to stdout for each number of objects
+ *     RETURN VALUE: 0 on success, 2 on bad arguments, 3 on failure
  */
-tc_action_t typed_cmd_use(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
+int main(int argc, char* argv[]) {
+    static const int32_t count[] = {1, 16, 256}; /* objects in the room */
+    room_view_t   view = {NULL, NULL, 1, 1};    /* the view(no context) */
+    unsigned char buf[SCROLL_X_DIM > SCROLL_Y_DIM ? SCROLL_X_DIM : SCROLL_Y_DIM];
+    room_t*  r;       /* starting room                        */
+    int32_t  c;       /* index over counts                    */
+    int32_t  idx;     /* index over objects                   */
+    int32_t  pass;    /* index over passes                    */
+    int32_t  line;    /* index over lines                     */
+    int32_t  wd, ht;  /* photo size                           */
+    double   start;   /* start time of current step           */
+    double   h_time;  /* time taken by the horizontal lines   */
+    double   v_time;  /* time taken by the vertical lines     */
+    uint32_t sum;     /* checksum of some of the pixels drawn */
+
+    if (2 != argc) {
+        fprintf(stderr, "usage: %s <world file>\n", argv[0]);
+        return 2;
+    }
+    srand(1);
+    if (!build_world(argv[1])) {
+        return 3;
+    }
+    if (count[2] > n_objects) {
+        fprintf(stderr, "%s has only %d objects.\n", argv[1], n_objects);
+        return 3;
+    }
+    view.room = r = start_in_room();
+    wd = room_photo_width(r);
+    ht = room_photo_height(r);
+
+    for (c = 0; 3 > c; c++) {
+        /* Empty the room, then fill it. */
+        while (NULL != r->contents) {
+            remove_object(r->contents);
+        }
+        for (idx = 0; count[c] > idx; idx++) {
+            insert_object(&world->object[idx], r);
+        }
 
-    /* Set current room. */
-    r = *rptr;
+        sum = 2166136261U;
+        start = now_usec();
+        for (pass = 0; TEST_FILL_PASSES > pass; pass++) {
+            for (line = 0; ht > line; line++) {
+                fill_horiz_buffer(&view, 0, line, SCROLL_X_DIM, buf);
+                sum = (sum ^ buf[line % SCROLL_X_DIM]) * 16777619U;
+            }
+        }
+        h_time = now_usec() - start;
+        start = now_usec();
+        for (pass = 0; TEST_FILL_PASSES > pass; pass++) {
+            for (line = 0; wd > line; line++) {
+                fill_vert_buffer(&view, line, 0, SCROLL_Y_DIM, buf);
+                sum = (sum ^ buf[line % SCROLL_Y_DIM]) * 16777619U;
+            }
+        }
+        v_time = now_usec() - start;
 
-    /* Try to use a car. */
-    if (0 == strcasecmp("car", arg)) {
-        if (&room[R_ALLERTON] == r) {
-            show_status("Go to campus or Willard Airport?");
-            return TC_DISCARD_TEXT;
-        }
-        if (&room[R_WILLARD] == r) {
-            show_status("Go to Allerton or campus?");
-            return TC_DISCARD_TEXT;
-        }
-        if (&room[R_CAR_SITE] != r) {
-            show_status("You have a car?");
-            return TC_DISCARD_TEXT;
-        }
-        if (player_flag_is_set(FLAG_CAR_FIXED)) {
-            show_status("Go to Allerton or Willard Airport?");
-            return TC_DISCARD_TEXT;
-        }
-        if (player_flag_is_set(FLAG_CAR_OPEN)) {
-            show_status("You'll have to charge the battery.");
-            return TC_DISCARD_TEXT;
-        }
-        if (object[O_CAR_KEY].loc != &room[R_INVENTORY]) {
-            show_status("Perhaps you can find a key?");
-            return TC_DISCARD_TEXT;
-        }
-        do_photo_swap(r, SWAP_CAR);
-        remove_object(&object[O_CAR_KEY]);
-        insert_object_at(&object[O_BATT_CAR], r, 265, 122);
-        player_set_flag(FLAG_CAR_OPEN);
-        show_status("The key works, but the battery's dead.");
-        return TC_CHANGE_ROOM;
+        printf("%4d objects in room: %7.1f ns per horizontal line, "
+               "%7.1f ns per vertical line, checksum %08x\n", count[c],
+               1e3 * h_time / ((double)TEST_FILL_PASSES * ht),
+               1e3 * v_time / ((double)TEST_FILL_PASSES * wd), sum);
     }
+    free_world();
+    return 0;
+}
+
+#endif
+
+
+#if (TEST_RESUME == 1)
+
+/*
+ * check_resumed
+ *   DESCRIPTION: Compares a resumed world with the world it was saved
+ *                from: the player's room and every room link and object
+ *                location must match.
+ *   INPUTS: a, b -- the saved and resumed worlds
+ *           ra, rb -- the player's room in each
+ *   OUTPUTS: none
+ *   RETURN VALUE: 1 if they match, 0 if not
+ *   SIDE EFFECTS: prints the first difference
+ */
+static int32_t check_resumed(const world_t* a, const room_t* ra, const world_t* b, const room_t* rb) {
+    int32_t idx; /* index over rooms and objects */
 
-    /* Try to use a fish. */
-    if (0 == strcasecmp("fish", arg)) {
-        if (object[O_FISH].loc != &room[R_INVENTORY] &&
-            object[O_FISH].loc != r) {
-            show_status("Using the invisible fish... no effect!");
-            return TC_DISCARD_TEXT;
+#define SAME_ROOM(p, q) ((NULL == (p) ? R_NONE : (p) - a->room) == (NULL == (q) ? R_NONE : (q) - b->room))
+    if (!SAME_ROOM(ra, rb)) {
+        printf("FAIL: player resumed in room %d, not %d\n", (int)(rb - b->room), (int)(ra - a->room));
+        return 0;
+    }
+    for (idx = 0; n_rooms > idx; idx++) {
+        if (!SAME_ROOM(a->room[idx].left, b->room[idx].left) ||
+            !SAME_ROOM(a->room[idx].enter, b->room[idx].enter) ||
+            !SAME_ROOM(a->room[idx].right, b->room[idx].right)) {
+            printf("FAIL: links of room %d differ\n", idx);
+            return 0;
         }
-        if (&room[R_REM_LAB] != r) {
-            show_status("I don't think that's sanitary.");
-            return TC_DISCARD_TEXT;
+    }
+    for (idx = 0; n_objects > idx; idx++) {
+        if (!SAME_ROOM(a->object[idx].loc, b->object[idx].loc)) {
+            printf("FAIL: object %d is in a different room\n", idx);
+            return 0;
         }
-        remove_object(&object[O_FISH]);
-        move_object_to_inventory(&object[O_TUX]);
-        player_set_flag(FLAG_LURED_TUX);
-        show_status("Tux likes you!");
-        return TC_REDRAW_ROOM;
     }
-
-    /* Don't ask. Oh, was that YOU who tried to use that? Uh. */
-    show_status("You want to use what!?");
-    return TC_ALLOW_EDIT;
+#undef SAME_ROOM
+    return 1;
 }
 
-
 /*
- * typed_cmd_wear
- *   DESCRIPTION: Execute the typed command "wear," which allows the player
- *                to wear objects.
- *   INPUTS: *rptr -- player's current room
- *           arg -- name of object to wear
- *   OUTPUTS: *rptr -- possibly new room for player
- *   RETURN VALUE: indicates types of action taken(see header file)
- *   SIDE EFFECTS: may move objects, show status messages, change player's room
+ * main -- for the resume test
+ *     DESCRIPTION: Builds the world, picks up an object in the starting
+ *                  room, enters the inventory view, and saves the game
+ *                  there.  Resumes the save in a fresh world and checks
+ *                  that it matches, then that "drop", "get", and
+ *                  "inventory" still work from the inventory(leaving it
+ *                  for the room it was entered from).  Also checks that a
+ *                  snapshot listing an object twice is refused.
+ *     INPUTS: argv[1] -- the world file
+ *     OUTPUTS: PASS or the first failure to stdout
+ *     RETURN VALUE: 0 if the test passes, 1 if it fails, 2 on bad
+ *                   arguments, 3 on other failures
  */
-tc_action_t typed_cmd_wear(room_t** rptr, const char* arg) {
-    room_t* r;    /* current room */
+int main(int argc, char* argv[]) {
+    world_t*     w[2];    /* saved and resumed worlds    */
+    room_t*      r[2];    /* player's room in each       */
+    room_t*      from;    /* room the inventory was entered from */
+    uint8_t*     snap;    /* the saved game              */
+    object_t*    obj;     /* object carried              */
+    obj_state_t* os;      /* object states in snap       */
+    int32_t      none;    /* word for no argument        */
+    int32_t      idx;     /* index over rooms            */
+    int32_t      ok;      /* test passed                 */
+
+    if (2 != argc) {
+        fprintf(stderr, "usage: %s <world file>\n", argv[0]);
+        return 2;
+    }
+    srand(1);
+    if (!build_world(argv[1]) ||
+        NULL == (snap = malloc(world_state_size())) ||
+        NULL == (w[0] = world_create(1)) || NULL == (w[1] = world_create(2))) {
+        return 3;
+    }
+    none = find_word("");
 
-    /* Set current room. */
-    r = *rptr;
+    /* Pick up the first object that can be picked up... */
+    world_use(w[0]);
+    for (idx = 0, obj = NULL; NULL == obj && n_rooms > idx; idx++) {
+        if (R_INVENTORY == idx) {
+            continue;
+        }
+        from = r[0] = &w[0]->room[idx];
+        for (obj = room_contents_iterate(r[0]); NULL != obj; obj = obj_next(obj)) {
+            (void)typed_cmd(&r[0], TC_GET, obj->word);
+            if (&w[0]->room[R_INVENTORY] == obj->loc) {
+                break;
+            }
+        }
+    }
+    if (NULL == obj || from != r[0]) {
+        fprintf(stderr, "No object can be picked up.\n");
+        return 3;
+    }
 
-    /* Only the bunnysuit can be worn. */
-    if (0 != strcasecmp("bunnysuit", arg)) {
-        show_status("Big Brother forbids fashion statements.");
-        return TC_ALLOW_EDIT;
+    /* ...then go into the inventory and save there. */
+    (void)typed_cmd(&r[0], TC_INVENTORY, none);
+    save_world_state(snap, r[0]);
+
+    /* Resume in the other world, which must then match. */
+    world_use(w[1]);
+    ok = (NULL != (r[1] = load_world_state(snap, world_state_size())) &&
+          check_resumed(w[0], r[0], w[1], r[1]));
+    if (NULL == r[1]) {
+        printf("FAIL: the save was refused\n");
     }
-    if (object[O_BUNNYSUIT].loc != &room[R_INVENTORY] &&
-        object[O_BUNNYSUIT].loc != r) {
-        show_status("Do you have a bunnysuit?");
-        return TC_DISCARD_TEXT;
+
+    /* Drop, get, and leave the inventory from the resumed game. */
+    if (ok) {
+        (void)typed_cmd(&r[1], TC_DROP, obj->word);
+        obj = &w[1]->object[obj - w[0]->object];
+        if (obj->loc != &w[1]->room[from - w[0]->room]) {
+            printf("FAIL: drop in the resumed inventory missed the room\n");
+            ok = 0;
+        }
     }
-    remove_object(&object[O_BUNNYSUIT]);
-    player_set_flag(FLAG_WEARING_SUIT);
-    show_status("You look good in pink!");
-    return TC_REDRAW_ROOM;
+    if (ok) {
+        (void)typed_cmd(&r[1], TC_GET, obj->word);
+        (void)typed_cmd(&r[1], TC_INVENTORY, none);
+        if (&w[1]->room[R_INVENTORY] != obj->loc || &w[1]->room[from - w[0]->room] != r[1]) {
+            printf("FAIL: get or inventory in the resumed game went wrong\n");
+            ok = 0;
+        }
+    }
+
+    /* A snapshot that lists an object twice must be refused. */
+    if (ok && 1 < n_objects) {
+        os = (obj_state_t*)(snap + sizeof (world_state_t) + n_rooms * sizeof (room_state_t));
+        os[1].id = os[0].id;
+        if (NULL != load_world_state(snap, world_state_size())) {
+            printf("FAIL: a snapshot listing an object twice was accepted\n");
+            ok = 0;
+        }
+    }
+
+    if (ok) {
+        printf("PASS\n");
+    }
+    world_use(NULL);
+    world_destroy(w[0]);
+    world_destroy(w[1]);
+    free(snap);
+    free_world();
+    return (ok ? 0 : 1);
 }
+
+#endif
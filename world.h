@@ -23,7 +23,7 @@
  * SUPPORT, UPDATES, ENHANCEMENTS, OR MODIFICATIONS."
  *
  * Author:        Steve Lumetta
- * Version:       1
+ * Version:       10
  * Creation Date: Tue Sep 13 23:47:11 2011
  * Filename:      world.h
  * History:
@@ -31,6 +31,23 @@
  *        Completed initial implementation.
  *    SL    2    Wed Sep 14 23:17:14 2011
  *        Cleaned up code for distribution.
+ *          3
+ *        Read the world layout from a world file.
+ *          4
+ *        Added snapshots of the world state.
+ *          5
+ *        Added worlds for game sessions.
+ *          6
+ *        Added inventory_room for the inventory view.
+ *          7
+ *        Passed typed nouns to the commands as interned words.
+ *          8
+ *        Replaced the typed command actions with typed_cmd, which
+ *        carries out the rules of the world file.
+ *          9
+ *        Added room_objects, which gives a room's objects as an array.
+ *          10
+ *        Added free_world.
  */
 #ifndef WORLD_H
 #define WORLD_H
@@ -39,23 +56,72 @@
 #include "types.h"
 
 
+/*
+ * The record of an object in a room, for drawing.  room_objects gives a
+ * room's records in one array, in the order of its contents; each object
+ * is drawn over those before it.
+ */
+typedef struct obj_rec_t obj_rec_t;
+struct obj_rec_t {
+    uint16_t       x, y;  /* location within room photo */
+    uint16_t       w, h;  /* size of image in pixels    */
+    const image_t* img;   /* image of the object        */
+};
+
 /* structure access functions */
 extern uint16_t obj_get_x(const object_t* obj);
 extern uint16_t obj_get_y(const object_t* obj);
 extern image_t* obj_image(const object_t* obj);
 extern object_t* obj_next(const object_t* obj);
 extern object_t* room_contents_iterate(const room_t* r);
+extern int32_t room_objects(const room_t* r, const obj_rec_t** recs);
 extern const char* room_name(const room_t* r);
 extern photo_t* room_photo(const room_t* r);
 extern uint32_t room_photo_height(const room_t* r);
 extern uint32_t room_photo_width(const room_t* r);
 
-/* Build the game world.  Returns 0 on failure, or 1 on success. */
-extern int32_t build_world(void);
+/* the world file read by default(built from world.txt by mkworld) */
+#define WORLD_FILE "world.bin"
+
+/*
+ * Build the game world from a world file.  Returns 0 on failure, or 1 on
+ * success.
+ */
+extern int32_t build_world(const char* fname);
+
+/*
+ * Free everything build_world made, including the photos and images(at
+ * the end of the game, after destroying the worlds from world_create).
+ */
+extern void free_world();
+
+/*
+ * Worlds for game sessions.  build_world makes the first world, on which
+ * every thread acts until it calls world_use.  world_create makes another
+ * world as build_world left the first, sharing its photos and images.
+ * The functions below, other than those that take a room or object,
+ * act on the calling thread's world.
+ */
+extern world_t* world_create(unsigned seed);
+extern void world_destroy(world_t* w);
+extern void world_use(world_t* w);
 
 /* Get pointer to starting room for player. */
 extern room_t* start_in_room(void);
 
+/* Get pointer to the inventory 'room'. */
+extern room_t* inventory_room(void);
+
+/*
+ * Snapshots of the world state(object locations, accomplishments, and
+ * photo swaps, along with the player's room).  A snapshot takes
+ * world_state_size() bytes.  load_world_state returns the player's room,
+ * or NULL if the snapshot does not fit the world.
+ */
+extern uint32_t world_state_size(void);
+extern void save_world_state(void* buf, const room_t* where);
+extern room_t* load_world_state(const void* buf, uint32_t size);
+
 /*
  * checks for accelerator object ownership; these make horizontal(board)
  * and vertical(jetpack) pixel panning faster
@@ -76,21 +142,17 @@ extern tc_action_t try_to_move_left(room_t** rptr);
 extern tc_action_t try_to_enter(room_t** rptr);
 extern tc_action_t try_to_move_right(room_t** rptr);
 
-/* typed command actions */
-extern tc_action_t typed_cmd_buy(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_charge(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_do(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_drink(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_drop(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_fix(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_flash(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_get(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_go(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_install(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_inventory(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_sigh(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_use(room_t** rptr, const char* arg);
-extern tc_action_t typed_cmd_wear(room_t** rptr, const char* arg);
+/*
+ * Intern a typed noun as a word id(W_NONE if it is no word of the world);
+ * typed commands take their argument as a word id.
+ */
+extern int32_t find_word(const char* s);
+
+/*
+ * typed command action: carries out a verb(a TC_* value from world_ids.h)
+ * by the rules of the world file, or by its built-in action
+ */
+extern tc_action_t typed_cmd(room_t** rptr, int32_t verb, int32_t word);
 
 /* in adventure.c */
 extern void show_status(const char* s);
@@ -0,0 +1,405 @@
+/* tab:4
+ *
+ * world_ids.h - identifiers of the rooms, objects, photo swaps, words, flags,
+ *               and verbs named by the game logic, and the binary world
+ *               file format
+ *
+ * Version:       4
+ * Filename:      world_ids.h
+ * History:
+ *    1    First written.
+ *    2    Added the words named by the game logic and a perfect hash
+ *         of all words to the world file.
+ *    3    Added flags, verbs, and the typed-command rules of the world
+ *         file with their index.
+ *    4    Dropped the hash of the rule keys, which the game now builds.
+ */
+
+#ifndef WORLD_IDS_H
+#define WORLD_IDS_H
+
+
+#include <ctype.h>
+#include <stdint.h>
+
+
+/*
+ * NOTES
+ *
+ * The world layout(rooms, their neighbors, objects, starting positions,
+ * and swap photos) is read from a binary world file produced by mkworld
+ * from a readable text source(world.txt).  The game logic in world.c
+ * refers by name to some rooms and objects; those names are listed here,
+ * and their order fixes their identifiers.  A world file may add any
+ * number of other rooms and objects, which are numbered after the named
+ * ones, so new rooms need no recompilation.  Every name listed here must
+ * be defined by the world file.
+ *
+ * Typed nouns are interned as words.  The words compared by the game
+ * logic are listed here, and the object keywords and the words of rules
+ * in the world file not among them are numbered after them.  Words are
+ * not case-sensitive.
+ *
+ * Most typed commands are carried out by rules in the world file rather
+ * than by code(see typed_cmd in world.c).  Rules name the verbs and
+ * accomplishment flags listed here, along with rooms, objects, swaps,
+ * and words.
+ */
+
+/* the rooms named by the game logic(X is applied to each name) */
+#define WORLD_ROOMS(X)                                                    \
+    /* Area 0: The Backpack */                                            \
+    X(R_INVENTORY)                                                        \
+                                                                          \
+    /* Area 1: Everitt and Green Street */                                \
+    X(R_IN_391LAB) /* inside the 391 lab               */                 \
+    X(R_BY_391LAB) /* outside of the 391 lab           */                 \
+    X(R_IN_IEEE)   /* inside the IEEE/HKN office       */                 \
+    X(R_BY_IEEE)   /* outside of the IEEE/HKN office   */                 \
+    X(R_IN_395LAB) /* inside the 395 lab               */                 \
+    X(R_BY_395LAB) /* outside of the 395 lab           */                 \
+    X(R_EVT_STAIR) /* Everitt Lab's eastern stairwell  */                 \
+    X(R_IN_CLEANR) /* inside the cleanroom             */                 \
+    X(R_BY_CLEANR) /* outside of the cleanroom         */                 \
+    X(R_EVRT_VEND) /* near the Everitt vending machine */                 \
+    X(R_ALMAMATER) /* near the Alma Mater statue       */                 \
+    X(R_IN_COCOMR) /* inside of Cocomero               */                 \
+    X(R_BY_COCOMR) /* just outside of Cocomero         */                 \
+    X(R_BY_ZAS)    /* across from the ruins of Za's    */                 \
+    X(R_EAST_EVRT) /* East entrance of Everitt Lab     */                 \
+    X(R_EVRT_BSMT) /* entrance to Everitt Lab basement */                 \
+                                                                          \
+    /* Area 2: Bardeen Quad and Environs */                               \
+    X(R_WEST_BONE) /* looking West along the Boneyard   */                \
+    X(R_CIRCLE_N)  /* Boneyard Bridge looking North     */                \
+    X(R_CIRCLE_SW) /* Boneyard Bridge looking Southwest */                \
+    X(R_EAST_BONE) /* looking East along the Boneyard   */                \
+    X(R_BARDEEN)   /* Bardeen Quad                      */                \
+    X(R_LIB_BACK)  /* rear of Grainger library          */                \
+    X(R_RESERVE)   /* Grainger reserve desk             */                \
+    X(R_TALBOT_NW) /* looking Northwest at Talbot       */                \
+    X(R_TALBOT_SW) /* looking Southwest at Talbot       */                \
+    X(R_TALBOT)    /* inside Talbot Laboratory          */                \
+    X(R_SPRINGFLD) /* looking West along Springfield    */                \
+    X(R_CARIBOU)   /* the Caribou coffee shop           */                \
+    X(R_KENNEY)    /* Kenney Gym                        */                \
+    X(R_DCL)       /* Digital Computer Laboratory       */                \
+    X(R_LIB_FRONT) /* front of Grainger library         */                \
+                                                                          \
+    /* Area 3: CSL and Environs */                                        \
+    X(R_KENNEY_E)  /* East of Kenney Gym                */                \
+    X(R_NEWMARK)   /* Newmark Laboratory                */                \
+    X(R_MNTL_NW)   /* looking Northwest at MNTL         */                \
+    X(R_MNTL_SW)   /* looking Southwest at MNTL         */                \
+    X(R_MNTLLOBBY) /* the lobby of MNTL                 */                \
+    X(R_MNTL_LAB1) /* a laboratory within MNTL (#1)     */                \
+    X(R_MNTL_LAB2) /* a laboratory within MNTL (#2)     */                \
+    X(R_MNTL_LAB3) /* a laboratory within MNTL (#3)     */                \
+    X(R_CSL_VIEW)  /* Coordinated Science Laboratory    */                \
+    X(R_CSL_DOOR)  /* the CSL main entrance             */                \
+    X(R_CSL_LOBBY) /* in the CSL lobby                  */                \
+    X(R_CSL_UPPER) /* on an upper floor of CSL          */                \
+    X(R_CSLLOUNGE) /* in the new CSL lounge area        */                \
+    X(R_BECK_LOT)  /* the Beckman Circle parking lot    */                \
+    X(R_BECKMAN)   /* the Beckman Institute             */                \
+    X(R_BECK_DOOR) /* Beckman main entrance             */                \
+    X(R_BECKLOBBY) /* in the lobby of Beckman           */                \
+    X(R_BECK_MRI)  /* an MRI machine ... somewhere      */                \
+                                                                          \
+    /* Area 4: The Rest of the World, Featuring the Remote Sensing Lab */ \
+    X(R_GARAGE)    /* the campus parking structure      */                \
+    X(R_CAR_SITE)  /* the (fictitious) ECE391 car       */                \
+    X(R_ALLERTON)  /* the Allerton mansion              */                \
+    X(R_FU_DOGS)   /* the Fu dogs at Allerton           */                \
+    X(R_STATUE)    /* a statue near the Fu dogs         */                \
+    X(R_SUNSINGER) /* the Allerton Sun Singer statue    */                \
+    X(R_WILLARD)   /* Willard Airport fountain view     */                \
+    X(R_WILL_SIDE) /* side view of Willard and tower    */                \
+    X(R_REM_PLANE) /* a sensor-laden plane              */                \
+    X(R_COCKPIT)   /* cockpit of remote sensing plane   */                \
+    X(R_OVER_WILL) /* flying above Willard Airport      */                \
+    X(R_AIR_RIO)   /* view of Rio de Janeiro from air   */                \
+    X(R_REM_ICE)   /* the ice fields near rem. sen. lab */                \
+    X(R_REM_LAB)   /* part of a remote sensing lab      */
+
+
+/* the objects named by the game logic */
+#define WORLD_OBJECTS(X)                                             \
+    X(O_BOARD)      /* a motorized mountain board                 */ \
+    X(O_JETPACK)    /* Buzz Lightyear: to Infinity ...            */ \
+    X(O_TUX)        /* Tux: our mascot                            */ \
+    X(O_MP2)        /* the MP2 specification (covers mode X)      */ \
+    X(O_BOOK_C)     /* the C programming language                 */ \
+    X(O_BOOK_WODE)  /* stories by P.G. Wodehouse                  */ \
+    X(O_GPS_BAD)    /* a malfunctioning GPS device                */ \
+    X(O_GPS_GOOD)   /* a working GPS device                       */ \
+    X(O_GPS_SPEC)   /* GPS chip data sheet (specifications)       */ \
+    X(O_BUNNYSUIT)  /* a pink bunny suit                          */ \
+    X(O_BATT_EMPTY) /* an uncharged car battery                   */ \
+    X(O_BATT_FULL)  /* a fully charged car battery                */ \
+    X(O_BATT_CAR)   /* battery as it appears in the car           */ \
+    X(O_MTN_DEW)    /* a bottle of dew                            */ \
+    X(O_FISH)       /* a fish to lure penguins                    */ \
+    X(O_ICARD)      /* an I-card                                  */ \
+    X(O_CAR_KEY)    /* the keys to a car                          */ \
+    X(O_ROBOT_DEAD) /* a buggy lockpicking robot                  */ \
+    X(O_ROBOT_LIVE) /* lockpicking robot with new control program */ \
+    X(O_MIMO_CARD)  /* a MIMO card for planes                     */
+
+
+/* the rooms with two photos(all swaps are named by the game logic) */
+#define WORLD_SWAPS(X)                                    \
+    X(SWAP_CIRCLE) /* Boneyard Creek Bridge photo swap */ \
+    X(SWAP_CAR)    /* open/closed hood                 */
+
+
+/* the words compared by the game logic(in lower case; X is applied to each symbol and word) */
+#define WORLD_WORDS(X)                   \
+    X(W_BOOK,        "book")
+
+/* flags recording the player's accomplishments */
+#define WORLD_FLAGS(X)                                             \
+    X(FLAG_HAS_EATEN)    /* player has eaten something         */ \
+    X(FLAG_WEARING_SUIT) /* player is wearing a bunny suit     */ \
+    X(FLAG_CAR_OPEN)     /* player has managed to open the car */ \
+    X(FLAG_CAR_FIXED)    /* player has fixed the car           */ \
+    X(FLAG_LURED_TUX)    /* player has lured Tux to their side */
+
+/* typed command verbs(TC = typed command; X is applied to each symbol and verb) */
+#define WORLD_VERBS(X)             \
+    X(TC_BUY,       "buy")         \
+    X(TC_CHARGE,    "charge")      \
+    X(TC_DO,        "do")          \
+    X(TC_DRINK,     "drink")       \
+    X(TC_DROP,      "drop")        \
+    X(TC_FIX,       "fix")         \
+    X(TC_FLASH,     "flash")       \
+    X(TC_GET,       "get")         \
+    X(TC_GO,        "go")          \
+    X(TC_INSTALL,   "install")     \
+    X(TC_INVENTORY, "inventory")   \
+    X(TC_SIGH,      "sigh")        \
+    X(TC_USE,       "use")         \
+    X(TC_WEAR,      "wear")
+
+#define WORLD_ID(sym) sym,
+#define WORLD_WORD_ID(sym, word) sym,
+
+/* room identifiers */
+enum {
+    R_NONE = -1,
+    WORLD_ROOMS(WORLD_ID)
+    N_NAMED_ROOMS
+};
+
+/* object identifiers */
+enum {
+    O_NONE = -1,
+    WORLD_OBJECTS(WORLD_ID)
+    N_NAMED_OBJECTS
+};
+
+/* identifiers for rooms with photo swapping */
+enum {
+    WORLD_SWAPS(WORLD_ID)
+    N_SWAPS
+};
+
+/* word identifiers */
+enum {
+    W_NONE = -1,
+    WORLD_WORDS(WORLD_WORD_ID)
+    N_NAMED_WORDS
+};
+
+/* accomplishment flag identifiers */
+enum {
+    WORLD_FLAGS(WORLD_ID)
+    NUM_FLAGS
+};
+
+/* verb identifiers */
+enum {
+    WORLD_VERBS(WORLD_WORD_ID)
+    NUM_TC_VALUES
+};
+
+
+/*
+ * The world file holds a header, then n_rooms room records, n_objects
+ * object records, N_SWAPS swap records, and n_words word records, all in
+ * identifier order, then hash_size hash records, the rules(below), and
+ * finally a table of NUL-terminated strings.  Strings are given as byte
+ * offsets into that table.  Everything is in host byte order, and every
+ * field is four bytes, so the records can be used directly from a
+ * mapping of the file.  The counts of named rooms, objects, words, flags,
+ * and verbs guard against files built for a different list of names.
+ *
+ * The hash records form a perfect hash of the words(in lower case),
+ * generated by mkworld.  A word's hash picks a bucket(HASH_BUCKET),
+ * whose displacement then picks the word's slot(HASH_SLOT); no two words
+ * share a slot.  A lookup thus hashes a typed word once and compares it with
+ * the one word that can match.
+ *
+ * The rules are n_rules rule records in source order, then the n_conds
+ * condition records and n_effects effect records to which they point(a
+ * rule's are consecutive), then n_keys key records sorted by verb, word,
+ * and room, and finally n_refs reference records.  A rule applies to
+ * each of its words(or RULE_ANY, for any word) and to the room of its
+ * first RC_IN condition that is not negated(or RULE_ANY).  A key lists,
+ * in increasing order, every rule that applies to its verb, word, and
+ * room, where RULE_ANY stands for a word or room with no key of its own.
+ * Keys are made for each word and room to which some rule applies, and
+ * also for a word with each room to which the verb's rules for RULE_ANY
+ * apply, unless they would list no rules.  The first of the keys (verb,
+ * word, room), (verb, word, RULE_ANY), (verb, RULE_ANY, room), and
+ * (verb, RULE_ANY, RULE_ANY) that exists thus lists all rules that apply
+ * to a command, and a key for RULE_ANY is never the first found for a
+ * word that has keys of its own.  The game indexes the keys when it
+ * loads them.
+ */
+#define WORLD_FILE_MAGIC   0x444C5257  /* "WRLD" */
+#define WORLD_FILE_VERSION 4
+
+/* kinds of rule conditions(or'ed with RULE_NOT to negate) */
+enum {
+    RC_IN,     /* a: player is viewing room a                         */
+    RC_AT,     /* a, b: object a is in room b(R_NONE for none)        */
+    RC_HERE,   /* a: object a is in the inventory or the viewed room  */
+    RC_FLAG,   /* a: flag a is set                                    */
+    N_RULE_CONDS
+};
+#define RULE_NOT 0x100
+
+/* kinds of rule effects */
+enum {
+    RE_GET,    /* a: move object a into the inventory                 */
+    RE_LOSE,   /* a: take object a out of the world                   */
+    RE_PUT,    /* a, b, c, d: put object a in room b at (c, d)        */
+    RE_SET,    /* a: set flag a                                       */
+    RE_SWAP,   /* a: show the photo of swap a in the viewed room      */
+    RE_LINK,   /* a, b: make 'enter' in room a lead to room b         */
+    RE_GOTO,   /* a: move the player to room a                        */
+    RE_WIN,    /* the player wins the game                            */
+    N_RULE_EFFECTS
+};
+
+/* results of rules(the action taken by the game once a rule fires) */
+enum {
+    RR_ALLOW,   /* let the player edit the typed text        */
+    RR_DISCARD, /* reset the typed text                      */
+    RR_REDRAW,  /* objects may have moved--redraw the room   */
+    RR_CHANGE,  /* the player's room changed                 */
+    RR_PASS,    /* carry on with the verb's built-in action  */
+    N_RULE_RESULTS
+};
+
+/* key word or room matching any */
+#define RULE_ANY (-1)
+
+/* 64-bit FNV-1a hash of a word, one character at a time, ignoring case */
+#define WORD_HASH_INIT        14695981039346656037ULL
+#define WORD_HASH_STEP(h, c)  (((h) ^ (uint8_t)tolower((uint8_t)(c))) * 1099511628211ULL)
+
+/*
+ * bucket and slot of a 64-bit hash h in a table of size(a power of two):
+ * the bucket comes from the high half and the slot from the low half
+ */
+#define HASH_BUCKET(h, size)      ((uint32_t)((h) >> 32) & ((size) - 1))
+#define HASH_SLOT(h, disp, size)  \
+    ((uint32_t)(((uint64_t)((uint32_t)(h) ^ (disp)) * 0x9E3779B97F4A7C15ULL) >> 40) & ((size) - 1))
+
+typedef struct world_file_header_t world_file_header_t;
+struct world_file_header_t {
+    uint32_t magic;           /* WORLD_FILE_MAGIC                  */
+    uint32_t version;         /* WORLD_FILE_VERSION                */
+    uint32_t n_named_rooms;   /* N_NAMED_ROOMS                     */
+    uint32_t n_named_objects; /* N_NAMED_OBJECTS                   */
+    uint32_t n_named_words;   /* N_NAMED_WORDS                     */
+    uint32_t n_flags;         /* NUM_FLAGS                         */
+    uint32_t n_verbs;         /* NUM_TC_VALUES                     */
+    uint32_t n_swaps;         /* N_SWAPS                           */
+    uint32_t n_rooms;         /* number of room records            */
+    uint32_t n_objects;       /* number of object records          */
+    uint32_t n_words;         /* number of word records            */
+    uint32_t hash_size;       /* hash records(a power of two)      */
+    uint32_t n_rules;         /* number of rule records            */
+    uint32_t n_conds;         /* number of condition records       */
+    uint32_t n_effects;       /* number of effect records          */
+    uint32_t n_keys;          /* number of key records             */
+    uint32_t n_refs;          /* number of reference records       */
+    int32_t  start;           /* room in which the player starts   */
+    uint32_t str_size;        /* size of string table in bytes     */
+};
+
+typedef struct world_file_room_t world_file_room_t;
+struct world_file_room_t {
+    uint32_t name;   /* name of room                  */
+    uint32_t photo;  /* file name for room photo      */
+    int32_t  left;   /* id of room to 'left'          */
+    int32_t  enter;  /* id of room reached by 'enter' */
+    int32_t  right;  /* id of room to 'right'         */
+};
+
+typedef struct world_file_obj_t world_file_obj_t;
+struct world_file_obj_t {
+    int32_t  word;   /* id of object keyword                */
+    uint32_t image;  /* object image file name              */
+    int32_t  room;   /* starting room or R_NONE             */
+    int32_t  x;      /* starting x position (-1 for random) */
+    int32_t  y;      /* starting y position                 */
+};
+
+typedef struct world_file_swap_t world_file_swap_t;
+struct world_file_swap_t {
+    uint32_t photo;  /* file name for the alternate photo */
+};
+
+typedef struct world_file_word_t world_file_word_t;
+struct world_file_word_t {
+    uint32_t name;   /* the word(in lower case) */
+};
+
+typedef struct world_file_hash_t world_file_hash_t;
+struct world_file_hash_t {
+    uint32_t disp;   /* displacement of words(or keys) in this bucket */
+    int32_t  id;     /* id of word(or key) in this slot, or -1        */
+};
+
+typedef struct world_file_rule_t world_file_rule_t;
+struct world_file_rule_t {
+    uint32_t cond;      /* first condition record         */
+    uint32_t n_conds;   /* number of conditions(all hold) */
+    uint32_t effect;    /* first effect record            */
+    uint32_t n_effects; /* number of effects(in order)    */
+    int32_t  result;    /* RR_* result                    */
+    int32_t  status;    /* status message, or -1 for none */
+};
+
+typedef struct world_file_cond_t world_file_cond_t;
+struct world_file_cond_t {
+    int32_t  kind;      /* RC_* kind, maybe with RULE_NOT */
+    int32_t  a, b;      /* arguments(see RC_*)            */
+};
+
+typedef struct world_file_effect_t world_file_effect_t;
+struct world_file_effect_t {
+    int32_t  kind;      /* RE_* kind                      */
+    int32_t  a, b, c, d; /* arguments(see RE_*)           */
+};
+
+typedef struct world_file_key_t world_file_key_t;
+struct world_file_key_t {
+    int32_t  verb;      /* verb id                        */
+    int32_t  word;      /* word id, or RULE_ANY           */
+    int32_t  room;      /* room id, or RULE_ANY           */
+    uint32_t ref;       /* first reference record         */
+    uint32_t n_refs;    /* number of reference records    */
+};
+
+typedef struct world_file_ref_t world_file_ref_t;
+struct world_file_ref_t {
+    uint32_t rule;      /* rule id                        */
+};
+
+#endif /* WORLD_IDS_H */